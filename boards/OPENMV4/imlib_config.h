@@ -20,6 +20,9 @@
 // Enable LAB LUT
 #define IMLIB_ENABLE_LAB_LUT
 
+// Enable compiled RGB565 color thresholds (8KB of heap per threshold)
+#define IMLIB_ENABLE_THRESHOLD_BITMAPS
+
 // Enable YUV LUT
 //#define IMLIB_ENABLE_YUV_LUT
 
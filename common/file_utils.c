@@ -36,45 +36,35 @@
 #include "file_utils.h"
 #define FF_MIN(x, y)    (((x) < (y))?(x):(y))
 
+static void file_abort(FIL *fp);
+
 NORETURN static void ff_read_fail(FIL *fp) {
-    if (fp) {
-        f_close(fp);
-    }
+    file_abort(fp);
     mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Failed to read requested bytes!"));
 }
 
 NORETURN static void ff_write_fail(FIL *fp) {
-    if (fp) {
-        f_close(fp);
-    }
+    file_abort(fp);
     mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Failed to write requested bytes!"));
 }
 
 NORETURN static void ff_expect_fail(FIL *fp) {
-    if (fp) {
-        f_close(fp);
-    }
+    file_abort(fp);
     mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Unexpected value read!"));
 }
 
 NORETURN void file_raise_format(FIL *fp) {
-    if (fp) {
-        f_close(fp);
-    }
+    file_abort(fp);
     mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Unsupported format!"));
 }
 
 NORETURN void file_raise_corrupted(FIL *fp) {
-    if (fp) {
-        f_close(fp);
-    }
+    file_abort(fp);
     mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("File corrupted!"));
 }
 
 NORETURN void file_raise_error(FIL *fp, FRESULT res) {
-    if (fp) {
-        f_close(fp);
-    }
+    file_abort(fp);
     mp_raise_msg(&mp_type_OSError, (mp_rom_error_text_t) file_strerror(res));
 }
 
@@ -169,6 +159,418 @@ FRESULT file_ll_touch(const TCHAR *path) {
     return FR_OK;
 }
 
+// Write-behind queue. Files opened with FILE_WRITE_BEHIND while the queue is
+// enabled are opened into one of the queue's slots instead of the caller's FIL
+// and their writes are copied into a ring of sector-aligned buffers which are
+// written out later. FatFs isn't re-entrant so the ring is drained from the
+// MicroPython scheduler, one buffer per callback, which runs between bytecodes
+// and while the VM is idle (e.g. in time.sleep()). If the ring is full the
+// oldest buffer is written out synchronously and the write counts as a stall.
+//
+// The ring is FIFO so the writes of every file stay in order. Only the newest
+// buffer may be appended to and it's only drained by the scheduler once it's
+// sealed (full, followed by another buffer, or its file was closed).
+//
+// Only FILs opened with FILE_HEAP_OWNER may outlive the call that opened them,
+// so only those are handed back their file when the queue goes away. Other
+// slots still owned after a call raised are released by file_queue_abort().
+#define FILE_QUEUE_SLOTS        (4)
+#define FILE_QUEUE_SECTOR_SIZE  (512)
+#define FILE_OPEN_FLAGS_MASK    (0xFF)
+
+typedef struct file_queue_slot {
+    FIL *owner;         // Caller's FIL, NULL once closed.
+    FIL fil;            // FatFs file the queued data is written to.
+    uint32_t pos;       // File position including queued data.
+    uint32_t size;      // File size including queued data.
+    uint32_t pending;   // Number of queued buffers.
+    FRESULT res;        // First error of a deferred write.
+    bool reported;      // The error was raised already.
+    bool heap;          // The owner is part of a heap object.
+    bool used;
+} file_queue_slot_t;
+
+typedef struct file_queue_buffer {
+    uint8_t *data;
+    uint32_t len;
+    uint32_t cap;
+    file_queue_slot_t *slot;
+    bool sealed;
+} file_queue_buffer_t;
+
+typedef struct _file_queue_t {
+    file_queue_slot_t slots[FILE_QUEUE_SLOTS];
+    file_queue_buffer_t *buffers;
+    uint8_t *pool;      // Keeps the buffer memory alive.
+    uint32_t count;
+    uint32_t size;
+    uint32_t tail;
+    uint32_t used;
+    bool scheduled;
+    FRESULT res;        // First error of a file that was already closed.
+    file_queue_stats_t stats;
+} file_queue_t;
+
+static file_queue_slot_t *file_queue_find(FIL *fp) {
+    file_queue_t *q = MP_STATE_PORT(file_queue);
+    if (q && fp) {
+        for (int i = 0; i < FILE_QUEUE_SLOTS; i++) {
+            if (q->slots[i].used && (q->slots[i].owner == fp)) {
+                return &q->slots[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+static file_queue_buffer_t *file_queue_newest(file_queue_t *q) {
+    return q->used ? &q->buffers[(q->tail + q->used - 1) % q->count] : NULL;
+}
+
+static void file_queue_seal(file_queue_t *q, file_queue_slot_t *s) {
+    file_queue_buffer_t *b = file_queue_newest(q);
+    if (b && ((!s) || (b->slot == s))) {
+        b->sealed = true;
+    }
+}
+
+// Closes a slot that has no owner and no queued data left.
+static void file_queue_release(file_queue_t *q, file_queue_slot_t *s) {
+    FRESULT res = f_close(&s->fil);
+    if (s->res == FR_OK) {
+        s->res = res;
+    }
+    if ((s->res != FR_OK) && (!s->reported) && (q->res == FR_OK)) {
+        q->res = s->res;
+    }
+    s->used = false;
+}
+
+// Writes out the oldest buffer. Errors are recorded in the slot and raised by
+// the next call on the file, or by file_queue_flush() if it was closed.
+static void file_queue_drain(file_queue_t *q) {
+    file_queue_buffer_t *b = &q->buffers[q->tail];
+    file_queue_slot_t *s = b->slot;
+
+    if (s->res == FR_OK) {
+        UINT bytes;
+        s->res = f_write(&s->fil, b->data, b->len, &bytes);
+        // A short write means that the volume is full.
+        if ((s->res == FR_OK) && (bytes != b->len)) {
+            s->res = FR_DENIED;
+        }
+        if (s->res == FR_OK) {
+            q->stats.written += b->len;
+        } else {
+            q->stats.errors += 1;
+        }
+    }
+
+    q->stats.queued -= b->len;
+    q->tail = (q->tail + 1) % q->count;
+    q->used -= 1;
+    s->pending -= 1;
+
+    if ((!s->owner) && (!s->pending)) {
+        file_queue_release(q, s);
+    }
+}
+
+static mp_obj_t file_queue_task(mp_obj_t unused);
+static MP_DEFINE_CONST_FUN_OBJ_1(file_queue_task_obj, file_queue_task);
+
+static void file_queue_schedule(file_queue_t *q) {
+    #if MICROPY_ENABLE_SCHEDULER
+    if ((!q->scheduled) && q->used && q->buffers[q->tail].sealed) {
+        q->scheduled = mp_sched_schedule(MP_OBJ_FROM_PTR(&file_queue_task_obj), mp_const_none);
+    }
+    #endif
+}
+
+static mp_obj_t file_queue_task(mp_obj_t unused) {
+    file_queue_t *q = MP_STATE_PORT(file_queue);
+    if (q) {
+        q->scheduled = false;
+        if (q->used && q->buffers[q->tail].sealed) {
+            file_queue_drain(q);
+        }
+        file_queue_schedule(q);
+    }
+    return mp_const_none;
+}
+
+// Raises a deferred error on the file's owner.
+static void file_queue_check(file_queue_slot_t *s) {
+    if ((s->res != FR_OK) && (!s->reported)) {
+        s->reported = true;
+        file_raise_error(s->owner, s->res);
+    }
+}
+
+// Writes out all queued data of a file before it's accessed directly.
+static FIL *file_queue_sync(file_queue_slot_t *s) {
+    file_queue_t *q = MP_STATE_PORT(file_queue);
+    file_queue_seal(q, s);
+    while (s->pending) {
+        file_queue_drain(q);
+    }
+    file_queue_check(s);
+    return &s->fil;
+}
+
+static void file_queue_update(file_queue_slot_t *s) {
+    s->pos = f_tell(&s->fil);
+    s->size = f_size(&s->fil);
+}
+
+static bool file_queue_open(FIL *fp, const char *path, uint32_t flags) {
+    file_queue_t *q = MP_STATE_PORT(file_queue);
+    if ((!q) || (flags & FA_READ)) {
+        return false;
+    }
+
+    file_queue_slot_t *s = NULL;
+    while (!s) {
+        for (int i = 0; (i < FILE_QUEUE_SLOTS) && (!s); i++) {
+            if (!q->slots[i].used) {
+                s = &q->slots[i];
+            }
+        }
+        // Wait for a closed file to be written out if all slots are busy.
+        if ((!s) && q->used) {
+            q->stats.stalls += 1;
+            file_queue_drain(q);
+        } else if (!s) {
+            return false;
+        }
+    }
+
+    FRESULT res = file_ll_open(&s->fil, path, flags & FILE_OPEN_FLAGS_MASK);
+    if (res != FR_OK) {
+        file_raise_error(NULL, res);
+    }
+
+    // The caller's FIL is never opened so any FatFs call made on it directly
+    // fails with FR_INVALID_OBJECT instead of touching random memory.
+    memset(fp, 0, sizeof(FIL));
+    s->owner = fp;
+    s->pos = 0;
+    s->size = f_size(&s->fil);
+    s->pending = 0;
+    s->res = FR_OK;
+    s->reported = false;
+    s->heap = (flags & FILE_HEAP_OWNER) != 0;
+    s->used = true;
+    return true;
+}
+
+static void file_queue_write(file_queue_slot_t *s, const void *data, size_t size) {
+    file_queue_t *q = MP_STATE_PORT(file_queue);
+    file_queue_check(s);
+
+    while (size) {
+        file_queue_buffer_t *b = file_queue_newest(q);
+
+        if ((!b) || (b->slot != s) || b->sealed) {
+            if (b) {
+                b->sealed = true;
+            }
+
+            if (q->used == q->count) {
+                q->stats.stalls += 1;
+                file_queue_drain(q);
+                file_queue_check(s);
+            }
+
+            b = &q->buffers[(q->tail + q->used) % q->count];
+            b->slot = s;
+            b->len = 0;
+            // Buffers end on sector boundaries so that FatFs writes whole
+            // sectors straight from them. Only the first buffer after a seek
+            // may be shorter.
+            b->cap = q->size - (s->pos % FILE_QUEUE_SECTOR_SIZE);
+            b->sealed = false;
+            q->used += 1;
+            q->stats.high_water = OMV_MAX(q->stats.high_water, q->used);
+            s->pending += 1;
+        }
+
+        uint32_t can_do = FF_MIN(size, b->cap - b->len);
+        memcpy(b->data + b->len, data, can_do);
+        b->len += can_do;
+        data += can_do;
+        size -= can_do;
+        s->pos += can_do;
+        s->size = OMV_MAX(s->size, s->pos);
+        q->stats.queued += can_do;
+
+        if (b->len == b->cap) {
+            b->sealed = true;
+        }
+    }
+
+    file_queue_schedule(q);
+}
+
+static void file_queue_close(file_queue_slot_t *s) {
+    file_queue_t *q = MP_STATE_PORT(file_queue);
+    file_queue_seal(q, s);
+    s->owner = NULL;
+
+    // Errors of data which is still queued are raised by file_queue_flush().
+    FRESULT res = FR_OK;
+    if ((s->res != FR_OK) && (!s->reported)) {
+        res = s->res;
+        s->reported = true;
+    }
+
+    if (!s->pending) {
+        FRESULT close_res = f_close(&s->fil);
+        if (res == FR_OK) {
+            res = close_res;
+        }
+        s->used = false;
+    }
+
+    file_queue_schedule(q);
+
+    if (res != FR_OK) {
+        file_raise_error(NULL, res);
+    }
+}
+
+static void file_queue_detach(file_queue_slot_t *s) {
+    file_queue_t *q = MP_STATE_PORT(file_queue);
+    file_queue_seal(q, s);
+    s->owner = NULL;
+    if (!s->pending) {
+        file_queue_release(q, s);
+    }
+    file_queue_schedule(q);
+}
+
+static void file_abort(FIL *fp) {
+    file_queue_slot_t *s = file_queue_find(fp);
+    if (s) {
+        file_queue_detach(s);
+    } else if (fp) {
+        f_close(fp);
+    }
+}
+
+// Writes out all queued data. Files of heap objects that are still open are
+// handed back to their owners, everything else is closed.
+static void file_queue_drain_all(file_queue_t *q, bool detach) {
+    file_queue_seal(q, NULL);
+    while (q->used) {
+        file_queue_drain(q);
+    }
+    if (detach) {
+        for (int i = 0; i < FILE_QUEUE_SLOTS; i++) {
+            file_queue_slot_t *s = &q->slots[i];
+            if (s->used && s->owner && s->heap && (s->res == FR_OK)) {
+                memcpy(s->owner, &s->fil, sizeof(FIL));
+                s->used = false;
+            } else if (s->used) {
+                file_queue_detach(s);
+            }
+        }
+    }
+}
+
+void file_queue_enable(uint32_t buffers, uint32_t buffer_size) {
+    file_queue_disable();
+
+    if (!buffers) {
+        return;
+    }
+
+    buffer_size = OMV_ALIGN_TO(OMV_MAX(buffer_size, 1U), FILE_QUEUE_SECTOR_SIZE);
+
+    file_queue_t *q = m_new0(file_queue_t, 1);
+    q->buffers = m_new0(file_queue_buffer_t, buffers);
+    q->pool = m_new(uint8_t, (buffers * buffer_size) + OMV_DMA_ALIGNMENT);
+    q->count = buffers;
+    q->size = buffer_size;
+
+    uint8_t *data = (uint8_t *) OMV_ALIGN_TO(q->pool, OMV_DMA_ALIGNMENT);
+    for (uint32_t i = 0; i < buffers; i++) {
+        q->buffers[i].data = data + (i * buffer_size);
+    }
+
+    MP_STATE_PORT(file_queue) = q;
+}
+
+void file_queue_disable() {
+    file_queue_t *q = MP_STATE_PORT(file_queue);
+    if (q) {
+        file_queue_drain_all(q, true);
+        MP_STATE_PORT(file_queue) = NULL;
+        FRESULT res = q->res;
+        m_free(q->pool);
+        m_free(q->buffers);
+        m_free(q);
+        if (res != FR_OK) {
+            file_raise_error(NULL, res);
+        }
+    }
+}
+
+void file_queue_flush() {
+    file_queue_t *q = MP_STATE_PORT(file_queue);
+    if (q) {
+        file_queue_drain_all(q, false);
+
+        for (int i = 0; i < FILE_QUEUE_SLOTS; i++) {
+            file_queue_slot_t *s = &q->slots[i];
+            if (s->used) {
+                file_queue_check(s);
+                FRESULT res = f_sync(&s->fil);
+                if (res != FR_OK) {
+                    file_raise_error(s->owner, res);
+                }
+            }
+        }
+
+        FRESULT res = q->res;
+        q->res = FR_OK;
+        if (res != FR_OK) {
+            file_raise_error(NULL, res);
+        }
+    }
+}
+
+void file_queue_abort() {
+    file_queue_t *q = MP_STATE_PORT(file_queue);
+    if (q) {
+        for (int i = 0; i < FILE_QUEUE_SLOTS; i++) {
+            file_queue_slot_t *s = &q->slots[i];
+            if (s->used && s->owner && (!s->heap)) {
+                file_queue_detach(s);
+            }
+        }
+    }
+}
+
+void file_queue_stats(file_queue_stats_t *stats) {
+    file_queue_t *q = MP_STATE_PORT(file_queue);
+    if (q) {
+        *stats = q->stats;
+    } else {
+        memset(stats, 0, sizeof(file_queue_stats_t));
+    }
+}
+
+// Called before the heap is swept so that the finalisers of Gif and Mjpeg
+// objects which are still open can finish their files.
+void file_queue_deinit() {
+    file_queue_t *q = MP_STATE_PORT(file_queue);
+    if (q) {
+        file_queue_drain_all(q, true);
+        MP_STATE_PORT(file_queue) = NULL;
+    }
+}
+
 // When a sector boundary is encountered while writing a file and there are
 // more than 512 bytes left to write FatFs will detect that it can bypass
 // its internal write buffer and pass the data buffer passed to it directly
@@ -189,6 +591,7 @@ void file_buffer_init0() {
     file_buffer_pointer = 0;
     file_buffer_size = 0;
     file_buffer_index = 0;
+    MP_STATE_PORT(file_queue) = NULL;
 }
 
 OMV_ATTR_ALWAYS_INLINE static void file_fill(FIL *fp) {
@@ -228,6 +631,9 @@ OMV_ATTR_ALWAYS_INLINE static void file_flush(FIL *fp) {
 }
 
 void file_buffer_on(FIL *fp) {
+    if (file_queue_find(fp)) {
+        return;
+    }
     file_buffer_offset = f_tell(fp) % 4;
     file_buffer_pointer = fb_alloc_all(&file_buffer_size, FB_ALLOC_PREFER_SIZE) + file_buffer_offset;
     if (!file_buffer_size) {
@@ -250,6 +656,9 @@ void file_buffer_on(FIL *fp) {
 }
 
 void file_buffer_off(FIL *fp) {
+    if (file_queue_find(fp)) {
+        return;
+    }
     if ((fp->flag & FA_WRITE) && file_buffer_index) {
         UINT bytes;
         FRESULT res = f_write(fp, file_buffer_pointer, file_buffer_index, &bytes);
@@ -265,7 +674,18 @@ void file_buffer_off(FIL *fp) {
 }
 
 void file_open(FIL *fp, const char *path, bool buffered, uint32_t flags) {
-    FRESULT res = file_ll_open(fp, path, flags);
+    // Drop a slot left by a file that was never closed (e.g. an exception
+    // during a save) which had the same FIL address.
+    file_queue_slot_t *s = file_queue_find(fp);
+    if (s) {
+        file_queue_detach(s);
+    }
+
+    if ((flags & FILE_WRITE_BEHIND) && file_queue_open(fp, path, flags)) {
+        return;
+    }
+
+    FRESULT res = file_ll_open(fp, path, flags & FILE_OPEN_FLAGS_MASK);
     if (res != FR_OK) {
         file_raise_error(fp, res);
     }
@@ -275,6 +695,12 @@ void file_open(FIL *fp, const char *path, bool buffered, uint32_t flags) {
 }
 
 void file_close(FIL *fp) {
+    file_queue_slot_t *s = file_queue_find(fp);
+    if (s) {
+        file_queue_close(s);
+        return;
+    }
+
     if (file_buffer_pointer) {
         file_buffer_off(fp);
     }
@@ -286,27 +712,40 @@ void file_close(FIL *fp) {
 }
 
 void file_seek(FIL *fp, UINT offset) {
-    FRESULT res = f_lseek(fp, offset);
+    file_queue_slot_t *s = file_queue_find(fp);
+    FRESULT res = f_lseek(s ? file_queue_sync(s) : fp, offset);
     if (res != FR_OK) {
         file_raise_error(fp, res);
     }
+    if (s) {
+        file_queue_update(s);
+    }
 }
 
 void file_truncate(FIL *fp) {
-    FRESULT res = f_truncate(fp);
+    file_queue_slot_t *s = file_queue_find(fp);
+    FRESULT res = f_truncate(s ? file_queue_sync(s) : fp);
     if (res != FR_OK) {
         file_raise_error(fp, res);
     }
+    if (s) {
+        file_queue_update(s);
+    }
 }
 
 void file_sync(FIL *fp) {
-    FRESULT res = f_sync(fp);
+    file_queue_slot_t *s = file_queue_find(fp);
+    FRESULT res = f_sync(s ? file_queue_sync(s) : fp);
     if (res != FR_OK) {
         file_raise_error(fp, res);
     }
 }
 
 uint32_t file_tell(FIL *fp) {
+    file_queue_slot_t *s = file_queue_find(fp);
+    if (s) {
+        return s->pos;
+    }
     if (file_buffer_pointer) {
         if (fp->flag & FA_READ) {
             return f_tell(fp) - file_buffer_size + file_buffer_index;
@@ -318,6 +757,10 @@ uint32_t file_tell(FIL *fp) {
 }
 
 uint32_t file_size(FIL *fp) {
+    file_queue_slot_t *s = file_queue_find(fp);
+    if (s) {
+        return s->size;
+    }
     if (file_buffer_pointer) {
         if (fp->flag & FA_READ) {
             return f_size(fp);
@@ -381,7 +824,10 @@ void file_read(FIL *fp, void *data, size_t size) {
 }
 
 void file_write(FIL *fp, const void *data, size_t size) {
-    if (file_buffer_pointer) {
+    file_queue_slot_t *s = file_queue_find(fp);
+    if (s) {
+        file_queue_write(s, data, size);
+    } else if (file_buffer_pointer) {
         // We get a massive speed boost by buffering up as much data as possible
         // before a write to the SD card. So much so that the time wasted by
         // all these operations does not cost us.
@@ -46,6 +46,27 @@ FRESULT file_ll_unlink(const TCHAR *path);
 FRESULT file_ll_rename(const TCHAR *path_old, const TCHAR *path_new);
 FRESULT file_ll_touch(const TCHAR *path);
 
+// Write-behind queue. Files opened for writing with FILE_WRITE_BEHIND while
+// the queue is enabled return from writes as soon as the data is queued.
+#define FILE_WRITE_BEHIND   (1 << 8)
+// The FIL is part of a heap object which keeps the file open across calls.
+#define FILE_HEAP_OWNER     (1 << 9)
+
+typedef struct file_queue_stats {
+    uint32_t queued;        // Bytes waiting to be written.
+    uint32_t written;       // Bytes written since the queue was enabled.
+    uint32_t stalls;        // Writes which had to wait for a free buffer.
+    uint32_t high_water;    // Most buffers in use at once.
+    uint32_t errors;        // Failed deferred writes.
+} file_queue_stats_t;
+
+void file_queue_enable(uint32_t buffers, uint32_t buffer_size);
+void file_queue_disable();
+void file_queue_flush();
+void file_queue_abort();
+void file_queue_stats(file_queue_stats_t *stats);
+void file_queue_deinit();
+
 // File buffer functions.
 void file_buffer_init0();
 void file_buffer_on(FIL *fp);  // Calls fb_alloc_all()
@@ -332,7 +332,7 @@ void usbdbg_data_out(uint32_t size, usbdbg_read_callback_t read_callback) {
             rectangle_t *roi = (rectangle_t *) buffer;
             char *path = (char *) buffer + sizeof(rectangle_t);
 
-            imlib_save_image(&image, path, roi, 50);
+            imlib_save_image(&image, path, roi, 50, PNG_LEVEL_DEFAULT);
             #endif  //IMLIB_ENABLE_IMAGE_FILE_IO
             break;
         }
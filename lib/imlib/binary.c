@@ -24,6 +24,7 @@
  * Binary image operations.
  */
 #include "imlib.h"
+#include "simd.h"
 
 void imlib_zero_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
     image_t *mask = data->callback_arg;
@@ -132,6 +133,55 @@ void imlib_mask_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data
     }
 }
 
+// Same as imlib_mask_line_op() but with a mask_rle_t callback_arg.
+void imlib_mask_rle_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
+    mask_rle_t *rle = data->callback_arg;
+
+    if (y_row >= rle->h) {
+        return;
+    }
+
+    mask_rle_for_each_span(span, rle, y_row, rle->w) {
+        int span_x = IM_MAX(x, span->x);
+        int span_x_end = IM_MIN(x_end, span->x + span->w);
+
+        if (span_x >= span_x_end) {
+            continue;
+        }
+
+        switch (data->dst_img->pixfmt) {
+            case PIXFORMAT_BINARY: {
+                uint32_t *row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(data->dst_img, y_row);
+                uint32_t *other = (uint32_t *) data->dst_row_override;
+                for (; span_x < span_x_end;) {
+                    int i = span_x >> UINT32_T_SHIFT;
+                    int shift = span_x & UINT32_T_MASK;
+                    int bits = IM_MIN(span_x_end - span_x, (int) UINT32_T_BITS - shift);
+                    uint32_t m = ((bits == UINT32_T_BITS) ? 0xFFFFFFFF : ((1U << bits) - 1)) << shift;
+                    row[i] = (row[i] & ~m) | (other[i] & m);
+                    span_x += bits;
+                }
+                break;
+            }
+            case PIXFORMAT_GRAYSCALE: {
+                uint8_t *row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(data->dst_img, y_row);
+                memcpy(row + span_x, ((uint8_t *) data->dst_row_override) + span_x,
+                       (span_x_end - span_x) * sizeof(uint8_t));
+                break;
+            }
+            case PIXFORMAT_RGB565: {
+                uint16_t *row = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(data->dst_img, y_row);
+                memcpy(row + span_x, ((uint16_t *) data->dst_row_override) + span_x,
+                       (span_x_end - span_x) * sizeof(uint16_t));
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+}
+
 #ifdef IMLIB_ENABLE_BINARY_OPS
 void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, bool zero, image_t *mask) {
     image_t bmp;
@@ -140,6 +190,16 @@ void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, b
     bmp.pixfmt = PIXFORMAT_BINARY;
     bmp.data = fb_alloc0(image_size(&bmp), FB_ALLOC_NO_HINT);
 
+    #if defined(IMLIB_ENABLE_THRESHOLD_BITMAPS)
+    imlib_thresholds_compile(thresholds, img, img->w * img->h);
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) != 0) {
+        // Unpin the bitmaps if anything below raises.
+        imlib_thresholds_release(thresholds);
+        nlr_jump(nlr.ret_val);
+    }
+    #endif
+
     list_for_each(it, thresholds) {
         color_thresholds_list_lnk_data_t *lnk_data = list_get_data(it);
 
@@ -187,12 +247,15 @@ void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, b
     }
 
     imlib_draw_row_callback_t callback = NULL;
+    void *callback_arg = mask;
+    mask_rle_t rle;
+
     if (zero) {
         callback = imlib_zero_line_op;
-    }
-
-    if ((!callback) && mask) {
-        callback = imlib_mask_line_op;
+    } else if (mask) {
+        imlib_mask_rle_from_image(&rle, out->w, out->h, mask);
+        callback = imlib_mask_rle_line_op;
+        callback_arg = &rle;
     }
 
     void *dst_row_override = NULL;
@@ -200,12 +263,21 @@ void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, b
         dst_row_override = fb_alloc0(image_line_size(out), FB_ALLOC_CACHE_ALIGN);
     }
 
-    imlib_draw_image(out, &bmp, 0, 0, 1.0f, 1.0f, NULL, -1, 255, NULL, NULL, 0, callback, mask, dst_row_override);
+    imlib_draw_image(out, &bmp, 0, 0, 1.0f, 1.0f, NULL, -1, 255, NULL, NULL, 0, callback, callback_arg, dst_row_override);
 
     if (dst_row_override) {
         fb_free(); // dst_row_override
     }
 
+    if (callback == imlib_mask_rle_line_op) {
+        imlib_mask_rle_free(&rle);
+    }
+
+    #if defined(IMLIB_ENABLE_THRESHOLD_BITMAPS)
+    nlr_pop();
+    imlib_thresholds_release(thresholds);
+    #endif
+
     fb_free(); // bmp.data
 }
 
@@ -254,229 +326,69 @@ void imlib_invert(image_t *img) {
     }
 }
 
-void imlib_b_and_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
-    image_t *mask = (image_t *) data->callback_arg;
-
-    switch (data->dst_img->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            uint32_t *row0 = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint32_t *row1 = (uint32_t *) data->dst_row_override;
-
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                // Align to 32-bit boundary.
-                for (; (x % 32) && (x < x_end); x++) {
-                    uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                    uint32_t p = p0 & p1;
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                }
-
-                for (; (x_end - x) >= 32; x += 32) {
-                    uint32_t p0 = row0[x / 32];
-                    uint32_t p1 = ((uint32_t *) row1)[x / 32];
-                    row0[x / 32] = p0 & p1;
-                }
-                #endif
-
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                    uint32_t p = p0 & p1;
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                }
-            } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                        uint32_t p = p0 & p1;
-                        IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                    }
-                }
-            }
-            break;
+OMV_ATTR_ALWAYS_INLINE static uint32_t imlib_b_op_pixel(uint32_t p0, uint32_t p1, b_op_t op) {
+    switch (op) {
+        case B_OP_AND: {
+            return p0 & p1;
         }
-        case PIXFORMAT_GRAYSCALE: {
-            uint8_t *row0 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint8_t *row1 = (uint8_t *) data->dst_row_override;
-
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                for (; (x_end - x) >= 4; x += 4) {
-                    uint32_t p0 = *((uint32_t *) (row0 + x));
-                    uint32_t p1 = *((uint32_t *) (row1 + x));
-                    *((uint32_t *) (row0 + x)) = p0 & p1;
-                }
-                #endif
-
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row1, x);
-                    uint32_t p = p0 & p1;
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row0, x, p);
-                }
-            } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row1, x);
-                        uint32_t p = p0 & p1;
-                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row0, x, p);
-                    }
-                }
-            }
-            break;
+        case B_OP_NAND: {
+            return ~(p0 & p1);
         }
-        case PIXFORMAT_RGB565: {
-            uint16_t *row0 = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint16_t *row1 = (uint16_t *) data->dst_row_override;
-
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                for (; (x_end - x) >= 2; x += 2) {
-                    uint32_t p0 = *((uint32_t *) (row0 + x));
-                    uint32_t p1 = *((uint32_t *) (row1 + x));
-                    *((uint32_t *) (row0 + x)) = p0 & p1;
-                }
-                #endif
-
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_RGB565_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_RGB565_PIXEL_FAST(row1, x);
-                    uint32_t p = p0 & p1;
-                    IMAGE_PUT_RGB565_PIXEL_FAST(row0, x, p);
-                }
-            } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_RGB565_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_RGB565_PIXEL_FAST(row1, x);
-                        uint32_t p = p0 & p1;
-                        IMAGE_PUT_RGB565_PIXEL_FAST(row0, x, p);
-                    }
-                }
-            }
-            break;
+        case B_OP_OR: {
+            return p0 | p1;
+        }
+        case B_OP_NOR: {
+            return ~(p0 | p1);
+        }
+        case B_OP_XOR: {
+            return p0 ^ p1;
         }
         default: {
-            break;
+            return ~(p0 ^ p1);
         }
     }
 }
 
-void imlib_b_nand_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
-    image_t *mask = (image_t *) data->callback_arg;
-
-    switch (data->dst_img->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            uint32_t *row0 = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint32_t *row1 = (uint32_t *) data->dst_row_override;
-
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                // Align to 32-bit boundary.
-                for (; (x % 32) && (x < x_end); x++) {
-                    uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                    uint32_t p = ~(p0 & p1);
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                }
-
-                for (; (x_end - x) >= 32; x += 32) {
-                    uint32_t p0 = row0[x / 32];
-                    uint32_t p1 = row1[x / 32];
-                    row0[x / 32] = ~(p0 & p1);
-                }
-                #endif
-
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                    uint32_t p = ~(p0 & p1);
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                }
-            } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                        uint32_t p = ~(p0 & p1);
-                        IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                    }
-                }
-            }
-            break;
+OMV_ATTR_ALWAYS_INLINE static v128_t imlib_b_op_vector(v128_t p0, v128_t p1, b_op_t op) {
+    switch (op) {
+        case B_OP_AND: {
+            return vand_u32(p0, p1);
         }
-        case PIXFORMAT_GRAYSCALE: {
-            uint8_t *row0 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint8_t *row1 = (uint8_t *) data->dst_row_override;
-
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                for (; (x_end - x) >= 4; x += 4) {
-                    uint32_t p0 = *((uint32_t *) (row0 + x));
-                    uint32_t p1 = *((uint32_t *) (row1 + x));
-                    *((uint32_t *) (row0 + x)) = ~(p0 & p1);
-                }
-                #endif
-
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row1, x);
-                    uint32_t p = ~(p0 & p1);
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row0, x, p);
-                }
-            } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row1, x);
-                        uint32_t p = ~(p0 & p1);
-                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row0, x, p);
-                    }
-                }
-            }
-            break;
+        case B_OP_NAND: {
+            return veor_u32(vand_u32(p0, p1), vdup_u32(UINT32_MAX));
         }
-        case PIXFORMAT_RGB565: {
-            uint16_t *row0 = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint16_t *row1 = (uint16_t *) data->dst_row_override;
-
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                for (; (x_end - x) >= 2; x += 2) {
-                    uint32_t p0 = *((uint32_t *) (row0 + x));
-                    uint32_t p1 = *((uint32_t *) (row1 + x));
-                    *((uint32_t *) (row0 + x)) = ~(p0 & p1);
-                }
-                #endif
-
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_RGB565_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_RGB565_PIXEL_FAST(row1, x);
-                    uint32_t p = ~(p0 & p1);
-                    IMAGE_PUT_RGB565_PIXEL_FAST(row0, x, p);
-                }
-            } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_RGB565_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_RGB565_PIXEL_FAST(row1, x);
-                        uint32_t p = ~(p0 & p1);
-                        IMAGE_PUT_RGB565_PIXEL_FAST(row0, x, p);
-                    }
-                }
-            }
-            break;
+        case B_OP_OR: {
+            return vorr_u32(p0, p1);
+        }
+        case B_OP_NOR: {
+            return veor_u32(vorr_u32(p0, p1), vdup_u32(UINT32_MAX));
+        }
+        case B_OP_XOR: {
+            return veor_u32(p0, p1);
         }
         default: {
-            break;
+            return veor_u32(veor_u32(p0, p1), vdup_u32(UINT32_MAX));
         }
     }
 }
 
-void imlib_b_or_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
+// Bitwise ops don't care about the pixel format so unmasked rows are processed as raw bytes.
+OMV_ATTR_ALWAYS_INLINE static void imlib_b_op_bytes(uint8_t *row0, const uint8_t *row1, int len, b_op_t op) {
+    int i = 0;
+
+    #if (__ARM_ARCH > 6)
+    for (; (len - i) >= UINT8_VECTOR_SIZE; i += UINT8_VECTOR_SIZE) {
+        vstr_u8(row0 + i, imlib_b_op_vector(vldr_u8(row0 + i), vldr_u8(row1 + i), op));
+    }
+    #endif
+
+    for (; i < len; i++) {
+        row0[i] = imlib_b_op_pixel(row0[i], row1[i], op);
+    }
+}
+
+OMV_ATTR_ALWAYS_INLINE static void imlib_b_op_line_op(int x, int x_end, int y_row,
+                                                      imlib_draw_row_data_t *data, b_op_t op) {
     image_t *mask = (image_t *) data->callback_arg;
 
     switch (data->dst_img->pixfmt) {
@@ -485,35 +397,29 @@ void imlib_b_or_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data
             uint32_t *row1 = (uint32_t *) data->dst_row_override;
 
             if (!mask) {
-                #if (__ARM_ARCH > 6)
                 // Align to 32-bit boundary.
                 for (; (x % 32) && (x < x_end); x++) {
                     uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
                     uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                    uint32_t p = p0 | p1;
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
+                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, imlib_b_op_pixel(p0, p1, op));
                 }
 
-                for (; (x_end - x) >= 32; x += 32) {
-                    uint32_t p0 = row0[x / 32];
-                    uint32_t p1 = row1[x / 32];
-                    row0[x / 32] = p0 | p1;
-                }
-                #endif
+                int words = (x_end - x) / 32;
+                imlib_b_op_bytes((uint8_t *) (row0 + (x / 32)), (uint8_t *) (row1 + (x / 32)),
+                                 words * sizeof(uint32_t), op);
+                x += words * 32;
 
                 for (; x < x_end; x++) {
                     uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
                     uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                    uint32_t p = p0 | p1;
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
+                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, imlib_b_op_pixel(p0, p1, op));
                 }
             } else {
                 for (; x < x_end; x++) {
                     if (image_get_mask_pixel(mask, x, y_row)) {
                         uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
                         uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                        uint32_t p = p0 | p1;
-                        IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
+                        IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, imlib_b_op_pixel(p0, p1, op));
                     }
                 }
             }
@@ -524,27 +430,13 @@ void imlib_b_or_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data
             uint8_t *row1 = (uint8_t *) data->dst_row_override;
 
             if (!mask) {
-                #if (__ARM_ARCH > 6)
-                for (; (x_end - x) >= 4; x += 4) {
-                    uint32_t p0 = *((uint32_t *) (row0 + x));
-                    uint32_t p1 = *((uint32_t *) (row1 + x));
-                    *((uint32_t *) (row0 + x)) = p0 | p1;
-                }
-                #endif
-
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row1, x);
-                    uint32_t p = p0 | p1;
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row0, x, p);
-                }
+                imlib_b_op_bytes(row0 + x, row1 + x, (x_end - x) * sizeof(uint8_t), op);
             } else {
                 for (; x < x_end; x++) {
                     if (image_get_mask_pixel(mask, x, y_row)) {
                         uint32_t p0 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row0, x);
                         uint32_t p1 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row1, x);
-                        uint32_t p = p0 | p1;
-                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row0, x, p);
+                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row0, x, imlib_b_op_pixel(p0, p1, op));
                     }
                 }
             }
@@ -555,27 +447,13 @@ void imlib_b_or_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data
             uint16_t *row1 = (uint16_t *) data->dst_row_override;
 
             if (!mask) {
-                #if (__ARM_ARCH > 6)
-                for (; (x_end - x) >= 2; x += 2) {
-                    uint32_t p0 = *((uint32_t *) (row0 + x));
-                    uint32_t p1 = *((uint32_t *) (row1 + x));
-                    *((uint32_t *) (row0 + x)) = p0 | p1;
-                }
-                #endif
-
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_RGB565_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_RGB565_PIXEL_FAST(row1, x);
-                    uint32_t p = p0 | p1;
-                    IMAGE_PUT_RGB565_PIXEL_FAST(row0, x, p);
-                }
+                imlib_b_op_bytes((uint8_t *) (row0 + x), (uint8_t *) (row1 + x), (x_end - x) * sizeof(uint16_t), op);
             } else {
                 for (; x < x_end; x++) {
                     if (image_get_mask_pixel(mask, x, y_row)) {
                         uint32_t p0 = IMAGE_GET_RGB565_PIXEL_FAST(row0, x);
                         uint32_t p1 = IMAGE_GET_RGB565_PIXEL_FAST(row1, x);
-                        uint32_t p = p0 | p1;
-                        IMAGE_PUT_RGB565_PIXEL_FAST(row0, x, p);
+                        IMAGE_PUT_RGB565_PIXEL_FAST(row0, x, imlib_b_op_pixel(p0, p1, op));
                     }
                 }
             }
@@ -587,337 +465,217 @@ void imlib_b_or_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data
     }
 }
 
-void imlib_b_nor_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
-    image_t *mask = (image_t *) data->callback_arg;
+void imlib_b_and_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
+    imlib_b_op_line_op(x, x_end, y_row, data, B_OP_AND);
+}
 
-    switch (data->dst_img->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            uint32_t *row0 = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint32_t *row1 = (uint32_t *) data->dst_row_override;
+void imlib_b_nand_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
+    imlib_b_op_line_op(x, x_end, y_row, data, B_OP_NAND);
+}
 
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                // Align to 32-bit boundary.
-                for (; (x % 32) && (x < x_end); x++) {
-                    uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                    uint32_t p = ~(p0 | p1);
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                }
+void imlib_b_or_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
+    imlib_b_op_line_op(x, x_end, y_row, data, B_OP_OR);
+}
 
-                for (; (x_end - x) >= 32; x += 32) {
-                    uint32_t p0 = row0[x / 32];
-                    uint32_t p1 = row1[x / 32];
-                    row0[x / 32] = ~(p0 | p1);
-                }
-                #endif
+void imlib_b_nor_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
+    imlib_b_op_line_op(x, x_end, y_row, data, B_OP_NOR);
+}
 
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                    uint32_t p = ~(p0 | p1);
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                }
-            } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                        uint32_t p = ~(p0 | p1);
-                        IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                    }
-                }
-            }
-            break;
-        }
-        case PIXFORMAT_GRAYSCALE: {
-            uint8_t *row0 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint8_t *row1 = (uint8_t *) data->dst_row_override;
+void imlib_b_xor_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
+    imlib_b_op_line_op(x, x_end, y_row, data, B_OP_XOR);
+}
 
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                for (; (x_end - x) >= 4; x += 4) {
-                    uint32_t p0 = *((uint32_t *) (row0 + x));
-                    uint32_t p1 = *((uint32_t *) (row1 + x));
-                    *((uint32_t *) (row0 + x)) = ~(p0 | p1);
-                }
-                #endif
+void imlib_b_xnor_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
+    imlib_b_op_line_op(x, x_end, y_row, data, B_OP_XNOR);
+}
 
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row1, x);
-                    uint32_t p = ~(p0 | p1);
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row0, x, p);
-                }
-            } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row1, x);
-                        uint32_t p = ~(p0 | p1);
-                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row0, x, p);
-                    }
-                }
-            }
-            break;
-        }
-        case PIXFORMAT_RGB565: {
-            uint16_t *row0 = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint16_t *row1 = (uint16_t *) data->dst_row_override;
+// Returns 32 pixels of a padded binary line starting at pixel offset x (which may be negative).
+static inline uint32_t imlib_morph_get_word(const uint32_t *line, int pad, int x) {
+    int p = x + (pad * UINT32_T_BITS);
+    int q = p >> UINT32_T_SHIFT;
+    int r = p & UINT32_T_MASK;
+    return r ? ((line[q] >> r) | (line[q + 1] << (UINT32_T_BITS - r))) : line[q];
+}
 
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                for (; (x_end - x) >= 2; x += 2) {
-                    uint32_t p0 = *((uint32_t *) (row0 + x));
-                    uint32_t p1 = *((uint32_t *) (row1 + x));
-                    *((uint32_t *) (row0 + x)) = ~(p0 | p1);
-                }
-                #endif
+// Applies the mask (if any) and the line padding to a computed output row and writes it back.
+static void imlib_morph_put_row(image_t *img, int y, uint32_t *out_row, image_t *mask) {
+    uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+    int words = IMAGE_BINARY_LINE_LEN(img);
 
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_RGB565_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_RGB565_PIXEL_FAST(row1, x);
-                    uint32_t p = ~(p0 | p1);
-                    IMAGE_PUT_RGB565_PIXEL_FAST(row0, x, p);
-                }
-            } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_RGB565_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_RGB565_PIXEL_FAST(row1, x);
-                        uint32_t p = ~(p0 | p1);
-                        IMAGE_PUT_RGB565_PIXEL_FAST(row0, x, p);
-                    }
-                }
+    if (mask) {
+        for (int x = 0; x < img->w; x++) {
+            if (!image_get_mask_pixel(mask, x, y)) {
+                IMAGE_PUT_BINARY_PIXEL_FAST(out_row, x, IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
             }
-            break;
-        }
-        default: {
-            break;
         }
     }
-}
 
-void imlib_b_xor_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
-    image_t *mask = (image_t *) data->callback_arg;
+    if (img->w & UINT32_T_MASK) {
+        uint32_t valid = UINT32_MAX >> (UINT32_T_BITS - (img->w & UINT32_T_MASK));
+        out_row[words - 1] = (out_row[words - 1] & valid) | (row_ptr[words - 1] & ~valid);
+    }
 
-    switch (data->dst_img->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            uint32_t *row0 = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint32_t *row1 = (uint32_t *) data->dst_row_override;
+    memcpy(row_ptr, out_row, words * sizeof(uint32_t));
+}
 
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                // Align to 32-bit boundary.
-                for (; (x % 32) && (x < x_end); x++) {
-                    uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                    uint32_t p = p0 ^ p1;
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                }
+// Word parallel erode (AND) or dilate (OR) of a binary image with a (2k+1)x(2k+1) kernel. The
+// kernel is separable so each row is first reduced horizontally with shifted copies of itself
+// and then 2k+1 horizontally reduced rows are combined to produce each output row. Pixels off
+// the image edge are ignored which is equivalent to replicating the edge pixels.
+static void imlib_erode_dilate_binary_fast(image_t *img, int ksize, int e_or_d, image_t *mask) {
+    int words = IMAGE_BINARY_LINE_LEN(img);
+    int pad = ((ksize + UINT32_T_MASK) >> UINT32_T_SHIFT) + 1;
+    int brows = (2 * ksize) + 1;
+    uint32_t fill = e_or_d ? 0 : UINT32_MAX;
+
+    uint32_t *line = fb_alloc((words + (2 * pad)) * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint32_t *h_buf = fb_alloc(words * brows * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint32_t *out_row = fb_alloc(words * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+    for (int i = 0; i < pad; i++) {
+        line[i] = fill;
+        line[pad + words + i] = fill;
+    }
 
-                for (; (x_end - x) >= 32; x += 32) {
-                    uint32_t p0 = row0[x / 32];
-                    uint32_t p1 = row1[x / 32];
-                    row0[x / 32] = p0 ^ p1;
-                }
-                #endif
+    for (int y = 0, h_y = 0; y < img->h; y++) {
+        // Horizontally reduce all rows needed by this output row before it overwrites the source.
+        for (int h_y_end = IM_MIN(y + ksize, img->h - 1); h_y <= h_y_end; h_y++) {
+            uint32_t *h_row = h_buf + ((h_y % brows) * words);
+            memcpy(line + pad, IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, h_y), words * sizeof(uint32_t));
 
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                    uint32_t p = p0 ^ p1;
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                }
-            } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                        uint32_t p = p0 ^ p1;
-                        IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                    }
-                }
+            if (img->w & UINT32_T_MASK) {
+                uint32_t valid = UINT32_MAX >> (UINT32_T_BITS - (img->w & UINT32_T_MASK));
+                line[pad + words - 1] = (line[pad + words - 1] & valid) | (fill & ~valid);
             }
-            break;
-        }
-        case PIXFORMAT_GRAYSCALE: {
-            uint8_t *row0 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint8_t *row1 = (uint8_t *) data->dst_row_override;
 
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                for (; (x_end - x) >= 4; x += 4) {
-                    uint32_t p0 = *((uint32_t *) (row0 + x));
-                    uint32_t p1 = *((uint32_t *) (row1 + x));
-                    *((uint32_t *) (row0 + x)) = p0 ^ p1;
-                }
-                #endif
+            for (int i = 0; i < words; i++) {
+                int x = i * UINT32_T_BITS;
+                uint32_t acc = line[pad + i];
 
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row1, x);
-                    uint32_t p = p0 ^ p1;
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row0, x, p);
-                }
-            } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row1, x);
-                        uint32_t p = p0 ^ p1;
-                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row0, x, p);
+                if (e_or_d) {
+                    for (int k = 1; k <= ksize; k++) {
+                        acc |= imlib_morph_get_word(line, pad, x - k) | imlib_morph_get_word(line, pad, x + k);
+                    }
+                } else {
+                    for (int k = 1; k <= ksize; k++) {
+                        acc &= imlib_morph_get_word(line, pad, x - k) & imlib_morph_get_word(line, pad, x + k);
                     }
                 }
+
+                h_row[i] = acc;
             }
-            break;
         }
-        case PIXFORMAT_RGB565: {
-            uint16_t *row0 = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint16_t *row1 = (uint16_t *) data->dst_row_override;
 
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                for (; (x_end - x) >= 2; x += 2) {
-                    uint32_t p0 = *((uint32_t *) (row0 + x));
-                    uint32_t p1 = *((uint32_t *) (row1 + x));
-                    *((uint32_t *) (row0 + x)) = p0 ^ p1;
-                }
-                #endif
+        int y_start = IM_MAX(y - ksize, 0), y_end = IM_MIN(y + ksize, img->h - 1);
+        memcpy(out_row, h_buf + ((y_start % brows) * words), words * sizeof(uint32_t));
 
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_RGB565_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_RGB565_PIXEL_FAST(row1, x);
-                    uint32_t p = p0 ^ p1;
-                    IMAGE_PUT_RGB565_PIXEL_FAST(row0, x, p);
+        for (int j = y_start + 1; j <= y_end; j++) {
+            uint32_t *h_row = h_buf + ((j % brows) * words);
+
+            if (e_or_d) {
+                for (int i = 0; i < words; i++) {
+                    out_row[i] |= h_row[i];
                 }
             } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_RGB565_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_RGB565_PIXEL_FAST(row1, x);
-                        uint32_t p = p0 ^ p1;
-                        IMAGE_PUT_RGB565_PIXEL_FAST(row0, x, p);
-                    }
+                for (int i = 0; i < words; i++) {
+                    out_row[i] &= h_row[i];
                 }
             }
-            break;
-        }
-        default: {
-            break;
         }
+
+        imlib_morph_put_row(img, y, out_row, mask);
     }
+
+    fb_free(); // out_row
+    fb_free(); // h_buf
+    fb_free(); // line
 }
 
-void imlib_b_xnor_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data) {
-    image_t *mask = (image_t *) data->callback_arg;
+// Thresholded erode/dilate of a binary image. Per column counts of set pixels in the vertical
+// window are updated a word at a time by only visiting the bits that differ between the row
+// entering and the row leaving the window. A sliding sum over the column counts then gives the
+// number of set pixels in each kernel in O(1) per pixel independent of the kernel size.
+static void imlib_erode_dilate_binary_count(image_t *img, int ksize, int threshold, int e_or_d, image_t *mask) {
+    int words = IMAGE_BINARY_LINE_LEN(img);
+    int brows = ksize + 1;
+    int w_max = img->w - 1, h_max = img->h - 1;
 
-    switch (data->dst_img->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            uint32_t *row0 = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint32_t *row1 = (uint32_t *) data->dst_row_override;
+    uint16_t *col_sum = fb_alloc0(img->w * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint32_t *o_buf = fb_alloc(words * brows * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint32_t *out_row = fb_alloc(words * sizeof(uint32_t), FB_ALLOC_NO_HINT);
 
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                // Align to 32-bit boundary.
-                for (; (x % 32) && (x < x_end); x++) {
-                    uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                    uint32_t p = ~(p0 ^ p1);
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                }
+    // Rows above the current row have been overwritten so they are read from the ring buffer.
+    #define ORIG_ROW_PTR(r) (((r) < y) ? (o_buf + (((r) % brows) * words)) : IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, (r)))
 
-                for (; (x_end - x) >= 32; x += 32) {
-                    uint32_t p0 = row0[x / 32];
-                    uint32_t p1 = row1[x / 32];
-                    row0[x / 32] = ~(p0 ^ p1);
-                }
-                #endif
+    for (int y = 0; y < img->h; y++) {
+        if (!y) {
+            for (int j = -ksize; j <= ksize; j++) {
+                uint32_t *row_ptr = ORIG_ROW_PTR(IM_CLAMP(j, 0, h_max));
 
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                    uint32_t p = ~(p0 ^ p1);
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                }
-            } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_BINARY_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_BINARY_PIXEL_FAST(row1, x);
-                        uint32_t p = ~(p0 ^ p1);
-                        IMAGE_PUT_BINARY_PIXEL_FAST(row0, x, p);
-                    }
+                for (int x = 0; x < img->w; x++) {
+                    col_sum[x] += IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x);
                 }
             }
-            break;
-        }
-        case PIXFORMAT_GRAYSCALE: {
-            uint8_t *row0 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint8_t *row1 = (uint8_t *) data->dst_row_override;
+        } else {
+            uint32_t *add_row = ORIG_ROW_PTR(IM_MIN(y + ksize, h_max));
+            uint32_t *sub_row = ORIG_ROW_PTR(IM_MAX(y - ksize - 1, 0));
 
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                for (; (x_end - x) >= 4; x += 4) {
-                    uint32_t p0 = *((uint32_t *) (row0 + x));
-                    uint32_t p1 = *((uint32_t *) (row1 + x));
-                    *((uint32_t *) (row0 + x)) = ~(p0 ^ p1);
-                }
-                #endif
+            for (int i = 0; i < words; i++) {
+                uint32_t add = add_row[i] & ~sub_row[i];
+                uint32_t sub = sub_row[i] & ~add_row[i];
 
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row1, x);
-                    uint32_t p = ~(p0 ^ p1);
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row0, x, p);
+                for (; add; add &= add - 1) {
+                    int x = (i * UINT32_T_BITS) + __builtin_ctz(add);
+                    if (x <= w_max) {
+                        col_sum[x] += 1;
+                    }
                 }
-            } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row1, x);
-                        uint32_t p = ~(p0 ^ p1);
-                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row0, x, p);
+
+                for (; sub; sub &= sub - 1) {
+                    int x = (i * UINT32_T_BITS) + __builtin_ctz(sub);
+                    if (x <= w_max) {
+                        col_sum[x] -= 1;
                     }
                 }
             }
-            break;
         }
-        case PIXFORMAT_RGB565: {
-            uint16_t *row0 = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(data->dst_img, y_row);
-            uint16_t *row1 = (uint16_t *) data->dst_row_override;
 
-            if (!mask) {
-                #if (__ARM_ARCH > 6)
-                for (; (x_end - x) >= 2; x += 2) {
-                    uint32_t p0 = *((uint32_t *) (row0 + x));
-                    uint32_t p1 = *((uint32_t *) (row1 + x));
-                    *((uint32_t *) (row0 + x)) = ~(p0 ^ p1);
-                }
-                #endif
+        uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+        int acc = 0;
 
-                for (; x < x_end; x++) {
-                    uint32_t p0 = IMAGE_GET_RGB565_PIXEL_FAST(row0, x);
-                    uint32_t p1 = IMAGE_GET_RGB565_PIXEL_FAST(row1, x);
-                    uint32_t p = ~(p0 ^ p1);
-                    IMAGE_PUT_RGB565_PIXEL_FAST(row0, x, p);
+        for (int k = -ksize; k <= ksize; k++) {
+            acc += col_sum[IM_CLAMP(k, 0, w_max)];
+        }
+
+        memcpy(out_row, row_ptr, words * sizeof(uint32_t));
+
+        for (int x = 0; x < img->w; x++) {
+            if (x) {
+                acc += col_sum[IM_MIN(x + ksize, w_max)] - col_sum[IM_MAX(x - ksize - 1, 0)];
+            }
+
+            if (!e_or_d) {
+                // Preserve original pixel value... or clear it (don't count the center pixel).
+                if ((acc - 1) < threshold) {
+                    IMAGE_CLEAR_BINARY_PIXEL_FAST(out_row, x);
                 }
             } else {
-                for (; x < x_end; x++) {
-                    if (image_get_mask_pixel(mask, x, y_row)) {
-                        uint32_t p0 = IMAGE_GET_RGB565_PIXEL_FAST(row0, x);
-                        uint32_t p1 = IMAGE_GET_RGB565_PIXEL_FAST(row1, x);
-                        uint32_t p = ~(p0 ^ p1);
-                        IMAGE_PUT_RGB565_PIXEL_FAST(row0, x, p);
-                    }
+                // Preserve original pixel value... or set it.
+                if (acc > threshold) {
+                    IMAGE_SET_BINARY_PIXEL_FAST(out_row, x);
                 }
             }
-            break;
-        }
-        default: {
-            break;
         }
+
+        memcpy(o_buf + ((y % brows) * words), row_ptr, words * sizeof(uint32_t));
+        imlib_morph_put_row(img, y, out_row, mask);
     }
+
+    #undef ORIG_ROW_PTR
+
+    fb_free(); // out_row
+    fb_free(); // o_buf
+    fb_free(); // col_sum
 }
 
 static void imlib_erode_dilate(image_t *img, int ksize, int threshold, int e_or_d, image_t *mask) {
@@ -929,72 +687,11 @@ static void imlib_erode_dilate(image_t *img, int ksize, int threshold, int e_or_
 
     switch (img->pixfmt) {
         case PIXFORMAT_BINARY: {
-            buf.data = fb_alloc(IMAGE_BINARY_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-
-            for (int y = 0; y < img->h; y++) {
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                uint32_t *buf_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, (y % brows));
-                int acc = 0;
-
-                for (int x = 0; x < img->w; x++) {
-                    int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x);
-                    IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, pixel);
-
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        continue; // Short circuit.
-                    }
-
-                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
-                        // faster
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y + j);
-                            // subtract old left column and add new right column
-                            acc -= IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x - ksize - 1);
-                            acc += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x + ksize);
-                        }
-                    } else {
-                        // slower (checks boundaries per pixel)
-                        acc = e_or_d ? 0 : -1; // Don't count center pixel...
-                        for (int j = -ksize; j <= ksize; j++) {
-                            int y_j = IM_CLAMP(y + j, 0, (img->h - 1));
-                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y_j);
-
-                            for (int k = -ksize; k <= ksize; k++) {
-                                int x_k = IM_CLAMP(x + k, 0, (img->w - 1));
-                                acc += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x_k);
-                            }
-                        }
-                    }
-
-                    if (!e_or_d) {
-                        // Preserve original pixel value... or clear it.
-                        if (acc < threshold) {
-                            IMAGE_CLEAR_BINARY_PIXEL_FAST(buf_row_ptr, x);
-                        }
-                    } else {
-                        // Preserve original pixel value... or set it.
-                        if (acc > threshold) {
-                            IMAGE_SET_BINARY_PIXEL_FAST(buf_row_ptr, x);
-                        }
-                    }
-                }
-
-                if (y >= ksize) {
-                    // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, (y - ksize)),
-                           IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
-                           IMAGE_BINARY_LINE_LEN_BYTES(img));
-                }
-            }
-
-            // Copy any remaining lines from the buffer image...
-            for (int y = IM_MAX(img->h - ksize, 0); y < img->h; y++) {
-                memcpy(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y),
-                       IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, (y % brows)),
-                       IMAGE_BINARY_LINE_LEN_BYTES(img));
+            if (threshold == (e_or_d ? 0 : (imlib_ksize_to_n(ksize) - 1))) {
+                imlib_erode_dilate_binary_fast(img, ksize, e_or_d, mask);
+            } else {
+                imlib_erode_dilate_binary_count(img, ksize, threshold, e_or_d, mask);
             }
-
-            fb_free();
             break;
         }
         case PIXFORMAT_GRAYSCALE: {
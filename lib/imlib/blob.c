@@ -166,6 +166,16 @@ void imlib_find_blobs(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int
 
     list_init(out, sizeof(find_blobs_list_lnk_data_t));
 
+    #if defined(IMLIB_ENABLE_THRESHOLD_BITMAPS)
+    imlib_thresholds_compile(thresholds, ptr, roi->w * roi->h);
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) != 0) {
+        // Unpin the bitmaps if anything below raises.
+        imlib_thresholds_release(thresholds);
+        nlr_jump(nlr.ret_val);
+    }
+    #endif
+
     size_t code = 0;
     list_for_each(it, thresholds) {
         color_thresholds_list_lnk_data_t *lnk_data = list_get_data(it);
@@ -1198,371 +1208,264 @@ void imlib_find_blobs(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int
             }
         }
     }
+
+    #if defined(IMLIB_ENABLE_THRESHOLD_BITMAPS)
+    nlr_pop();
+    imlib_thresholds_release(thresholds);
+    #endif
 }
 
-void imlib_flood_fill_int(image_t *out, image_t *img, int x, int y,
-                          int seed_threshold, int floating_threshold,
-                          flood_fill_call_back_t cb, void *data) {
-    lifo_t lifo;
-    size_t lifo_len;
-    lifo_alloc_all(&lifo, &lifo_len, sizeof(xylr_t));
+typedef struct flood_fill_span {
+    int16_t y, l, r;
+}
+flood_fill_span_t;
 
-    switch (img->pixfmt) {
+OMV_ATTR_ALWAYS_INLINE static int flood_fill_get_pixel(const void *row_ptr, int x, pixformat_t pixfmt) {
+    switch (pixfmt) {
         case PIXFORMAT_BINARY: {
-            for (int seed_pixel = IMAGE_GET_BINARY_PIXEL(img, x, y);;) {
-                int left = x, right = x;
-                uint32_t *row     = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                uint32_t *out_row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
+            return IMAGE_GET_BINARY_PIXEL_FAST((const uint32_t *) row_ptr, x);
+        }
+        case PIXFORMAT_GRAYSCALE: {
+            return IMAGE_GET_GRAYSCALE_PIXEL_FAST((const uint8_t *) row_ptr, x);
+        }
+        default: {
+            return IMAGE_GET_RGB565_PIXEL_FAST((const uint16_t *) row_ptr, x);
+        }
+    }
+}
 
-                while ((left > 0)
-                       && (!IMAGE_GET_BINARY_PIXEL_FAST(out_row, left - 1))
-                       && COLOR_BOUND_BINARY(IMAGE_GET_BINARY_PIXEL_FAST(row, left - 1), seed_pixel, seed_threshold)
-                       && COLOR_BOUND_BINARY(IMAGE_GET_BINARY_PIXEL_FAST(row, left - 1),
-                                             IMAGE_GET_BINARY_PIXEL_FAST(row, left), floating_threshold)) {
-                    left--;
-                }
+OMV_ATTR_ALWAYS_INLINE static bool flood_fill_bound(int pixel0, int pixel1, int threshold, pixformat_t pixfmt) {
+    switch (pixfmt) {
+        case PIXFORMAT_BINARY: {
+            return COLOR_BOUND_BINARY(pixel0, pixel1, threshold);
+        }
+        case PIXFORMAT_GRAYSCALE: {
+            return COLOR_BOUND_GRAYSCALE(pixel0, pixel1, threshold);
+        }
+        default: {
+            return COLOR_BOUND_RGB565(pixel0, pixel1, threshold);
+        }
+    }
+}
 
-                while ((right < (img->w - 1))
-                       && (!IMAGE_GET_BINARY_PIXEL_FAST(out_row, right + 1))
-                       && COLOR_BOUND_BINARY(IMAGE_GET_BINARY_PIXEL_FAST(row, right + 1), seed_pixel, seed_threshold)
-                       && COLOR_BOUND_BINARY(IMAGE_GET_BINARY_PIXEL_FAST(row, right + 1),
-                                             IMAGE_GET_BINARY_PIXEL_FAST(row, right), floating_threshold)) {
-                    right++;
-                }
+static void flood_fill_set_span(uint32_t *out_row, int l, int r) {
+    int l_word = l >> UINT32_T_SHIFT, r_word = r >> UINT32_T_SHIFT;
+    uint32_t l_mask = UINT32_MAX << (l & UINT32_T_MASK);
+    uint32_t r_mask = UINT32_MAX >> (UINT32_T_MASK - (r & UINT32_T_MASK));
+
+    if (l_word == r_word) {
+        out_row[l_word] |= l_mask & r_mask;
+    } else {
+        out_row[l_word] |= l_mask;
+        for (int i = l_word + 1; i < r_word; i++) {
+            out_row[i] = UINT32_MAX;
+        }
+        out_row[r_word] |= r_mask;
+    }
+}
 
-                for (int i = left; i <= right; i++) {
-                    IMAGE_SET_BINARY_PIXEL_FAST(out_row, i);
-                }
+// Scanline span fill. Each span popped off the stack is scanned on the rows above and below it
+// where new runs are grown horizontally, marked in the output and pushed. Spans are marked when
+// pushed so no span is pushed twice. Row pointers are computed once per popped span.
+//
+// The stack only holds O(w + h) spans. Spans that don't fit are marked in the pending bitmap
+// instead and are picked up again by rescanning it once the stack is empty.
+OMV_ATTR_ALWAYS_INLINE static void flood_fill_push(flood_fill_t *ff, int y, int l, int r) {
+    if (lifo_is_not_full(&ff->lifo)) {
+        flood_fill_span_t span = { .y = y, .l = l, .r = r };
+        lifo_enqueue(&ff->lifo, &span);
+    } else {
+        flood_fill_set_span(ff->pending + (y * ff->out_stride), l, r);
+        ff->pending_y_min = IM_MIN(ff->pending_y_min, y);
+        ff->pending_y_max = IM_MAX(ff->pending_y_max, y);
+    }
+}
 
-                int top_left = left;
-                int bot_left = left;
-                bool break_out = false;
-                for (;;) {
-                    if (lifo_size(&lifo) < lifo_len) {
-                        uint32_t *old_row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-
-                        if (y > 0) {
-                            row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y - 1);
-                            out_row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y - 1);
-
-                            bool recurse = false;
-                            for (int i = top_left; i <= right; i++) {
-                                if ((!IMAGE_GET_BINARY_PIXEL_FAST(out_row, i))
-                                    && COLOR_BOUND_BINARY(IMAGE_GET_BINARY_PIXEL_FAST(row, i), seed_pixel, seed_threshold)
-                                    && COLOR_BOUND_BINARY(IMAGE_GET_BINARY_PIXEL_FAST(row, i),
-                                                          IMAGE_GET_BINARY_PIXEL_FAST(old_row, i), floating_threshold)) {
-                                    xylr_t context;
-                                    context.x = x;
-                                    context.y = y;
-                                    context.l = left;
-                                    context.r = right;
-                                    context.t_l = i + 1; // Don't test the same pixel again...
-                                    context.b_l = bot_left;
-                                    lifo_enqueue(&lifo, &context);
-                                    x = i;
-                                    y = y - 1;
-                                    recurse = true;
-                                    break;
-                                }
-                            }
-                            if (recurse) {
-                                break;
-                            }
-                        }
+// Removes the first pending span from the pending bitmap. Returns false if there are none left.
+static bool flood_fill_pop_pending(flood_fill_t *ff, flood_fill_span_t *span) {
+    for (; ff->pending_y_min <= ff->pending_y_max; ff->pending_y_min++) {
+        uint32_t *row = ff->pending + (ff->pending_y_min * ff->out_stride);
 
-                        if (y < (img->h - 1)) {
-                            row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y + 1);
-                            out_row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y + 1);
+        for (size_t i = 0; i < ff->out_stride; i++) {
+            if (!row[i]) {
+                continue;
+            }
 
-                            bool recurse = false;
-                            for (int i = bot_left; i <= right; i++) {
-                                if ((!IMAGE_GET_BINARY_PIXEL_FAST(out_row, i))
-                                    && COLOR_BOUND_BINARY(IMAGE_GET_BINARY_PIXEL_FAST(row, i), seed_pixel, seed_threshold)
-                                    && COLOR_BOUND_BINARY(IMAGE_GET_BINARY_PIXEL_FAST(row, i),
-                                                          IMAGE_GET_BINARY_PIXEL_FAST(old_row, i), floating_threshold)) {
-                                    xylr_t context;
-                                    context.x = x;
-                                    context.y = y;
-                                    context.l = left;
-                                    context.r = right;
-                                    context.t_l = top_left;
-                                    context.b_l = i + 1; // Don't test the same pixel again...
-                                    lifo_enqueue(&lifo, &context);
-                                    x = i;
-                                    y = y + 1;
-                                    recurse = true;
-                                    break;
-                                }
-                            }
-                            if (recurse) {
-                                break;
-                            }
-                        }
-                    }
+            int l = (int) (i << UINT32_T_SHIFT) + __builtin_ctz(row[i]), r = l;
 
-                    if (cb) {
-                        cb(img, y, left, right, data);
-                    }
+            while (((r + 1) < ff->img->w) && IMAGE_GET_BINARY_PIXEL_FAST(row, r + 1)) {
+                r++;
+            }
 
-                    if (!lifo_size(&lifo)) {
-                        break_out = true;
-                        break;
-                    }
+            for (int x = l; x <= r; x++) {
+                IMAGE_CLEAR_BINARY_PIXEL_FAST(row, x);
+            }
 
-                    xylr_t context;
-                    lifo_dequeue(&lifo, &context);
-                    x = context.x;
-                    y = context.y;
-                    left = context.l;
-                    right = context.r;
-                    top_left = context.t_l;
-                    bot_left = context.b_l;
-                }
+            span->y = ff->pending_y_min;
+            span->l = l;
+            span->r = r;
+            return true;
+        }
+    }
 
-                if (break_out) {
-                    break;
-                }
-            }
+    return false;
+}
+
+OMV_ATTR_ALWAYS_INLINE static void flood_fill_seed_int(flood_fill_t *ff, int x, int y,
+                                                       flood_fill_call_back_t cb, void *data,
+                                                       pixformat_t pixfmt) {
+    image_t *img = ff->img;
+    int w_max = img->w - 1, h_max = img->h - 1;
+    int seed_threshold = ff->seed_threshold;
+    int floating_threshold = ff->floating_threshold;
+
+    const void *row = ff->img_data + (y * ff->img_stride);
+    uint32_t *out_row = ff->out_data + (y * ff->out_stride);
+
+    // Seeds landing in an already filled region are no-ops.
+    if (IMAGE_GET_BINARY_PIXEL_FAST(out_row, x)) {
+        return;
+    }
+
+    int seed_pixel = flood_fill_get_pixel(row, x, pixfmt);
+    int left = x, right = x;
+
+    while ((left > 0)
+           && (!IMAGE_GET_BINARY_PIXEL_FAST(out_row, left - 1))
+           && flood_fill_bound(flood_fill_get_pixel(row, left - 1, pixfmt), seed_pixel, seed_threshold, pixfmt)
+           && flood_fill_bound(flood_fill_get_pixel(row, left - 1, pixfmt),
+                               flood_fill_get_pixel(row, left, pixfmt), floating_threshold, pixfmt)) {
+        left--;
+    }
+
+    while ((right < w_max)
+           && (!IMAGE_GET_BINARY_PIXEL_FAST(out_row, right + 1))
+           && flood_fill_bound(flood_fill_get_pixel(row, right + 1, pixfmt), seed_pixel, seed_threshold, pixfmt)
+           && flood_fill_bound(flood_fill_get_pixel(row, right + 1, pixfmt),
+                               flood_fill_get_pixel(row, right, pixfmt), floating_threshold, pixfmt)) {
+        right++;
+    }
+
+    flood_fill_set_span(out_row, left, right);
+
+    flood_fill_span_t span = { .y = y, .l = left, .r = right };
+    lifo_enqueue(&ff->lifo, &span);
+
+    for (;;) {
+        if (lifo_is_not_empty(&ff->lifo)) {
+            lifo_dequeue(&ff->lifo, &span);
+        } else if (!flood_fill_pop_pending(ff, &span)) {
             break;
         }
-        case PIXFORMAT_GRAYSCALE: {
-            for (int seed_pixel = IMAGE_GET_GRAYSCALE_PIXEL(img, x, y);;) {
-                int left = x, right = x;
-                uint8_t *row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                uint32_t *out_row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
 
-                while ((left > 0)
-                       && (!IMAGE_GET_BINARY_PIXEL_FAST(out_row, left - 1))
-                       && COLOR_BOUND_GRAYSCALE(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row, left - 1), seed_pixel, seed_threshold)
-                       && COLOR_BOUND_GRAYSCALE(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row, left - 1),
-                                                IMAGE_GET_GRAYSCALE_PIXEL_FAST(row, left), floating_threshold)) {
-                    left--;
-                }
+        if (cb) {
+            cb(img, span.y, span.l, span.r, data);
+        }
 
-                while ((right < (img->w - 1))
-                       && (!IMAGE_GET_BINARY_PIXEL_FAST(out_row, right + 1))
-                       && COLOR_BOUND_GRAYSCALE(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row, right + 1), seed_pixel, seed_threshold)
-                       && COLOR_BOUND_GRAYSCALE(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row, right + 1),
-                                                IMAGE_GET_GRAYSCALE_PIXEL_FAST(row, right), floating_threshold)) {
-                    right++;
-                }
+        const void *old_row = ff->img_data + (span.y * ff->img_stride);
 
-                for (int i = left; i <= right; i++) {
-                    IMAGE_SET_BINARY_PIXEL_FAST(out_row, i);
-                }
+        for (int dy = -1; dy <= 1; dy += 2) {
+            int ny = span.y + dy;
 
-                int top_left = left;
-                int bot_left = left;
-                bool break_out = false;
-                for (;;) {
-                    if (lifo_size(&lifo) < lifo_len) {
-                        uint8_t *old_row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-
-                        if (y > 0) {
-                            row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y - 1);
-                            out_row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y - 1);
-
-                            bool recurse = false;
-                            for (int i = top_left; i <= right; i++) {
-                                if ((!IMAGE_GET_BINARY_PIXEL_FAST(out_row, i))
-                                    && COLOR_BOUND_GRAYSCALE(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row, i), seed_pixel, seed_threshold)
-                                    && COLOR_BOUND_GRAYSCALE(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row, i),
-                                                             IMAGE_GET_GRAYSCALE_PIXEL_FAST(old_row, i), floating_threshold)) {
-                                    xylr_t context;
-                                    context.x = x;
-                                    context.y = y;
-                                    context.l = left;
-                                    context.r = right;
-                                    context.t_l = i + 1; // Don't test the same pixel again...
-                                    context.b_l = bot_left;
-                                    lifo_enqueue(&lifo, &context);
-                                    x = i;
-                                    y = y - 1;
-                                    recurse = true;
-                                    break;
-                                }
-                            }
-                            if (recurse) {
-                                break;
-                            }
-                        }
+            if ((ny < 0) || (ny > h_max)) {
+                continue;
+            }
 
-                        if (y < (img->h - 1)) {
-                            row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y + 1);
-                            out_row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y + 1);
+            row = ff->img_data + (ny * ff->img_stride);
+            out_row = ff->out_data + (ny * ff->out_stride);
 
-                            bool recurse = false;
-                            for (int i = bot_left; i <= right; i++) {
-                                if ((!IMAGE_GET_BINARY_PIXEL_FAST(out_row, i))
-                                    && COLOR_BOUND_GRAYSCALE(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row, i), seed_pixel, seed_threshold)
-                                    && COLOR_BOUND_GRAYSCALE(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row, i),
-                                                             IMAGE_GET_GRAYSCALE_PIXEL_FAST(old_row, i), floating_threshold)) {
-                                    xylr_t context;
-                                    context.x = x;
-                                    context.y = y;
-                                    context.l = left;
-                                    context.r = right;
-                                    context.t_l = top_left;
-                                    context.b_l = i + 1; // Don't test the same pixel again...
-                                    lifo_enqueue(&lifo, &context);
-                                    x = i;
-                                    y = y + 1;
-                                    recurse = true;
-                                    break;
-                                }
-                            }
-                            if (recurse) {
-                                break;
-                            }
-                        }
-                    }
+            for (int i = span.l; i <= span.r; i++) {
+                // Skip over runs that are already filled a word at a time.
+                if ((!(i & UINT32_T_MASK)) && (out_row[i >> UINT32_T_SHIFT] == UINT32_MAX)) {
+                    i += UINT32_T_MASK;
+                    continue;
+                }
 
-                    if (cb) {
-                        cb(img, y, left, right, data);
-                    }
+                if (IMAGE_GET_BINARY_PIXEL_FAST(out_row, i)) {
+                    continue;
+                }
 
-                    if (!lifo_size(&lifo)) {
-                        break_out = true;
-                        break;
-                    }
+                int pixel = flood_fill_get_pixel(row, i, pixfmt);
 
-                    xylr_t context;
-                    lifo_dequeue(&lifo, &context);
-                    x = context.x;
-                    y = context.y;
-                    left = context.l;
-                    right = context.r;
-                    top_left = context.t_l;
-                    bot_left = context.b_l;
+                if ((!flood_fill_bound(pixel, seed_pixel, seed_threshold, pixfmt))
+                    || (!flood_fill_bound(pixel, flood_fill_get_pixel(old_row, i, pixfmt),
+                                          floating_threshold, pixfmt))) {
+                    continue;
                 }
 
-                if (break_out) {
-                    break;
-                }
-            }
-            break;
-        }
-        case PIXFORMAT_RGB565: {
-            for (int seed_pixel = IMAGE_GET_RGB565_PIXEL(img, x, y);;) {
-                int left = x, right = x;
-                uint16_t *row     = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                uint32_t *out_row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
+                left = i;
+                right = i;
 
                 while ((left > 0)
                        && (!IMAGE_GET_BINARY_PIXEL_FAST(out_row, left - 1))
-                       && COLOR_BOUND_RGB565(IMAGE_GET_RGB565_PIXEL_FAST(row, left - 1), seed_pixel, seed_threshold)
-                       && COLOR_BOUND_RGB565(IMAGE_GET_RGB565_PIXEL_FAST(row, left - 1),
-                                             IMAGE_GET_RGB565_PIXEL_FAST(row, left), floating_threshold)) {
+                       && flood_fill_bound(flood_fill_get_pixel(row, left - 1, pixfmt),
+                                           seed_pixel, seed_threshold, pixfmt)
+                       && flood_fill_bound(flood_fill_get_pixel(row, left - 1, pixfmt),
+                                           flood_fill_get_pixel(row, left, pixfmt), floating_threshold, pixfmt)) {
                     left--;
                 }
 
-                while ((right < (img->w - 1))
+                while ((right < w_max)
                        && (!IMAGE_GET_BINARY_PIXEL_FAST(out_row, right + 1))
-                       && COLOR_BOUND_RGB565(IMAGE_GET_RGB565_PIXEL_FAST(row, right + 1), seed_pixel, seed_threshold)
-                       && COLOR_BOUND_RGB565(IMAGE_GET_RGB565_PIXEL_FAST(row, right + 1),
-                                             IMAGE_GET_RGB565_PIXEL_FAST(row, right), floating_threshold)) {
+                       && flood_fill_bound(flood_fill_get_pixel(row, right + 1, pixfmt),
+                                           seed_pixel, seed_threshold, pixfmt)
+                       && flood_fill_bound(flood_fill_get_pixel(row, right + 1, pixfmt),
+                                           flood_fill_get_pixel(row, right, pixfmt), floating_threshold, pixfmt)) {
                     right++;
                 }
 
-                for (int i = left; i <= right; i++) {
-                    IMAGE_SET_BINARY_PIXEL_FAST(out_row, i);
-                }
-
-                int top_left = left;
-                int bot_left = left;
-                bool break_out = false;
-                for (;;) {
-                    if (lifo_size(&lifo) < lifo_len) {
-                        uint16_t *old_row = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-
-                        if (y > 0) {
-                            row = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y - 1);
-                            out_row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y - 1);
-
-                            bool recurse = false;
-                            for (int i = top_left; i <= right; i++) {
-                                if ((!IMAGE_GET_BINARY_PIXEL_FAST(out_row, i))
-                                    && COLOR_BOUND_RGB565(IMAGE_GET_RGB565_PIXEL_FAST(row, i), seed_pixel, seed_threshold)
-                                    && COLOR_BOUND_RGB565(IMAGE_GET_RGB565_PIXEL_FAST(row, i),
-                                                          IMAGE_GET_RGB565_PIXEL_FAST(old_row, i), floating_threshold)) {
-                                    xylr_t context;
-                                    context.x = x;
-                                    context.y = y;
-                                    context.l = left;
-                                    context.r = right;
-                                    context.t_l = i + 1; // Don't test the same pixel again...
-                                    context.b_l = bot_left;
-                                    lifo_enqueue(&lifo, &context);
-                                    x = i;
-                                    y = y - 1;
-                                    recurse = true;
-                                    break;
-                                }
-                            }
-                            if (recurse) {
-                                break;
-                            }
-                        }
-
-                        if (y < (img->h - 1)) {
-                            row = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y + 1);
-                            out_row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y + 1);
-
-                            bool recurse = false;
-                            for (int i = bot_left; i <= right; i++) {
-                                if ((!IMAGE_GET_BINARY_PIXEL_FAST(out_row, i))
-                                    && COLOR_BOUND_RGB565(IMAGE_GET_RGB565_PIXEL_FAST(row, i), seed_pixel, seed_threshold)
-                                    && COLOR_BOUND_RGB565(IMAGE_GET_RGB565_PIXEL_FAST(row, i),
-                                                          IMAGE_GET_RGB565_PIXEL_FAST(old_row, i), floating_threshold)) {
-                                    xylr_t context;
-                                    context.x = x;
-                                    context.y = y;
-                                    context.l = left;
-                                    context.r = right;
-                                    context.t_l = top_left;
-                                    context.b_l = i + 1; // Don't test the same pixel again...
-                                    lifo_enqueue(&lifo, &context);
-                                    x = i;
-                                    y = y + 1;
-                                    recurse = true;
-                                    break;
-                                }
-                            }
-                            if (recurse) {
-                                break;
-                            }
-                        }
-                    }
+                flood_fill_set_span(out_row, left, right);
+                flood_fill_push(ff, ny, left, right);
+                i = right;
+            }
+        }
+    }
+}
 
-                    if (cb) {
-                        cb(img, y, left, right, data);
-                    }
+void imlib_flood_fill_init(flood_fill_t *ff, image_t *out, image_t *img,
+                           int seed_threshold, int floating_threshold) {
+    ff->out = out;
+    ff->img = img;
+    ff->seed_threshold = seed_threshold;
+    ff->floating_threshold = floating_threshold;
+    ff->img_data = img->data;
+    ff->img_stride = image_line_size(img);
+    ff->out_data = (uint32_t *) out->data;
+    ff->out_stride = IMAGE_BINARY_LINE_LEN(out);
+
+    // The pending bitmap and the stack are allocated once and shared by all seeds filled with
+    // this context. Simple shapes need a few spans per row, twisty ones overflow to the bitmap.
+    ff->pending = fb_alloc0(ff->out_stride * out->h * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    ff->pending_y_min = out->h;
+    ff->pending_y_max = -1;
+    lifo_alloc(&ff->lifo, FLOOD_FILL_STACK_SPANS(img->w, img->h), sizeof(flood_fill_span_t));
+}
 
-                    if (!lifo_size(&lifo)) {
-                        break_out = true;
-                        break;
-                    }
+void imlib_flood_fill_deinit(flood_fill_t *ff) {
+    lifo_free(&ff->lifo);
+    fb_free(); // ff->pending
+}
 
-                    xylr_t context;
-                    lifo_dequeue(&lifo, &context);
-                    x = context.x;
-                    y = context.y;
-                    left = context.l;
-                    right = context.r;
-                    top_left = context.t_l;
-                    bot_left = context.b_l;
-                }
+void imlib_flood_fill_seed(flood_fill_t *ff, int x, int y, flood_fill_call_back_t cb, void *data) {
+    if ((x < 0) || (ff->img->w <= x) || (y < 0) || (ff->img->h <= y)) {
+        return;
+    }
 
-                if (break_out) {
-                    break;
-                }
-            }
+    switch (ff->img->pixfmt) {
+        case PIXFORMAT_BINARY: {
+            flood_fill_seed_int(ff, x, y, cb, data, PIXFORMAT_BINARY);
+            break;
+        }
+        case PIXFORMAT_GRAYSCALE: {
+            flood_fill_seed_int(ff, x, y, cb, data, PIXFORMAT_GRAYSCALE);
+            break;
+        }
+        case PIXFORMAT_RGB565: {
+            flood_fill_seed_int(ff, x, y, cb, data, PIXFORMAT_RGB565);
             break;
         }
         default: {
             break;
         }
     }
-
-    lifo_free(&lifo);
 }
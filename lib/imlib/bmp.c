@@ -300,7 +300,7 @@ void bmp_write_subimg(image_t *img, const char *path, rectangle_t *r) {
     }
 
     FIL fp;
-    file_open(&fp, path, true, FA_WRITE | FA_CREATE_ALWAYS);
+    file_open(&fp, path, true, FA_WRITE | FA_CREATE_ALWAYS | FILE_WRITE_BEHIND);
 
     if (IM_IS_GS(img)) {
         const int row_bytes = (((rect.w * 8) + 31) / 32) * 4;
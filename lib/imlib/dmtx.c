@@ -6006,7 +6006,10 @@ dmtxMatrix3Print(DmtxMatrix3 m)
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void imlib_find_datamatrices(list_t *out, image_t *ptr, rectangle_t *roi, int effort)
+// Scan grid locations visited between time budget checks.
+#define DMTX_BUDGET_ITERATIONS 64
+
+void imlib_find_datamatrices(list_t *out, image_t *ptr, rectangle_t *roi, int effort, imlib_budget_t *budget)
 {
     uint8_t *grayscale_image = (ptr->pixfmt == PIXFORMAT_GRAYSCALE) ? ptr->data : fb_alloc(roi->w * roi->h, FB_ALLOC_NO_HINT);
 
@@ -6036,7 +6039,33 @@ void imlib_find_datamatrices(list_t *out, image_t *ptr, rectangle_t *roi, int ef
 
     int max_iterations = effort;
     int current_iterations = 0;
-    for (DmtxRegion *region = dmtxRegionFindNext(decode, max_iterations, &current_iterations); region; region = dmtxRegionFindNext(decode, max_iterations, &current_iterations)) {
+    // dmtxRegionFindNext() doesn't count the location a region was found at,
+    // so the resume point adds those back to match the scan grid.
+    int regions = 0;
+
+    // Skip the scan grid locations visited by the call being resumed. The
+    // effort limit only counts the locations visited by this call.
+    if (budget && budget->resume) {
+        DmtxPixelLoc loc;
+        while ((current_iterations < budget->resume) && (PopGridLocation(&(decode->grid), &loc) != DmtxRangeEnd)) {
+            current_iterations += 1;
+        }
+        max_iterations += current_iterations;
+    }
+
+    // The first chunk always runs so that every call makes progress.
+    do {
+        int chunk_iterations = IM_MIN(current_iterations + DMTX_BUDGET_ITERATIONS, max_iterations);
+        DmtxRegion *region = dmtxRegionFindNext(decode, chunk_iterations, &current_iterations);
+
+        if (!region) {
+            if ((current_iterations < chunk_iterations) || (chunk_iterations == max_iterations)) {
+                break; // Out of locations or out of effort.
+            }
+            continue;
+        }
+
+        regions += 1;
         DmtxMessage *message = dmtxDecodeMatrixRegion(decode, region, DmtxUndefined);
 
         if (message) {
@@ -6095,6 +6124,10 @@ void imlib_find_datamatrices(list_t *out, image_t *ptr, rectangle_t *roi, int ef
         }
 
         dmtxRegionDestroy(&region);
+    } while (!imlib_budget_expired(budget));
+
+    if (budget) {
+        budget->resume = budget->expired ? (current_iterations + regions) : 0;
     }
 
     dmtxDecodeDestroy(&decode);
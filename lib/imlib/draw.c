@@ -2803,6 +2803,79 @@ void imlib_draw_image_get_bounds(image_t *dst_img,
     return;
 }
 
+// Runs a row callback over two images with the same size and pixel format. The source rows are
+// passed to the callback in place so no scaling, conversion or row copies are performed.
+void imlib_draw_image_rows(image_t *dst_img, image_t *src_img,
+                           imlib_draw_row_callback_t callback, void *callback_arg) {
+    imlib_draw_row_data_t data = {
+        .dst_img = dst_img,
+        .src_img_pixfmt = src_img->pixfmt,
+        .rgb_channel = -1,
+        .alpha = 255,
+        .callback = callback,
+        .callback_arg = callback_arg,
+    };
+
+    size_t line_size = image_line_size(src_img);
+
+    for (int y = 0; y < dst_img->h; y++) {
+        data.dst_row_override = src_img->data + (y * line_size);
+        callback(0, dst_img->w, y, &data);
+    }
+}
+
+typedef struct imlib_draw_jpeg_band {
+    image_t *dst_img;
+    int dst_x_start;
+    float x_scale;
+    int roi_x, roi_w;
+    int rgb_channel;
+    int alpha;
+    const uint16_t *color_palette;
+    const uint8_t *alpha_palette;
+    image_hint_t hint;
+    imlib_draw_row_callback_t callback;
+    void *callback_arg;
+    void *dst_row_override;
+    int y, y_end;
+    long src_y_accum, src_y_frac;
+    int scale;
+} imlib_draw_jpeg_band_t;
+
+// Draws the destination rows whose source rows are in the decoded band. Runs of rows which step
+// through consecutive source rows are drawn 1:1 in y, other rows one at a time, so the output
+// matches nearest neighbor scaling of the whole decoded image. The y accumulator is kept in full
+// resolution source rows and divided down by the DCT scale the JPEG is decoded at.
+static bool imlib_draw_jpeg_band(image_t *band, int band_y, void *arg) {
+    imlib_draw_jpeg_band_t *s = (imlib_draw_jpeg_band_t *) arg;
+    int band_y_end = band_y + band->h;
+
+    while (s->y < s->y_end) {
+        int src_y = (s->src_y_accum >> 16) / s->scale;
+
+        if (src_y >= band_y_end) {
+            return true;
+        }
+
+        int n = 1;
+        while (((s->y + n) < s->y_end) &&
+               ((src_y + n) < band_y_end) &&
+               ((((s->src_y_accum + (n * s->src_y_frac)) >> 16) / s->scale) == (src_y + n))) {
+            n++;
+        }
+
+        rectangle_t roi = { .x = s->roi_x, .y = src_y - band_y, .w = s->roi_w, .h = n };
+        imlib_draw_image(s->dst_img, band, s->dst_x_start, s->y, s->x_scale, 1.f, &roi,
+                         s->rgb_channel, s->alpha, s->color_palette, s->alpha_palette, s->hint,
+                         s->callback, s->callback_arg, s->dst_row_override);
+
+        s->y += n;
+        s->src_y_accum += n * s->src_y_frac;
+    }
+
+    return false;
+}
+
 void imlib_draw_image(image_t *dst_img,
                       image_t *src_img,
                       int dst_x_start,
@@ -3060,6 +3133,56 @@ void imlib_draw_image(image_t *dst_img,
     }
     #endif
 
+    // JPEG sources are decoded one row of MCUs at a time and drawn as they are decoded instead of
+    // decoding the whole image first. This only works when each destination row depends on a
+    // single source row and the rows are drawn top to bottom. When downscaling by 2x, 4x, or 8x
+    // or more the JPEG is also decoded at a reduced size in the DCT domain (the IDCT only computes
+    // the low frequency 4x4, 2x2, or DC coefficients of each block) which is much faster and
+    // averages the pixels that nearest neighbor scaling would otherwise drop.
+    if ((src_img->pixfmt == PIXFORMAT_JPEG) &&
+        (dst_delta_y == 1) &&
+        (!(hint & (IMAGE_HINT_AREA | IMAGE_HINT_BICUBIC | IMAGE_HINT_BILINEAR | IMAGE_HINT_TRANSPOSE))) &&
+        ((dst_img->data >= (src_img->data + src_img->size)) ||
+         (src_img->data >= (dst_img->data + image_size(dst_img))))) {
+        int scale = 8;
+        while ((scale > 1) && (((x_scale * scale) > 1.f) || ((y_scale * scale) > 1.f))) {
+            scale >>= 1;
+        }
+
+        imlib_draw_jpeg_band_t state = {
+            .dst_img = dst_img,
+            .dst_x_start = dst_x_start_backup,
+            .x_scale = x_scale,
+            .roi_x = w_start,
+            .roi_w = src_img_w,
+            .rgb_channel = rgb_channel,
+            .alpha = alpha,
+            .color_palette = color_palette,
+            .alpha_palette = alpha_palette,
+            .hint = (hint & ~(IMAGE_HINT_HMIRROR | IMAGE_HINT_VFLIP)) | ((dst_delta_x < 0) ? IMAGE_HINT_HMIRROR : 0),
+            .callback = callback,
+            .callback_arg = callback_arg,
+            .dst_row_override = dst_row_override,
+            .y = dst_y_start,
+            .y_end = dst_y_end,
+            .src_y_accum = src_y_accum_reset,
+            .src_y_frac = src_y_frac,
+            .scale = scale,
+        };
+
+        if (scale > 1) {
+            // Map the roi onto the reduced size image and pick an x scale that draws exactly as many
+            // pixels as the full size image would have.
+            state.roi_x = w_start / scale;
+            state.roi_w = IM_MAX((((w_start + src_img_w) + scale - 1) / scale) - state.roi_x, 1);
+            state.x_scale = (src_width_scaled + 0.5f) / state.roi_w;
+        }
+
+        if (jpeg_decompress_bands(src_img, new_not_mutable_pixfmt, scale, imlib_draw_jpeg_band, &state)) {
+            goto exit_cleanup;
+        }
+    }
+
     // Make a deep copy of the source image.
     if (((dst_img->data == src_img->data) &&
          (is_scaling || is_upscaling || is_bayer_yuv_conversion)) ||
@@ -5388,10 +5511,19 @@ exit_cleanup:
 }
 
 #ifdef IMLIB_ENABLE_FLOOD_FILL
-void imlib_flood_fill(image_t *img, int x, int y,
+void imlib_flood_fill(image_t *img, point_t *seeds, size_t seeds_len,
                       float seed_threshold, float floating_threshold,
                       int c, bool invert, bool clear_background, image_t *mask) {
-    if ((0 <= x) && (x < img->w) && (0 <= y) && (y < img->h)) {
+    bool in_bounds = false;
+
+    for (size_t i = 0; i < seeds_len; i++) {
+        if ((0 <= seeds[i].x) && (seeds[i].x < img->w) && (0 <= seeds[i].y) && (seeds[i].y < img->h)) {
+            in_bounds = true;
+            break;
+        }
+    }
+
+    if (in_bounds) {
         image_t out;
         out.w = img->w;
         out.h = img->h;
@@ -5437,7 +5569,15 @@ void imlib_flood_fill(image_t *img, int x, int y,
             }
         }
 
-        imlib_flood_fill_int(&out, img, x, y, color_seed_threshold, color_floating_threshold, NULL, NULL);
+        // All seeds share one span stack. Seeds landing in an already filled region are no-ops.
+        flood_fill_t ff;
+        imlib_flood_fill_init(&ff, &out, img, color_seed_threshold, color_floating_threshold);
+
+        for (size_t i = 0; i < seeds_len; i++) {
+            imlib_flood_fill_seed(&ff, seeds[i].x, seeds[i].y, NULL, NULL);
+        }
+
+        imlib_flood_fill_deinit(&ff);
 
         switch (img->pixfmt) {
             case PIXFORMAT_BINARY: {
@@ -28,12 +28,23 @@
 #include <string.h>
 #include "imlib.h"
 #include "fb_alloc.h"
+#include "simd.h"
 #ifdef IMLIB_ENABLE_BINARY_OPS
 
-typedef struct gvec {
-    uint16_t t;
-    uint16_t g;
-} gvec_t;
+// Canny non-maximum suppression output. Weak edges are kept only if they connect to a strong edge.
+#define CANNY_NONE      (0)
+#define CANNY_WEAK      (127)
+#define CANNY_STRONG    (255)
+
+// Gradient directions (the direction to look for the neighbors to suppress).
+#define CANNY_DIR_0     (0) // horizontal
+#define CANNY_DIR_45    (1) // bottom-left to top-right
+#define CANNY_DIR_90    (2) // vertical
+#define CANNY_DIR_135   (3) // top-left to bottom-right
+
+// tan(22.5) and tan(67.5) in 8.8 fixed point.
+#define CANNY_TAN_22_5  (106)
+#define CANNY_TAN_67_5  (618)
 
 void imlib_edge_simple(image_t *src, rectangle_t *roi, int low_thresh, int high_thresh) {
     imlib_morph(src, 1, kernel_high_pass_3, 1.0f, 0.0f, false, 0, false, NULL);
@@ -42,130 +53,207 @@ void imlib_edge_simple(image_t *src, rectangle_t *roi, int low_thresh, int high_
     color_thresholds_list_lnk_data_t lnk_data;
     lnk_data.LMin = low_thresh;
     lnk_data.LMax = high_thresh;
+    lnk_data.bitmap = NULL;
     list_push_back(&thresholds, &lnk_data);
     imlib_binary(src, src, &thresholds, false, false, NULL);
     list_free(&thresholds);
     imlib_erode(src, 1, 2, NULL);
 }
 
-void imlib_edge_canny(image_t *src, rectangle_t *roi, int low_thresh, int high_thresh) {
-    int w = src->w;
+// Computes the squared gradient magnitude and direction of one row with a 3x3 sobel kernel. The
+// first and last pixels of the row are left at zero.
+static void imlib_edge_canny_gradient_row(uint8_t *row_0, uint8_t *row_1, uint8_t *row_2, int w,
+                                          int16_t *gx_buf, int16_t *gy_buf, uint32_t *mag, uint8_t *dir) {
+    for (int x = 1; x < (w - 1); x += UINT16_VECTOR_SIZE) {
+        v128_predicate_t pred = vpredicate_16(w - 1 - x);
+        v128_t a0 = vldr_u8_widen_u16_pred(row_0 + x - 1, pred);
+        v128_t b0 = vldr_u8_widen_u16_pred(row_0 + x + 0, pred);
+        v128_t c0 = vldr_u8_widen_u16_pred(row_0 + x + 1, pred);
+        v128_t a1 = vldr_u8_widen_u16_pred(row_1 + x - 1, pred);
+        v128_t c1 = vldr_u8_widen_u16_pred(row_1 + x + 1, pred);
+        v128_t a2 = vldr_u8_widen_u16_pred(row_2 + x - 1, pred);
+        v128_t b2 = vldr_u8_widen_u16_pred(row_2 + x + 0, pred);
+        v128_t c2 = vldr_u8_widen_u16_pred(row_2 + x + 1, pred);
+
+        // [1 0 -1; 2 0 -2; 1 0 -1] and [1 2 1; 0 0 0; -1 -2 -1]
+        v128_t gx = vmla_n_s16(vsub_s16(a1, c1), 2, vsub_s16(vsub_s16(a0, c0), vsub_s16(c2, a2)));
+        v128_t gy = vmla_n_s16(vsub_s16(b0, b2), 2, vsub_s16(vsub_s16(a0, a2), vsub_s16(c2, c0)));
+
+        vstr_u16_pred((uint16_t *) (gx_buf + x), gx, pred);
+        vstr_u16_pred((uint16_t *) (gy_buf + x), gy, pred);
+    }
+
+    for (int x = 1; x < (w - 1); x++) {
+        int gx = gx_buf[x];
+        int gy = gy_buf[x];
+        int ax = abs(gx) * 256;
+        int ay = abs(gy);
+
+        mag[x] = (gx * gx) + (gy * gy);
+
+        // Classify the direction into one of four octant pairs with integer comparisons.
+        if ((ay * CANNY_TAN_22_5) <= ax) {
+            dir[x] = CANNY_DIR_0;
+        } else if ((ay * CANNY_TAN_67_5) <= ax) {
+            dir[x] = ((gx ^ gy) < 0) ? CANNY_DIR_45 : CANNY_DIR_135;
+        } else {
+            dir[x] = CANNY_DIR_90;
+        }
+    }
+}
+
+// Thins the edges of the center row to local maximums along the gradient and classifies them.
+static void imlib_edge_canny_suppress_row(uint32_t *mag_0, uint32_t *mag_1, uint32_t *mag_2, uint8_t *dir,
+                                          int w, uint32_t low, uint32_t high, uint8_t *out) {
+    out[0] = CANNY_NONE;
+
+    for (int x = 1; x < (w - 1); x++) {
+        uint32_t g = mag_1[x], a, b;
+
+        if (g < low) {
+            out[x] = CANNY_NONE;
+            continue;
+        }
+
+        switch (dir[x]) {
+            case CANNY_DIR_0: {
+                a = mag_1[x - 1];
+                b = mag_1[x + 1];
+                break;
+            }
+            case CANNY_DIR_45: {
+                a = mag_2[x - 1];
+                b = mag_0[x + 1];
+                break;
+            }
+            case CANNY_DIR_90: {
+                a = mag_2[x];
+                b = mag_0[x];
+                break;
+            }
+            default: {
+                a = mag_2[x + 1];
+                b = mag_0[x - 1];
+                break;
+            }
+        }
+
+        out[x] = ((g > a) && (g > b)) ? ((g >= high) ? CANNY_STRONG : CANNY_WEAK) : CANNY_NONE;
+    }
 
-    gvec_t *gm = fb_alloc0(roi->w * roi->h * sizeof *gm, FB_ALLOC_NO_HINT);
+    out[w - 1] = CANNY_NONE;
+}
 
+void imlib_edge_canny(image_t *src, rectangle_t *roi, int low_thresh, int high_thresh) {
     //1. Noise Reduction with a Gaussian filter
     imlib_sepconv3(src, kernel_gauss_3, 1.0f / 16.0f, 0.0f);
 
+    if ((roi->w < 3) || (roi->h < 3)) {
+        for (int y = roi->y; y < (roi->y + roi->h); y++) {
+            memset(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y) + roi->x, CANNY_NONE, roi->w);
+        }
+        return;
+    }
+
+    // Magnitudes are squared so compare against squared thresholds.
+    uint32_t low = IM_MAX(low_thresh, 0) * IM_MAX(low_thresh, 0);
+    uint32_t high = IM_MAX(high_thresh, 0) * IM_MAX(high_thresh, 0);
+
+    // The gradient rows are kept in a 3 row ring buffer. Once the gradient of row y is computed
+    // the source row y - 2 isn't needed anymore so row y - 1 is suppressed and written in place.
+    int w = roi->w;
+    int16_t *gx_buf = fb_alloc(w * sizeof(int16_t), FB_ALLOC_NO_HINT);
+    int16_t *gy_buf = fb_alloc(w * sizeof(int16_t), FB_ALLOC_NO_HINT);
+    uint32_t *mag = fb_alloc0(w * 3 * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint8_t *dir = fb_alloc0(w * 3 * sizeof(uint8_t), FB_ALLOC_NO_HINT);
+
     //2. Finding Image Gradients
-    for (int gy = 1, y = roi->y + 1; y < roi->y + roi->h - 1; y++, gy++) {
-        for (int gx = 1, x = roi->x + 1; x < roi->x + roi->w - 1; x++, gx++) {
-            int vx = 0, vy = 0;
-            // sobel kernel in the horizontal direction
-            vx = src->data [(y - 1) * w + x - 1]
-                 - src->data [(y - 1) * w + x + 1]
-                 + (src->data[(y + 0) * w + x - 1] << 1)
-                 - (src->data[(y + 0) * w + x + 1] << 1)
-                 + src->data [(y + 1) * w + x - 1]
-                 - src->data [(y + 1) * w + x + 1];
-
-            // sobel kernel in the vertical direction
-            vy = src->data [(y - 1) * w + x - 1]
-                 + (src->data[(y - 1) * w + x + 0] << 1)
-                 + src->data [(y - 1) * w + x + 1]
-                 - src->data [(y + 1) * w + x - 1]
-                 - (src->data[(y + 1) * w + x + 0] << 1)
-                 - src->data [(y + 1) * w + x + 1];
-
-            // Find magnitude
-            int g = (int) fast_sqrtf(vx * vx + vy * vy);
-            // Find the direction and round angle to 0, 45, 90 or 135
-            int t = (int) fast_fabsf((atan2f(vy, vx) * 180.0f / M_PI));
-            if (t < 22) {
-                t = 0;
-            } else if (t < 67) {
-                t = 45;
-            } else if (t < 112) {
-                t = 90;
-            } else if (t < 160) {
-                t = 135;
-            } else if (t <= 180) {
-                t = 0;
-            }
+    //3. Non-maximum Suppression
+    for (int y = 1; y < roi->h; y++) {
+        uint32_t *mag_y = mag + ((y % 3) * w);
+        uint8_t *dir_y = dir + ((y % 3) * w);
+
+        if (y < (roi->h - 1)) {
+            uint8_t *row_0 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, roi->y + y - 1) + roi->x;
+            uint8_t *row_1 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, roi->y + y + 0) + roi->x;
+            uint8_t *row_2 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, roi->y + y + 1) + roi->x;
+            imlib_edge_canny_gradient_row(row_0, row_1, row_2, w, gx_buf, gy_buf, mag_y, dir_y);
+        } else {
+            memset(mag_y, 0, w * sizeof(uint32_t));
+        }
+
+        uint8_t *out = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, roi->y + y - 1) + roi->x;
 
-            gm[gy * roi->w + gx].t = t;
-            gm[gy * roi->w + gx].g = g;
+        if (y == 1) {
+            memset(out, CANNY_NONE, w);
+        } else {
+            imlib_edge_canny_suppress_row(mag + (((y - 2) % 3) * w), mag + (((y - 1) % 3) * w), mag_y,
+                                          dir + (((y - 1) % 3) * w), w, low, high, out);
         }
     }
 
-    // 3. Hysteresis Thresholding
-    // 4. Non-maximum Suppression and output
-    for (int gy = 0, y = roi->y; y < roi->y + roi->h; y++, gy++) {
-        for (int gx = 0, x = roi->x; x < roi->x + roi->w; x++, gx++) {
-            int i = y * w + x;
-            gvec_t *va = NULL, *vb = NULL, *vc = &gm[gy * roi->w + gx];
-
-            // Clear the borders
-            if (y == (roi->y) || y == (roi->y + roi->h - 1) ||
-                x == (roi->x) || x == (roi->x + roi->w - 1)) {
-                src->data[i] = 0;
-                continue;
-            }
+    memset(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, roi->y + roi->h - 1) + roi->x, CANNY_NONE, w);
 
-            if (vc->g < low_thresh) {
-                // Not an edge
-                src->data[i] = 0;
-                continue;
-                // Check if strong or weak edge
-            } else if (vc->g >= high_thresh ||
-                       gm[(gy - 1) * roi->w + (gx - 1)].g >= high_thresh ||
-                       gm[(gy - 1) * roi->w + (gx + 0)].g >= high_thresh ||
-                       gm[(gy - 1) * roi->w + (gx + 1)].g >= high_thresh ||
-                       gm[(gy + 0) * roi->w + (gx - 1)].g >= high_thresh ||
-                       gm[(gy + 0) * roi->w + (gx + 1)].g >= high_thresh ||
-                       gm[(gy + 1) * roi->w + (gx - 1)].g >= high_thresh ||
-                       gm[(gy + 1) * roi->w + (gx + 0)].g >= high_thresh ||
-                       gm[(gy + 1) * roi->w + (gx + 1)].g >= high_thresh) {
-                vc->g = vc->g;
-            } else {
-                // Not an edge
-                src->data[i] = 0;
-                continue;
-            }
+    fb_free(); // dir
+    fb_free(); // mag
+    fb_free(); // gy_buf
+    fb_free(); // gx_buf
 
-            switch (vc->t) {
-                case 0: {
-                    va = &gm[(gy + 0) * roi->w + (gx - 1)];
-                    vb = &gm[(gy + 0) * roi->w + (gx + 1)];
-                    break;
-                }
+    //4. Hysteresis Thresholding
+    // Weak edges connected to strong edges through other weak edges become strong. The trace uses
+    // all free memory for its stack. If it runs out the scan is repeated until nothing changes.
+    lifo_t lifo;
+    size_t lifo_len;
+    lifo_alloc_all(&lifo, &lifo_len, sizeof(point_t));
 
-                case 45: {
-                    va = &gm[(gy + 1) * roi->w + (gx - 1)];
-                    vb = &gm[(gy - 1) * roi->w + (gx + 1)];
-                    break;
-                }
+    for (bool overflow = true; overflow;) {
+        overflow = false;
 
-                case 90: {
-                    va = &gm[(gy + 1) * roi->w + (gx + 0)];
-                    vb = &gm[(gy - 1) * roi->w + (gx + 0)];
-                    break;
+        for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y++) {
+            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y);
+
+            for (int x = roi->x + 1, xx = roi->x + roi->w - 1; x < xx; x++) {
+                if (row_ptr[x] != CANNY_STRONG) {
+                    continue;
                 }
 
-                case 135: {
-                    va = &gm[(gy + 1) * roi->w + (gx + 1)];
-                    vb = &gm[(gy - 1) * roi->w + (gx - 1)];
-                    break;
+                point_t p = { .x = x, .y = y };
+                lifo_enqueue(&lifo, &p);
+
+                while (lifo_is_not_empty(&lifo)) {
+                    lifo_dequeue(&lifo, &p);
+
+                    for (int j = -1; j <= 1; j++) {
+                        uint8_t *n_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, p.y + j);
+
+                        for (int i = -1; i <= 1; i++) {
+                            if (n_row_ptr[p.x + i] == CANNY_WEAK) {
+                                if (lifo_is_not_full(&lifo)) {
+                                    n_row_ptr[p.x + i] = CANNY_STRONG;
+                                    point_t n = { .x = p.x + i, .y = p.y + j };
+                                    lifo_enqueue(&lifo, &n);
+                                } else {
+                                    overflow = true;
+                                }
+                            }
+                        }
+                    }
                 }
             }
+        }
+    }
 
-            if (!(vc->g > va->g && vc->g > vb->g)) {
-                src->data[i] = 0;
-            } else {
-                src->data[i] = 255;
+    lifo_free(&lifo);
+
+    // Drop the weak edges that aren't connected to anything.
+    for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y++) {
+        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y);
+
+        for (int x = roi->x + 1, xx = roi->x + roi->w - 1; x < xx; x++) {
+            if (row_ptr[x] == CANNY_WEAK) {
+                row_ptr[x] = CANNY_NONE;
             }
         }
     }
-
-    fb_free();
 }
 #endif
@@ -27,6 +27,12 @@
 #include "imlib.h"
 
 void imlib_histeq(image_t *img, image_t *mask) {
+    mask_rle_t rle, *rle_ptr = NULL;
+    if (mask) {
+        imlib_mask_rle_from_image(&rle, img->w, img->h, mask);
+        rle_ptr = &rle;
+    }
+
     switch (img->pixfmt) {
         case PIXFORMAT_BINARY: {
             int a = img->w * img->h;
@@ -47,13 +53,12 @@ void imlib_histeq(image_t *img, image_t *mask) {
 
             for (int y = 0, yy = img->h; y < yy; y++) {
                 uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        continue;
+                mask_rle_for_each_span(span, rle_ptr, y, img->w) {
+                    for (int x = span->x, xx = span->x + span->w; x < xx; x++) {
+                        int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x);
+                        IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x,
+                                                    fast_floorf((s * hist[pixel - COLOR_BINARY_MIN]) + COLOR_BINARY_MIN));
                     }
-                    int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x);
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x,
-                                                fast_floorf((s * hist[pixel - COLOR_BINARY_MIN]) + COLOR_BINARY_MIN));
                 }
             }
 
@@ -79,13 +84,12 @@ void imlib_histeq(image_t *img, image_t *mask) {
 
             for (int y = 0, yy = img->h; y < yy; y++) {
                 uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        continue;
+                mask_rle_for_each_span(span, rle_ptr, y, img->w) {
+                    for (int x = span->x, xx = span->x + span->w; x < xx; x++) {
+                        int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
+                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row_ptr, x,
+                                                       fast_floorf((s * hist[pixel - COLOR_GRAYSCALE_MIN]) + COLOR_GRAYSCALE_MIN));
                     }
-                    int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row_ptr, x,
-                                                   fast_floorf((s * hist[pixel - COLOR_GRAYSCALE_MIN]) + COLOR_GRAYSCALE_MIN));
                 }
             }
 
@@ -111,19 +115,18 @@ void imlib_histeq(image_t *img, image_t *mask) {
 
             for (int y = 0, yy = img->h; y < yy; y++) {
                 uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        continue;
+                mask_rle_for_each_span(span, rle_ptr, y, img->w) {
+                    for (int x = span->x, xx = span->x + span->w; x < xx; x++) {
+                        int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
+                        int r = COLOR_RGB565_TO_R8(pixel);
+                        int g = COLOR_RGB565_TO_G8(pixel);
+                        int b = COLOR_RGB565_TO_B8(pixel);
+                        uint8_t y, u, v;
+                        y = (uint8_t) (((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
+                        u = (uint8_t) (((b << 14) - (r * 5529) - (g * 10855)) >> 15);  // -0.168736*r + -0.331264*g + 0.5*b
+                        v = (uint8_t) (((r << 14) - (g * 13682) - (b * 2664)) >> 15);  // 0.5*r + -0.418688*g + -0.081312*b
+                        IMAGE_PUT_RGB565_PIXEL_FAST(row_ptr, x, imlib_yuv_to_rgb(fast_floorf(s * hist[y]), u, v));
                     }
-                    int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
-                    int r = COLOR_RGB565_TO_R8(pixel);
-                    int g = COLOR_RGB565_TO_G8(pixel);
-                    int b = COLOR_RGB565_TO_B8(pixel);
-                    uint8_t y, u, v;
-                    y = (uint8_t) (((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    u = (uint8_t) (((b << 14) - (r * 5529) - (g * 10855)) >> 15);  // -0.168736*r + -0.331264*g + 0.5*b
-                    v = (uint8_t) (((r << 14) - (g * 13682) - (b * 2664)) >> 15);  // 0.5*r + -0.418688*g + -0.081312*b
-                    IMAGE_PUT_RGB565_PIXEL_FAST(row_ptr, x, imlib_yuv_to_rgb(fast_floorf(s * hist[y]), u, v));
                 }
             }
 
@@ -134,6 +137,10 @@ void imlib_histeq(image_t *img, image_t *mask) {
             break;
         }
     }
+
+    if (mask) {
+        imlib_mask_rle_free(&rle);
+    }
 }
 
 // ksize == 0 -> 1x1 kernel
@@ -160,6 +167,14 @@ void imlib_mean_filter(image_t *img, const int ksize, bool threshold, int offset
 
     int32_t over32_n = 65536 / (((ksize * 2) + 1) * ((ksize * 2) + 1));
 
+    // The running sum is restarted at the beginning of each span, so pixels
+    // outside of the mask are skipped without breaking the sliding window.
+    mask_rle_t rle, *rle_ptr = NULL;
+    if (mask) {
+        imlib_mask_rle_from_image(&rle, img->w, img->h, mask);
+        rle_ptr = &rle;
+    }
+
     switch (img->pixfmt) {
         case PIXFORMAT_BINARY: {
             buf.data = fb_alloc(IMAGE_BINARY_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
@@ -169,43 +184,44 @@ void imlib_mean_filter(image_t *img, const int ksize, bool threshold, int offset
                 uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
                 uint32_t *buf_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, (y % brows));
 
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                        continue; // Short circuit.
-                    }
+                if (mask) {
+                    memcpy(buf_row_ptr, row_ptr, IMAGE_BINARY_LINE_LEN_BYTES(img));
+                }
 
-                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y + j);
-                            acc -= IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x - ksize - 1);
-                            acc += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x + ksize);
-                        }
-                    } else {
-                        acc = 0;
+                mask_rle_for_each_span(span, rle_ptr, y, img->w) {
+                    for (int x = span->x, xx = span->x + span->w; x < xx; x++) {
+                        if (x > span->x && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
+                            for (int j = -ksize; j <= ksize; j++) {
+                                uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y + j);
+                                acc -= IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x - ksize - 1);
+                                acc += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x + ksize);
+                            }
+                        } else {
+                            acc = 0;
 
-                        for (int j = -ksize; j <= ksize; j++) {
-                            int y_j = IM_CLAMP(y + j, 0, (img->h - 1));
-                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y_j);
+                            for (int j = -ksize; j <= ksize; j++) {
+                                int y_j = IM_CLAMP(y + j, 0, (img->h - 1));
+                                uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y_j);
 
-                            for (int k = -ksize; k <= ksize; k++) {
-                                int x_k = IM_CLAMP(x + k, 0, (img->w - 1));
-                                acc += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x_k);
+                                for (int k = -ksize; k <= ksize; k++) {
+                                    int x_k = IM_CLAMP(x + k, 0, (img->w - 1));
+                                    acc += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x_k);
+                                }
                             }
                         }
-                    }
 
-                    pixel = (int) ((acc * over32_n) >> 16);
+                        pixel = (int) ((acc * over32_n) >> 16);
 
-                    if (threshold) {
-                        if (((pixel - offset) < IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x)) ^ invert) {
-                            pixel = COLOR_BINARY_MAX;
-                        } else {
-                            pixel = COLOR_BINARY_MIN;
+                        if (threshold) {
+                            if (((pixel - offset) < IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x)) ^ invert) {
+                                pixel = COLOR_BINARY_MAX;
+                            } else {
+                                pixel = COLOR_BINARY_MIN;
+                            }
                         }
-                    }
 
-                    IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, pixel);
+                        IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, pixel);
+                    }
                 }
 
                 if (y >= ksize) {
@@ -234,41 +250,43 @@ void imlib_mean_filter(image_t *img, const int ksize, bool threshold, int offset
                 uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
                 uint8_t *buf_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % brows));
 
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x));
-                        continue; // Short circuit.
-                    }
-                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y + j);
-                            acc -= IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x - ksize - 1);
-                            acc += IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x + ksize);
-                        }
-                    } else {
-                        acc = 0;
-                        for (int j = -ksize; j <= ksize; j++) {
-                            int y_j = IM_CLAMP(y + j, 0, (img->h - 1));
-                            uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y_j);
+                if (mask) {
+                    memcpy(buf_row_ptr, row_ptr, IMAGE_GRAYSCALE_LINE_LEN_BYTES(img));
+                }
 
-                            for (int k = -ksize; k <= ksize; k++) {
-                                int x_k = IM_CLAMP(x + k, 0, (img->w - 1));
-                                acc += IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x_k);
+                mask_rle_for_each_span(span, rle_ptr, y, img->w) {
+                    for (int x = span->x, xx = span->x + span->w; x < xx; x++) {
+                        if (x > span->x && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
+                            for (int j = -ksize; j <= ksize; j++) {
+                                uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y + j);
+                                acc -= IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x - ksize - 1);
+                                acc += IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x + ksize);
+                            }
+                        } else {
+                            acc = 0;
+                            for (int j = -ksize; j <= ksize; j++) {
+                                int y_j = IM_CLAMP(y + j, 0, (img->h - 1));
+                                uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y_j);
+
+                                for (int k = -ksize; k <= ksize; k++) {
+                                    int x_k = IM_CLAMP(x + k, 0, (img->w - 1));
+                                    acc += IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x_k);
+                                }
                             }
                         }
-                    }
 
-                    pixel = (int) ((acc * over32_n) >> 16);
+                        pixel = (int) ((acc * over32_n) >> 16);
 
-                    if (threshold) {
-                        if (((pixel - offset) < IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x)) ^ invert) {
-                            pixel = COLOR_GRAYSCALE_BINARY_MAX;
-                        } else {
-                            pixel = COLOR_GRAYSCALE_BINARY_MIN;
+                        if (threshold) {
+                            if (((pixel - offset) < IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x)) ^ invert) {
+                                pixel = COLOR_GRAYSCALE_BINARY_MAX;
+                            } else {
+                                pixel = COLOR_GRAYSCALE_BINARY_MIN;
+                            }
                         }
-                    }
 
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, pixel);
+                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, pixel);
+                    }
                 }
 
                 if (y >= ksize) {
@@ -298,57 +316,59 @@ void imlib_mean_filter(image_t *img, const int ksize, bool threshold, int offset
                 uint16_t *buf_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, (y % brows));
 
                 r_acc = g_acc = b_acc = 0;
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_RGB565_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                        continue; // Short circuit.
-                    }
-                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint16_t *k_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y + j);
-                            // subtract last left-most pixel from the sums
-                            pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr, x - ksize - 1);
-                            r_acc -= COLOR_RGB565_TO_R5(pixel);
-                            g_acc -= COLOR_RGB565_TO_G6(pixel);
-                            b_acc -= COLOR_RGB565_TO_B5(pixel);
-                            // add new right edge pixel to the sums
-                            pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr, x + ksize);
-                            r_acc += COLOR_RGB565_TO_R5(pixel);
-                            g_acc += COLOR_RGB565_TO_G6(pixel);
-                            b_acc += COLOR_RGB565_TO_B5(pixel);
-                        }
-                    } else {
-                        // check bounds and do full sum calculations
-                        r_acc = g_acc = b_acc = 0;
-                        for (int j = -ksize; j <= ksize; j++) {
-                            int y_j = IM_CLAMP(y + j, 0, (img->h - 1));
-                            uint16_t *k_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y_j);
+                if (mask) {
+                    memcpy(buf_row_ptr, row_ptr, IMAGE_RGB565_LINE_LEN_BYTES(img));
+                }
 
-                            for (int k = -ksize; k <= ksize; k++) {
-                                int x_k = IM_CLAMP(x + k, 0, (img->w - 1));
-                                pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr, x_k);
+                mask_rle_for_each_span(span, rle_ptr, y, img->w) {
+                    for (int x = span->x, xx = span->x + span->w; x < xx; x++) {
+                        if (x > span->x && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
+                            for (int j = -ksize; j <= ksize; j++) {
+                                uint16_t *k_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y + j);
+                                // subtract last left-most pixel from the sums
+                                pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr, x - ksize - 1);
+                                r_acc -= COLOR_RGB565_TO_R5(pixel);
+                                g_acc -= COLOR_RGB565_TO_G6(pixel);
+                                b_acc -= COLOR_RGB565_TO_B5(pixel);
+                                // add new right edge pixel to the sums
+                                pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr, x + ksize);
                                 r_acc += COLOR_RGB565_TO_R5(pixel);
                                 g_acc += COLOR_RGB565_TO_G6(pixel);
                                 b_acc += COLOR_RGB565_TO_B5(pixel);
                             }
+                        } else {
+                            // check bounds and do full sum calculations
+                            r_acc = g_acc = b_acc = 0;
+                            for (int j = -ksize; j <= ksize; j++) {
+                                int y_j = IM_CLAMP(y + j, 0, (img->h - 1));
+                                uint16_t *k_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y_j);
+
+                                for (int k = -ksize; k <= ksize; k++) {
+                                    int x_k = IM_CLAMP(x + k, 0, (img->w - 1));
+                                    pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr, x_k);
+                                    r_acc += COLOR_RGB565_TO_R5(pixel);
+                                    g_acc += COLOR_RGB565_TO_G6(pixel);
+                                    b_acc += COLOR_RGB565_TO_B5(pixel);
+                                }
+                            }
                         }
-                    }
-                    int pixel;
-                    r = (int) ((r_acc * over32_n) >> 16);
-                    g = (int) ((g_acc * over32_n) >> 16);
-                    b = (int) ((b_acc * over32_n) >> 16);
-                    pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
+                        int pixel;
+                        r = (int) ((r_acc * over32_n) >> 16);
+                        g = (int) ((g_acc * over32_n) >> 16);
+                        b = (int) ((b_acc * over32_n) >> 16);
+                        pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
 
-                    if (threshold) {
-                        if (((COLOR_RGB565_TO_Y(pixel) - offset) <
-                             COLOR_RGB565_TO_Y(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x))) ^ invert) {
-                            pixel = COLOR_RGB565_BINARY_MAX;
-                        } else {
-                            pixel = COLOR_RGB565_BINARY_MIN;
+                        if (threshold) {
+                            if (((COLOR_RGB565_TO_Y(pixel) - offset) <
+                                 COLOR_RGB565_TO_Y(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x))) ^ invert) {
+                                pixel = COLOR_RGB565_BINARY_MAX;
+                            } else {
+                                pixel = COLOR_RGB565_BINARY_MIN;
+                            }
                         }
-                    }
 
-                    IMAGE_PUT_RGB565_PIXEL_FAST(buf_row_ptr, x, pixel);
+                        IMAGE_PUT_RGB565_PIXEL_FAST(buf_row_ptr, x, pixel);
+                    }
                 }
 
                 if (y >= ksize) {
@@ -373,6 +393,10 @@ void imlib_mean_filter(image_t *img, const int ksize, bool threshold, int offset
             break;
         }
     }
+
+    if (mask) {
+        imlib_mask_rle_free(&rle);
+    }
 }
 #endif // IMLIB_ENABLE_MEAN
 
@@ -22,111 +22,462 @@
  * THE SOFTWARE.
  *
  * A simple GIF encoder.
+ *
+ * Frames are LZW compressed with 8-bit codes. Color recordings use a median
+ * cut palette built from the first frame and grayscale recordings use 255 gray
+ * levels. Palette index 255 is reserved for transparency so that after the first
+ * frame only the rectangle which changed is written, with unchanged pixels in it
+ * set transparent.
  */
 #include "imlib.h"
 #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
 
+#include "py/runtime.h"
 #include "fb_alloc.h"
 #include "file_utils.h"
-#define BLOCK_SIZE    (126) // (2^7) - 2 // (DO NOT CHANGE!)
 
-void gif_open(FIL *fp, int width, int height, bool color, bool loop) {
-    file_buffer_on(fp);
+#define GIF_TRANSPARENT         (255)
+#define GIF_MAX_COLORS          (255)
+#define GIF_LZW_MIN_CODE_SIZE   (8)
+#define GIF_LZW_CLEAR_CODE      (1 << GIF_LZW_MIN_CODE_SIZE)
+#define GIF_LZW_EOI_CODE        (GIF_LZW_CLEAR_CODE + 1)
+#define GIF_LZW_MAX_CODE        (4095)
+#define GIF_LZW_HASH_BITS       (13)
+#define GIF_LZW_HASH_SIZE       (1 << GIF_LZW_HASH_BITS)
+#define GIF_LZW_HASH_EMPTY      (0xFFFFFFFF)
 
-    file_write(fp, "GIF89a", 6);
-    file_write(fp, (uint16_t []) {width, height}, 4);
-    file_write(fp, (uint8_t []) {0xF6, 0x00, 0x00}, 3);
+// RGB565 is reduced to RGB444 to index the palette lookup table.
+#define GIF_LUT_KEY(pixel) \
+    (((COLOR_RGB565_TO_R5(pixel) >> 1) << 8) | ((COLOR_RGB565_TO_G6(pixel) >> 2) << 4) | (COLOR_RGB565_TO_B5(pixel) >> 1))
 
-    if (color) {
-        for (int i = 0; i < 128; i++) {
-            int red = ((((i & 0x60) >> 5) * 255) + 1.5) / 3;
-            int green = ((((i & 0x1C) >> 2) * 255) + 3.5) / 7;
-            int blue = (((i & 0x3) * 255) + 1.5) / 3;
-            file_write(fp, (uint8_t []) {red, green, blue}, 3);
+typedef struct gif_lzw {
+    FIL *fp;
+    uint32_t *hash; // (((prefix << 8) | suffix) << 12) | code
+    int prefix;
+    int next_code;
+    int code_size;
+    uint32_t bit_buf;
+    int bit_count;
+    int block_len;
+    uint8_t block[256];
+} gif_lzw_t;
+
+static void gif_lzw_reset(gif_lzw_t *lzw) {
+    memset(lzw->hash, 0xFF, GIF_LZW_HASH_SIZE * sizeof(uint32_t));
+    lzw->next_code = GIF_LZW_EOI_CODE + 1;
+    lzw->code_size = GIF_LZW_MIN_CODE_SIZE + 1;
+}
+
+static void gif_lzw_write_byte(gif_lzw_t *lzw, uint8_t value) {
+    lzw->block[++lzw->block_len] = value;
+
+    if (lzw->block_len == 255) {
+        lzw->block[0] = lzw->block_len;
+        file_write(lzw->fp, lzw->block, lzw->block_len + 1);
+        lzw->block_len = 0;
+    }
+}
+
+static void gif_lzw_write_code(gif_lzw_t *lzw, int code) {
+    lzw->bit_buf |= code << lzw->bit_count;
+    lzw->bit_count += lzw->code_size;
+
+    while (lzw->bit_count >= 8) {
+        gif_lzw_write_byte(lzw, lzw->bit_buf);
+        lzw->bit_buf >>= 8;
+        lzw->bit_count -= 8;
+    }
+
+    // Decoders grow the code size once the next code no longer fits.
+    if ((lzw->next_code >= (1 << lzw->code_size)) && (lzw->code_size < 12)) {
+        lzw->code_size += 1;
+    }
+}
+
+static void gif_lzw_start(gif_lzw_t *lzw, FIL *fp, uint32_t *hash) {
+    lzw->fp = fp;
+    lzw->hash = hash;
+    lzw->prefix = -1;
+    lzw->bit_buf = 0;
+    lzw->bit_count = 0;
+    lzw->block_len = 0;
+    gif_lzw_reset(lzw);
+
+    file_write_byte(fp, GIF_LZW_MIN_CODE_SIZE);
+    gif_lzw_write_code(lzw, GIF_LZW_CLEAR_CODE);
+}
+
+static void gif_lzw_push(gif_lzw_t *lzw, uint8_t pixel) {
+    if (lzw->prefix < 0) {
+        lzw->prefix = pixel;
+        return;
+    }
+
+    uint32_t key = (lzw->prefix << 8) | pixel;
+    uint32_t h = ((key >> GIF_LZW_HASH_BITS) ^ key) & (GIF_LZW_HASH_SIZE - 1);
+
+    // Linear probing, the table is never more than half full.
+    for (; lzw->hash[h] != GIF_LZW_HASH_EMPTY; h = (h + 1) & (GIF_LZW_HASH_SIZE - 1)) {
+        if ((lzw->hash[h] >> 12) == key) {
+            lzw->prefix = lzw->hash[h] & 0xFFF;
+            return;
         }
+    }
+
+    gif_lzw_write_code(lzw, lzw->prefix);
+    lzw->prefix = pixel;
+
+    if (lzw->next_code >= GIF_LZW_MAX_CODE) {
+        gif_lzw_write_code(lzw, GIF_LZW_CLEAR_CODE);
+        gif_lzw_reset(lzw);
     } else {
-        for (int i = 0; i < 128; i++) {
-            int gray = ((i * 255) + 63.5) / 127;
-            file_write(fp, (uint8_t []) {gray, gray, gray}, 3);
+        lzw->hash[h] = (key << 12) | lzw->next_code++;
+    }
+}
+
+static void gif_lzw_end(gif_lzw_t *lzw) {
+    if (lzw->prefix >= 0) {
+        gif_lzw_write_code(lzw, lzw->prefix);
+    }
+
+    gif_lzw_write_code(lzw, GIF_LZW_EOI_CODE);
+
+    if (lzw->bit_count) {
+        gif_lzw_write_byte(lzw, lzw->bit_buf);
+    }
+
+    if (lzw->block_len) {
+        lzw->block[0] = lzw->block_len;
+        file_write(lzw->fp, lzw->block, lzw->block_len + 1);
+    }
+
+    file_write_byte(lzw->fp, 0x00); // block terminator
+}
+
+// Reads a row of the image as RGB565 for color recordings or as grayscale.
+static void gif_read_row(gif_state_t *gif, image_t *img, int y, void *row) {
+    pixformat_t pixfmt = gif->color ? PIXFORMAT_RGB565 : PIXFORMAT_GRAYSCALE;
+
+    if (img->is_bayer) {
+        imlib_debayer_line(0, img->w, y, row, pixfmt, img);
+    } else if (img->is_yuv) {
+        imlib_deyuv_line(0, img->w, y, row, pixfmt, img);
+    } else if (IM_IS_GS(img)) {
+        uint8_t *src = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+        if (gif->color) {
+            for (int x = 0; x < img->w; x++) {
+                ((uint16_t *) row)[x] = COLOR_GRAYSCALE_TO_RGB565(src[x]);
+            }
+        } else {
+            memcpy(row, src, img->w);
+        }
+    } else if (IM_IS_RGB565(img)) {
+        uint16_t *src = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+        if (gif->color) {
+            memcpy(row, src, img->w * sizeof(uint16_t));
+        } else {
+            for (int x = 0; x < img->w; x++) {
+                ((uint8_t *) row)[x] = COLOR_RGB565_TO_GRAYSCALE(src[x]);
+            }
+        }
+    }
+}
+
+// Converts a row read by gif_read_row() into palette indices in place.
+static void gif_index_row(gif_state_t *gif, int w, void *row) {
+    uint8_t *dst = (uint8_t *) row;
+
+    if (gif->color) {
+        for (int x = 0; x < w; x++) {
+            dst[x] = gif->lut[GIF_LUT_KEY(((uint16_t *) row)[x])];
+        }
+    } else {
+        for (int x = 0; x < w; x++) {
+            dst[x] = ((dst[x] * (GIF_MAX_COLORS - 1)) + 127) / 255;
+        }
+    }
+}
+
+// Median cut over the RGB444 histogram of the first frame. Boxes of histogram
+// bins are split at the population median of their widest channel until there
+// are GIF_MAX_COLORS boxes or no box has more than one bin left.
+static void gif_build_palette(gif_state_t *gif, image_t *img) {
+    uint32_t *hist = fb_alloc0(4096 * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint16_t *bins = fb_alloc(4096 * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint16_t *temp = fb_alloc(4096 * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint16_t *row = fb_alloc(img->w * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint16_t box_start[GIF_MAX_COLORS + 1];
+    int n_bins = 0, n_boxes = 1;
+
+    for (int y = 0; y < img->h; y++) {
+        gif_read_row(gif, img, y, row);
+        for (int x = 0; x < img->w; x++) {
+            hist[GIF_LUT_KEY(row[x])] += 1;
+        }
+    }
+
+    for (int i = 0; i < 4096; i++) {
+        if (hist[i]) {
+            bins[n_bins++] = i;
+        }
+    }
+
+    box_start[0] = 0;
+    box_start[1] = n_bins;
+
+    while (n_boxes < GIF_MAX_COLORS) {
+        int best = -1, best_shift = 0, best_range = 0;
+
+        for (int b = 0; b < n_boxes; b++) {
+            for (int shift = 0; shift < 12; shift += 4) {
+                int lo = 15, hi = 0;
+                for (int i = box_start[b]; i < box_start[b + 1]; i++) {
+                    int c = (bins[i] >> shift) & 0xF;
+                    lo = IM_MIN(lo, c);
+                    hi = IM_MAX(hi, c);
+                }
+                if ((hi - lo) > best_range) {
+                    best = b;
+                    best_shift = shift;
+                    best_range = hi - lo;
+                }
+            }
+        }
+
+        if (best < 0) {
+            break;
+        }
+
+        // Counting sort the box on the channel.
+        int start = box_start[best], end = box_start[best + 1], offsets[17] = {0};
+        for (int i = start; i < end; i++) {
+            offsets[((bins[i] >> best_shift) & 0xF) + 1] += 1;
+        }
+        for (int i = 1; i < 17; i++) {
+            offsets[i] += offsets[i - 1];
+        }
+        for (int i = start; i < end; i++) {
+            temp[start + offsets[(bins[i] >> best_shift) & 0xF]++] = bins[i];
+        }
+        memcpy(bins + start, temp + start, (end - start) * sizeof(uint16_t));
+
+        uint32_t total = 0, sum = 0;
+        for (int i = start; i < end; i++) {
+            total += hist[bins[i]];
+        }
+
+        // The box has at least two distinct values on the channel so the
+        // split always leaves at least one bin on each side.
+        int split = start + 1;
+        for (int i = start; i < (end - 1); i++) {
+            sum += hist[bins[i]];
+            split = i + 1;
+            if ((sum * 2) >= total) {
+                break;
+            }
+        }
+
+        memmove(box_start + best + 2, box_start + best + 1, (n_boxes - best) * sizeof(uint16_t));
+        box_start[best + 1] = split;
+        n_boxes += 1;
+    }
+
+    memset(gif->palette, 0, sizeof(gif->palette));
+
+    for (int b = 0; b < n_boxes; b++) {
+        uint32_t total = 0, r = 0, g = 0, bl = 0;
+        for (int i = box_start[b]; i < box_start[b + 1]; i++) {
+            uint32_t count = hist[bins[i]];
+            total += count;
+            r += ((bins[i] >> 8) & 0xF) * 17 * count;
+            g += ((bins[i] >> 4) & 0xF) * 17 * count;
+            bl += (bins[i] & 0xF) * 17 * count;
+        }
+        if (total) {
+            gif->palette[b][0] = (r + (total / 2)) / total;
+            gif->palette[b][1] = (g + (total / 2)) / total;
+            gif->palette[b][2] = (bl + (total / 2)) / total;
         }
     }
 
-    if (loop) {
+    // Map every RGB444 value to its nearest palette color, including values
+    // that were not in the first frame.
+    for (int i = 0; i < 4096; i++) {
+        int r = ((i >> 8) & 0xF) * 17, g = ((i >> 4) & 0xF) * 17, bl = (i & 0xF) * 17;
+        int best = 0, best_dist = INT_MAX;
+        for (int b = 0; b < IM_MAX(n_boxes, 1); b++) {
+            int dr = r - gif->palette[b][0], dg = g - gif->palette[b][1], db = bl - gif->palette[b][2];
+            int dist = (dr * dr) + (dg * dg) + (db * db);
+            if (dist < best_dist) {
+                best = b;
+                best_dist = dist;
+            }
+        }
+        gif->lut[i] = best;
+    }
+
+    fb_free(); // row
+    fb_free(); // temp
+    fb_free(); // bins
+    fb_free(); // hist
+}
+
+static void gif_write_header(FIL *fp, gif_state_t *gif) {
+    file_write(fp, "GIF89a", 6);
+    file_write(fp, (uint16_t []) {gif->width, gif->height}, 4);
+    file_write(fp, (uint8_t []) {0xF7, 0x00, 0x00}, 3); // 256 color global table
+    file_write(fp, gif->palette, sizeof(gif->palette));
+
+    if (gif->loop) {
         file_write(fp, (uint8_t []) {'!', 0xFF, 0x0B}, 3);
         file_write(fp, "NETSCAPE2.0", 11);
         file_write(fp, (uint8_t []) {0x03, 0x01, 0x00, 0x00, 0x00}, 5);
     }
 
-    file_buffer_off(fp);
+    gif->header = true;
 }
 
-void gif_add_frame(FIL *fp, image_t *img, uint16_t delay) {
+void gif_open(FIL *fp, gif_state_t *gif, int width, int height, bool color, bool loop, bool delta) {
+    gif->width = width;
+    gif->height = height;
+    gif->color = color;
+    gif->loop = loop;
+    gif->header = false;
+    gif->prev_valid = false;
+    gif->lut = NULL;
+    gif->prev = NULL;
+
+    if (color) {
+        // The palette is built from the first frame and the header with it.
+        gif->lut = m_malloc(4096);
+        memset(gif->palette, 0, sizeof(gif->palette));
+    } else {
+        for (int i = 0; i < GIF_MAX_COLORS; i++) {
+            int gray = ((i * 255) + ((GIF_MAX_COLORS - 1) / 2)) / (GIF_MAX_COLORS - 1);
+            gif->palette[i][0] = gif->palette[i][1] = gif->palette[i][2] = gray;
+        }
+        memset(gif->palette[GIF_TRANSPARENT], 0, 3);
+    }
+
+    // Delta frames need the previous frame. Fall back to full frames if
+    // there's no room for it.
+    if (delta) {
+        gif->prev = m_malloc_maybe(width * height);
+    }
+}
+
+void gif_add_frame(FIL *fp, gif_state_t *gif, image_t *img, uint16_t delay) {
+    if ((!gif->header) && gif->color) {
+        gif_build_palette(gif, img);
+    }
+
+    // The write buffer takes all the remaining frame buffer memory so it must be allocated last.
+    void *row = fb_alloc(img->w * (gif->color ? sizeof(uint16_t) : sizeof(uint8_t)), FB_ALLOC_NO_HINT);
+    uint32_t *hash = fb_alloc(GIF_LZW_HASH_SIZE * sizeof(uint32_t), FB_ALLOC_NO_HINT);
     file_buffer_on(fp);
 
-    if (delay) {
-        file_write(fp, (uint8_t []) {'!', 0xF9, 0x04, 0x04}, 4);
-        file_write_short(fp, delay);
-        file_write_short(fp, 0); // end
+    if (!gif->header) {
+        gif_write_header(fp, gif);
     }
 
-    file_write_byte(fp, 0x2C);
-    file_write_long(fp, 0);
-    file_write(fp, (uint16_t []) {img->w, img->h}, 4);
-    file_write(fp, (uint8_t []) {0x00, 0x07}, 2); // 7-bits
-
-    int bytes = img->h * img->w;
-    int blocks = (bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
-
-    if (IM_IS_GS(img)) {
-        for (int y = 0; y < blocks; y++) {
-            int block_size = IM_MIN(BLOCK_SIZE, bytes - (y * BLOCK_SIZE));
-            file_write_byte(fp, 1 + block_size);
-            file_write_byte(fp, 0x80); // clear code
-            for (int x = 0; x < block_size; x++) {
-                file_write_byte(fp, img->pixels[(y * BLOCK_SIZE) + x] >> 1);
-            }
-        }
-    } else if (IM_IS_RGB565(img)) {
-        for (int y = 0; y < blocks; y++) {
-            int block_size = IM_MIN(BLOCK_SIZE, bytes - (y * BLOCK_SIZE));
-            file_write_byte(fp, 1 + block_size);
-            file_write_byte(fp, 0x80); // clear code
-            for (int x = 0; x < block_size; x++) {
-                uint16_t pixel = ((uint16_t *) img->pixels)[(y * BLOCK_SIZE) + x];
-                uint16_t r = COLOR_RGB565_TO_R5(pixel) >> 3;
-                uint16_t g = COLOR_RGB565_TO_G6(pixel) >> 3;
-                uint16_t b = COLOR_RGB565_TO_B5(pixel) >> 3;
-                file_write_byte(fp, (r << 5) | (g << 2) | b);
+    bool delta = gif->prev && gif->prev_valid;
+    int x_start = 0, y_start = 0, x_end = img->w, y_end = img->h;
+
+    // Find the rectangle which changed since the last frame.
+    if (delta) {
+        x_start = img->w;
+        y_start = img->h;
+        x_end = 0;
+        y_end = 0;
+
+        for (int y = 0; y < img->h; y++) {
+            uint8_t *prev = gif->prev + (y * img->w);
+            gif_read_row(gif, img, y, row);
+            gif_index_row(gif, img->w, row);
+
+            for (int x = 0; x < img->w; x++) {
+                if (((uint8_t *) row)[x] != prev[x]) {
+                    x_start = IM_MIN(x_start, x);
+                    x_end = IM_MAX(x_end, x + 1);
+                    y_start = IM_MIN(y_start, y);
+                    y_end = y + 1;
+                }
             }
         }
-    } else if (img->is_bayer || img->is_yuv) {
-        for (int y = 0; y < blocks; y++) {
-            int block_size = IM_MIN(BLOCK_SIZE, bytes - (y * BLOCK_SIZE));
-            file_write_byte(fp, 1 + block_size);
-            file_write_byte(fp, 0x80); // clear code
-            uint16_t pixels[block_size];
-            if (img->is_bayer) {
-                imlib_debayer_line(0, block_size, y, pixels, PIXFORMAT_RGB565, img);
+    }
+
+    // Nothing changed, write a single transparent pixel to keep the delay.
+    bool empty = (x_start >= x_end) || (y_start >= y_end);
+
+    if (empty) {
+        x_start = y_start = 0;
+        x_end = y_end = 1;
+    }
+
+    if (delay || delta) {
+        // Disposal method 1 keeps the last frame under the transparent pixels.
+        file_write(fp, (uint8_t []) {'!', 0xF9, 0x04, 0x04 | (delta ? 0x01 : 0x00)}, 4);
+        file_write_short(fp, delay);
+        file_write(fp, (uint8_t []) {delta ? GIF_TRANSPARENT : 0x00, 0x00}, 2); // end
+    }
+
+    file_write_byte(fp, 0x2C);
+    file_write(fp, (uint16_t []) {x_start, y_start, x_end - x_start, y_end - y_start}, 8);
+    file_write_byte(fp, 0x00); // uses the global color table
+
+    gif_lzw_t lzw;
+    gif_lzw_start(&lzw, fp, hash);
+
+    if (empty) {
+        gif_lzw_push(&lzw, GIF_TRANSPARENT);
+    } else {
+        for (int y = y_start; y < y_end; y++) {
+            uint8_t *index = (uint8_t *) row;
+            gif_read_row(gif, img, y, row);
+            gif_index_row(gif, img->w, row);
+
+            if (delta) {
+                uint8_t *prev = gif->prev + (y * img->w);
+                for (int x = x_start; x < x_end; x++) {
+                    gif_lzw_push(&lzw, (index[x] == prev[x]) ? GIF_TRANSPARENT : index[x]);
+                    prev[x] = index[x];
+                }
             } else {
-                imlib_deyuv_line(0, block_size, y, pixels, PIXFORMAT_RGB565, img);
-            }
-            for (int x = 0; x < block_size; x++) {
-                uint16_t pixel = pixels[2];
-                uint16_t r = COLOR_RGB565_TO_R5(pixel) >> 3;
-                uint16_t g = COLOR_RGB565_TO_G6(pixel) >> 3;
-                uint16_t b = COLOR_RGB565_TO_B5(pixel) >> 3;
-                file_write_byte(fp, (r << 5) | (g << 2) | b);
+                for (int x = x_start; x < x_end; x++) {
+                    gif_lzw_push(&lzw, index[x]);
+                }
+
+                if (gif->prev) {
+                    memcpy(gif->prev + (y * img->w), index, img->w);
+                }
             }
         }
     }
 
-    file_write(fp, (uint8_t []) {0x01, 0x81, 0x00}, 3); // end code
+    gif_lzw_end(&lzw);
+    gif->prev_valid = gif->prev != NULL;
 
     file_buffer_off(fp);
+    fb_free(); // hash
+    fb_free(); // row
 }
 
-void gif_close(FIL *fp) {
+void gif_close(FIL *fp, gif_state_t *gif) {
+    if (!gif->header) {
+        gif_write_header(fp, gif);
+    }
+
     file_write_byte(fp, ';');
     file_close(fp);
+
+    if (gif->lut) {
+        m_free(gif->lut);
+        gif->lut = NULL;
+    }
+
+    if (gif->prev) {
+        m_free(gif->prev);
+        gif->prev = NULL;
+    }
 }
 #endif //IMLIB_ENABLE_IMAGE_FILE_IO
@@ -28,123 +28,207 @@
 #include <math.h>
 #include <string.h>
 #include "imlib.h"
+#include "simd.h"
 #include "fb_alloc.h"
 
 #ifdef IMLIB_ENABLE_HOG
-#define N_BINS    (9)
-typedef struct bin {
-    int d;
-    int m;
-} bin_t;
-
-int bin_array_comp(const void *obj0, const void *obj1) {
-    const bin_t *b0 = obj0;
-    const bin_t *b1 = obj1;
-    if (b0->m < b1->m) {
-        return -1;
-    }
-    if (b0->m > b1->m) {
-        return 1;
+#define HOG_BIN_DEGREES     (180 / HOG_BINS)
+#define HOG_MAG_SCALE       (16.0f)     // Magnitudes are accumulated in 1/16 units.
+#define HOG_CLIP            (0.2f)      // L2-Hys clipping threshold.
+#define HOG_EPSILON         (1.0f)
+#define HOG_EPSILON_HYS     (1e-3f)
+
+// Unit vectors of the boundaries between the orientation bins (20, 40, ... 160 degrees) in Q14.
+static const int16_t hog_bin_edges[HOG_BINS - 1][2] = {
+    { 15396,  5604}, { 12551, 10531}, {  8192, 14189}, {  2845, 16135},
+    { -2845, 16135}, { -8192, 14189}, {-12551, 10531}, {-15396,  5604},
+};
+
+// Computes the centered [-1 0 1] derivatives of a row. row_1 is padded by one pixel on each side.
+static void imlib_hog_gradient_row(uint8_t *row_0, uint8_t *row_1, uint8_t *row_2, int w,
+                                   int16_t *gx_buf, int16_t *gy_buf) {
+    for (int x = 0; x < w; x += UINT16_VECTOR_SIZE) {
+        v128_predicate_t pred = vpredicate_16(w - x);
+        v128_t a = vldr_u8_widen_u16_pred(row_1 + x + 0, pred);
+        v128_t c = vldr_u8_widen_u16_pred(row_1 + x + 2, pred);
+        v128_t b0 = vldr_u8_widen_u16_pred(row_0 + x, pred);
+        v128_t b2 = vldr_u8_widen_u16_pred(row_2 + x, pred);
+        vstr_u16_pred((uint16_t *) (gx_buf + x), vsub_s16(c, a), pred);
+        vstr_u16_pred((uint16_t *) (gy_buf + x), vsub_s16(b2, b0), pred);
     }
+}
+
+// Votes the gradients of one pixel row into the histograms of a row of cells.
+static void imlib_hog_vote_row(int16_t *gx_buf, int16_t *gy_buf, int x_cells, int cell_size, uint32_t *cells) {
+    for (int cx = 0, x = 0; cx < x_cells; cx++, cells += HOG_BINS) {
+        for (int xe = x + cell_size; x < xe; x++) {
+            int gx = gx_buf[x];
+            int gy = gy_buf[x];
+
+            if (!(gx | gy)) {
+                continue;
+            }
 
-    return 0;
+            // Fold the gradient into [0, 180) degrees.
+            if ((gy < 0) || ((gy == 0) && (gx < 0))) {
+                gx = -gx;
+                gy = -gy;
+            }
+
+            // The orientation is at or past an edge if the gradient is on its left side.
+            int bin = 0;
+            while ((bin < (HOG_BINS - 1)) && ((hog_bin_edges[bin][0] * gy) >= (hog_bin_edges[bin][1] * gx))) {
+                bin += 1;
+            }
+
+            cells[bin] += (uint32_t) (fast_sqrtf((gx * gx) + (gy * gy)) * HOG_MAG_SCALE);
+        }
+    }
 }
 
-void imlib_find_hog(image_t *src, rectangle_t *roi, int cell_size) {
-    int s = src->w;
-    int w = roi->x + roi->w - 1;
-    int h = roi->y + roi->h - 1;
-
-    int block_size = cell_size * 2;
-    int x_cells = (roi->w / cell_size);
-    int y_cells = (roi->h / cell_size);
-
-    // TODO: Assert row->w/h >= cell_size *2;
-    float *hog = fb_alloc0(x_cells * y_cells * N_BINS * sizeof *hog, FB_ALLOC_NO_HINT);
-
-    //2. Finding Image Gradients
-    for (int y = roi->y, hog_index = 0; y < h; y += block_size) {
-        for (int x = roi->x; x < w; x += block_size) {
-            float k = 0.0f;
-            for (int cy = 0; cy < block_size; cy++) {
-                for (int cx = 0; cx < block_size; cx++) {
-                    if ((y + cy) > 0 && (y + cy) < h && (x + cx) > 0 && (x + cx) < w) {
-                        // Find horizontal/vertical direction
-                        int vx = src->data[(y + cy + 0) * s + (x + cx + 1)] - src->data[(y + cy - 0) * s + (x + cx - 1)];
-                        int vy = src->data[(y + cy + 1) * s + (x + cx + 0)] - src->data[(y + cy - 1) * s + (x + cx - 0)];
-                        // Find magnitude
-                        float m = fast_sqrtf(vx * vx + vy * vy);
-                        if (((int) m) > 1) {
-                            k += m * m;
-                            // Find and quantize gradient degree
-                            // TODO atan2f is swapped for visualization
-                            int t = ((int) fast_fabsf((atan2f(vx, vy) * 180.0f / M_PI))) / 20;
-                            t = (t == 9)? 0 : t;
-
-                            // hog[((cy/cell_size) * x_cells + (cx/cell_size)) * N_BINS + t] += m;
-                            hog[hog_index + (((cy / 8) * 2 + (cx / 8)) * N_BINS) + t] += m;
-                        }
-                    }
+void imlib_hog_grid_init(hog_grid_t *grid, image_t *src, rectangle_t *roi, int cell_size) {
+    grid->cell_size = cell_size;
+    grid->x_cells = roi->w / cell_size;
+    grid->y_cells = roi->h / cell_size;
+
+    int x_blocks = IM_MAX(grid->x_cells - 1, 0);
+    int y_blocks = IM_MAX(grid->y_cells - 1, 0);
+    grid->cells = fb_alloc0(IM_MAX(grid->x_cells * grid->y_cells, 1) * HOG_BINS * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    grid->norms = fb_alloc(IM_MAX(x_blocks * y_blocks, 1) * 2 * sizeof(float), FB_ALLOC_NO_HINT);
+
+    int w = grid->x_cells * cell_size;
+    int h = grid->y_cells * cell_size;
+
+    if (w && h) {
+        uint8_t *row_1 = fb_alloc(w + 2, FB_ALLOC_NO_HINT);
+        int16_t *gx_buf = fb_alloc(w * sizeof(int16_t), FB_ALLOC_NO_HINT);
+        int16_t *gy_buf = fb_alloc(w * sizeof(int16_t), FB_ALLOC_NO_HINT);
+
+        // Gradients at the border of the roi use the pixels around it. Those at the border
+        // of the image replicate the edge pixels.
+        int x_l = IM_MAX(roi->x - 1, 0);
+        int x_r = IM_MIN(roi->x + w, src->w - 1);
+
+        for (int y = 0; y < h; y++) {
+            int iy = roi->y + y;
+            uint8_t *row_0 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, IM_MAX(iy - 1, 0));
+            uint8_t *row_c = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, iy);
+            uint8_t *row_2 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, IM_MIN(iy + 1, src->h - 1));
+
+            row_1[0] = row_c[x_l];
+            memcpy(row_1 + 1, row_c + roi->x, w);
+            row_1[w + 1] = row_c[x_r];
+
+            imlib_hog_gradient_row(row_0 + roi->x, row_1, row_2 + roi->x, w, gx_buf, gy_buf);
+            imlib_hog_vote_row(gx_buf, gy_buf, grid->x_cells, cell_size,
+                               grid->cells + ((y / cell_size) * grid->x_cells * HOG_BINS));
+        }
+
+        fb_free(); // gy_buf
+        fb_free(); // gx_buf
+        fb_free(); // row_1
+    }
+
+    // L2-Hys: normalize, clip and renormalize each block. Both scales are kept so that lookups
+    // only need a multiply, a min and a multiply per value.
+    for (int by = 0; by < y_blocks; by++) {
+        for (int bx = 0; bx < x_blocks; bx++) {
+            float *norm = grid->norms + (((by * x_blocks) + bx) * 2);
+            float sum = 0.0f, sum_hys = 0.0f;
+
+            for (int i = 0; i < 4; i++) {
+                uint32_t *cell = grid->cells + ((((by + (i >> 1)) * grid->x_cells) + bx + (i & 1)) * HOG_BINS);
+
+                for (int b = 0; b < HOG_BINS; b++) {
+                    sum += ((float) cell[b]) * cell[b];
                 }
             }
 
-            // Normalize the last block
-            k = sqrtf(k);
-            for (int i = hog_index; i < (hog_index + (N_BINS * 4)); i++) {
-                hog[i] = hog[i] / k;
+            norm[0] = 1.0f / fast_sqrtf(sum + HOG_EPSILON);
+
+            for (int i = 0; i < 4; i++) {
+                uint32_t *cell = grid->cells + ((((by + (i >> 1)) * grid->x_cells) + bx + (i & 1)) * HOG_BINS);
+
+                for (int b = 0; b < HOG_BINS; b++) {
+                    float v = IM_MIN(cell[b] * norm[0], HOG_CLIP);
+                    sum_hys += v * v;
+                }
             }
 
-            hog_index += (N_BINS * 4);
+            norm[1] = 1.0f / fast_sqrtf(sum_hys + HOG_EPSILON_HYS);
         }
     }
+}
 
-    memset(src->pixels, 0, src->w * src->h);
+void imlib_hog_grid_free(hog_grid_t *grid) {
+    fb_free(); // grid->norms
+    fb_free(); // grid->cells
+}
+
+// Writes the HOG_DESCRIPTOR_SIZE(x_cells, y_cells) features of the window of cells starting at
+// cell (cell_x, cell_y). Blocks are ordered by row, the cells in a block by row and then the bins.
+void imlib_hog_descriptor(hog_grid_t *grid, int cell_x, int cell_y, int x_cells, int y_cells, float *out) {
+    int x_blocks = grid->x_cells - 1;
 
-    array_t *gds;
-    bin_t bins[9];
-    array_alloc(&gds, NULL);
+    for (int by = cell_y, bye = cell_y + y_cells - 1; by < bye; by++) {
+        for (int bx = cell_x, bxe = cell_x + x_cells - 1; bx < bxe; bx++) {
+            float *norm = grid->norms + (((by * x_blocks) + bx) * 2);
 
-    for (int i = 0; i < N_BINS; i++) {
-        array_push_back(gds, &bins[i]);
+            for (int i = 0; i < 4; i++) {
+                uint32_t *cell = grid->cells + ((((by + (i >> 1)) * grid->x_cells) + bx + (i & 1)) * HOG_BINS);
+
+                for (int b = 0; b < HOG_BINS; b++) {
+                    *out++ = IM_MIN(cell[b] * norm[0], HOG_CLIP) * norm[1];
+                }
+            }
+        }
     }
+}
+
+// Draws the histogram of each cell as lines along the edge orientations of its bins with the
+// strongest bins drawn last.
+void imlib_find_hog(image_t *src, rectangle_t *roi, int cell_size) {
+    hog_grid_t grid;
+    imlib_hog_grid_init(&grid, src, roi, cell_size);
+
+    memset(src->pixels, 0, src->w * src->h);
 
     int l = cell_size / 2;
-    // Note cells are not ordered histograms of 4 cells
-    for (int by = 0, hog_index = 0; by < y_cells; by += 2) {
-        for (int bx = 0; bx < x_cells; bx += 2) {
-            for (int y = 0; y < 2; y++) {
-                for (int x = 0; x < 2; x++) {
-                    // Sort and draw bins
-                    for (int i = hog_index; i < hog_index + N_BINS; i++) {
-                        int m = (int) (hog[i] * 255);
-                        if (m > 255) {
-                            m = 255;
-                        } else if (m < 0) {
-                            m = 0;
-                        }
-                        bin_t *bin = array_at(gds, (i % N_BINS));
-                        bin->m = m;
-                        bin->d = ((i % N_BINS) * 20);
-                    }
-
-                    array_sort(gds, bin_array_comp);
-
-                    int x1 = (x + bx) * cell_size + l;
-                    int y1 = (y + by) * cell_size + l;
-                    for (int i = 0; i < N_BINS; i++) {
-                        bin_t *bin = array_at(gds, i);
-                        int x2 = l * cos_table[bin->d];
-                        int y2 = l * sin_table[bin->d];
-                        imlib_draw_line(src, (x1 - x2), (y1 + y2), (x1 + x2), (y1 - y2), bin->m, 1);
-                    }
-
-                    hog_index += N_BINS;
+
+    for (int cy = 0; cy < grid.y_cells; cy++) {
+        for (int cx = 0; cx < grid.x_cells; cx++) {
+            uint32_t *cell = grid.cells + (((cy * grid.x_cells) + cx) * HOG_BINS);
+            uint8_t order[HOG_BINS];
+            float sum = 0.0f;
+
+            // Insertion sort the bins by magnitude.
+            for (int b = 0; b < HOG_BINS; b++) {
+                int i = b;
+
+                for (; (i > 0) && (cell[order[i - 1]] > cell[b]); i--) {
+                    order[i] = order[i - 1];
                 }
+
+                order[i] = b;
+                sum += ((float) cell[b]) * cell[b];
+            }
+
+            float scale = 255.0f / fast_sqrtf(sum + HOG_EPSILON);
+            int x1 = roi->x + (cx * cell_size) + l;
+            int y1 = roi->y + (cy * cell_size) + l;
+
+            for (int i = 0; i < HOG_BINS; i++) {
+                int b = order[i];
+                int m = IM_MIN(fast_roundf(cell[b] * scale), COLOR_GRAYSCALE_MAX);
+                // Edges are perpendicular to the gradient at the center of the bin.
+                int d = ((b * HOG_BIN_DEGREES) + (HOG_BIN_DEGREES / 2) + 90) % 360;
+                int x2 = l * cos_table[d];
+                int y2 = l * sin_table[d];
+                imlib_draw_line(src, x1 - x2, y1 - y2, x1 + x2, y1 + y2, m, 1);
             }
         }
     }
 
-    m_free(gds);
-    fb_free();
+    imlib_hog_grid_free(&grid);
 }
 #endif // IMLIB_ENABLE_HOG
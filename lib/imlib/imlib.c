@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include "py/obj.h"
 #include "py/runtime.h"
+#include "py/mphal.h"
 
 #include "font.h"
 #include "array.h"
@@ -45,6 +46,12 @@ void imlib_init_all() {
 }
 
 void imlib_deinit_all() {
+    #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+    file_queue_deinit();
+    #endif
+    #if defined(IMLIB_ENABLE_THRESHOLD_BITMAPS)
+    imlib_thresholds_deinit();
+    #endif
     #if (OMV_GPU_ENABLE == 1)
     omv_gpu_deinit();
     #endif
@@ -320,6 +327,21 @@ bool image_get_mask_pixel(image_t *ptr, int x, int y) {
     return false;
 }
 
+void imlib_budget_init(imlib_budget_t *budget, uint32_t budget_us, uint32_t resume) {
+    budget->start_us = mp_hal_ticks_us();
+    budget->budget_us = budget_us;
+    budget->resume = resume;
+    budget->expired = false;
+}
+
+bool imlib_budget_expired(imlib_budget_t *budget) {
+    if (budget && (!budget->expired) && budget->budget_us) {
+        budget->expired = ((uint32_t) (mp_hal_ticks_us() - budget->start_us)) >= budget->budget_us;
+    }
+
+    return budget && budget->expired;
+}
+
 // Gamma uncompress
 extern const float xyz_table[256];
 
@@ -567,6 +589,136 @@ uint16_t imlib_yuv_to_rgb(uint8_t y, int8_t u, int8_t v) {
     return COLOR_R8_G8_B8_TO_RGB565(r, g, b);
 }
 
+#if defined(IMLIB_ENABLE_THRESHOLD_BITMAPS)
+// Compiled RGB565 color thresholds. Each bitmap has one bit per RGB565 value which is set when
+// the pixel's LAB value is within the threshold's bounds. Bitmaps are kept on the heap keyed by
+// the bounds since scripts usually pass the same thresholds every frame. Bitmaps are pinned by
+// the calls using them so a nested call (e.g. from a find_blobs() callback) can't recycle them.
+typedef struct _threshold_bitmap_t {
+    color_thresholds_list_lnk_data_t bounds;
+    uint32_t stamp;
+    uint32_t pins;
+    uint32_t bits[65536 / UINT32_T_BITS];
+} threshold_bitmap_t;
+
+static uint32_t threshold_bitmaps_stamp = 0;
+
+static bool imlib_threshold_bitmap_match(threshold_bitmap_t *bmp, color_thresholds_list_lnk_data_t *lnk_data) {
+    return bmp
+           && (bmp->bounds.LMin == lnk_data->LMin) && (bmp->bounds.LMax == lnk_data->LMax)
+           && (bmp->bounds.AMin == lnk_data->AMin) && (bmp->bounds.AMax == lnk_data->AMax)
+           && (bmp->bounds.BMin == lnk_data->BMin) && (bmp->bounds.BMax == lnk_data->BMax);
+}
+
+static void imlib_threshold_bitmap_fill(threshold_bitmap_t *bmp, color_thresholds_list_lnk_data_t *lnk_data) {
+    bmp->bounds = *lnk_data;
+    bmp->bounds.bitmap = NULL;
+
+    for (int i = 0; i < (65536 / UINT32_T_BITS); i++) {
+        uint32_t bits = 0;
+
+        for (int j = 0; j < UINT32_T_BITS; j++) {
+            int pixel = (i << UINT32_T_SHIFT) + j;
+            int l = COLOR_RGB565_TO_L(pixel);
+            int a = COLOR_RGB565_TO_A(pixel);
+            int b = COLOR_RGB565_TO_B(pixel);
+
+            if ((lnk_data->LMin <= l) && (l <= lnk_data->LMax) &&
+                (lnk_data->AMin <= a) && (a <= lnk_data->AMax) &&
+                (lnk_data->BMin <= b) && (b <= lnk_data->BMax)) {
+                bits |= 1 << j;
+            }
+        }
+
+        bmp->bits[i] = bits;
+    }
+}
+
+void imlib_thresholds_compile(list_t *thresholds, image_t *img, size_t pixels) {
+    if ((!thresholds) || (img->pixfmt != PIXFORMAT_RGB565)) {
+        return;
+    }
+
+    uint32_t stamp = ++threshold_bitmaps_stamp;
+
+    list_for_each(it, thresholds) {
+        color_thresholds_list_lnk_data_t *lnk_data = list_get_data(it);
+        int victim = -1;
+
+        lnk_data->bitmap = NULL;
+
+        for (int i = 0; i < IMLIB_THRESHOLD_BITMAPS; i++) {
+            threshold_bitmap_t *bmp = MP_STATE_PORT(threshold_bitmaps)[i];
+
+            if (imlib_threshold_bitmap_match(bmp, lnk_data)) {
+                bmp->stamp = stamp;
+                bmp->pins += 1;
+                lnk_data->bitmap = bmp->bits;
+                break;
+            }
+
+            // Prefer empty slots, then the least recently used slot not in use by any call.
+            if (bmp && bmp->pins) {
+                continue;
+            }
+
+            threshold_bitmap_t *old = (victim < 0) ? NULL : MP_STATE_PORT(threshold_bitmaps)[victim];
+            if ((victim < 0) || (old && ((!bmp) || (bmp->stamp < old->stamp)))) {
+                victim = i;
+            }
+        }
+
+        // Compiling a bitmap costs about as much as thresholding 64K pixels the slow way
+        // so it's not worth it for small images.
+        if (lnk_data->bitmap || (victim < 0) || (pixels < IMLIB_THRESHOLD_BITMAP_MIN_PIXELS)) {
+            continue;
+        }
+
+        threshold_bitmap_t *bmp = MP_STATE_PORT(threshold_bitmaps)[victim];
+
+        if (!bmp) {
+            bmp = m_malloc_maybe(sizeof(threshold_bitmap_t));
+            if (!bmp) {
+                continue;
+            }
+            MP_STATE_PORT(threshold_bitmaps)[victim] = bmp;
+        }
+
+        imlib_threshold_bitmap_fill(bmp, lnk_data);
+        bmp->stamp = stamp;
+        bmp->pins = 1;
+        lnk_data->bitmap = bmp->bits;
+    }
+}
+
+// Unpins the bitmaps compiled for the list. Callers must also call this if they raise (e.g. from
+// a find_blobs() callback) or the bitmaps stay pinned and the slots can't be reused.
+void imlib_thresholds_release(list_t *thresholds) {
+    if (!thresholds) {
+        return;
+    }
+
+    list_for_each(it, thresholds) {
+        color_thresholds_list_lnk_data_t *lnk_data = list_get_data(it);
+
+        for (int i = 0; lnk_data->bitmap && (i < IMLIB_THRESHOLD_BITMAPS); i++) {
+            threshold_bitmap_t *bmp = MP_STATE_PORT(threshold_bitmaps)[i];
+
+            if (bmp && (bmp->bits == lnk_data->bitmap) && bmp->pins) {
+                bmp->pins -= 1;
+                lnk_data->bitmap = NULL;
+            }
+        }
+    }
+}
+
+void imlib_thresholds_deinit() {
+    for (int i = 0; i < IMLIB_THRESHOLD_BITMAPS; i++) {
+        MP_STATE_PORT(threshold_bitmaps)[i] = NULL;
+    }
+}
+#endif // IMLIB_ENABLE_THRESHOLD_BITMAPS
+
 ////////////////////////////////////////////////////////////////////////////////
 
 #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
@@ -701,7 +853,7 @@ void imlib_load_image(image_t *img, const char *path) {
     imblib_parse_extension(img, path); // Enforce extension!
 }
 
-void imlib_save_image(image_t *img, const char *path, rectangle_t *roi, int quality) {
+static void imlib_save_image_file(image_t *img, const char *path, rectangle_t *roi, int quality, png_level_t level) {
     switch (imblib_parse_extension(img, path)) {
         case FORMAT_BMP:
             bmp_write_subimg(img, path, roi);
@@ -711,7 +863,7 @@ void imlib_save_image(image_t *img, const char *path, rectangle_t *roi, int qual
             break;
         case FORMAT_RAW: {
             FIL fp;
-            file_open(&fp, path, false, FA_WRITE | FA_CREATE_ALWAYS);
+            file_open(&fp, path, false, FA_WRITE | FA_CREATE_ALWAYS | FILE_WRITE_BEHIND);
             file_write(&fp, img->pixels, img->w * img->h);
             file_close(&fp);
             break;
@@ -720,7 +872,7 @@ void imlib_save_image(image_t *img, const char *path, rectangle_t *roi, int qual
             jpeg_write(img, path, quality);
             break;
         case FORMAT_PNG:
-            png_write(img, path);
+            png_write(img, path, level);
             break;
         case FORMAT_DONT_CARE:
             // Path doesn't have an extension.
@@ -730,12 +882,12 @@ void imlib_save_image(image_t *img, const char *path, rectangle_t *roi, int qual
                 fb_free();
             } else if (img->pixfmt == PIXFORMAT_PNG) {
                 char *new_path = strcat(strcpy(fb_alloc(strlen(path) + 5, FB_ALLOC_NO_HINT), path), ".png");
-                png_write(img, new_path);
+                png_write(img, new_path, level);
                 fb_free();
             } else if (IM_IS_BAYER(img)) {
                 FIL fp;
                 char *new_path = strcat(strcpy(fb_alloc(strlen(path) + 5, FB_ALLOC_NO_HINT), path), ".raw");
-                file_open(&fp, new_path, false, FA_WRITE | FA_CREATE_ALWAYS);
+                file_open(&fp, new_path, false, FA_WRITE | FA_CREATE_ALWAYS | FILE_WRITE_BEHIND);
                 file_write(&fp, img->pixels, img->w * img->h);
                 file_close(&fp);
                 fb_free();
@@ -748,43 +900,52 @@ void imlib_save_image(image_t *img, const char *path, rectangle_t *roi, int qual
             break;
     }
 }
+
+void imlib_save_image(image_t *img, const char *path, rectangle_t *roi, int quality, png_level_t level) {
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        imlib_save_image_file(img, path, roi, quality, level);
+        nlr_pop();
+    } else {
+        // The writers raise with their file still open (e.g. out of memory
+        // while compressing) so free its write-behind slot before the FIL
+        // on the writer's stack goes away.
+        file_queue_abort();
+        nlr_jump(nlr.ret_val);
+    }
+}
 #endif //IMLIB_ENABLE_IMAGE_FILE_IO
 
 ////////////////////////////////////////////////////////////////////////////////
 
 void imlib_zero(image_t *img, image_t *mask, bool invert) {
+    mask_rle_t rle;
+    imlib_mask_rle_from_image(&rle, img->w, img->h, mask);
+    imlib_zero_rle(img, &rle, invert);
+    imlib_mask_rle_free(&rle);
+}
+
+static void imlib_zero_span(image_t *img, uint8_t *row_ptr, int x, int x_end) {
     switch (img->pixfmt) {
         case PIXFORMAT_BINARY: {
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (image_get_mask_pixel(mask, x, y) ^ invert) {
-                        IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x, 0);
-                    }
-                }
+            uint32_t *row32_ptr = (uint32_t *) row_ptr;
+            for (; (x < x_end) && (x & UINT32_T_MASK); x++) {
+                IMAGE_CLEAR_BINARY_PIXEL_FAST(row32_ptr, x);
+            }
+            for (; (x + UINT32_T_BITS) <= x_end; x += UINT32_T_BITS) {
+                row32_ptr[x >> UINT32_T_SHIFT] = 0;
+            }
+            for (; x < x_end; x++) {
+                IMAGE_CLEAR_BINARY_PIXEL_FAST(row32_ptr, x);
             }
             break;
         }
         case PIXFORMAT_GRAYSCALE: {
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (image_get_mask_pixel(mask, x, y) ^ invert) {
-                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row_ptr, x, 0);
-                    }
-                }
-            }
+            memset(row_ptr + x, 0, (x_end - x) * sizeof(uint8_t));
             break;
         }
         case PIXFORMAT_RGB565: {
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (image_get_mask_pixel(mask, x, y) ^ invert) {
-                        IMAGE_PUT_RGB565_PIXEL_FAST(row_ptr, x, 0);
-                    }
-                }
-            }
+            memset(((uint16_t *) row_ptr) + x, 0, (x_end - x) * sizeof(uint16_t));
             break;
         }
         default: {
@@ -793,6 +954,33 @@ void imlib_zero(image_t *img, image_t *mask, bool invert) {
     }
 }
 
+void imlib_zero_rle(image_t *img, mask_rle_t *rle, bool invert) {
+    size_t stride = image_line_size(img);
+
+    for (int y = 0, yy = IM_MIN(img->h, rle->h); y < yy; y++) {
+        uint8_t *row_ptr = img->data + (stride * y);
+        int x = 0;
+
+        mask_rle_for_each_span(span, rle, y, img->w) {
+            if (invert) {
+                imlib_zero_span(img, row_ptr, x, span->x);
+            } else {
+                imlib_zero_span(img, row_ptr, span->x, span->x + span->w);
+            }
+            x = span->x + span->w;
+        }
+
+        if (invert) {
+            imlib_zero_span(img, row_ptr, x, img->w);
+        }
+    }
+
+    // Rows past the end of the mask have no set pixels.
+    for (int y = rle->h, yy = img->h; invert && (y < yy); y++) {
+        imlib_zero_span(img, img->data + (stride * y), 0, img->w);
+    }
+}
+
 #ifdef IMLIB_ENABLE_LENS_CORR
 // A simple algorithm for correcting lens distortion.
 // See http://www.tannerhelland.com/4743/simple-algorithm-correcting-lens-distortion/
@@ -171,9 +171,15 @@ typedef struct color_thresholds_list_lnk_data {
     uint8_t LMin, LMax; // or grayscale
     int8_t AMin, AMax;
     int8_t BMin, BMax;
+    const uint32_t *bitmap; // compiled RGB565 threshold or NULL
 }
 color_thresholds_list_lnk_data_t;
 
+// Number of compiled RGB565 thresholds kept on the heap (8KB each).
+#define IMLIB_THRESHOLD_BITMAPS                 (4)
+// Images smaller than this are thresholded without compiling the thresholds.
+#define IMLIB_THRESHOLD_BITMAP_MIN_PIXELS       (16384)
+
 #define COLOR_THRESHOLD_BINARY(pixel, threshold, invert)                          \
     ({                                                                            \
         __typeof__ (pixel) _pixel = (pixel);                                      \
@@ -190,6 +196,26 @@ color_thresholds_list_lnk_data_t;
         ((_threshold->LMin <= _pixel) && (_pixel <= _threshold->LMax)) ^ _invert; \
     })
 
+#if defined(IMLIB_ENABLE_THRESHOLD_BITMAPS)
+#define COLOR_THRESHOLD_RGB565(pixel, threshold, invert)                                   \
+    ({                                                                                     \
+        __typeof__ (pixel) _pixel = (pixel);                                               \
+        __typeof__ (threshold) _threshold = (threshold);                                   \
+        __typeof__ (invert) _invert = (invert);                                            \
+        bool _result;                                                                      \
+        if (_threshold->bitmap) {                                                          \
+            _result = (_threshold->bitmap[_pixel >> 5] >> (_pixel & 0x1F)) & 1;            \
+        } else {                                                                           \
+            uint8_t _l = COLOR_RGB565_TO_L(_pixel);                                        \
+            int8_t _a = COLOR_RGB565_TO_A(_pixel);                                         \
+            int8_t _b = COLOR_RGB565_TO_B(_pixel);                                         \
+            _result = (_threshold->LMin <= _l) && (_l <= _threshold->LMax) &&              \
+                      (_threshold->AMin <= _a) && (_a <= _threshold->AMax) &&              \
+                      (_threshold->BMin <= _b) && (_b <= _threshold->BMax);                \
+        }                                                                                  \
+        _result ^ _invert;                                                                 \
+    })
+#else
 #define COLOR_THRESHOLD_RGB565(pixel, threshold, invert)                  \
     ({                                                                    \
         __typeof__ (pixel) _pixel = (pixel);                              \
@@ -202,6 +228,7 @@ color_thresholds_list_lnk_data_t;
          (_threshold->AMin <= _a) && (_a <= _threshold->AMax) &&          \
          (_threshold->BMin <= _b) && (_b <= _threshold->BMax)) ^ _invert; \
     })
+#endif
 
 #define COLOR_BOUND_BINARY(pixel0, pixel1, threshold)    \
     ({                                                   \
@@ -790,6 +817,19 @@ typedef enum jpeg_subsampling {
     JPEG_SUBSAMPLING_420  = 0x22, // Chroma subsampling 4:2:0
 } jpeg_subsampling_t;
 
+typedef enum png_level {
+    PNG_LEVEL_STORE   = 0, // Stored deflate blocks, no compression.
+    PNG_LEVEL_HUFFMAN = 1, // Huffman coded literals only.
+    PNG_LEVEL_RLE     = 2, // Huffman coded literals and byte runs.
+    PNG_LEVEL_FULL    = 3, // Full LZ77 deflate (lodepng).
+} png_level_t;
+
+#define PNG_LEVEL_DEFAULT          (PNG_LEVEL_RLE)
+
+// Called by jpeg_decompress_bands() with each row of decoded MCUs. The band
+// starts at row y of the (scaled) image. Return false to stop decoding.
+typedef bool (*jpeg_band_callback_t) (image_t *band, int y, void *arg);
+
 // Old Image Macros - Will be refactor and removed. But, only after making sure through testing new macros work.
 
 // Image kernels
@@ -898,6 +938,15 @@ typedef struct cluster {
 // Return the distance between a cluster centroid and some object.
 typedef float (*cluster_dist_t) (int cx, int cy, void *obj);
 
+// Color clusters found by imlib_color_kmeans(). Centroids are RGB888 and count is the number of
+// sampled pixels nearest to each one.
+#define COLOR_KMEANS_MAX_K  (16)
+
+typedef struct color_cluster {
+    uint8_t r, g, b;
+    uint32_t count;
+} color_cluster_t;
+
 /* Keypoint */
 typedef struct kp {
     uint16_t x;
@@ -982,10 +1031,86 @@ typedef struct img_read_settings {
     save_image_format_t format;
 } img_read_settings_t;
 
+// GIF recording state. lut maps RGB444 to palette indices for color
+// recordings and prev holds the palette indices of the last frame written
+// for delta frames (NULL if disabled).
+typedef struct gif_state {
+    int width;
+    int height;
+    bool color;
+    bool loop;
+    bool header;
+    bool prev_valid;
+    uint8_t *lut;
+    uint8_t *prev;
+    uint8_t palette[256][3];
+} gif_state_t;
+
 typedef void (*binary_morph_op_t) (image_t *, int, int, image_t *);
+
+typedef enum b_op {
+    B_OP_AND,
+    B_OP_NAND,
+    B_OP_OR,
+    B_OP_NOR,
+    B_OP_XOR,
+    B_OP_XNOR,
+} b_op_t;
 typedef void (*line_op_t) (image_t *, int, void *, void *, bool);
 typedef void (*flood_fill_call_back_t) (image_t *, int, int, int, void *);
 
+typedef struct flood_fill {
+    image_t *out;
+    image_t *img;
+    int seed_threshold;
+    int floating_threshold;
+    uint8_t *img_data;
+    size_t img_stride;
+    uint32_t *out_data;
+    size_t out_stride;
+    uint32_t *pending;
+    int pending_y_min;
+    int pending_y_max;
+    lifo_t lifo;
+} flood_fill_t;
+
+// Span stack entries of a flood fill, spans that don't fit are rescanned later.
+#define FLOOD_FILL_STACK_SPANS(w, h)    (2 * ((w) + (h)))
+
+// Run-length encoded mask. The set pixels of row y are the [x, x + w) spans
+// from spans[rows[y]] up to spans[rows[y + 1]].
+typedef struct mask_span {
+    uint16_t x;
+    uint16_t w;
+} mask_span_t;
+
+typedef struct mask_rle {
+    int w;
+    int h;
+    uint32_t *rows;
+    mask_span_t *spans;
+} mask_rle_t;
+
+// Time budget for long running detectors. Detectors poll imlib_budget_expired()
+// between units of work (scan lines, seeds, etc.) and stop once it fires, but
+// only after processing at least one new unit. resume is the unit to start from
+// on input. expired is set on output if the detector stopped early, and resume
+// is then the unit to continue at. The budget starts before the detector is
+// called, so any preprocessing redone on every call counts toward it.
+typedef struct imlib_budget {
+    uint32_t start_us;
+    uint32_t budget_us;
+    uint32_t resume;
+    bool expired;
+} imlib_budget_t;
+
+// Iterates over the spans of row y, or over the whole row if rle is NULL.
+#define mask_rle_for_each_span(span, rle, y, row_w)                                          \
+    for (mask_span_t span##_row = {0, (row_w)},                                              \
+         *span = (rle) ? ((rle)->spans + (rle)->rows[(y)]) : &span##_row,                    \
+         *span##_end = (rle) ? ((rle)->spans + (rle)->rows[(y) + 1]) : (&span##_row + 1);    \
+         span < span##_end; span++)
+
 typedef enum descriptor_type {
     DESC_LBP,
     DESC_ORB,
@@ -1033,6 +1158,47 @@ typedef struct statistics {
     int8_t BMean, BMedian, BMode, BSTDev, BMin, BMax, BLQ, BUQ;
 } statistics_t;
 
+// LBPu2 8,2 descriptors are 7x7 regions of 59 bin histograms.
+#define LBP_HIST_SIZE      (59) //58 uniform hist + 1
+#define LBP_NUM_REGIONS    (7)  //7x7 regions
+#define LBP_DESC_SIZE      (LBP_NUM_REGIONS * LBP_NUM_REGIONS * LBP_HIST_SIZE)
+
+typedef struct lbp_match {
+    uint32_t index;
+    uint32_t distance;
+} lbp_match_t;
+
+// Summed-area tables of the 8x8 block sums of every channel so that the statistics of many
+// regions can be looked up without rescanning their pixels. Only the pixels around the blocks
+// completely inside of a region are read again. Takes 14 bytes per block per channel.
+#define ROI_STATS_BLOCK_SHIFT   (3)
+#define ROI_STATS_MAX_CHANNELS  (3)
+
+typedef struct roi_stats_index {
+    image_t *img;
+    int channels;
+    int blocks_w, blocks_h;
+    uint32_t *sum[ROI_STATS_MAX_CHANNELS];
+    uint64_t *sum_sq[ROI_STATS_MAX_CHANNELS];
+    uint8_t *block_min[ROI_STATS_MAX_CHANNELS];
+    uint8_t *block_max[ROI_STATS_MAX_CHANNELS];
+} roi_stats_index_t;
+
+// Histograms of oriented gradients. The unsigned gradient orientation of every pixel votes its
+// magnitude into one of HOG_BINS bins of the cell it falls in. Blocks are 2x2 cells overlapping
+// by one cell. norms holds two L2-Hys scales per block so descriptors of any window of cells can
+// be looked up without renormalizing the shared blocks.
+#define HOG_BINS            (9)
+#define HOG_BLOCK_SIZE      (HOG_BINS * 4)
+#define HOG_DESCRIPTOR_SIZE(x_cells, y_cells) (((x_cells) - 1) * ((y_cells) - 1) * HOG_BLOCK_SIZE)
+
+typedef struct hog_grid {
+    int cell_size;
+    int x_cells, y_cells;
+    uint32_t *cells;
+    float *norms;
+} hog_grid_t;
+
 #define FIND_BLOBS_CORNERS_RESOLUTION    20 // multiple of 4
 #define FIND_BLOBS_ANGLE_RESOLUTION      (360 / FIND_BLOBS_CORNERS_RESOLUTION)
 
@@ -1209,6 +1375,7 @@ void imlib_hardware_jpeg_deinit();
 void jpeg_get_mcu(image_t *src, int x_offset, int y_offset, int dx, int dy,
                   int8_t *Y0, int8_t *CB, int8_t *CR);
 void jpeg_decompress(image_t *dst, image_t *src);
+bool jpeg_decompress_bands(image_t *src, pixformat_t pixfmt, int scale, jpeg_band_callback_t callback, void *arg);
 bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc, jpeg_subsampling_t subsampling);
 bool jpeg_is_valid(image_t *img);
 int jpeg_clean_trailing_bytes(int bpp, uint8_t *data);
@@ -1217,20 +1384,20 @@ void jpeg_read_pixels(FIL *fp, image_t *img);
 void jpeg_read(image_t *img, const char *path);
 void jpeg_write(image_t *img, const char *path, int quality);
 void png_decompress(image_t *dst, image_t *src);
-bool png_compress(image_t *src, image_t *dst);
+bool png_compress(image_t *src, image_t *dst, png_level_t level);
 void png_read_geometry(FIL *fp, image_t *img, const char *path, png_read_settings_t *rs);
 void png_read_pixels(FIL *fp, image_t *img);
 void png_read(image_t *img, const char *path);
-void png_write(image_t *img, const char *path);
+void png_write(image_t *img, const char *path, png_level_t level);
 bool imlib_read_geometry(FIL *fp, image_t *img, const char *path, img_read_settings_t *rs);
 void imlib_image_operation(image_t *img, const char *path, image_t *other, int scalar, line_op_t op, void *data);
 void imlib_load_image(image_t *img, const char *path);
-void imlib_save_image(image_t *img, const char *path, rectangle_t *roi, int quality);
+void imlib_save_image(image_t *img, const char *path, rectangle_t *roi, int quality, png_level_t level);
 
 /* GIF functions */
-void gif_open(FIL *fp, int width, int height, bool color, bool loop);
-void gif_add_frame(FIL *fp, image_t *img, uint16_t delay);
-void gif_close(FIL *fp);
+void gif_open(FIL *fp, gif_state_t *gif, int width, int height, bool color, bool loop, bool delta);
+void gif_add_frame(FIL *fp, gif_state_t *gif, image_t *img, uint16_t delay);
+void gif_close(FIL *fp, gif_state_t *gif);
 
 /* MJPEG functions */
 void mjpeg_open(FIL *fp, int width, int height);
@@ -1268,6 +1435,8 @@ float imlib_template_match_ex(image_t *image, image_t *t, rectangle_t *roi, int
 
 /* Clustering functions */
 array_t *cluster_kmeans(array_t *points, int k, cluster_dist_t dist_func);
+int imlib_color_kmeans(image_t *img, rectangle_t *roi, int stride, int k, int max_iter,
+                       color_cluster_t *clusters, int n_init);
 
 /* Integral image functions */
 void imlib_integral_image_alloc(struct integral_image *sum, int w, int h);
@@ -1309,7 +1478,9 @@ float orb_cluster_dist(int cx, int cy, void *kp);
 /* LBP Operator */
 uint8_t *imlib_lbp_desc(image_t *image, rectangle_t *roi);
 int imlib_lbp_desc_distance(uint8_t *d0, uint8_t *d1);
+int imlib_lbp_desc_knn(uint8_t *desc, uint8_t *gallery, size_t count, int k, lbp_match_t *matches);
 int imlib_lbp_desc_save(FIL *fp, uint8_t *desc);
+int imlib_lbp_desc_read(FIL *fp, uint8_t *desc);
 int imlib_lbp_desc_load(FIL *fp, uint8_t **desc);
 
 /* Iris detector */
@@ -1325,9 +1496,24 @@ void imlib_edge_canny(image_t *src, rectangle_t *roi, int low_thresh, int high_t
 
 // HoG
 void imlib_find_hog(image_t *src, rectangle_t *roi, int cell_size);
+void imlib_hog_grid_init(hog_grid_t *grid, image_t *src, rectangle_t *roi, int cell_size);
+void imlib_hog_grid_free(hog_grid_t *grid);
+void imlib_hog_descriptor(hog_grid_t *grid, int cell_x, int cell_y, int x_cells, int y_cells, float *out);
+
+// Image masks
+void imlib_mask_rle_from_image(mask_rle_t *rle, int w, int h, image_t *mask);
+void imlib_mask_rle_from_rectangle(mask_rle_t *rle, int w, int h, int rx, int ry, int rw, int rh);
+void imlib_mask_rle_from_circle(mask_rle_t *rle, int w, int h, int cx, int cy, int r);
+void imlib_mask_rle_from_ellipse(mask_rle_t *rle, int w, int h, int cx, int cy, int rx, int ry, int rotation);
+void imlib_mask_rle_free(mask_rle_t *rle);
+
+// Detector time budgets
+void imlib_budget_init(imlib_budget_t *budget, uint32_t budget_us, uint32_t resume);
+bool imlib_budget_expired(imlib_budget_t *budget);
 
 // Helper Functions
 void imlib_zero(image_t *img, image_t *mask, bool invert);
+void imlib_zero_rle(image_t *img, mask_rle_t *rle, bool invert);
 void imlib_draw_row_setup(imlib_draw_row_data_t *data);
 void imlib_draw_row_teardown(imlib_draw_row_data_t *data);
 void imlib_draw_row(int x_start, int x_end, int y_row, imlib_draw_row_data_t *data);
@@ -1343,9 +1529,10 @@ void imlib_draw_image_get_bounds(image_t *dst_img,
                                  image_hint_t hint,
                                  point_t *p0,
                                  point_t *p1);
-void imlib_flood_fill_int(image_t *out, image_t *img, int x, int y,
-                          int seed_threshold, int floating_threshold,
-                          flood_fill_call_back_t cb, void *data);
+void imlib_flood_fill_init(flood_fill_t *ff, image_t *out, image_t *img,
+                           int seed_threshold, int floating_threshold);
+void imlib_flood_fill_deinit(flood_fill_t *ff);
+void imlib_flood_fill_seed(flood_fill_t *ff, int x, int y, flood_fill_call_back_t cb, void *data);
 // Drawing Functions
 int imlib_get_pixel(image_t *img, int x, int y);
 int imlib_get_pixel_fast(image_t *img, const void *row_ptr, int x);
@@ -1384,7 +1571,9 @@ void imlib_draw_image(image_t *dst_img,
                       imlib_draw_row_callback_t callback,
                       void *callback_arg,
                       void *dst_row_override);
-void imlib_flood_fill(image_t *img, int x, int y,
+void imlib_draw_image_rows(image_t *dst_img, image_t *src_img,
+                           imlib_draw_row_callback_t callback, void *callback_arg);
+void imlib_flood_fill(image_t *img, point_t *seeds, size_t seeds_len,
                       float seed_threshold, float floating_threshold,
                       int c, bool invert, bool clear_background, image_t *mask);
 // ISP Functions
@@ -1396,6 +1585,10 @@ void imlib_gamma(image_t *img, float gamma, float scale, float offset);
 // Binary Functions
 void imlib_zero_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data);
 void imlib_mask_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data);
+void imlib_mask_rle_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data);
+void imlib_thresholds_compile(list_t *thresholds, image_t *img, size_t pixels);
+void imlib_thresholds_release(list_t *thresholds);
+void imlib_thresholds_deinit();
 void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, bool zero, image_t *mask);
 void imlib_invert(image_t *img);
 void imlib_b_and_line_op(int x, int x_end, int y_row, imlib_draw_row_data_t *data);
@@ -1472,6 +1665,9 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
 void imlib_get_percentile(percentile_t *out, pixformat_t pixfmt, histogram_t *ptr, float percentile);
 void imlib_get_threshold(threshold_t *out, pixformat_t pixfmt, histogram_t *ptr);
 void imlib_get_statistics(statistics_t *out, pixformat_t pixfmt, histogram_t *ptr);
+void imlib_roi_stats_index_init(roi_stats_index_t *index, image_t *img);
+void imlib_roi_stats_index_free(roi_stats_index_t *index);
+void imlib_roi_stats(roi_stats_index_t *index, rectangle_t *roi, statistics_t *out);
 bool imlib_get_regression(find_lines_list_lnk_data_t *out,
                           image_t *ptr,
                           rectangle_t *roi,
@@ -1498,7 +1694,8 @@ void imlib_lsd_find_line_segments(list_t *out,
                                   image_t *ptr,
                                   rectangle_t *roi,
                                   unsigned int merge_distance,
-                                  unsigned int max_theta_diff);
+                                  unsigned int max_theta_diff,
+                                  imlib_budget_t *budget);
 void imlib_find_line_segments(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
                               uint32_t threshold, unsigned int theta_margin, unsigned int rho_margin,
                               uint32_t segment_threshold);
@@ -1508,11 +1705,11 @@ void imlib_find_circles(list_t *out, image_t *ptr, rectangle_t *roi, unsigned in
 void imlib_find_rects(list_t *out, image_t *ptr, rectangle_t *roi,
                       uint32_t threshold);
 // 1/2D Bar Codes
-void imlib_find_qrcodes(list_t *out, image_t *ptr, rectangle_t *roi);
+void imlib_find_qrcodes(list_t *out, image_t *ptr, rectangle_t *roi, imlib_budget_t *budget);
 void imlib_find_apriltags(list_t *out, image_t *ptr, rectangle_t *roi, apriltag_families_t families,
                           float fx, float fy, float cx, float cy);
-void imlib_find_datamatrices(list_t *out, image_t *ptr, rectangle_t *roi, int effort);
-void imlib_find_barcodes(list_t *out, image_t *ptr, rectangle_t *roi);
+void imlib_find_datamatrices(list_t *out, image_t *ptr, rectangle_t *roi, int effort, imlib_budget_t *budget);
+void imlib_find_barcodes(list_t *out, image_t *ptr, rectangle_t *roi, imlib_budget_t *budget);
 // Template Matching
 void imlib_phasecorrelate(image_t *img0,
                           image_t *img1,
@@ -1526,7 +1723,9 @@ void imlib_phasecorrelate(image_t *img0,
                           float *scale,
                           float *response);
 // Stereo Imaging
-void imlib_stereo_disparity(image_t *img, bool reversed, int max_disparity, int threshold);
+void imlib_stereo_disparity(image_t *img, bool reversed, int max_disparity, int threshold,
+                            int block_w, int block_h, bool census, int paths, int p1, int p2, bool subpixel);
 
-array_t *imlib_selective_search(image_t *src, float t, int min_size, float a1, float a2, float a3);
+array_t *imlib_selective_search(image_t *src, float t, int min_size, float a1, float a2, float a3,
+                                int scale, int max_regions);
 #endif //__IMLIB_H__
@@ -58,6 +58,7 @@ IMLIB_SRC_C += \
     line.c \
     lodepng.c \
     lsd.c \
+    mask.c \
     mathop.c \
     mjpeg.c \
     orb.c \
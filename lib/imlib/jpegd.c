@@ -172,6 +172,7 @@ typedef struct jpeg_image_tag {
     int iVLCSize;                // current quantity of data in the VLC buffer
     int iResInterval, iResCount; // restart interval
     int iMaxMCUs;                // max MCUs of pixels per JPEGDraw call
+    int iPitch;                  // output image pitch in pixels
     JPEG_READ_CALLBACK *pfnRead;
     JPEG_SEEK_CALLBACK *pfnSeek;
     JPEG_DRAW_CALLBACK *pfnDraw;
@@ -1539,6 +1540,31 @@ static void JPEGPutMCUGray(JPEGIMAGE *pJPEG, int x, int y) {
     int i, j, xcount, ycount;
     uint8_t *pSrc = (uint8_t *) &pJPEG->sMCUs[0];
 
+    if (pJPEG->iOptions & (JPEG_SCALE_HALF | JPEG_SCALE_QUARTER | JPEG_SCALE_EIGHTH)) {
+        // Scaled MCUs are written whole, the output is padded to a whole number of MCUs.
+        int n = (pJPEG->iOptions & JPEG_SCALE_HALF) ? 4 : ((pJPEG->iOptions & JPEG_SCALE_QUARTER) ? 2 : 1);
+        for (i = 0; i < n; i++) {
+            for (j = 0; j < n; j++) {
+                int pix;
+                if (n == 4) {
+                    uint8_t *s = pSrc + (i * 16) + (j * 2);
+                    pix = (s[0] + s[1] + s[8] + s[9] + 2) >> 2; // average 2x2 block
+                } else {
+                    pix = pSrc[(i * n) + j]; // 2x2 or 1x1 IDCT output
+                }
+                if (pJPEG->ucPixelType == ONE_BIT_GRAYSCALE) {
+                    const int iPitch = ((pJPEG->iPitch + 31) >> 3) & 0xfffc;
+                    if (pix > 127) {
+                        pJPEG->pImage[((y + i) * iPitch) + ((x + j) >> 3)] |= 1 << ((x + j) & 7);
+                    }
+                } else {
+                    ((uint16_t *) pJPEG->pImage)[((y + i) * pJPEG->iPitch) + x + j] = usGrayTo565[pix];
+                }
+            }
+        }
+        return;
+    }
+
     // For odd-sized JPEGs, don't draw past the edge of the image bounds
     xcount = ycount = 8;
     if (x + 8 > pJPEG->iWidth) {
@@ -1548,7 +1574,7 @@ static void JPEGPutMCUGray(JPEGIMAGE *pJPEG, int x, int y) {
         ycount = pJPEG->iHeight & 7;
     }
     if (pJPEG->ucPixelType == ONE_BIT_GRAYSCALE) {
-        const int iPitch = ((pJPEG->iWidth + 31) >> 3) & 0xfffc;
+        const int iPitch = ((pJPEG->iPitch + 31) >> 3) & 0xfffc;
         uint8_t *pDest = (uint8_t *) &pJPEG->pImage[(y * iPitch) + (x >> 3)];
 
         for (i = 0; i < ycount; i++) {
@@ -1565,7 +1591,7 @@ static void JPEGPutMCUGray(JPEGIMAGE *pJPEG, int x, int y) {
         }
     } else {
         // must be RGB565 output
-        const int iPitch = pJPEG->iWidth;
+        const int iPitch = pJPEG->iPitch;
         uint16_t *usDest = (uint16_t *) &pJPEG->pImage[(y * iPitch * 2) + x * 2];
 
         for (i = 0; i < ycount; i++) {
@@ -1582,7 +1608,7 @@ static void JPEGPutMCUGray(JPEGIMAGE *pJPEG, int x, int y) {
 
 static void JPEGPutMCU8BitGray(JPEGIMAGE *pJPEG, int x, int y) {
     int i, j, xcount, ycount;
-    const int iPitch = pJPEG->iWidth;
+    const int iPitch = pJPEG->iPitch;
     uint8_t *pDest, *pSrc = (uint8_t *) &pJPEG->sMCUs[0];
     pDest = (uint8_t *) &pJPEG->pImage[(y * iPitch) + x];
     if (pJPEG->ucSubSample <= 0x11) {
@@ -1606,19 +1632,21 @@ static void JPEGPutMCU8BitGray(JPEGIMAGE *pJPEG, int x, int y) {
             xcount = ycount = 2;
         } else if (pJPEG->iOptions & JPEG_SCALE_EIGHTH) {
             xcount = ycount = 1;
-        }
-        if ((x + 8) > pJPEG->iWidth) {
-            xcount = pJPEG->iWidth & 7;
-        }
-        if ((y + 8) > pJPEG->iHeight) {
-            ycount = pJPEG->iHeight & 7;
+        } else {
+            // Only full size MCUs are clipped.
+            if ((x + 8) > pJPEG->iWidth) {
+                xcount = pJPEG->iWidth & 7;
+            }
+            if ((y + 8) > pJPEG->iHeight) {
+                ycount = pJPEG->iHeight & 7;
+            }
         }
         for (i = 0; i < ycount; i++) {
             // do up to 8 rows
             for (j = 0; j < xcount; j++) {
                 *pDest++ = *pSrc++;
             }
-            pSrc += (8 - xcount);
+            pSrc += (pJPEG->iOptions & JPEG_SCALE_QUARTER) ? 0 : (8 - xcount); // 1/4 IDCT output is packed 2x2
             pDest -= xcount;
             pDest += iPitch; // next line
         }
@@ -1784,7 +1812,7 @@ static void JPEGPutMCU8BitGray(JPEGIMAGE *pJPEG, int x, int y) {
 
 static void JPEGPutMCU1BitGray(JPEGIMAGE *pJPEG, int x, int y) {
     int i, j, xcount, ycount;
-    const int iPitch = ((pJPEG->iWidth + 31) >> 3) & 0xfffc;
+    const int iPitch = ((pJPEG->iPitch + 31) >> 3) & 0xfffc;
     uint8_t *pDest, *pSrc = (uint8_t *) &pJPEG->sMCUs[0];
     pDest = (uint8_t *) &pJPEG->pImage[(y * iPitch) + (x >> 3)];
     if (pJPEG->ucSubSample <= 0x11) {
@@ -2045,7 +2073,7 @@ static void JPEGPutMCU11(JPEGIMAGE *pJPEG, int x, int y) {
     int iCr, iCb;
     signed int Y;
     int iCol, iRow, cx, cy;
-    const int iPitch = pJPEG->iWidth;
+    const int iPitch = pJPEG->iPitch;
     uint8_t *pY, *pCr, *pCb;
     uint16_t *pOutput = (uint16_t *) &pJPEG->pImage[(y * iPitch * 2) + x * 2];
 
@@ -2128,7 +2156,7 @@ static void JPEGPutMCU22(JPEGIMAGE *pJPEG, int x, int y) {
     signed int Y1, Y2, Y3, Y4;
     int iRow, iRowLimit, iCol, iXCount1, iXCount2;
     unsigned char *pY, *pCr, *pCb;
-    const int iPitch = pJPEG->iWidth;
+    const int iPitch = pJPEG->iPitch;
     int bUseOdd1, bUseOdd2; // special case where 24bpp odd sized image can clobber first column
     uint16_t *pOutput = (uint16_t *) &pJPEG->pImage[(y * iPitch * 2) + x * 2];
 
@@ -2370,7 +2398,7 @@ static void JPEGPutMCU12(JPEGIMAGE *pJPEG, int x, int y) {
     signed int Y1, Y2;
     int iRow, iCol, iXCount, iYCount;
     uint8_t *pY, *pCr, *pCb;
-    const int iPitch = pJPEG->iWidth;
+    const int iPitch = pJPEG->iPitch;
     uint16_t *pOutput = (uint16_t *) &pJPEG->pImage[(y * iPitch * 2) + x * 2];
 
     pY = (uint8_t *) &pJPEG->sMCUs[0 * DCTSIZE];
@@ -2477,7 +2505,7 @@ static void JPEGPutMCU21(JPEGIMAGE *pJPEG, int x, int y) {
     int iCol;
     int iRow, iXCount, iYCount;
     uint8_t *pY, *pCr, *pCb;
-    const int iPitch = pJPEG->iWidth;
+    const int iPitch = pJPEG->iPitch;
     uint16_t *pOutput = (uint16_t *) &pJPEG->pImage[(y * iPitch * 2) + x * 2];
 
     pY = (uint8_t *) &pJPEG->sMCUs[0 * DCTSIZE];
@@ -2703,6 +2731,9 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG) {
         iMCUCount = cx; // do the whole row
     }
     for (y = 0; y < cy && bContinue; y++) {
+        // In band mode each MCU row is decoded to the top of the band buffer
+        // and handed to the draw callback once it's complete.
+        int iMCUY = (pJPEG->pfnDraw) ? 0 : (y * mcuCY);
         for (x = 0; x < cx && bContinue && iErr == 0; x++) {
             pJPEG->ucACTable = cACTable0;
             pJPEG->ucDCTable = cDCTable0;
@@ -2812,25 +2843,25 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG) {
                 }
             } // if color components present
             if (pJPEG->ucPixelType == EIGHT_BIT_GRAYSCALE) {
-                JPEGPutMCU8BitGray(pJPEG, x * mcuCX, y * mcuCY);
+                JPEGPutMCU8BitGray(pJPEG, x * mcuCX, iMCUY);
             } else if (pJPEG->ucPixelType == ONE_BIT_GRAYSCALE) {
-                JPEGPutMCU1BitGray(pJPEG, x * mcuCX, y * mcuCY);
+                JPEGPutMCU1BitGray(pJPEG, x * mcuCX, iMCUY);
             } else {
                 switch (pJPEG->ucSubSample) {
                     case 0x00: // grayscale
-                        JPEGPutMCUGray(pJPEG, x * mcuCX, y * mcuCY);
+                        JPEGPutMCUGray(pJPEG, x * mcuCX, iMCUY);
                         break; // not used
                     case 0x11:
-                        JPEGPutMCU11(pJPEG, x * mcuCX, y * mcuCY);
+                        JPEGPutMCU11(pJPEG, x * mcuCX, iMCUY);
                         break;
                     case 0x12:
-                        JPEGPutMCU12(pJPEG, x * mcuCX, y * mcuCY);
+                        JPEGPutMCU12(pJPEG, x * mcuCX, iMCUY);
                         break;
                     case 0x21:
-                        JPEGPutMCU21(pJPEG, x * mcuCX, y * mcuCY);
+                        JPEGPutMCU21(pJPEG, x * mcuCX, iMCUY);
                         break;
                     case 0x22:
-                        JPEGPutMCU22(pJPEG, x * mcuCX, y * mcuCY);
+                        JPEGPutMCU22(pJPEG, x * mcuCX, iMCUY);
                         break;
                 } // switch on color option
             }
@@ -2850,6 +2881,18 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG) {
                 JPEGGetMoreData(pJPEG); // need more 'filtered' VLC data
             }
         } // for x
+        if (pJPEG->pfnDraw && iErr == 0) {
+            int iHeight = (pJPEG->iHeight + (1 << iScaleShift) - 1) >> iScaleShift;
+            JPEGDRAW jd;
+            jd.x = 0;
+            jd.y = y * mcuCY;
+            jd.iWidth = pJPEG->iPitch;
+            jd.iHeight = IM_MIN(mcuCY, iHeight - jd.y);
+            jd.iBpp = (pJPEG->ucPixelType == RGB565_LITTLE_ENDIAN) ? 16 : 8;
+            jd.pPixels = (uint16_t *) pJPEG->pImage;
+            jd.pUser = pJPEG->pUser;
+            bContinue = (*pJPEG->pfnDraw)(&jd);
+        }
     } // for y
     if (iErr != 0) {
         pJPEG->iError = JPEG_DECODE_ERROR;
@@ -2890,6 +2933,7 @@ void jpeg_decompress(image_t *dst, image_t *src) {
 
     // Set up dest image params
     jpg.pUser = (void *) dst;
+    jpg.iPitch = dst->w;
 
     // Fill buffer with 0's so we only need to write "set" bits
     memset(dst->data, 0, image_size(dst));
@@ -2901,4 +2945,107 @@ void jpeg_decompress(image_t *dst, image_t *src) {
 
     OMV_PROFILE_PRINT();
 }
+
+typedef struct jpeg_band {
+    image_t img;
+    uint8_t *gray;
+    jpeg_band_callback_t callback;
+    void *arg;
+} jpeg_band_t;
+
+static int jpeg_draw_band(JPEGDRAW *pDraw) {
+    jpeg_band_t *band = (jpeg_band_t *) pDraw->pUser;
+    band->img.h = pDraw->iHeight;
+
+    // Binary bands are decoded to grayscale and thresholded here, the 1-bit
+    // output paths do not support scaling.
+    if (band->img.pixfmt == PIXFORMAT_BINARY) {
+        for (int y = 0; y < band->img.h; y++) {
+            uint8_t *src_row_ptr = band->gray + (y * band->img.w);
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&band->img, y);
+            for (int x = 0; x < band->img.w; x++) {
+                IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x, COLOR_GRAYSCALE_TO_BINARY(src_row_ptr[x]));
+            }
+        }
+    }
+
+    return band->callback(&band->img, pDraw->y, band->arg);
+}
+
+bool jpeg_decompress_bands(image_t *src, pixformat_t pixfmt, int scale, jpeg_band_callback_t callback, void *arg) {
+    OMV_PROFILE_START();
+    int iOptions, iShift, iMCUW, iMCUH;
+
+    switch (scale) {
+        case 1: iOptions = 0; iShift = 0; break;
+        case 2: iOptions = JPEG_SCALE_HALF; iShift = 1; break;
+        case 4: iOptions = JPEG_SCALE_QUARTER; iShift = 2; break;
+        case 8: iOptions = JPEG_SCALE_EIGHTH; iShift = 3; break;
+        default: return false;
+    }
+
+    if ((pixfmt != PIXFORMAT_BINARY) && (pixfmt != PIXFORMAT_GRAYSCALE) && (pixfmt != PIXFORMAT_RGB565)) {
+        return false;
+    }
+
+    // Supports decoding baseline JPEGs only.
+    if (!jpeg_is_valid(src)) {
+        return false;
+    }
+
+    JPEGIMAGE *jpg = fb_alloc(sizeof(JPEGIMAGE), FB_ALLOC_NO_HINT);
+
+    if (JPEG_openRAM(jpg, src->data, src->size, NULL) == 0) {
+        // failed to parse the header
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("JPEG decoder failed."));
+    }
+
+    switch (jpg->ucSubSample) {
+        case 0x12: iMCUW = 8; iMCUH = 16; break;
+        case 0x21: iMCUW = 16; iMCUH = 8; break;
+        case 0x22: iMCUW = 16; iMCUH = 16; break;
+        default: iMCUW = 8; iMCUH = 8; break;
+    }
+
+    // The band holds one row of MCUs. The scaled MCU paths do not clip at the
+    // right edge so the band is padded out to a whole number of MCUs.
+    jpeg_band_t band = {
+        .img.w = ((jpg->iWidth + iMCUW - 1) / iMCUW) * (iMCUW >> iShift),
+        .img.h = iMCUH >> iShift,
+        .img.pixfmt = pixfmt,
+        .gray = NULL,
+        .callback = callback,
+        .arg = arg,
+    };
+
+    band.img.data = fb_alloc0(image_size(&band.img), FB_ALLOC_NO_HINT);
+
+    if (pixfmt == PIXFORMAT_BINARY) {
+        band.gray = fb_alloc0(band.img.w * band.img.h, FB_ALLOC_NO_HINT);
+    }
+
+    jpg->ucPixelType = (pixfmt == PIXFORMAT_RGB565) ? RGB565_LITTLE_ENDIAN : EIGHT_BIT_GRAYSCALE;
+    jpg->pImage = band.gray ? band.gray : band.img.data;
+    jpg->iPitch = band.img.w;
+    jpg->pUser = &band;
+    jpg->pfnDraw = jpeg_draw_band;
+
+    if (JPEG_decode(jpg, 0, 0, iOptions) == 0) {
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("JPEG decoder failed."));
+    }
+
+    if (band.gray) {
+        fb_free(); // band.gray
+    }
+
+    fb_free(); // band.img.data
+    fb_free(); // jpg
+    OMV_PROFILE_PRINT();
+    return true;
+}
+#else
+bool jpeg_decompress_bands(image_t *src, pixformat_t pixfmt, int scale, jpeg_band_callback_t callback, void *arg) {
+    // Banded decoding needs the software decoder.
+    return false;
+}
 #endif
@@ -344,9 +344,27 @@ typedef struct {
     bool overflow;
 } jpeg_buf_t;
 
+// Quantization is fused with the descaling of the AAN DCT output into a single
+// fixed-point multiply by qtbl >> JPEG_QUANT_SHIFT.
+#define JPEG_QUANT_SHIFT           (18)
+
+// Number of prepared quantization table sets kept around. The adaptive quality
+// loop in the framebuffer code bounces between a few quality levels and would
+// otherwise rebuild the tables on almost every frame.
+#define JPEG_TABLES_CACHE_SIZE     (4)
+
 // Quantization tables
-static float fdtbl_Y[64], fdtbl_UV[64];
-static uint8_t YTable[64], UVTable[64];
+typedef struct {
+    int quality;
+    uint8_t YTable[64], UVTable[64];
+    int32_t qtbl_Y[64], qtbl_UV[64];
+} jpeg_tables_t;
+
+static jpeg_tables_t jpeg_tables_cache[JPEG_TABLES_CACHE_SIZE];
+// Indices into jpeg_tables_cache, most recently used first. Only the first
+// jpeg_tables_used entries refer to filled slots.
+static uint8_t jpeg_tables_lru[JPEG_TABLES_CACHE_SIZE];
+static uint8_t jpeg_tables_used;
 
 static const uint8_t s_jpeg_ZigZag[] = {
     0,  1,   5,  6, 14, 15, 27, 28,
@@ -652,7 +670,7 @@ static inline void jpeg_calc_bits(int val, uint16_t bits[2]) {
     bits[0] = val & ((1 << bits[1]) - 1);
 }
 
-static int jpeg_processDU(jpeg_buf_t *jpeg_buf, int8_t *CDU, float *fdtbl, int DC, const uint16_t (*HTDC)[2],
+static int jpeg_processDU(jpeg_buf_t *jpeg_buf, int8_t *CDU, const int32_t *qtbl, int DC, const uint16_t (*HTDC)[2],
                           const uint16_t (*HTAC)[2]) {
     int DU[64];
     int DUQ[64];
@@ -749,9 +767,10 @@ static int jpeg_processDU(jpeg_buf_t *jpeg_buf, int8_t *CDU, float *fdtbl, int D
 
     // first non-zero element in reverse order
     int end0pos = 0;
-    // Quantize/descale/zigzag the coefficients
+    // Quantize/descale/zigzag the coefficients (rounds to nearest, ties away from zero).
     for (int i = 0; i < 64; ++i) {
-        DUQ[s_jpeg_ZigZag[i]] = fast_roundf(DU[i] * fdtbl[i]);
+        int v = DU[i] * qtbl[i];
+        DUQ[s_jpeg_ZigZag[i]] = (v + (1 << (JPEG_QUANT_SHIFT - 1)) - (v < 0)) >> JPEG_QUANT_SHIFT;
         if (s_jpeg_ZigZag[i] > end0pos && DUQ[s_jpeg_ZigZag[i]]) {
             end0pos = s_jpeg_ZigZag[i];
         }
@@ -802,31 +821,58 @@ static int jpeg_processDU(jpeg_buf_t *jpeg_buf, int8_t *CDU, float *fdtbl, int D
     return DUQ[0];
 }
 
-static void jpeg_init(int quality) {
-    static int q = 0;
+static const jpeg_tables_t *jpeg_init(int quality) {
+    int i = 0;
+
+    // Look for a prepared table set first.
+    while ((i < jpeg_tables_used) && (jpeg_tables_cache[jpeg_tables_lru[i]].quality != quality)) {
+        i++;
+    }
+
+    bool hit = (i < jpeg_tables_used);
 
-    quality = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    if (!hit) {
+        if (jpeg_tables_used < JPEG_TABLES_CACHE_SIZE) {
+            // Fill an unused slot.
+            jpeg_tables_lru[i] = jpeg_tables_used++;
+        } else {
+            // Otherwise rebuild the least recently used one.
+            i = JPEG_TABLES_CACHE_SIZE - 1;
+        }
+    }
+
+    jpeg_tables_t *tables = &jpeg_tables_cache[jpeg_tables_lru[i]];
 
-    // If quality changed, update quantization matrix
-    if (q != quality) {
-        q = quality;
-        for (int i = 0; i < 64; ++i) {
-            int yti = (YQT[i] * quality + 50) / 100;
-            YTable[s_jpeg_ZigZag[i]] = yti < 1 ? 1 : yti > 255 ? 255 : yti;
-            int uvti = (UVQT[i] * quality + 50) / 100;
-            UVTable[s_jpeg_ZigZag[i]] = uvti < 1 ? 1 : uvti > 255 ? 255 : uvti;
+    if (!hit) {
+        int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+        for (int j = 0; j < 64; ++j) {
+            int yti = (YQT[j] * scale + 50) / 100;
+            tables->YTable[s_jpeg_ZigZag[j]] = yti < 1 ? 1 : yti > 255 ? 255 : yti;
+            int uvti = (UVQT[j] * scale + 50) / 100;
+            tables->UVTable[s_jpeg_ZigZag[j]] = uvti < 1 ? 1 : uvti > 255 ? 255 : uvti;
         }
 
         for (int r = 0, k = 0; r < 8; ++r) {
             for (int c = 0; c < 8; ++c, ++k) {
-                fdtbl_Y[k] = 1.0f / (aasf[r] * aasf[c] * YTable [s_jpeg_ZigZag[k]] * 8.0f);
-                fdtbl_UV[k] = 1.0f / (aasf[r] * aasf[c] * UVTable[s_jpeg_ZigZag[k]] * 8.0f);
+                float aa = aasf[r] * aasf[c] * 8.0f;
+                tables->qtbl_Y[k] = fast_roundf((1 << JPEG_QUANT_SHIFT) / (aa * tables->YTable[s_jpeg_ZigZag[k]]));
+                tables->qtbl_UV[k] = fast_roundf((1 << JPEG_QUANT_SHIFT) / (aa * tables->UVTable[s_jpeg_ZigZag[k]]));
             }
         }
+
+        tables->quality = quality;
     }
+
+    // Move to the front of the LRU list.
+    uint8_t index = jpeg_tables_lru[i];
+    memmove(jpeg_tables_lru + 1, jpeg_tables_lru, i);
+    jpeg_tables_lru[0] = index;
+    return tables;
 }
 
-static void jpeg_write_headers(jpeg_buf_t *jpeg_buf, int w, int h, int bpp, jpeg_subsampling_t subsampling) {
+static void jpeg_write_headers(jpeg_buf_t *jpeg_buf, int w, int h, int bpp, jpeg_subsampling_t subsampling,
+                               const jpeg_tables_t *tables) {
     // Number of components (1 or 3)
     uint8_t nr_comp = (bpp == 1)? 1 : 3;
 
@@ -879,12 +925,12 @@ static void jpeg_write_headers(jpeg_buf_t *jpeg_buf, int w, int h, int bpp, jpeg
     jpeg_put_bytes(jpeg_buf, m_dqt, sizeof(m_dqt));
     // Write Y quantization table (index, table)
     jpeg_put_char(jpeg_buf, 0);
-    jpeg_put_bytes(jpeg_buf, YTable, sizeof(YTable));
+    jpeg_put_bytes(jpeg_buf, tables->YTable, sizeof(tables->YTable));
 
     if (bpp > 1) {
         // Write UV quantization table (index, table)
         jpeg_put_char(jpeg_buf, 1);
-        jpeg_put_bytes(jpeg_buf, UVTable, sizeof(UVTable));
+        jpeg_put_bytes(jpeg_buf, tables->UVTable, sizeof(tables->UVTable));
     }
 
     // Write SOF0 marker
@@ -955,7 +1001,7 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc, jpeg_s
     };
 
     // Initialize quantization tables
-    jpeg_init(quality);
+    const jpeg_tables_t *tables = jpeg_init(quality);
 
     if (src->is_color) {
         if (subsampling == JPEG_SUBSAMPLING_AUTO) {
@@ -971,7 +1017,7 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc, jpeg_s
         subsampling = JPEG_SUBSAMPLING_444;
     }
 
-    jpeg_write_headers(&jpeg_buf, src->w, src->h, src->is_color ? 2 : 1, subsampling);
+    jpeg_write_headers(&jpeg_buf, src->w, src->h, src->is_color ? 2 : 1, subsampling, tables);
 
     int DCY = 0, DCU = 0, DCV = 0;
 
@@ -992,11 +1038,11 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc, jpeg_s
                     int dx = IM_MIN(JPEG_MCU_W, src->w - x_offset);
 
                     jpeg_get_mcu(src, x_offset, y_offset, dx, dy, YDU, UDU, VDU);
-                    DCY = jpeg_processDU(&jpeg_buf, YDU, fdtbl_Y, DCY, YDC_HT, YAC_HT);
+                    DCY = jpeg_processDU(&jpeg_buf, YDU, tables->qtbl_Y, DCY, YDC_HT, YAC_HT);
 
                     if (src->is_color) {
-                        DCU = jpeg_processDU(&jpeg_buf, UDU, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
-                        DCV = jpeg_processDU(&jpeg_buf, VDU, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
+                        DCU = jpeg_processDU(&jpeg_buf, UDU, tables->qtbl_UV, DCU, UVDC_HT, UVAC_HT);
+                        DCV = jpeg_processDU(&jpeg_buf, VDU, tables->qtbl_UV, DCV, UVDC_HT, UVAC_HT);
                     }
                 }
 
@@ -1030,7 +1076,7 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc, jpeg_s
                             memset(VDU + i, 0, JPEG_444_GS_MCU_SIZE);
                         }
 
-                        DCY = jpeg_processDU(&jpeg_buf, YDU + i, fdtbl_Y, DCY, YDC_HT, YAC_HT);
+                        DCY = jpeg_processDU(&jpeg_buf, YDU + i, tables->qtbl_Y, DCY, YDC_HT, YAC_HT);
                     }
 
                     // horizontal subsampling of U & V
@@ -1100,8 +1146,8 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc, jpeg_s
                         #endif
                     }
 
-                    DCU = jpeg_processDU(&jpeg_buf, UDU_avg, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
-                    DCV = jpeg_processDU(&jpeg_buf, VDU_avg, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
+                    DCU = jpeg_processDU(&jpeg_buf, UDU_avg, tables->qtbl_UV, DCU, UVDC_HT, UVAC_HT);
+                    DCV = jpeg_processDU(&jpeg_buf, VDU_avg, tables->qtbl_UV, DCV, UVDC_HT, UVAC_HT);
                 }
 
                 if (jpeg_buf.overflow) {
@@ -1136,7 +1182,7 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc, jpeg_s
                                 memset(VDU + i + j, 0, JPEG_444_GS_MCU_SIZE);
                             }
 
-                            DCY = jpeg_processDU(&jpeg_buf, YDU + i + j, fdtbl_Y, DCY, YDC_HT, YAC_HT);
+                            DCY = jpeg_processDU(&jpeg_buf, YDU + i + j, tables->qtbl_Y, DCY, YDC_HT, YAC_HT);
                         }
 
                         // Reset back two columns.
@@ -1237,8 +1283,8 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc, jpeg_s
                         #endif
                     }
 
-                    DCU = jpeg_processDU(&jpeg_buf, UDU_avg, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
-                    DCV = jpeg_processDU(&jpeg_buf, VDU_avg, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
+                    DCU = jpeg_processDU(&jpeg_buf, UDU_avg, tables->qtbl_UV, DCU, UVDC_HT, UVAC_HT);
+                    DCV = jpeg_processDU(&jpeg_buf, VDU_avg, tables->qtbl_UV, DCV, UVDC_HT, UVAC_HT);
                 }
 
                 if (jpeg_buf.overflow) {
@@ -1380,7 +1426,7 @@ void jpeg_read(image_t *img, const char *path) {
 
 void jpeg_write(image_t *img, const char *path, int quality) {
     FIL fp;
-    file_open(&fp, path, false, FA_WRITE | FA_CREATE_ALWAYS);
+    file_open(&fp, path, false, FA_WRITE | FA_CREATE_ALWAYS | FILE_WRITE_BEHIND);
     if (IM_IS_JPEG(img)) {
         file_write(&fp, img->pixels, img->size);
     } else {
@@ -147,3 +147,185 @@ array_t *cluster_kmeans(array_t *points, int k, cluster_dist_t dist_func) {
 
     return clusters;
 }
+
+// Dense color k-means over RGB565 pixels. Pixels are sampled every stride pixels on every stride
+// rows and are read straight from the image on each pass so no sample buffer is needed.
+static inline void color_kmeans_rgb(uint16_t *row_ptr, int x, int *r, int *g, int *b) {
+    int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
+    *r = COLOR_RGB565_TO_R8(pixel);
+    *g = COLOR_RGB565_TO_G8(pixel);
+    *b = COLOR_RGB565_TO_B8(pixel);
+}
+
+static inline uint32_t color_kmeans_dist(const color_cluster_t *c, int r, int g, int b) {
+    int dr = c->r - r, dg = c->g - g, db = c->b - b;
+    return (dr * dr) + (dg * dg) + (db * db);
+}
+
+static int color_kmeans_nearest(const color_cluster_t *clusters, int k, int r, int g, int b, uint32_t *dist) {
+    int best = 0;
+    uint32_t best_dist = UINT32_MAX;
+
+    for (int i = 0; i < k; i++) {
+        uint32_t d = color_kmeans_dist(clusters + i, r, g, b);
+        if (d < best_dist) {
+            best_dist = d;
+            best = i;
+        }
+    }
+
+    *dist = best_dist;
+    return best;
+}
+
+// Returns the sum of the squared distances of the samples to their nearest centroid. If pick is
+// not NULL the sample where the running sum passes *pick becomes centroid n. The first centroid
+// weights every sample by 1.
+static uint64_t color_kmeans_seed_pass(image_t *img, rectangle_t *roi, int stride,
+                                       color_cluster_t *clusters, int n, uint64_t *pick) {
+    uint64_t total = 0;
+
+    for (int y = roi->y, ye = roi->y + roi->h; y < ye; y += stride) {
+        uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+
+        for (int x = roi->x, xe = roi->x + roi->w; x < xe; x += stride) {
+            int r, g, b;
+            uint32_t d = 1;
+            color_kmeans_rgb(row_ptr, x, &r, &g, &b);
+
+            if (n) {
+                color_kmeans_nearest(clusters, n, r, g, b, &d);
+            }
+
+            total += d;
+
+            if (pick && (*pick < total)) {
+                clusters[n].r = r;
+                clusters[n].g = g;
+                clusters[n].b = b;
+                return total;
+            }
+        }
+    }
+
+    return total;
+}
+
+// Seeds clusters[n..k) with k-means++. Each new centroid is a sample picked with a probability
+// proportional to its squared distance from the nearest centroid so far. A fixed seed keeps the
+// palette of a static scene stable from frame to frame. Returns the number of centroids, which is
+// less than k if there are fewer distinct colors than that.
+static int color_kmeans_seed(image_t *img, rectangle_t *roi, int stride, int k,
+                             color_cluster_t *clusters, int n) {
+    uint32_t rng = 0x9E3779B9;
+
+    for (; n < k; n++) {
+        uint64_t total = color_kmeans_seed_pass(img, roi, stride, clusters, n, NULL);
+
+        if (!total) {
+            break;
+        }
+
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+
+        // (total * rng) >> 32 without overflowing.
+        uint64_t pick = ((total >> 32) * rng) + (((total & UINT32_MAX) * rng) >> 32);
+        color_kmeans_seed_pass(img, roi, stride, clusters, n, &pick);
+    }
+
+    return n;
+}
+
+// Clusters the colors of the RGB565 image in roi. clusters[0..n_init) are used as the initial
+// centroids (e.g. the result of the last frame) and the rest are seeded with k-means++. Lloyd
+// iterations run until no centroid moves or max_iter is reached. An emptied cluster is moved to
+// the sample farthest from its centroid. Returns the number of clusters found, sorted by count.
+int imlib_color_kmeans(image_t *img, rectangle_t *roi, int stride, int k, int max_iter,
+                       color_cluster_t *clusters, int n_init) {
+    uint32_t sum[COLOR_KMEANS_MAX_K][4];
+
+    k = color_kmeans_seed(img, roi, stride, k, clusters, IM_MIN(n_init, k));
+
+    for (int i = 0; i < k; i++) {
+        clusters[i].count = 0;
+    }
+
+    for (int iter = 0; iter < max_iter; iter++) {
+        uint32_t far_dist = 0;
+        int far_r = 0, far_g = 0, far_b = 0;
+
+        memset(sum, 0, sizeof(sum));
+
+        for (int y = roi->y, ye = roi->y + roi->h; y < ye; y += stride) {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+
+            for (int x = roi->x, xe = roi->x + roi->w; x < xe; x += stride) {
+                int r, g, b;
+                uint32_t d;
+                color_kmeans_rgb(row_ptr, x, &r, &g, &b);
+
+                uint32_t *s = sum[color_kmeans_nearest(clusters, k, r, g, b, &d)];
+                s[0] += r;
+                s[1] += g;
+                s[2] += b;
+                s[3] += 1;
+
+                if (d > far_dist) {
+                    far_dist = d;
+                    far_r = r;
+                    far_g = g;
+                    far_b = b;
+                }
+            }
+        }
+
+        bool changed = false;
+
+        for (int i = 0; i < k; i++) {
+            color_cluster_t *c = clusters + i;
+            uint32_t count = sum[i][3];
+            c->count = count;
+
+            if (count) {
+                uint8_t r = (sum[i][0] + (count / 2)) / count;
+                uint8_t g = (sum[i][1] + (count / 2)) / count;
+                uint8_t b = (sum[i][2] + (count / 2)) / count;
+                changed |= (r != c->r) || (g != c->g) || (b != c->b);
+                c->r = r;
+                c->g = g;
+                c->b = b;
+            } else if (far_dist) {
+                c->r = far_r;
+                c->g = far_g;
+                c->b = far_b;
+                far_dist = 0;
+                changed = true;
+            }
+        }
+
+        if (!changed) {
+            break;
+        }
+    }
+
+    // Drop empty clusters and sort by count.
+    int n = 0;
+
+    for (int i = 0; i < k; i++) {
+        color_cluster_t c = clusters[i];
+
+        if (c.count) {
+            int j = n++;
+
+            for (; (j > 0) && (clusters[j - 1].count < c.count); j--) {
+                clusters[j] = clusters[j - 1];
+            }
+
+            clusters[j] = c;
+        }
+    }
+
+    return n;
+}
@@ -33,10 +33,6 @@
 #include "file_utils.h"
 #ifdef IMLIB_ENABLE_FIND_LBP
 
-#define LBP_HIST_SIZE      (59) //58 uniform hist + 1
-#define LBP_NUM_REGIONS    (7)  //7x7 regions
-#define LBP_DESC_SIZE      (LBP_NUM_REGIONS * LBP_NUM_REGIONS * LBP_HIST_SIZE)
-
 const static int8_t lbp_weights[49] = {
     2, 1, 1, 1, 1, 1, 2,
     2, 4, 4, 1, 4, 4, 2,
@@ -66,6 +62,74 @@ const static uint8_t uniform_tbl[256] = {
     47, 48, 58, 49, 58, 58, 58, 50, 51, 52, 58, 53, 54, 55, 56, 57
 };
 
+// ceil(2^31 / (a + b)). ((a - b)^2 * recip) >> 31 == (a - b)^2 / (a + b) for all 8-bit a and b.
+const static uint32_t lbp_chi_recip[(UINT8_MAX * 2) + 1] = {
+    0x00000000, 0x80000000, 0x40000000, 0x2AAAAAAB, 0x20000000, 0x1999999A, 0x15555556, 0x12492493,
+    0x10000000, 0x0E38E38F, 0x0CCCCCCD, 0x0BA2E8BB, 0x0AAAAAAB, 0x09D89D8A, 0x0924924A, 0x08888889,
+    0x08000000, 0x07878788, 0x071C71C8, 0x06BCA1B0, 0x06666667, 0x06186187, 0x05D1745E, 0x0590B217,
+    0x05555556, 0x051EB852, 0x04EC4EC5, 0x04BDA130, 0x04924925, 0x0469EE59, 0x04444445, 0x04210843,
+    0x04000000, 0x03E0F83F, 0x03C3C3C4, 0x03A83A84, 0x038E38E4, 0x03759F23, 0x035E50D8, 0x03483484,
+    0x03333334, 0x031F3832, 0x030C30C4, 0x02FA0BE9, 0x02E8BA2F, 0x02D82D83, 0x02C8590C, 0x02B93106,
+    0x02AAAAAB, 0x029CBC15, 0x028F5C29, 0x02828283, 0x02762763, 0x026A43A0, 0x025ED098, 0x0253C826,
+    0x02492493, 0x023EE090, 0x0234F72D, 0x022B63CC, 0x02222223, 0x02192E2A, 0x02108422, 0x02082083,
+    0x02000000, 0x01F81F82, 0x01F07C20, 0x01E9131B, 0x01E1E1E2, 0x01DAE608, 0x01D41D42, 0x01CD8569,
+    0x01C71C72, 0x01C0E071, 0x01BACF92, 0x01B4E81C, 0x01AF286C, 0x01A98EF7, 0x01A41A42, 0x019EC8EA,
+    0x0199999A, 0x01948B10, 0x018F9C19, 0x018ACB91, 0x01861862, 0x01818182, 0x017D05F5, 0x0178A4C9,
+    0x01745D18, 0x01702E06, 0x016C16C2, 0x01681682, 0x01642C86, 0x01605817, 0x015C9883, 0x0158ED24,
+    0x01555556, 0x0151D07F, 0x014E5E0B, 0x014AFD6B, 0x0147AE15, 0x01446F87, 0x01414142, 0x013E22CC,
+    0x013B13B2, 0x01381382, 0x013521D0, 0x01323E35, 0x012F684C, 0x012C9FB5, 0x0129E413, 0x0127350C,
+    0x0124924A, 0x0121FB79, 0x011F7048, 0x011CF06B, 0x011A7B97, 0x01181182, 0x0115B1E6, 0x01135C82,
+    0x01111112, 0x010ECF57, 0x010C9715, 0x010A6811, 0x01084211, 0x010624DE, 0x01041042, 0x01020409,
+    0x01000000, 0x00FE03F9, 0x00FC0FC1, 0x00FA232D, 0x00F83E10, 0x00F6603E, 0x00F4898E, 0x00F2B9D7,
+    0x00F0F0F1, 0x00EF2EB8, 0x00ED7304, 0x00EBBDB3, 0x00EA0EA1, 0x00E865AD, 0x00E6C2B5, 0x00E52599,
+    0x00E38E39, 0x00E1FC79, 0x00E07039, 0x00DEE95D, 0x00DD67C9, 0x00DBEB62, 0x00DA740E, 0x00D901B3,
+    0x00D79436, 0x00D62B81, 0x00D4C77C, 0x00D3680E, 0x00D20D21, 0x00D0B6A0, 0x00CF6475, 0x00CE168B,
+    0x00CCCCCD, 0x00CB8728, 0x00CA4588, 0x00C907DB, 0x00C7CE0D, 0x00C6980D, 0x00C565C9, 0x00C43730,
+    0x00C30C31, 0x00C1E4BC, 0x00C0C0C1, 0x00BFA030, 0x00BE82FB, 0x00BD6911, 0x00BC5265, 0x00BB3EE8,
+    0x00BA2E8C, 0x00B92144, 0x00B81703, 0x00B70FBC, 0x00B60B61, 0x00B509E7, 0x00B40B41, 0x00B30F64,
+    0x00B21643, 0x00B11FD4, 0x00B02C0C, 0x00AF3ADE, 0x00AE4C42, 0x00AD602C, 0x00AC7692, 0x00AB8F6A,
+    0x00AAAAAB, 0x00A9C84B, 0x00A8E840, 0x00A80A81, 0x00A72F06, 0x00A655C5, 0x00A57EB6, 0x00A4A9D0,
+    0x00A3D70B, 0x00A3065F, 0x00A237C4, 0x00A16B32, 0x00A0A0A1, 0x009FD80A, 0x009F1166, 0x009E4CAE,
+    0x009D89D9, 0x009CC8E2, 0x009C09C1, 0x009B4C70, 0x009A90E8, 0x0099D723, 0x00991F1B, 0x009868C9,
+    0x0097B426, 0x0097012F, 0x00964FDB, 0x0095A026, 0x0094F20A, 0x00944581, 0x00939A86, 0x0092F114,
+    0x00924925, 0x0091A2B4, 0x0090FDBD, 0x00905A39, 0x008FB824, 0x008F177A, 0x008E7836, 0x008DDA53,
+    0x008D3DCC, 0x008CA29D, 0x008C08C1, 0x008B7035, 0x008AD8F3, 0x008A42F9, 0x0089AE41, 0x00891AC8,
+    0x00888889, 0x0087F781, 0x008767AC, 0x0086D906, 0x00864B8B, 0x0085BF38, 0x00853409, 0x0084A9FA,
+    0x00842109, 0x00839931, 0x0083126F, 0x00828CC0, 0x00820821, 0x0081848E, 0x00810205, 0x00808081,
+    0x00800000, 0x007F8080, 0x007F01FD, 0x007E8473, 0x007E07E1, 0x007D8C43, 0x007D1197, 0x007C97DA,
+    0x007C1F08, 0x007BA720, 0x007B301F, 0x007ABA02, 0x007A44C7, 0x0079D06B, 0x00795CEC, 0x0078EA46,
+    0x00787879, 0x00780781, 0x0077975C, 0x00772808, 0x0076B982, 0x00764BC9, 0x0075DEDA, 0x007572B3,
+    0x00750751, 0x00749CB3, 0x007432D7, 0x0073C9BA, 0x0073615B, 0x0072F9B7, 0x007292CD, 0x00722C9A,
+    0x0071C71D, 0x00716254, 0x0070FE3D, 0x00709AD5, 0x0070381D, 0x006FD610, 0x006F74AF, 0x006F13F6,
+    0x006EB3E5, 0x006E5479, 0x006DF5B1, 0x006D978C, 0x006D3A07, 0x006CDD22, 0x006C80DA, 0x006C252D,
+    0x006BCA1B, 0x006B6FA2, 0x006B15C1, 0x006ABC75, 0x006A63BE, 0x006A0B9A, 0x0069B407, 0x00695D05,
+    0x00690691, 0x0068B0AB, 0x00685B50, 0x00680681, 0x0067B23B, 0x00675E7D, 0x00670B46, 0x0066B894,
+    0x00666667, 0x006614BD, 0x0065C394, 0x006572ED, 0x006522C4, 0x0064D31A, 0x006483EE, 0x0064353D,
+    0x0063E707, 0x0063994A, 0x00634C07, 0x0062FF3B, 0x0062B2E5, 0x00626704, 0x00621B98, 0x0061D09F,
+    0x00618619, 0x00613C04, 0x0060F25E, 0x0060A929, 0x00606061, 0x00601807, 0x005FD018, 0x005F8896,
+    0x005F417E, 0x005EFACF, 0x005EB489, 0x005E6EAA, 0x005E2933, 0x005DE421, 0x005D9F74, 0x005D5B2C,
+    0x005D1746, 0x005CD3C4, 0x005C90A2, 0x005C4DE2, 0x005C0B82, 0x005BC981, 0x005B87DE, 0x005B4699,
+    0x005B05B1, 0x005AC525, 0x005A84F4, 0x005A451D, 0x005A05A1, 0x0059C67D, 0x005987B2, 0x0059493F,
+    0x00590B22, 0x0058CD5B, 0x00588FEA, 0x005852CE, 0x00581606, 0x0057D991, 0x00579D6F, 0x005761A0,
+    0x00572621, 0x0056EAF4, 0x0056B016, 0x00567588, 0x00563B49, 0x00560159, 0x0055C7B5, 0x00558E5F,
+    0x00555556, 0x00551C98, 0x0054E426, 0x0054ABFE, 0x00547420, 0x00543C8C, 0x00540541, 0x0053CE3E,
+    0x00539783, 0x0053610F, 0x00532AE3, 0x0052F4FC, 0x0052BF5B, 0x005289FF, 0x005254E8, 0x00522015,
+    0x0051EB86, 0x0051B739, 0x00518330, 0x00514F68, 0x00511BE2, 0x0050E89D, 0x0050B599, 0x005082D5,
+    0x00505051, 0x00501E0C, 0x004FEC05, 0x004FBA3E, 0x004F88B3, 0x004F5767, 0x004F2657, 0x004EF584,
+    0x004EC4ED, 0x004E9491, 0x004E6471, 0x004E348C, 0x004E04E1, 0x004DD570, 0x004DA638, 0x004D773A,
+    0x004D4874, 0x004D19E7, 0x004CEB92, 0x004CBD74, 0x004C8F8E, 0x004C61DE, 0x004C3465, 0x004C0721,
+    0x004BDA13, 0x004BAD3B, 0x004B8098, 0x004B5429, 0x004B27EE, 0x004AFBE7, 0x004AD013, 0x004AA473,
+    0x004A7905, 0x004A4DCA, 0x004A22C1, 0x0049F7E9, 0x0049CD43, 0x0049A2CE, 0x0049788A, 0x00494E76,
+    0x00492493, 0x0048FADF, 0x0048D15A, 0x0048A805, 0x00487EDF, 0x004855E7, 0x00482D1D, 0x00480481,
+    0x0047DC12, 0x0047B3D1, 0x00478BBD, 0x004763D6, 0x00473C1B, 0x0047148C, 0x0046ED2A, 0x0046C5F2,
+    0x00469EE6, 0x00467805, 0x0046514F, 0x00462AC3, 0x00460461, 0x0045DE29, 0x0045B81B, 0x00459236,
+    0x00456C7A, 0x004546E7, 0x0045217D, 0x0044FC3B, 0x0044D721, 0x0044B22F, 0x00448D64, 0x004468C1,
+    0x00444445, 0x00441FEF, 0x0043FBC1, 0x0043D7B8, 0x0043B3D6, 0x0043901A, 0x00436C83, 0x00434912,
+    0x004325C6, 0x0043029F, 0x0042DF9C, 0x0042BCBE, 0x00429A05, 0x0042776F, 0x004254FD, 0x004232AF,
+    0x00421085, 0x0041EE7D, 0x0041CC99, 0x0041AAD7, 0x00418938, 0x004167BB, 0x00414660, 0x00412528,
+    0x00410411, 0x0040E31B, 0x0040C247, 0x0040A194, 0x00408103, 0x00406091, 0x00404041,
+};
+
 uint8_t *imlib_lbp_desc(image_t *image, rectangle_t *roi) {
     int s = image->w; //stride
     int RX = roi->w / LBP_NUM_REGIONS;
@@ -95,31 +159,84 @@ uint8_t *imlib_lbp_desc(image_t *image, rectangle_t *roi) {
     return desc;
 }
 
-int imlib_lbp_desc_distance(uint8_t *d0, uint8_t *d1) {
+// Chi-square distance between the histograms of one region.
+static uint32_t imlib_lbp_region_distance(const uint8_t *d0, const uint8_t *d1) {
+    uint32_t sum = 0;
+    for (int i = 0; i < LBP_HIST_SIZE; i++) {
+        int d = d0[i] - d1[i];
+        sum += (uint32_t) (((uint64_t) (d * d) * lbp_chi_recip[d0[i] + d1[i]]) >> 31);
+    }
+    return sum;
+}
+
+// Returns the weighted distance or bound if the distance reaches bound. Regions with a zero weight are skipped.
+static uint32_t imlib_lbp_desc_distance_bounded(const uint8_t *d0, const uint8_t *d1, uint32_t bound) {
     uint32_t sum = 0;
-    for (int i = 0; i < LBP_DESC_SIZE; i++) {
-        int w = lbp_weights[i / LBP_HIST_SIZE];
-        sum += w * ((((d0[i] - d1[i]) * (d0[i] - d1[i])) / IM_MAX((d0[i] + d1[i]), 1)));
+    for (int r = 0; r < (LBP_NUM_REGIONS * LBP_NUM_REGIONS); r++) {
+        if (lbp_weights[r]) {
+            sum += lbp_weights[r] * imlib_lbp_region_distance(d0 + (r * LBP_HIST_SIZE), d1 + (r * LBP_HIST_SIZE));
+            if (sum >= bound) {
+                return bound;
+            }
+        }
     }
     return sum;
 }
 
+int imlib_lbp_desc_distance(uint8_t *d0, uint8_t *d1) {
+    return imlib_lbp_desc_distance_bounded(d0, d1, UINT32_MAX);
+}
+
+// Finds the k nearest of count descriptors stored back to back in gallery. Matches are sorted
+// by distance and then by index. Once k matches are found candidates are abandoned as soon as
+// their partial distance reaches the kth best. Returns the number of matches.
+int imlib_lbp_desc_knn(uint8_t *desc, uint8_t *gallery, size_t count, int k, lbp_match_t *matches) {
+    int n = 0;
+
+    for (size_t i = 0; i < count; i++, gallery += LBP_DESC_SIZE) {
+        uint32_t bound = (n == k) ? matches[k - 1].distance : UINT32_MAX;
+        uint32_t distance = imlib_lbp_desc_distance_bounded(desc, gallery, bound);
+
+        if ((n == k) && (distance >= bound)) {
+            continue;
+        }
+
+        int j = (n < k) ? n++ : (k - 1);
+
+        for (; (j > 0) && (matches[j - 1].distance > distance); j--) {
+            matches[j] = matches[j - 1];
+        }
+
+        matches[j].index = i;
+        matches[j].distance = distance;
+    }
+
+    return n;
+}
+
 int imlib_lbp_desc_save(FIL *fp, uint8_t *desc) {
     UINT bytes;
     // Write descriptor
     return file_ll_write(fp, desc, LBP_DESC_SIZE, &bytes);
 }
 
-int imlib_lbp_desc_load(FIL *fp, uint8_t **desc) {
+int imlib_lbp_desc_read(FIL *fp, uint8_t *desc) {
     UINT bytes;
-    FRESULT res = FR_OK;
+    FRESULT res = file_ll_read(fp, desc, LBP_DESC_SIZE, &bytes);
+
+    if ((res == FR_OK) && (bytes != LBP_DESC_SIZE)) {
+        res = FR_INT_ERR;
+    }
 
-    *desc = NULL;
+    return res;
+}
+
+int imlib_lbp_desc_load(FIL *fp, uint8_t **desc) {
     uint8_t *hist = m_malloc(LBP_DESC_SIZE);
 
     // Read descriptor
-    res = file_ll_read(fp, hist, LBP_DESC_SIZE, &bytes);
-    if (res != FR_OK || bytes != LBP_DESC_SIZE) {
+    FRESULT res = imlib_lbp_desc_read(fp, hist);
+    if (res != FR_OK) {
         *desc = NULL;
         m_free(hist);
     } else {
@@ -160,7 +160,8 @@ float *LineSegmentDetection(int *n_out,
                             float scale, float sigma_scale, float quant,
                             float ang_th, float log_eps, float density_th,
                             int n_bins,
-                            int **reg_img, int *reg_x, int *reg_y);
+                            int **reg_img, int *reg_x, int *reg_y,
+                            imlib_budget_t *budget);
 
 /** LSD Simple Interface with Scale and Region output.
 
@@ -2459,7 +2460,8 @@ float *LineSegmentDetection(int *n_out,
                             float scale, float sigma_scale, float quant,
                             float ang_th, float log_eps, float density_th,
                             int n_bins,
-                            int **reg_img, int *reg_x, int *reg_y) {
+                            int **reg_img, int *reg_x, int *reg_y,
+                            imlib_budget_t *budget) {
     image_char image;
     ntuple_list out = new_ntuple_list(7);
     float *return_value;
@@ -2474,6 +2476,8 @@ float *LineSegmentDetection(int *n_out,
     unsigned int xsize, ysize;
     float rho, reg_angle, prec, p, log_nfa, logNT;
     int ls_count = 0;                 /* line segments are numbered 1,2,3,... */
+    unsigned int seed = 0;            /* region seeds are numbered 0,1,2,... */
+    unsigned int resume = budget ? budget->resume : 0;
 
 
     /* check parameters */
@@ -2546,6 +2550,20 @@ float *LineSegmentDetection(int *n_out,
             angles->data[ list_p->x + list_p->y * angles->xsize ] != NOTDEF_INT) {
             /* there is no risk of float comparison problems here
                because we are only interested in the exact NOTDEF value */
+            /* seeds before the resume point were fully processed by the
+               previous call. they are replayed up to the refinement, which
+               marks pixels as used and releases them again, so that later
+               seeds see the same used map as in a single call. */
+            int replay = seed < resume;
+
+            /* stop here if out of time, the next call restarts at this seed.
+               at least one new seed is processed per call. */
+            if ((seed > resume) && imlib_budget_expired(budget)) {
+                break;
+            }
+
+            seed++;
+
             /* find the region of connected point and ~equal angle */
             region_grow(list_p->x, list_p->y, angles, reg, &reg_size,
                         &reg_angle, used, prec);
@@ -2572,6 +2590,11 @@ float *LineSegmentDetection(int *n_out,
                 continue;
             }
 
+            /* the rest doesn't touch the used map */
+            if (replay) {
+                continue;
+            }
+
             /* compute NFA value */
             log_nfa = rect_improve(&rec, angles, logNT, log_eps);
             if (log_nfa <= log_eps) {
@@ -2609,6 +2632,10 @@ float *LineSegmentDetection(int *n_out,
     }
 
 
+    if (budget) {
+        budget->resume = budget->expired ? seed : 0;
+    }
+
     /* free memory */
     free( (void *) image);  /* only the char_image structure should be freed,
                                the data pointer was provided to this functions
@@ -2667,7 +2694,7 @@ float *lsd_scale_region(int *n_out,
 
     return LineSegmentDetection(n_out, img, X, Y, scale, sigma_scale, quant,
                                 ang_th, log_eps, density_th, n_bins,
-                                reg_img, reg_x, reg_y);
+                                reg_img, reg_x, reg_y, NULL);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -2691,7 +2718,8 @@ void imlib_lsd_find_line_segments(list_t *out,
                                   image_t *ptr,
                                   rectangle_t *roi,
                                   unsigned int merge_distance,
-                                  unsigned int max_theta_diff) {
+                                  unsigned int max_theta_diff,
+                                  imlib_budget_t *budget) {
     uint8_t *grayscale_image = fb_alloc(roi->w * roi->h, FB_ALLOC_NO_HINT);
 
     image_t img;
@@ -2717,7 +2745,8 @@ void imlib_lsd_find_line_segments(list_t *out,
                                      1024,
                                      NULL,
                                      NULL,
-                                     NULL);
+                                     NULL,
+                                     budget);
     list_init(out, sizeof(find_lines_list_lnk_data_t));
 
     for (int i = 0, j = n_ls; i < j; i++) {
@@ -0,0 +1,254 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (C) 2013-2024 OpenMV, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Run-length encoded image masks.
+ *
+ * A mask_rle_t stores the set pixels of each mask row as a sorted list of
+ * [x, x + w) spans. Ops walk the spans with mask_rle_for_each_span() instead
+ * of testing every pixel with image_get_mask_pixel().
+ */
+#include "imlib.h"
+
+// Extracts the set runs of a binary row. Words which are all zeros outside a
+// run or all ones inside a run are skipped 32 pixels at a time. Spans are only
+// counted when spans is NULL.
+static size_t imlib_mask_rle_binary_row(uint32_t *row, int w, mask_span_t *spans) {
+    size_t n = 0;
+    int start = -1;
+
+    for (int i = 0, ii = (w + UINT32_T_MASK) >> UINT32_T_SHIFT; i < ii; i++) {
+        int base = i << UINT32_T_SHIFT;
+        uint32_t v = row[i];
+
+        if ((base + UINT32_T_BITS) > w) {
+            v &= (1U << (w - base)) - 1;
+        }
+
+        if (v == ((start < 0) ? 0 : 0xFFFFFFFF)) {
+            continue;
+        }
+
+        for (int b = 0; b < UINT32_T_BITS;) {
+            uint32_t t = ((start < 0) ? v : ~v) >> b;
+
+            if (!t) {
+                break;
+            }
+
+            b += __builtin_ctz(t);
+
+            if (start < 0) {
+                start = base + b;
+            } else {
+                if (spans) {
+                    spans[n].x = start;
+                    spans[n].w = base + b - start;
+                }
+                n += 1;
+                start = -1;
+            }
+        }
+    }
+
+    if (start >= 0) {
+        if (spans) {
+            spans[n].x = start;
+            spans[n].w = w - start;
+        }
+        n += 1;
+    }
+
+    return n;
+}
+
+static size_t imlib_mask_rle_row(image_t *mask, int y, int w, mask_span_t *spans) {
+    if ((y < 0) || (y >= mask->h)) {
+        return 0;
+    }
+
+    w = IM_MIN(w, mask->w);
+
+    if (mask->pixfmt == PIXFORMAT_BINARY) {
+        return imlib_mask_rle_binary_row(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(mask, y), w, spans);
+    }
+
+    size_t n = 0;
+    int start = -1;
+
+    for (int x = 0; x <= w; x++) {
+        bool pixel = false;
+
+        if (x < w) {
+            switch (mask->pixfmt) {
+                case PIXFORMAT_GRAYSCALE: {
+                    uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(mask, y);
+                    pixel = COLOR_GRAYSCALE_TO_BINARY(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x));
+                    break;
+                }
+                case PIXFORMAT_RGB565: {
+                    uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(mask, y);
+                    pixel = COLOR_RGB565_TO_BINARY(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
+                    break;
+                }
+                default: {
+                    break;
+                }
+            }
+        }
+
+        if (pixel && (start < 0)) {
+            start = x;
+        } else if ((!pixel) && (start >= 0)) {
+            if (spans) {
+                spans[n].x = start;
+                spans[n].w = x - start;
+            }
+            n += 1;
+            start = -1;
+        }
+    }
+
+    return n;
+}
+
+void imlib_mask_rle_from_image(mask_rle_t *rle, int w, int h, image_t *mask) {
+    rle->w = w;
+    rle->h = h;
+    rle->rows = fb_alloc((h + 1) * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+    // Size the span table with a counting pass first so that only the spans
+    // which exist are allocated.
+    rle->rows[0] = 0;
+    for (int y = 0; y < h; y++) {
+        rle->rows[y + 1] = rle->rows[y] + imlib_mask_rle_row(mask, y, w, NULL);
+    }
+
+    rle->spans = fb_alloc(IM_MAX(rle->rows[h], 1U) * sizeof(mask_span_t), FB_ALLOC_NO_HINT);
+
+    for (int y = 0; y < h; y++) {
+        imlib_mask_rle_row(mask, y, w, rle->spans + rle->rows[y]);
+    }
+}
+
+static void imlib_mask_rle_alloc_convex(mask_rle_t *rle, int w, int h) {
+    rle->w = w;
+    rle->h = h;
+    rle->rows = fb_alloc((h + 1) * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    rle->spans = fb_alloc(IM_MAX(h, 1) * sizeof(mask_span_t), FB_ALLOC_NO_HINT);
+    rle->rows[0] = 0;
+}
+
+static void imlib_mask_rle_put_convex_row(mask_rle_t *rle, int y, int x_start, int x_end) {
+    x_start = IM_MAX(x_start, 0);
+    x_end = IM_MIN(x_end, rle->w);
+    rle->rows[y + 1] = rle->rows[y];
+
+    if (x_start < x_end) {
+        mask_span_t *span = rle->spans + rle->rows[y];
+        span->x = x_start;
+        span->w = x_end - x_start;
+        rle->rows[y + 1] += 1;
+    }
+}
+
+void imlib_mask_rle_from_rectangle(mask_rle_t *rle, int w, int h, int rx, int ry, int rw, int rh) {
+    imlib_mask_rle_alloc_convex(rle, w, h);
+
+    for (int y = 0; y < h; y++) {
+        bool inside = (ry <= y) && (y < (ry + rh));
+        imlib_mask_rle_put_convex_row(rle, y, inside ? rx : 0, inside ? (rx + rw) : 0);
+    }
+}
+
+// Circles and ellipses are rendered with the same code that draws them so
+// the mask matches a filled imlib_draw_circle()/imlib_draw_ellipse(). Only the
+// part of the image within r of the center is rendered (all of it if r < 0)
+// and each row is reduced to a single span since the shapes are convex.
+// Circles use rx as their radius.
+static void imlib_mask_rle_from_shape(mask_rle_t *rle, int w, int h, int cx, int cy, int r,
+                                      int rx, int ry, int rotation, bool ellipse) {
+    imlib_mask_rle_alloc_convex(rle, w, h);
+
+    image_t temp;
+    int x_offset = (r < 0) ? 0 : IM_MAX(cx - r, 0);
+    int y_offset = (r < 0) ? 0 : IM_MAX(cy - r, 0);
+    temp.w = IM_MAX(((r < 0) ? w : IM_MIN(cx + r + 1, w)) - x_offset, 0);
+    temp.h = IM_MAX(((r < 0) ? h : IM_MIN(cy + r + 1, h)) - y_offset, 0);
+    temp.pixfmt = PIXFORMAT_BINARY;
+    temp.data = NULL;
+
+    if (temp.w && temp.h) {
+        temp.data = fb_alloc0(image_size(&temp), FB_ALLOC_NO_HINT);
+
+        if (ellipse) {
+            imlib_draw_ellipse(&temp, cx - x_offset, cy - y_offset, rx, ry, rotation, -1, 0, true);
+        } else {
+            imlib_draw_circle(&temp, cx - x_offset, cy - y_offset, rx, -1, 0, true);
+        }
+    }
+
+    for (int y = 0; y < h; y++) {
+        int x_start = 0, x_end = 0, temp_y = y - y_offset;
+
+        if (temp.data && (0 <= temp_y) && (temp_y < temp.h)) {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&temp, temp_y);
+            int first = -1, last = -1;
+
+            for (int i = 0, ii = IMAGE_BINARY_LINE_LEN(&temp); i < ii; i++) {
+                if (row_ptr[i]) {
+                    if (first < 0) {
+                        first = (i << UINT32_T_SHIFT) + __builtin_ctz(row_ptr[i]);
+                    }
+                    last = (i << UINT32_T_SHIFT) + (UINT32_T_MASK - __builtin_clz(row_ptr[i]));
+                }
+            }
+
+            if (first >= 0) {
+                x_start = x_offset + first;
+                x_end = x_offset + last + 1;
+            }
+        }
+
+        imlib_mask_rle_put_convex_row(rle, y, x_start, x_end);
+    }
+
+    if (temp.data) {
+        fb_free(); // temp.data
+    }
+}
+
+void imlib_mask_rle_from_circle(mask_rle_t *rle, int w, int h, int cx, int cy, int r) {
+    // The anti-aliased edge may land one pixel outside of the radius.
+    imlib_mask_rle_from_shape(rle, w, h, cx, cy, IM_MAX(r, 0) + 1, r, 0, 0, false);
+}
+
+void imlib_mask_rle_from_ellipse(mask_rle_t *rle, int w, int h, int cx, int cy, int rx, int ry, int rotation) {
+    // The sheared ellipse rasterizer may overshoot its axes by a lot for
+    // nearly circular rotated ellipses so there's no tight bound to render.
+    imlib_mask_rle_from_shape(rle, w, h, cx, cy, -1, rx, ry, rotation, true);
+}
+
+void imlib_mask_rle_free(mask_rle_t *rle) {
+    fb_free(); // rle->spans
+    fb_free(); // rle->rows
+}
@@ -214,7 +214,7 @@ void mjpeg_write(FIL *fp, int width, int height, uint32_t *frames, uint32_t *byt
 }
 
 void mjpeg_sync(FIL *fp, uint32_t frames, uint32_t bytes, uint32_t us_avg) {
-    uint32_t position = f_tell(fp);
+    uint32_t position = file_tell(fp);
     // size of all mjpeg headers and jpegs.
     uint32_t datasize = (frames * 8) + bytes;
     // frames_per_second == rate / scale
@@ -119,13 +119,569 @@ unsigned lodepng_convert_cb(unsigned char *out, const unsigned char *in,
 }
 
 #if defined(IMLIB_ENABLE_PNG_ENCODER)
-bool png_compress(image_t *src, image_t *dst) {
-    OMV_PROFILE_START();
+// Streaming PNG encoder.
+//
+// Rows are converted to 8-bit grayscale or RGB888, filtered with one filter
+// per row picked by a sampled sum of absolute differences, and deflated as
+// they are produced. Nothing larger than a few rows, one deflate block of
+// tokens and one IDAT chunk is ever held in memory.
+//
+// PNG_LEVEL_STORE writes stored deflate blocks, PNG_LEVEL_HUFFMAN writes
+// dynamic Huffman blocks of literals and PNG_LEVEL_RLE also matches runs of
+// repeated bytes (distance 1), which is where most of the gain on filtered
+// image data comes from.
+#define PNG_IDAT_SIZE           (8192)
+#define PNG_BLOCK_TOKENS        (8192)
+#define PNG_LITLEN_CODES        (286)
+#define PNG_CLEN_CODES          (19)
+#define PNG_MAX_BITS            (15)
+#define PNG_CLEN_MAX_BITS       (7)
+#define PNG_MIN_RUN             (3)
+#define PNG_MAX_RUN             (258)
+#define PNG_FILTER_SAMPLE       (4)
+#define PNG_ADLER_MOD           (65521)
+#define PNG_ADLER_NMAX          (5552)
+
+typedef struct png_encoder {
+    FIL *fp;
+    uint8_t *buf;
+    uint32_t buf_size;
+    uint32_t len;
+    uint32_t chunk;
+    uint32_t bits;
+    uint32_t bit_count;
+    uint32_t adler_a;
+    uint32_t adler_b;
+    png_level_t level;
+    int last;
+    uint16_t *tokens;
+    uint32_t token_count;
+    uint32_t freq[PNG_LITLEN_CODES];
+    uint32_t weight[PNG_LITLEN_CODES * 2];
+    uint16_t parent[PNG_LITLEN_CODES * 2];
+    uint16_t sorted[PNG_LITLEN_CODES];
+    uint16_t codes[PNG_LITLEN_CODES];
+    uint8_t lengths[PNG_LITLEN_CODES];
+} png_encoder_t;
+
+static const uint8_t png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+static const uint32_t png_crc_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static const uint16_t png_len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t png_len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+// Length code (minus 257) of each run length (minus 3).
+static const uint8_t png_len_code[256] = {
+    0,  1,  2,  3,  4,  5,  6,  7,  8,  8,  9,  9, 10, 10, 11, 11,
+    12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15,
+    16, 16, 16, 16, 16, 16, 16, 16, 17, 17, 17, 17, 17, 17, 17, 17,
+    18, 18, 18, 18, 18, 18, 18, 18, 19, 19, 19, 19, 19, 19, 19, 19,
+    20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20,
+    21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,
+    24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+    24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+    25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+    25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+    26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+    26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+    27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+    27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 28,
+};
+
+static const uint8_t png_clen_order[PNG_CLEN_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static uint32_t png_crc32(uint32_t crc, const uint8_t *data, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ png_crc_table[crc & 0xF];
+        crc = (crc >> 4) ^ png_crc_table[crc & 0xF];
+    }
+    return crc;
+}
 
-    if (src->is_compressed) {
-        return true;
+static void png_adler32(png_encoder_t *e, const uint8_t *data, uint32_t size) {
+    while (size) {
+        uint32_t n = IM_MIN(size, (uint32_t) PNG_ADLER_NMAX);
+        for (uint32_t i = 0; i < n; i++) {
+            e->adler_a += data[i];
+            e->adler_b += e->adler_a;
+        }
+        e->adler_a %= PNG_ADLER_MOD;
+        e->adler_b %= PNG_ADLER_MOD;
+        data += n;
+        size -= n;
+    }
+}
+
+static void png_reserve(png_encoder_t *e, uint32_t size) {
+    // Room for the data and the CRC of the current chunk.
+    if ((e->len + size + 4) > e->buf_size) {
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Out of Memory!"));
+    }
+}
+
+static void png_put_u32(png_encoder_t *e, uint32_t value) {
+    png_reserve(e, 4);
+    e->buf[e->len++] = value >> 24;
+    e->buf[e->len++] = value >> 16;
+    e->buf[e->len++] = value >> 8;
+    e->buf[e->len++] = value;
+}
+
+static void png_chunk_begin(png_encoder_t *e, const char *type) {
+    e->chunk = e->len;
+    png_put_u32(e, 0);
+    png_reserve(e, 4);
+    memcpy(e->buf + e->len, type, 4);
+    e->len += 4;
+}
+
+static void png_chunk_end(png_encoder_t *e) {
+    uint32_t size = e->len - e->chunk - 8;
+    uint8_t *p = e->buf + e->chunk;
+    p[0] = size >> 24;
+    p[1] = size >> 16;
+    p[2] = size >> 8;
+    p[3] = size;
+    png_put_u32(e, png_crc32(0xFFFFFFFF, p + 4, size + 4) ^ 0xFFFFFFFF);
+
+    #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+    if (e->fp) {
+        file_write(e->fp, e->buf, e->len);
+        e->len = 0;
+    }
+    #endif
+}
+
+static void png_idat_put(png_encoder_t *e, uint8_t value) {
+    if ((e->len - e->chunk - 8) == PNG_IDAT_SIZE) {
+        png_chunk_end(e);
+        png_chunk_begin(e, "IDAT");
+    }
+    png_reserve(e, 1);
+    e->buf[e->len++] = value;
+}
+
+static void png_put_bits(png_encoder_t *e, uint32_t bits, uint32_t count) {
+    e->bits |= bits << e->bit_count;
+    e->bit_count += count;
+    while (e->bit_count >= 8) {
+        png_idat_put(e, e->bits);
+        e->bits >>= 8;
+        e->bit_count -= 8;
+    }
+}
+
+static void png_align_bits(png_encoder_t *e) {
+    if (e->bit_count) {
+        png_put_bits(e, 0, 8 - e->bit_count);
+    }
+}
+
+// Computes code lengths of at most max_bits bits. The lengths of an optimal
+// tree are counted and squeezed into max_bits (like miniz does) before the
+// longest codes are handed out to the least frequent symbols. At least two
+// symbols always get a code so that the code is complete.
+static void png_huffman_lengths(png_encoder_t *e, const uint32_t *freq, uint8_t *lengths, int n, int max_bits) {
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        lengths[i] = 0;
+        if (freq[i] || ((count < 2) && (i >= (n - 2)))) {
+            // Insertion sort by frequency.
+            uint32_t w = IM_MAX(freq[i], 1U);
+            int j = count++;
+            for (; j && (e->weight[j - 1] > w); j--) {
+                e->weight[j] = e->weight[j - 1];
+                e->sorted[j] = e->sorted[j - 1];
+            }
+            e->weight[j] = w;
+            e->sorted[j] = i;
+        }
+    }
+
+    // Two queue Huffman tree construction. Leaves are nodes [0, count), the
+    // inner nodes follow in the order they're created.
+    int leaf = 0, inner = count;
+    for (int next = count; next < ((count * 2) - 1); next++) {
+        e->weight[next] = 0;
+        for (int k = 0; k < 2; k++) {
+            int child;
+            if ((leaf < count) && ((inner >= next) || (e->weight[leaf] <= e->weight[inner]))) {
+                child = leaf++;
+            } else {
+                child = inner++;
+            }
+            e->parent[child] = next;
+            e->weight[next] += e->weight[child];
+        }
+    }
+
+    // Parents are created after their children so walking down from the root
+    // turns the parent indices into depths.
+    int root = (count * 2) - 2;
+    e->parent[root] = 0;
+    for (int i = root - 1; i >= 0; i--) {
+        e->parent[i] = e->parent[e->parent[i]] + 1;
+    }
+
+    uint32_t num[PNG_MAX_BITS + 1] = { 0 };
+    for (int i = 0; i < count; i++) {
+        num[IM_MIN(e->parent[i], max_bits)] += 1;
+    }
+
+    uint32_t total = 0;
+    for (int i = max_bits; i > 0; i--) {
+        total += num[i] << (max_bits - i);
+    }
+
+    while (total != (1U << max_bits)) {
+        num[max_bits] -= 1;
+        for (int i = max_bits - 1; i > 0; i--) {
+            if (num[i]) {
+                num[i] -= 1;
+                num[i + 1] += 2;
+                break;
+            }
+        }
+        total -= 1;
+    }
+
+    for (int len = max_bits, k = 0; len > 0; len--) {
+        for (uint32_t i = 0; i < num[len]; i++) {
+            lengths[e->sorted[k++]] = len;
+        }
+    }
+}
+
+// Canonical codes, bit reversed since deflate sends Huffman codes MSB first.
+static void png_huffman_codes(const uint8_t *lengths, uint16_t *codes, int n) {
+    uint16_t count[PNG_MAX_BITS + 1] = { 0 };
+    uint16_t next[PNG_MAX_BITS + 1];
+
+    for (int i = 0; i < n; i++) {
+        count[lengths[i]] += 1;
+    }
+
+    count[0] = 0;
+    for (int bits = 1, code = 0; bits <= PNG_MAX_BITS; bits++) {
+        code = (code + count[bits - 1]) << 1;
+        next[bits] = code;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (lengths[i]) {
+            uint32_t code = next[lengths[i]]++, reversed = 0;
+            for (int b = 0; b < lengths[i]; b++, code >>= 1) {
+                reversed = (reversed << 1) | (code & 1);
+            }
+            codes[i] = reversed;
+        }
+    }
+}
+
+// Writes the queued tokens as a dynamic Huffman block. Distances only ever
+// use the first of two 1-bit distance codes.
+static void png_deflate_block(png_encoder_t *e) {
+    memset(e->freq, 0, sizeof(e->freq));
+    for (uint32_t i = 0; i < e->token_count; i++) {
+        uint32_t t = e->tokens[i];
+        e->freq[(t < 256) ? t : (257 + png_len_code[t - 256])] += 1;
+    }
+    e->freq[256] = 1;
+
+    png_huffman_lengths(e, e->freq, e->lengths, PNG_LITLEN_CODES, PNG_MAX_BITS);
+    png_huffman_codes(e->lengths, e->codes, PNG_LITLEN_CODES);
+
+    int hlit = PNG_LITLEN_CODES;
+    while ((hlit > 257) && (!e->lengths[hlit - 1])) {
+        hlit--;
+    }
+
+    // Run length encode the literal/length and distance code lengths.
+    uint8_t all[PNG_LITLEN_CODES + 2];
+    uint8_t rle_sym[PNG_LITLEN_CODES + 2];
+    uint8_t rle_extra[PNG_LITLEN_CODES + 2];
+    uint32_t clen_freq[PNG_CLEN_CODES] = { 0 };
+    uint8_t clen_lengths[PNG_CLEN_CODES];
+    uint16_t clen_codes[PNG_CLEN_CODES];
+    int n = hlit + 2, rle = 0;
+
+    memcpy(all, e->lengths, hlit);
+    all[hlit] = 1;
+    all[hlit + 1] = 1;
+
+    for (int i = 0; i < n;) {
+        int l = all[i], r = 1;
+        while (((i + r) < n) && (all[i + r] == l)) {
+            r++;
+        }
+        if ((!l) && (r >= 3)) {
+            r = IM_MIN(r, 138);
+            rle_sym[rle] = (r >= 11) ? 18 : 17;
+            rle_extra[rle] = r - ((r >= 11) ? 11 : 3);
+        } else if (l && i && (all[i - 1] == l) && (r >= 3)) {
+            r = IM_MIN(r, 6);
+            rle_sym[rle] = 16;
+            rle_extra[rle] = r - 3;
+        } else {
+            r = 1;
+            rle_sym[rle] = l;
+            rle_extra[rle] = 0;
+        }
+        clen_freq[rle_sym[rle++]] += 1;
+        i += r;
+    }
+
+    png_huffman_lengths(e, clen_freq, clen_lengths, PNG_CLEN_CODES, PNG_CLEN_MAX_BITS);
+    png_huffman_codes(clen_lengths, clen_codes, PNG_CLEN_CODES);
+
+    int hclen = PNG_CLEN_CODES;
+    while ((hclen > 4) && (!clen_lengths[png_clen_order[hclen - 1]])) {
+        hclen--;
+    }
+
+    png_put_bits(e, 0, 1); // BFINAL
+    png_put_bits(e, 2, 2); // BTYPE - dynamic Huffman
+    png_put_bits(e, hlit - 257, 5);
+    png_put_bits(e, 1, 5); // HDIST - 2 codes
+    png_put_bits(e, hclen - 4, 4);
+
+    for (int i = 0; i < hclen; i++) {
+        png_put_bits(e, clen_lengths[png_clen_order[i]], 3);
+    }
+
+    for (int i = 0; i < rle; i++) {
+        png_put_bits(e, clen_codes[rle_sym[i]], clen_lengths[rle_sym[i]]);
+        if (rle_sym[i] >= 16) {
+            png_put_bits(e, rle_extra[i], (rle_sym[i] == 16) ? 2 : ((rle_sym[i] == 17) ? 3 : 7));
+        }
+    }
+
+    for (uint32_t i = 0; i < e->token_count; i++) {
+        uint32_t t = e->tokens[i];
+        if (t < 256) {
+            png_put_bits(e, e->codes[t], e->lengths[t]);
+        } else {
+            uint32_t code = png_len_code[t - 256];
+            png_put_bits(e, e->codes[257 + code], e->lengths[257 + code]);
+            png_put_bits(e, t - 256 + 3 - png_len_base[code], png_len_extra[code]);
+            png_put_bits(e, 0, 1); // Distance 1.
+        }
+    }
+
+    png_put_bits(e, e->codes[256], e->lengths[256]);
+    e->token_count = 0;
+}
+
+static void png_token(png_encoder_t *e, uint32_t token) {
+    if (e->token_count == PNG_BLOCK_TOKENS) {
+        png_deflate_block(e);
+    }
+    e->tokens[e->token_count++] = token;
+}
+
+static void png_deflate_row(png_encoder_t *e, const uint8_t *data, uint32_t size) {
+    png_adler32(e, data, size);
+
+    if (e->level == PNG_LEVEL_STORE) {
+        png_put_bits(e, 0, 3); // BFINAL and BTYPE - stored
+        png_align_bits(e);
+        png_put_bits(e, size, 16);
+        png_put_bits(e, size ^ 0xFFFF, 16);
+        for (uint32_t i = 0; i < size; i++) {
+            png_idat_put(e, data[i]);
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < size;) {
+        uint32_t run = 0;
+        if (e->level == PNG_LEVEL_RLE) {
+            uint32_t max = IM_MIN(size - i, (uint32_t) PNG_MAX_RUN);
+            while ((run < max) && (data[i + run] == e->last)) {
+                run++;
+            }
+        }
+
+        if (run >= PNG_MIN_RUN) {
+            png_token(e, 256 + run - PNG_MIN_RUN);
+            i += run;
+        } else {
+            e->last = data[i++];
+            png_token(e, e->last);
+        }
+    }
+}
+
+static int png_paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return ((pa <= pb) && (pa <= pc)) ? a : ((pb <= pc) ? b : c);
+}
+
+static uint8_t png_predict(int filter, const uint8_t *row, const uint8_t *prev, int i, int bpp) {
+    int a = (i >= bpp) ? row[i - bpp] : 0;
+    int c = (i >= bpp) ? prev[i - bpp] : 0;
+    switch (filter) {
+        case 1: return a;
+        case 2: return prev[i];
+        case 3: return (a + prev[i]) >> 1;
+        case 4: return png_paeth(a, prev[i], c);
+        default: return 0;
+    }
+}
+
+// Picks the filter with the smallest sum of absolute residuals over a sample
+// of the row and applies it.
+static void png_filter_row(png_encoder_t *e, const uint8_t *row, const uint8_t *prev, uint8_t *out, int n, int bpp) {
+    int filter = 0;
+
+    if (e->level != PNG_LEVEL_STORE) {
+        uint32_t best = UINT32_MAX;
+        for (int f = 0; f < 5; f++) {
+            uint32_t sum = 0;
+            for (int i = 0; i < n; i += PNG_FILTER_SAMPLE) {
+                sum += abs((int8_t) (row[i] - png_predict(f, row, prev, i, bpp)));
+            }
+            if (sum < best) {
+                best = sum;
+                filter = f;
+            }
+        }
+    }
+
+    out[0] = filter;
+    for (int i = 0; i < n; i++) {
+        out[i + 1] = row[i] - png_predict(filter, row, prev, i, bpp);
+    }
+}
+
+static int png_bpp(image_t *src) {
+    return (src->pixfmt == PIXFORMAT_RGB565) ? 3 : 1;
+}
+
+static uint32_t png_scratch_size(image_t *src, png_level_t level) {
+    uint32_t row = src->w * png_bpp(src);
+    return sizeof(png_encoder_t) +
+           ((level == PNG_LEVEL_STORE) ? 0 : (PNG_BLOCK_TOKENS * sizeof(uint16_t))) +
+           (((row * 3) + 1 + 3) & ~3);
+}
+
+// Encodes src to fp through buf, or into buf if fp is NULL. Returns the number
+// of bytes left in buf.
+static uint32_t png_encode(image_t *src, png_level_t level, FIL *fp, uint8_t *buf, uint32_t buf_size, uint8_t *scratch) {
+    if ((!IM_IS_BINARY(src)) && (!IM_IS_GS(src)) && (!IM_IS_RGB565(src))) {
+        mp_raise_msg_varg(&mp_type_RuntimeError, MP_ERROR_TEXT("Input format is not supported"));
+    }
+
+    int bpp = png_bpp(src), n = src->w * bpp;
+    png_encoder_t *e = (png_encoder_t *) scratch;
+    memset(e, 0, sizeof(png_encoder_t));
+    scratch += sizeof(png_encoder_t);
+
+    if (level != PNG_LEVEL_STORE) {
+        e->tokens = (uint16_t *) scratch;
+        scratch += PNG_BLOCK_TOKENS * sizeof(uint16_t);
+    }
+
+    uint8_t *prev = scratch;
+    uint8_t *row = prev + n;
+    uint8_t *out = row + n;
+    memset(prev, 0, n);
+
+    e->fp = fp;
+    e->buf = buf;
+    e->buf_size = buf_size;
+    e->level = level;
+    e->adler_a = 1;
+    e->last = -1;
+
+    png_reserve(e, sizeof(png_signature));
+    memcpy(e->buf, png_signature, sizeof(png_signature));
+    e->len = sizeof(png_signature);
+
+    png_chunk_begin(e, "IHDR");
+    png_put_u32(e, src->w);
+    png_put_u32(e, src->h);
+    png_put_u32(e, (8 << 24) | (((bpp == 3) ? 2 : 0) << 16)); // 8-bit, gray/RGB, deflate, no filter...
+    png_reserve(e, 1);
+    e->buf[e->len++] = 0; // ...no interlace.
+    png_chunk_end(e);
+
+    png_chunk_begin(e, "IDAT");
+    png_idat_put(e, 0x78); // zlib - deflate, 32K window.
+    png_idat_put(e, 0x01);
+
+    for (int y = 0; y < src->h; y++) {
+        switch (src->pixfmt) {
+            case PIXFORMAT_BINARY: {
+                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(src, y);
+                for (int x = 0; x < src->w; x++) {
+                    row[x] = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
+                }
+                break;
+            }
+            case PIXFORMAT_GRAYSCALE: {
+                memcpy(row, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y), n);
+                break;
+            }
+            case PIXFORMAT_RGB565: {
+                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, y);
+                for (int x = 0; x < src->w; x++) {
+                    int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
+                    row[(x * 3) + 0] = COLOR_RGB565_TO_R8(pixel);
+                    row[(x * 3) + 1] = COLOR_RGB565_TO_G8(pixel);
+                    row[(x * 3) + 2] = COLOR_RGB565_TO_B8(pixel);
+                }
+                break;
+            }
+        }
+
+        png_filter_row(e, row, prev, out, n, bpp);
+        png_deflate_row(e, out, n + 1);
+
+        uint8_t *tmp = prev;
+        prev = row;
+        row = tmp;
+    }
+
+    if (e->token_count) {
+        png_deflate_block(e);
     }
 
+    // An empty final fixed Huffman block ends the stream.
+    png_put_bits(e, 1, 1); // BFINAL
+    png_put_bits(e, 1, 2); // BTYPE - fixed Huffman
+    png_put_bits(e, 0, 7); // End of block
+    png_align_bits(e);
+
+    png_idat_put(e, e->adler_b >> 8);
+    png_idat_put(e, e->adler_b);
+    png_idat_put(e, e->adler_a >> 8);
+    png_idat_put(e, e->adler_a);
+    png_chunk_end(e);
+
+    png_chunk_begin(e, "IEND");
+    png_chunk_end(e);
+    return e->len;
+}
+
+static void png_compress_full(image_t *src, image_t *dst) {
     umm_init_x(fb_avail());
 
     LodePNGState state;
@@ -192,9 +748,61 @@ bool png_compress(image_t *src, image_t *dst) {
         // free fb_alloc() memory used for umm_init_x().
         fb_free(); // umm_init_x();
     }
+}
+
+bool png_compress(image_t *src, image_t *dst, png_level_t level) {
+    OMV_PROFILE_START();
+
+    if (src->is_compressed) {
+        return true;
+    }
+
+    if (level == PNG_LEVEL_FULL) {
+        png_compress_full(src, dst);
+        OMV_PROFILE_PRINT();
+        return false;
+    }
+
+    // The encoder scratch is carved from the end of the output buffer so that
+    // a single fb_free() releases both.
+    uint32_t size, scratch_size = png_scratch_size(src, level);
+    uint8_t *buf = fb_alloc_all(&size, FB_ALLOC_PREFER_SIZE);
+
+    if (size <= scratch_size) {
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Out of Memory!"));
+    }
+
+    size -= scratch_size;
+    uint32_t png_size = png_encode(src, level, NULL, buf, size, buf + size);
+
+    if (dst->data == NULL) {
+        dst->data = buf;
+        dst->size = png_size;
+        // fb_alloc() memory will be free'd by the caller.
+    } else {
+        if (image_size(dst) <= png_size) {
+            dst->size = png_size;
+            memcpy(dst->data, buf, png_size);
+        } else {
+            mp_raise_msg_varg(&mp_type_RuntimeError,
+                              MP_ERROR_TEXT("Failed to compress image in place"));
+        }
+        fb_free(); // buf
+    }
+
     OMV_PROFILE_PRINT();
     return false;
 }
+
+#if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+static void png_write_stream(image_t *src, FIL *fp, png_level_t level) {
+    uint32_t scratch_size = png_scratch_size(src, level);
+    uint32_t buf_size = PNG_IDAT_SIZE + 64;
+    uint8_t *scratch = fb_alloc(scratch_size + buf_size, FB_ALLOC_NO_HINT);
+    png_encode(src, level, fp, scratch + scratch_size, buf_size, scratch);
+    fb_free(); // scratch
+}
+#endif
 #endif // IMLIB_ENABLE_PNG_ENCODER
 
 #if defined(IMLIB_ENABLE_PNG_DECODER)
@@ -248,7 +856,7 @@ void png_decompress(image_t *dst, image_t *src) {
 
 
 #if !defined(IMLIB_ENABLE_PNG_ENCODER)
-bool png_compress(image_t *src, image_t *dst) {
+bool png_compress(image_t *src, image_t *dst, png_level_t level) {
     mp_raise_msg_varg(&mp_type_RuntimeError, MP_ERROR_TEXT("PNG encoder is not enabled"));
 }
 #endif
@@ -309,14 +917,19 @@ void png_read(image_t *img, const char *path) {
     file_close(&fp);
 }
 
-void png_write(image_t *img, const char *path) {
+void png_write(image_t *img, const char *path, png_level_t level) {
     FIL fp;
-    file_open(&fp, path, false, FA_WRITE | FA_CREATE_ALWAYS);
+    file_open(&fp, path, false, FA_WRITE | FA_CREATE_ALWAYS | FILE_WRITE_BEHIND);
     if (img->pixfmt == PIXFORMAT_PNG) {
         file_write(&fp, img->pixels, img->size);
+    #if defined(IMLIB_ENABLE_PNG_ENCODER)
+    } else if (level != PNG_LEVEL_FULL) {
+        // Encoded straight to the file without buffering the whole image.
+        png_write_stream(img, &fp, level);
+    #endif
     } else {
         image_t out = { .w = img->w, .h = img->h, .pixfmt = PIXFORMAT_PNG, .size = 0, .pixels = NULL }; // alloc in png compress
-        png_compress(img, &out);
+        png_compress(img, &out, level);
         file_write(&fp, out.pixels, out.size);
         fb_free(); // frees alloc in png_compress()
     }
@@ -155,7 +155,7 @@ void ppm_write_subimg(image_t *img, const char *path, rectangle_t *r) {
     }
 
     FIL fp;
-    file_open(&fp, path, true, FA_WRITE | FA_CREATE_ALWAYS);
+    file_open(&fp, path, true, FA_WRITE | FA_CREATE_ALWAYS | FILE_WRITE_BEHIND);
 
     if (IM_IS_GS(img)) {
         char buffer[20]; // exactly big enough for 5-digit w/h
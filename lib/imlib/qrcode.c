@@ -2973,7 +2973,7 @@ const char *quirc_strerror(quirc_decode_error_t err)
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void imlib_find_qrcodes(list_t *out, image_t *ptr, rectangle_t *roi)
+void imlib_find_qrcodes(list_t *out, image_t *ptr, rectangle_t *roi, imlib_budget_t *budget)
 {
     struct quirc *controller = quirc_new();
     quirc_resize(controller, roi->w, roi->h);
@@ -2989,7 +2989,18 @@ void imlib_find_qrcodes(list_t *out, image_t *ptr, rectangle_t *roi)
     quirc_end(controller);
     list_init(out, sizeof(find_qrcodes_list_lnk_data_t));
 
-    for (int i = 0, j = quirc_count(controller); i < j; i++) {
+    // Thresholding, the finder scan and grouping always run to completion and
+    // are redone on every call as the image may have changed in between. Their
+    // time counts toward the budget, which is only checked between grids, so
+    // the resume point is a grid index. At least one new grid is decoded per
+    // call, so a budget shorter than the prepass decodes one grid per call.
+    int resume = budget ? budget->resume : 0, i = resume;
+
+    for (int j = quirc_count(controller); i < j; i++) {
+        if ((i > resume) && imlib_budget_expired(budget)) {
+            break;
+        }
+
         struct quirc_code *code = fb_alloc(sizeof(struct quirc_code), FB_ALLOC_NO_HINT);
         struct quirc_data *data = fb_alloc(sizeof(struct quirc_data), FB_ALLOC_NO_HINT);
         quirc_extract(controller, i, code);
@@ -3032,6 +3043,10 @@ void imlib_find_qrcodes(list_t *out, image_t *ptr, rectangle_t *roi)
         fb_free();
     }
 
+    if (budget) {
+        budget->resume = budget->expired ? i : 0;
+    }
+
     quirc_destroy(controller);
 }
 #endif //IMLIB_ENABLE_QRCODES *INDENT-ON*
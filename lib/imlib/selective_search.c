@@ -22,443 +22,412 @@
  * THE SOFTWARE.
  *
  * Selective search.
+ * See Selective Search for Object Recognition (J.R.R. Uijlings et al.) and
+ * Efficient Graph-Based Image Segmentation (Pedro F. Felzenszwalb and Daniel P. Huttenlocher).
  */
-#include <stdio.h>
-#include <math.h>
 #include <string.h>
 #include <stdint.h>
 #include "imlib.h"
 #include "fb_alloc.h"
+#include "fsort.h"
 #ifdef IMLIB_ENABLE_SELECTIVE_SEARCH
+#define SS_AUTO_PIXELS      (80 * 60)   // Images are downscaled to about this size by default.
+#define SS_MAX_WEIGHT       (442)       // ceil(sqrt(3 * 255^2))
+#define SS_HIST_BINS        (25)        // Bins per channel.
+#define SS_HIST_SIZE        (SS_HIST_BINS * 3)
+#define SS_HIST_ONE         (32768)     // Normalized histograms of each channel sum to this.
 
-#define THRESHOLD(size, c)    (c / size)
-typedef struct {
-    uint16_t y;
-    uint16_t h;
-    uint16_t x;
-    uint16_t w;
-} region;
+// Edges are stored as the index of their first pixel times 4 plus the direction of the second.
+#define SS_EDGE(a, dir)     (((a) << 2) | (dir))
+#define SS_EDGE_A(e)        ((e) >> 2)
+#define SS_EDGE_DIR(e)      ((e) & 3)
 
 typedef struct {
-    uint16_t p;
-    uint16_t rank;
-    uint16_t size;
-} uni_elt;
+    uint32_t *parent;
+    uint32_t *size;
+    uint32_t sets;
+} ss_forest_t;
 
 typedef struct {
-    int num;
-    uni_elt *elts;
-} universe;
+    uint16_t x0, y0, x1, y1;
+    uint32_t count;
+} ss_region_t;
 
 typedef struct {
-    float w;
-    uint16_t a;
-    uint16_t b;
-} edge;
-
-static inline int min(int a, int b) {
-    return (a < b) ? a : b;
-}
-static inline int max(int a, int b) {
-    return (a > b) ? a : b;
-}
-static inline float minf(float a, float b) {
-    return (a < b) ? a : b;
-}
-static inline float maxf(float a, float b) {
-    return (a > b) ? a : b;
-}
-extern uint32_t rng_randint(uint32_t min, uint32_t max);
-
-static universe *universe_create(int elements) {
-    universe *uni = (universe *) fb_alloc(sizeof(universe), FB_ALLOC_NO_HINT);
-    uni->elts = (uni_elt *) fb_alloc(sizeof(uni_elt) * elements, FB_ALLOC_NO_HINT);
-    uni->num = elements;
-    for (int i = 0; i < elements; ++i) {
-        uni->elts[i].p = i;
-        uni->elts[i].rank = 0;
-        uni->elts[i].size = 1;
+    uint16_t a, b;
+    float similarity;
+} ss_pair_t;
+
+static uint32_t ss_find(ss_forest_t *f, uint32_t x) {
+    while (f->parent[x] != x) {
+        // Path halving.
+        f->parent[x] = f->parent[f->parent[x]];
+        x = f->parent[x];
     }
-    return uni;
+    return x;
 }
 
-static int universe_size(universe *uni, int x) {
-    return uni->elts[x].size;
-}
+// Joins the sets of roots a and b by size and returns the new root.
+static uint32_t ss_join(ss_forest_t *f, uint32_t a, uint32_t b) {
+    if (f->size[a] < f->size[b]) {
+        uint32_t t = a;
+        a = b;
+        b = t;
+    }
 
-static int universe_num_sets(universe *uni) {
-    return uni->num;
+    f->parent[b] = a;
+    f->size[a] += f->size[b];
+    f->sets -= 1;
+    return a;
 }
 
-static int universe_find(universe *uni, int x) {
-    int y = x;
-    while (y != uni->elts[y].p) {
-        y = uni->elts[y].p;
-    }
-    // Path compression
-    uni->elts[x].p = y;
-    return y;
+static inline int ss_weight(uint16_t p0, uint16_t p1) {
+    int dr = COLOR_RGB565_TO_R8(p0) - COLOR_RGB565_TO_R8(p1);
+    int dg = COLOR_RGB565_TO_G8(p0) - COLOR_RGB565_TO_G8(p1);
+    int db = COLOR_RGB565_TO_B8(p0) - COLOR_RGB565_TO_B8(p1);
+    return fast_roundf(fast_sqrtf((dr * dr) + (dg * dg) + (db * db)));
 }
 
-static void universe_join(universe *uni, int x, int y) {
-    if (uni->elts[x].rank > uni->elts[y].rank) {
-        uni->elts[y].p = x;
-        uni->elts[x].size += uni->elts[y].size;
-    } else {
-        uni->elts[x].p = y;
-        uni->elts[y].size += uni->elts[x].size;
-        if (uni->elts[x].rank == uni->elts[y].rank) {
-            uni->elts[y].rank++;
+// Calls the callback for the right, down, down-right and up-right edge of every pixel. When
+// edges is NULL the number of edges of each weight is counted into buckets. Otherwise edges
+// are placed at the offsets in buckets, which sorts them by weight.
+static void ss_edges(image_t *img, uint32_t *buckets, uint32_t *edges) {
+    int w = img->w, h = img->h;
+    const int dx[4] = {1, 0, 1, 1};
+    const int dy[4] = {0, 1, 1, -1};
+
+    for (int y = 0; y < h; y++) {
+        uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+
+        for (int x = 0; x < w; x++) {
+            uint16_t p = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
+
+            for (int d = 0; d < 4; d++) {
+                int x2 = x + dx[d], y2 = y + dy[d];
+
+                if ((x2 >= w) || (y2 < 0) || (y2 >= h)) {
+                    continue;
+                }
+
+                int weight = ss_weight(p, IMAGE_GET_RGB565_PIXEL(img, x2, y2));
+
+                if (edges) {
+                    edges[buckets[weight]++] = SS_EDGE((y * w) + x, d);
+                } else {
+                    buckets[weight] += 1;
+                }
+            }
         }
     }
-    uni->num--;
 }
 
-static int universe_get_id(universe *this, int x) {
-    return this->elts[x].rank;
+static inline uint32_t ss_edge_b(uint32_t e, int w) {
+    const int offset[4] = {1, w, w + 1, 1 - w};
+    return SS_EDGE_A(e) + offset[SS_EDGE_DIR(e)];
 }
 
-static void universe_set_id(universe *this, int x, int id) {
-    this->elts[x].rank = id;
-}
-
-static inline float color_similarity(float *hist1, float *hist2) {
-    float sim = 0;
-    for (int i = 0; i < 75; ++i) {
-        sim += minf(hist1[i], hist2[i]);
+// Returns the (a << 16) | b keys, a < b, of the neighboring regions across the right and down
+// edge of every pixel, skipping repeats of the previous key. When keys is NULL they're only counted.
+static uint32_t ss_neighbors(uint16_t *ids, int w, int h, int *keys) {
+    uint32_t n = 0;
+    int last = -1;
+
+    for (int y = 0, i = 0; y < h; y++) {
+        for (int x = 0; x < w; x++, i++) {
+            int a = ids[i];
+            int nb[2] = {(x < (w - 1)) ? ids[i + 1] : a, (y < (h - 1)) ? ids[i + w] : a};
+
+            for (int j = 0; j < 2; j++) {
+                if (nb[j] != a) {
+                    int key = (IM_MIN(a, nb[j]) << 16) | IM_MAX(a, nb[j]);
+
+                    if (key != last) {
+                        if (keys) {
+                            keys[n] = key;
+                        }
+
+                        n += 1;
+                        last = key;
+                    }
+                }
+            }
+        }
     }
-    return sim;
-}
 
-static inline float size_similarity(int a, int b, int size) {
-    return 1.0f - (a + b) / size;
+    return n;
 }
 
-static inline float fill_similarity(region *ra, region *rb, int a, int b, int size) {
-    int width = max(ra->w, rb->w) - min(ra->x, rb->x);
-    int height = max(ra->h, rb->h) - min(ra->y, rb->y);
-    return 1.0f - (width * height - a - b) / size;
-}
+// Nearest neighbor downscale.
+static void ss_downscale(image_t *src, image_t *dst, int scale) {
+    for (int y = 0; y < dst->h; y++) {
+        uint16_t *src_row = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, (y * scale) + (scale / 2));
+        uint16_t *dst_row = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(dst, y);
 
-static inline float square(float x) {
-    return x * x;
-};
+        for (int x = 0; x < dst->w; x++) {
+            dst_row[x] = src_row[(x * scale) + (scale / 2)];
+        }
+    }
+}
 
-static inline float diff(image_t *img, int x1, int y1, int x2, int y2) {
-    uint16_t p1 = IMAGE_GET_RGB565_PIXEL(img, x1, y1);
-    uint16_t p2 = IMAGE_GET_RGB565_PIXEL(img, x2, y2);
-    uint8_t r1 = COLOR_RGB565_TO_R8(p1);
-    uint8_t r2 = COLOR_RGB565_TO_R8(p2);
+static float ss_similarity(ss_region_t *regions, uint16_t *hists, int a, int b, float size,
+                           float a1, float a2, float a3) {
+    ss_region_t *ra = regions + a, *rb = regions + b;
+    uint16_t *ha = hists + (a * SS_HIST_SIZE), *hb = hists + (b * SS_HIST_SIZE);
+    uint32_t color = 0;
 
-    uint8_t g1 = COLOR_RGB565_TO_G8(p1);
-    uint8_t g2 = COLOR_RGB565_TO_G8(p2);
+    for (int i = 0; i < SS_HIST_SIZE; i++) {
+        color += IM_MIN(ha[i], hb[i]);
+    }
 
-    uint8_t b1 = COLOR_RGB565_TO_B8(p1);
-    uint8_t b2 = COLOR_RGB565_TO_B8(p2);
-    // dissimilarity measure between pixels
-    return sqrtf((r1 - r2) * (r1 - r2) + (g1 - g2) * (g1 - g2) + (b1 - b2) * (b1 - b2));
-}
+    int bw = IM_MAX(ra->x1, rb->x1) - IM_MIN(ra->x0, rb->x0) + 1;
+    int bh = IM_MAX(ra->y1, rb->y1) - IM_MIN(ra->y0, rb->y0) + 1;
+    float count = ra->count + rb->count;
 
-int comp(const void *elem1, const void *elem2) {
-    edge *f = (edge *) elem1;
-    edge *s = (edge *) elem2;
-    if (f->w > s->w) {
-        return 1;
-    }
-    if (f->w < s->w) {
-        return -1;
-    }
-    return 0;
+    return (a1 * (color / (3.0f * SS_HIST_ONE))) +
+           (a2 * (1.0f - (count / size))) +
+           (a3 * (1.0f - (((bw * bh) - count) / size)));
 }
 
-static void segment_graph(universe *u, int num_vertices, int num_edges, edge *edges, float c) {
-    qsort(edges, num_edges, sizeof(edge), comp);
-
-    float *threshold = fb_alloc(num_vertices * sizeof(float), FB_ALLOC_NO_HINT);
-    for (int i = 0; i < num_vertices; i++) {
-        threshold[i] = THRESHOLD(1, c);
-    }
+static void ss_add_proposal(array_t *proposals, ss_region_t *r, int scale, image_t *src) {
+    int x = r->x0 * scale;
+    int y = r->y0 * scale;
+    int w = IM_MIN((r->x1 + 1) * scale, src->w) - x;
+    int h = IM_MIN((r->y1 + 1) * scale, src->h) - y;
 
-    for (int i = 0; i < num_edges; i++) {
-        edge *pedge = edges + i;
-        int a = universe_find(u, pedge->a);
-        int b = universe_find(u, pedge->b);
-        if (a != b) {
-            if ((pedge->w <= threshold[a]) && (pedge->w <= threshold[b])) {
-                universe_join(u, a, b);
-                a = universe_find(u, a);
-                threshold[a] = pedge->w + THRESHOLD(universe_size(u, a), c);
-            }
+    for (int i = 0, ii = array_length(proposals); i < ii; i++) {
+        rectangle_t *p = array_at(proposals, i);
+        if ((p->x == x) && (p->y == y) && (p->w == w) && (p->h == h)) {
+            return;
         }
     }
 
-    // Free thresholds.
-    fb_free();
+    array_push_back(proposals, rectangle_alloc(x, y, w, h));
 }
 
-static void image_scale(image_t *src, image_t *dst) {
-    int x_ratio = (int) ((src->w << 16) / dst->w) + 1;
-    int y_ratio = (int) ((src->h << 16) / dst->h) + 1;
+// Segments the (downscaled) image into at most max_regions regions with Felzenszwalb's graph
+// segmentation and then greedily merges the most similar neighboring regions until one is left.
+// The bounding box of every initial and merged region is a proposal. Edge weights are integers
+// so the edges are bucket sorted, and the histograms are uint16.
+array_t *imlib_selective_search(image_t *src, float t, int min_size, float a1, float a2, float a3,
+                                int scale, int max_regions) {
+    array_t *proposals;
+    array_alloc(&proposals, m_free);
 
-    for (int y = 0; y < dst->h; y++) {
-        int sy = (y * y_ratio) >> 16;
-        for (int x = 0; x < dst->w; x++) {
-            int sx = (x * x_ratio) >> 16;
-            ((uint16_t *) dst->pixels)[y * dst->w + x] = ((uint16_t *) src->pixels)[sy * src->w + sx];
+    if (scale <= 0) {
+        scale = 1;
+        while (((src->w / scale) * (src->h / scale)) > SS_AUTO_PIXELS) {
+            scale += 1;
         }
     }
-}
 
-array_t *imlib_selective_search(image_t *src, float t, int min_size, float a1, float a2, float a3) {
-    int i, j;
-    int num = 0;
-    int width = 0, height = 0;
-    image_t *img = NULL;
+    image_t img = {
+        .w = src->w / scale,
+        .h = src->h / scale,
+        .pixfmt = PIXFORMAT_RGB565,
+        .data = src->data
+    };
 
-    fb_alloc_mark();
+    int w = img.w, h = img.h, n_pixels = w * h;
 
-    if ((src->w * src->h) <= (80 * 60)) {
-        img = src;
-        width = src->w;
-        height = src->h;
-    } else {
-        // Down scale image
-        width = src->w / 4;
-        height = src->h / 4;
-        img = fb_alloc(sizeof(image_t), FB_ALLOC_NO_HINT);
-        img->w = width;
-        img->h = height;
-        img->pixels = fb_alloc(width * height * 2, FB_ALLOC_NO_HINT);
-        image_scale(src, img);
+    if (!n_pixels) {
+        return proposals;
     }
 
-    // Region proposals array
-    array_t *proposals;
-    array_alloc(&proposals, m_free);
-
-    universe *u = universe_create(width * height);
-    edge *edges = (edge *) fb_alloc(width * height * sizeof(edge) * 4, FB_ALLOC_NO_HINT);
+    fb_alloc_mark();
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            if (x < width - 1) {
-                edges[num].a = y * width + x;
-                edges[num].b = y * width + (x + 1);
-                edges[num].w = diff(img, x, y, x + 1, y);
-                num++;
-            }
+    if (scale > 1) {
+        img.data = fb_alloc(image_size(&img), FB_ALLOC_NO_HINT);
+        ss_downscale(src, &img, scale);
+    }
 
-            if (y < height - 1) {
-                edges[num].a = y * width + x;
-                edges[num].b = (y + 1) * width + x;
-                edges[num].w = diff(img, x, y, x, y + 1);
-                num++;
-            }
+    ss_forest_t f = {
+        .parent = fb_alloc(n_pixels * sizeof(uint32_t), FB_ALLOC_NO_HINT),
+        .size = fb_alloc(n_pixels * sizeof(uint32_t), FB_ALLOC_NO_HINT),
+        .sets = n_pixels
+    };
+    float *threshold = fb_alloc(n_pixels * sizeof(float), FB_ALLOC_NO_HINT);
+
+    for (int i = 0; i < n_pixels; i++) {
+        f.parent[i] = i;
+        f.size[i] = 1;
+        threshold[i] = t;
+    }
 
-            if ((x < width - 1) && (y < height - 1)) {
-                edges[num].a = y * width + x;
-                edges[num].b = (y + 1) * width + (x + 1);
-                edges[num].w = diff(img, x, y, x + 1, y + 1);
-                num++;
-            }
+    // Count the edges of each weight and turn the counts into offsets.
+    uint32_t *buckets = fb_alloc0((SS_MAX_WEIGHT + 1) * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    ss_edges(&img, buckets, NULL);
 
-            if ((x < width - 1) && (y > 0)) {
-                edges[num].a = y * width + x;
-                edges[num].b = (y - 1) * width + (x + 1);
-                edges[num].w = diff(img, x, y, x + 1, y - 1);
-                num++;
-            }
-        }
+    uint32_t n_edges = 0;
+    for (int i = 0; i <= SS_MAX_WEIGHT; i++) {
+        uint32_t count = buckets[i];
+        buckets[i] = n_edges;
+        n_edges += count;
     }
 
-    segment_graph(u, width * height, num, edges, t);
+    uint32_t *edges = fb_alloc(IM_MAX(n_edges, 1U) * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    ss_edges(&img, buckets, edges);
 
-    for (i = 0; i < num; i++) {
-        int a = universe_find(u, edges[i].a);
-        int b = universe_find(u, edges[i].b);
-        if ((a != b) && ((universe_size(u, a) < min_size) || (universe_size(u, b) < min_size))) {
-            universe_join(u, a, b);
+    // Edges are now sorted by weight. buckets[i] is the end of weight i.
+    for (uint32_t i = 0, weight = 0; i < n_edges; i++) {
+        while (i >= buckets[weight]) {
+            weight += 1;
         }
-    }
 
-    // Free graph edges
-    fb_free();
+        uint32_t a = ss_find(&f, SS_EDGE_A(edges[i]));
+        uint32_t b = ss_find(&f, ss_edge_b(edges[i], w));
 
-    int num_ccs = universe_num_sets(u);
-    region *regions = (region *) fb_alloc(num_ccs * sizeof(region), FB_ALLOC_NO_HINT);
-    for (i = 0; i < num_ccs; i++) {
-        regions[i].x = width;
-        regions[i].w = 0;
-        regions[i].y = height;
-        regions[i].h = 0;
+        if ((a != b) && (weight <= threshold[a]) && (weight <= threshold[b])) {
+            a = ss_join(&f, a, b);
+            threshold[a] = weight + (t / f.size[a]);
+        }
     }
 
-    int next_component = 0;
-    int *counts = (int *) fb_alloc0(num_ccs * sizeof(int), FB_ALLOC_NO_HINT);
-    int *components = (int *) fb_alloc(num_ccs * sizeof(int), FB_ALLOC_NO_HINT);
-    float *histogram = (float *) fb_alloc0(num_ccs * sizeof(float) * 75, FB_ALLOC_NO_HINT);
-
-    // Calc histograms
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int component_id = -1;
-            int comp = universe_find(u, y * width + x);
-            for (i = 0; i < next_component; i++) {
-                if (components[i] == comp) {
-                    component_id = i;
-                    break;
-                }
-            }
-            if (i == next_component) {
-                components[next_component] = comp;
-                component_id = next_component;
-                ++next_component;
+    // Merge regions smaller than min_size and then keep merging along the weakest edges
+    // until there are no more than max_regions regions.
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t i = 0; (i < n_edges) && ((pass == 0) || (f.sets > max_regions)); i++) {
+            uint32_t a = ss_find(&f, SS_EDGE_A(edges[i]));
+            uint32_t b = ss_find(&f, ss_edge_b(edges[i], w));
+
+            if ((a != b) && (pass || (f.size[a] < min_size) || (f.size[b] < min_size))) {
+                ss_join(&f, a, b);
             }
-            universe_set_id(u, y * width + x, component_id);
-            region *r = regions + component_id;
-            r->y = min(r->y, y);
-            r->h = max(r->h, y);
-            r->x = min(r->x, x);
-            r->w = max(r->w, x);
-
-            uint16_t p = IMAGE_GET_RGB565_PIXEL(img, x, y);
-            int r_bin = min(COLOR_RGB565_TO_R8(p), 240) / 10;
-            int g_bin = min(COLOR_RGB565_TO_G8(p), 240) / 10;
-            int b_bin = min(COLOR_RGB565_TO_B8(p), 240) / 10;
-
-            histogram[75 * component_id + 0 + r_bin]++;
-            histogram[75 * component_id + 25 + g_bin]++;
-            histogram[75 * component_id + 50 + b_bin]++;
-            counts[component_id]++;
         }
     }
 
-    // Normalize histograms
-    for (i = 0; i < num_ccs; i++) {
-        float max_val = 0;
-        for (j = 0; j < 75; j++) {
-            max_val = max(max_val, histogram[75 * i + j]);
+    fb_free(); // edges
+    fb_free(); // buckets
+    fb_free(); // threshold
+
+    // Number the regions and compute their bounds and histograms.
+    int n = f.sets;
+    uint16_t *ids = fb_alloc(n_pixels * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    ss_region_t *regions = fb_alloc(n * sizeof(ss_region_t), FB_ALLOC_NO_HINT);
+    uint16_t *hists = fb_alloc(n * SS_HIST_SIZE * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint32_t *raw = fb_alloc0(n * SS_HIST_SIZE * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+    // Roots are numbered in place of their size which is no longer needed.
+    for (int i = 0, id = 0; i < n_pixels; i++) {
+        if (f.parent[i] == i) {
+            f.size[i] = id;
+            regions[id].x0 = w;
+            regions[id].y0 = h;
+            regions[id].x1 = 0;
+            regions[id].y1 = 0;
+            regions[id].count = 0;
+            id += 1;
         }
-        for (j = 0; j < 75; j++) {
-            histogram[75 * i + j] /= max_val;
+    }
+
+    for (int y = 0, i = 0; y < h; y++) {
+        uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&img, y);
+
+        for (int x = 0; x < w; x++, i++) {
+            int id = ids[i] = f.size[ss_find(&f, i)];
+            ss_region_t *r = regions + id;
+            r->x0 = IM_MIN(r->x0, x);
+            r->y0 = IM_MIN(r->y0, y);
+            r->x1 = IM_MAX(r->x1, x);
+            r->y1 = IM_MAX(r->y1, y);
+            r->count += 1;
+
+            uint16_t p = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
+            uint32_t *hist = raw + (id * SS_HIST_SIZE);
+            hist[(COLOR_RGB565_TO_R8(p) * SS_HIST_BINS) >> 8] += 1;
+            hist[SS_HIST_BINS + ((COLOR_RGB565_TO_G8(p) * SS_HIST_BINS) >> 8)] += 1;
+            hist[(SS_HIST_BINS * 2) + ((COLOR_RGB565_TO_B8(p) * SS_HIST_BINS) >> 8)] += 1;
         }
     }
 
-    uint8_t *adjacency = (uint8_t *) fb_alloc0(num_ccs * num_ccs * sizeof(uint8_t), FB_ALLOC_NO_HINT);
-    for (int y = 0; y < height - 1; ++y) {
-        for (int x = 0; x < width - 1; ++x) {
-            int component1 = universe_get_id(u, y * width + x);
-            int component2 = universe_get_id(u, y * width + x + 1);
-            int component3 = universe_get_id(u, y * width + x + width);
+    for (int i = 0; i < (n * SS_HIST_SIZE); i++) {
+        hists[i] = (((uint64_t) raw[i]) * SS_HIST_ONE) / regions[i / SS_HIST_SIZE].count;
+    }
 
-            if (component1 != component2) {
-                adjacency[component1 * num_ccs + component2] = 1;
-                adjacency[component2 * num_ccs + component1] = 1;
-            }
+    fb_free(); // raw
 
-            if (component1 != component3) {
-                adjacency[component1 * num_ccs + component3] = 1;
-                adjacency[component3 * num_ccs + component1] = 1;
-            }
+    // Collect the pairs of neighboring regions. The region boundary keys are sorted to drop the
+    // duplicates so memory grows with the boundary length instead of with n^2.
+    uint32_t n_keys = ss_neighbors(ids, w, h, NULL);
+    int *keys = fb_alloc(IM_MAX(n_keys, 1U) * sizeof(int), FB_ALLOC_NO_HINT);
+    ss_neighbors(ids, w, h, keys);
+    fsort(keys, n_keys);
+
+    uint32_t n_pairs = 0;
+    for (uint32_t i = 0; i < n_keys; i++) {
+        if ((!n_pairs) || (keys[i] != keys[n_pairs - 1])) {
+            keys[n_pairs++] = keys[i];
         }
     }
 
-    int size = height * width;
-    float *similarity_table = (float *) fb_alloc(num_ccs * num_ccs * sizeof(float), FB_ALLOC_NO_HINT);
-    for (i = 0; i < num_ccs; ++i) {
-        for (j = i + 1; j < num_ccs; ++j) {
-            float color_sim = a1 * color_similarity(histogram + 75 * i, histogram + 75 * j);
-            float size_sim = a2 * size_similarity(counts[i], counts[j], size);
-            float fill_sim = a3 * fill_similarity(regions + i, regions + j, counts[i], counts[j], size);
-            float similarity = color_sim + size_sim + fill_sim;
-            similarity_table[i * num_ccs + j] = similarity;
-            similarity_table[j * num_ccs + i] = similarity;
-        }
+    ss_pair_t *pairs = fb_alloc(IM_MAX(n_pairs, 1U) * sizeof(ss_pair_t), FB_ALLOC_NO_HINT);
+    uint16_t *stamp = fb_alloc0(n * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    float size = n_pixels;
+
+    for (uint32_t i = 0; i < n_pairs; i++) {
+        pairs[i].a = keys[i] >> 16;
+        pairs[i].b = keys[i] & 0xFFFF;
+        pairs[i].similarity = ss_similarity(regions, hists, pairs[i].a, pairs[i].b, size, a1, a2, a3);
     }
 
-    int remaining = num_ccs;
-    while (remaining > 1) {
-        int best_i = -1;
-        int best_j = -1;
-        float best_similarity = 0;
-        for (i = 0; i < num_ccs; i++) {
-            for (j = i + 1; j < num_ccs; j++) {
-                if (adjacency[i * num_ccs + j] == 0) {
-                    continue;
-                }
-                float similarity = similarity_table[i * num_ccs + j];
-                if (similarity > best_similarity) {
-                    best_similarity = similarity;
-                    best_i = i;
-                    best_j = j;
-                }
+    for (int i = 0; i < n; i++) {
+        ss_add_proposal(proposals, regions + i, scale, src);
+    }
+
+    // Merge the most similar pair of neighbors into its first region until no pairs are left.
+    for (int merge = 1; n_pairs; merge++) {
+        uint32_t best = 0;
+        for (uint32_t i = 1; i < n_pairs; i++) {
+            if (pairs[i].similarity > pairs[best].similarity) {
+                best = i;
             }
         }
 
-        if (best_i == -1) {
-            printf("failed to build tree\n");
-            break;
+        int a = pairs[best].a, b = pairs[best].b;
+        ss_region_t *ra = regions + a, *rb = regions + b;
+        uint16_t *ha = hists + (a * SS_HIST_SIZE), *hb = hists + (b * SS_HIST_SIZE);
+        uint32_t count = ra->count + rb->count;
+
+        for (int i = 0; i < SS_HIST_SIZE; i++) {
+            ha[i] = ((((uint64_t) ha[i]) * ra->count) + (((uint64_t) hb[i]) * rb->count) + (count / 2)) / count;
         }
 
-        // update regions, histograms, counts, adjacency, similarity
-        regions[best_i].x = min(regions[best_i].x, regions[best_j].x);
-        regions[best_i].y = min(regions[best_i].y, regions[best_j].y);
-        regions[best_i].w = max(regions[best_i].w, regions[best_j].w);
-        regions[best_i].h = max(regions[best_i].h, regions[best_j].h);
-
-        bool add = true;
-        for (i = 0; i < array_length(proposals); i++) {
-            rectangle_t *r = array_at(proposals, i);
-            if (regions[best_i].x == r->x && regions[best_i].y == r->y &&
-                regions[best_i].w == r->w && regions[best_i].h == r->h) {
-                add = false;
-                break;
+        ra->x0 = IM_MIN(ra->x0, rb->x0);
+        ra->y0 = IM_MIN(ra->y0, rb->y0);
+        ra->x1 = IM_MAX(ra->x1, rb->x1);
+        ra->y1 = IM_MAX(ra->y1, rb->y1);
+        ra->count = count;
+        ss_add_proposal(proposals, ra, scale, src);
+
+        // Move the pairs of b to a, dropping the merged pair and duplicates.
+        stamp[a] = merge;
+
+        for (uint32_t i = 0; i < n_pairs;) {
+            ss_pair_t *p = pairs + i;
+
+            if (p->a == b) {
+                p->a = a;
             }
-        }
-        if (add) {
-            array_push_back(proposals, rectangle_alloc(regions[best_i].x,
-                                                       regions[best_i].y, regions[best_i].w, regions[best_i].h));
-        }
 
+            if (p->b == b) {
+                p->b = a;
+            }
 
-        for (i = 0; i < 75; i++) {
-            histogram[75 * best_i + i] = (counts[best_i] * histogram[75 * best_i + i]
-                                          + counts[best_j] * histogram[75 * best_j + i]) / (counts[best_i] + counts[best_j]);
-        }
-        counts[best_i] += counts[best_j];
+            if ((p->a == a) || (p->b == a)) {
+                int other = (p->a == a) ? p->b : p->a;
 
-        for (i = 0; i < num_ccs; i++) {
-            adjacency[best_i * num_ccs + i] |= adjacency[best_j * num_ccs + i];
-            adjacency[i * num_ccs + best_i] |= adjacency[i * num_ccs + best_j];
-            adjacency[best_j * num_ccs + i] = adjacency[i * num_ccs + best_j] = 0;
-        }
-        adjacency[best_i * num_ccs + best_i] = 0;
+                if (stamp[other] == merge) {
+                    *p = pairs[--n_pairs];
+                    continue;
+                }
 
-        for (i = 0; i < num_ccs; i++) {
-            if (adjacency[best_i * num_ccs + i] == 0) {
-                continue;
+                stamp[other] = merge;
+                p->similarity = ss_similarity(regions, hists, a, other, size, a1, a2, a3);
             }
-            float color_sim = a1 * color_similarity(histogram + 75 * i, histogram + 75 * best_i);
-            float size_sim = a2 * size_similarity(counts[i], counts[best_i], size);
-            float fill_sim = a3 * fill_similarity(regions + i, regions + best_i, counts[i], counts[best_i], size);
-            float similarity = color_sim + size_sim + fill_sim;
-            similarity_table[i * num_ccs + best_i] = similarity;
-            similarity_table[best_i * num_ccs + i] = similarity;
-        }
-        --remaining;
-    }
 
-    for (int i = 0; i < array_length(proposals); i++) {
-        rectangle_t *r = array_at(proposals, i);
-        r->w = r->w - r->x;
-        r->h = r->h - r->y;
-        if ((src->w * src->h) > (80 * 60)) {
-            r->x *= 4;
-            r->y *= 4;
-            r->w *= 4;
-            r->h *= 4;
+            i += 1;
         }
     }
+
     fb_alloc_free_till_mark();
     return proposals;
 }
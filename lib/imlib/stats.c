@@ -195,13 +195,58 @@ void imlib_get_similarity(image_t *img,
 }
 #endif // IMLIB_ENABLE_GET_SIMILARITY
 
+// Maps every value in [min, max] to its histogram bin so that pixels don't need to be scaled.
+static uint32_t *imlib_histogram_bin_lut(int min, int max, int bins) {
+    uint32_t *lut = fb_alloc((max - min + 1) * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    float mult = (bins - 1) / ((float) (max - min));
+
+    for (int i = 0, ii = max - min; i <= ii; i++) {
+        lut[i] = fast_roundf(i * mult);
+    }
+
+    return lut;
+}
+
+// Pixels are counted into interleaved sub-histograms so that neighboring pixels falling into the
+// same bin don't wait on each other's increments. The sub-histograms are summed at the end.
+#define IMLIB_HISTOGRAM_SPLIT (4)
+
+static void imlib_histogram_merge(uint32_t *out, uint32_t *bins, int bin_count, int n) {
+    for (int i = 0; i < bin_count; i++) {
+        uint32_t sum = 0;
+
+        for (int j = 0; j < n; j++) {
+            sum += bins[(j * bin_count) + i];
+        }
+
+        out[i] = sum;
+    }
+}
+
+static inline int imlib_histogram_rgb565_diff(int pixel, int other_pixel) {
+    int r = abs(COLOR_RGB565_TO_R5(pixel) - COLOR_RGB565_TO_R5(other_pixel));
+    int g = abs(COLOR_RGB565_TO_G6(pixel) - COLOR_RGB565_TO_G6(other_pixel));
+    int b = abs(COLOR_RGB565_TO_B5(pixel) - COLOR_RGB565_TO_B5(other_pixel));
+    return COLOR_R5_G6_B5_TO_RGB565(r, g, b);
+}
+
 void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_t *thresholds, bool invert, image_t *other) {
+    #if defined(IMLIB_ENABLE_THRESHOLD_BITMAPS)
+    imlib_thresholds_compile(thresholds, ptr, roi->w * roi->h);
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) != 0) {
+        // Unpin the bitmaps if anything below raises.
+        imlib_thresholds_release(thresholds);
+        nlr_jump(nlr.ret_val);
+    }
+    #endif
+
     switch (ptr->pixfmt) {
         case PIXFORMAT_BINARY: {
             memset(out->LBins, 0, out->LBinCount * sizeof(uint32_t));
 
             int pixel_count = roi->w * roi->h;
-            float mult = (out->LBinCount - 1) / ((float) (COLOR_BINARY_MAX - COLOR_BINARY_MIN));
+            uint32_t *lut = imlib_histogram_bin_lut(COLOR_BINARY_MIN, COLOR_BINARY_MAX, out->LBinCount);
 
             if ((!thresholds) || (!list_size(thresholds))) {
                 // Fast histogram code when no color thresholds list...
@@ -210,7 +255,7 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
                         uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
                         for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
                             int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x);
-                            ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_BINARY_MIN) * mult)]++;
+                            ((uint32_t *) out->LBins)[lut[pixel - COLOR_BINARY_MIN]]++;
                         }
                     }
                 } else {
@@ -219,7 +264,7 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
                                  *other_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(other, y);
                         for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
                             int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x) ^ IMAGE_GET_BINARY_PIXEL_FAST(other_row_ptr, x);
-                            ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_BINARY_MIN) * mult)]++;
+                            ((uint32_t *) out->LBins)[lut[pixel - COLOR_BINARY_MIN]]++;
                         }
                     }
                 }
@@ -234,7 +279,7 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
                             for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
                                 int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x);
                                 if (COLOR_THRESHOLD_BINARY(pixel, lnk_data, invert)) {
-                                    ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_BINARY_MIN) * mult)]++;
+                                    ((uint32_t *) out->LBins)[lut[pixel - COLOR_BINARY_MIN]]++;
                                     pixel_count++;
                                 }
                             }
@@ -251,7 +296,7 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
                                 int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x) ^ IMAGE_GET_BINARY_PIXEL_FAST(other_row_ptr,
                                                                                                                   x);
                                 if (COLOR_THRESHOLD_BINARY(pixel, lnk_data, invert)) {
-                                    ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_BINARY_MIN) * mult)]++;
+                                    ((uint32_t *) out->LBins)[lut[pixel - COLOR_BINARY_MIN]]++;
                                     pixel_count++;
                                 }
                             }
@@ -266,36 +311,55 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
                 out->LBins[i] = ((uint32_t *) out->LBins)[i] * pixels;
             }
 
+            fb_free(); // lut
             break;
         }
         case PIXFORMAT_GRAYSCALE: {
             memset(out->LBins, 0, out->LBinCount * sizeof(uint32_t));
 
             int pixel_count = roi->w * roi->h;
-            float mult = (out->LBinCount - 1) / ((float) (COLOR_GRAYSCALE_MAX - COLOR_GRAYSCALE_MIN));
+            uint32_t *lut = imlib_histogram_bin_lut(COLOR_GRAYSCALE_MIN, COLOR_GRAYSCALE_MAX, out->LBinCount);
 
             if ((!thresholds) || (!list_size(thresholds))) {
                 // Fast histogram code when no color thresholds list...
-                if (!other) {
-                    for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y);
-                        for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                            int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                            ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_GRAYSCALE_MIN) * mult)]++;
+                uint32_t *bins = fb_alloc0(IMLIB_HISTOGRAM_SPLIT * out->LBinCount * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+                uint32_t *bins_0 = bins;
+                uint32_t *bins_1 = bins_0 + out->LBinCount;
+                uint32_t *bins_2 = bins_1 + out->LBinCount;
+                uint32_t *bins_3 = bins_2 + out->LBinCount;
+
+                for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
+                    uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y) + roi->x;
+                    uint8_t *other_row_ptr = other ? (IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(other, y) + roi->x) : NULL;
+                    int x = 0, xx = roi->w;
+
+                    if (!other) {
+                        for (; (x + 3) < xx; x += 4) {
+                            bins_0[lut[row_ptr[x + 0]]]++;
+                            bins_1[lut[row_ptr[x + 1]]]++;
+                            bins_2[lut[row_ptr[x + 2]]]++;
+                            bins_3[lut[row_ptr[x + 3]]]++;
                         }
-                    }
-                } else {
-                    for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y),
-                                *other_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(other, y);
-                        for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                            int pixel =
-                                abs(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x) - IMAGE_GET_GRAYSCALE_PIXEL_FAST(other_row_ptr,
-                                                                                                                x));
-                            ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_GRAYSCALE_MIN) * mult)]++;
+
+                        for (; x < xx; x++) {
+                            bins_0[lut[row_ptr[x]]]++;
+                        }
+                    } else {
+                        for (; (x + 3) < xx; x += 4) {
+                            bins_0[lut[abs(row_ptr[x + 0] - other_row_ptr[x + 0])]]++;
+                            bins_1[lut[abs(row_ptr[x + 1] - other_row_ptr[x + 1])]]++;
+                            bins_2[lut[abs(row_ptr[x + 2] - other_row_ptr[x + 2])]]++;
+                            bins_3[lut[abs(row_ptr[x + 3] - other_row_ptr[x + 3])]]++;
+                        }
+
+                        for (; x < xx; x++) {
+                            bins_0[lut[abs(row_ptr[x] - other_row_ptr[x])]]++;
                         }
                     }
                 }
+
+                imlib_histogram_merge((uint32_t *) out->LBins, bins, out->LBinCount, IMLIB_HISTOGRAM_SPLIT);
+                fb_free(); // bins
             } else {
                 // Reset pixel count.
                 pixel_count = 0;
@@ -308,7 +372,7 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
                             for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
                                 int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
                                 if (COLOR_THRESHOLD_GRAYSCALE(pixel, lnk_data, invert)) {
-                                    ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_GRAYSCALE_MIN) * mult)]++;
+                                    ((uint32_t *) out->LBins)[lut[pixel - COLOR_GRAYSCALE_MIN]]++;
                                     pixel_count++;
                                 }
                             }
@@ -327,7 +391,7 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
                                                                        x) - IMAGE_GET_GRAYSCALE_PIXEL_FAST(other_row_ptr,
                                                                                                            x));
                                 if (COLOR_THRESHOLD_GRAYSCALE(pixel, lnk_data, invert)) {
-                                    ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_GRAYSCALE_MIN) * mult)]++;
+                                    ((uint32_t *) out->LBins)[lut[pixel - COLOR_GRAYSCALE_MIN]]++;
                                     pixel_count++;
                                 }
                             }
@@ -342,6 +406,7 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
                 out->LBins[i] = ((uint32_t *) out->LBins)[i] * pixels;
             }
 
+            fb_free(); // lut
             break;
         }
         case PIXFORMAT_RGB565: {
@@ -350,39 +415,53 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
             memset(out->BBins, 0, out->BBinCount * sizeof(uint32_t));
 
             int pixel_count = roi->w * roi->h;
-            float l_mult = (out->LBinCount - 1) / ((float) (COLOR_L_MAX - COLOR_L_MIN));
-            float a_mult = (out->ABinCount - 1) / ((float) (COLOR_A_MAX - COLOR_A_MIN));
-            float b_mult = (out->BBinCount - 1) / ((float) (COLOR_B_MAX - COLOR_B_MIN));
+            uint32_t *l_lut = imlib_histogram_bin_lut(COLOR_L_MIN, COLOR_L_MAX, out->LBinCount);
+            uint32_t *a_lut = imlib_histogram_bin_lut(COLOR_A_MIN, COLOR_A_MAX, out->ABinCount);
+            uint32_t *b_lut = imlib_histogram_bin_lut(COLOR_B_MIN, COLOR_B_MAX, out->BBinCount);
 
             if ((!thresholds) || (!list_size(thresholds))) {
                 // Fast histogram code when no color thresholds list...
-                if (!other) {
-                    for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                        uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
-                        for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                            int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
-                            ((uint32_t *) out->LBins)[fast_roundf((COLOR_RGB565_TO_L(pixel) - COLOR_L_MIN) * l_mult)]++;
-                            ((uint32_t *) out->ABins)[fast_roundf((COLOR_RGB565_TO_A(pixel) - COLOR_A_MIN) * a_mult)]++;
-                            ((uint32_t *) out->BBins)[fast_roundf((COLOR_RGB565_TO_B(pixel) - COLOR_B_MIN) * b_mult)]++;
+                uint32_t *l_bins = fb_alloc0(2 * out->LBinCount * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+                uint32_t *a_bins = fb_alloc0(2 * out->ABinCount * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+                uint32_t *b_bins = fb_alloc0(2 * out->BBinCount * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+                uint32_t *l_bins_0 = l_bins, *l_bins_1 = l_bins + out->LBinCount;
+                uint32_t *a_bins_0 = a_bins, *a_bins_1 = a_bins + out->ABinCount;
+                uint32_t *b_bins_0 = b_bins, *b_bins_1 = b_bins + out->BBinCount;
+
+                for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
+                    uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y) + roi->x;
+                    uint16_t *other_row_ptr = other ? (IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(other, y) + roi->x) : NULL;
+
+                    for (int x = 0, xx = roi->w; x < xx; x += 2) {
+                        int pixel_0 = row_ptr[x];
+                        int pixel_1 = ((x + 1) < xx) ? row_ptr[x + 1] : -1;
+
+                        if (other) {
+                            pixel_0 = imlib_histogram_rgb565_diff(pixel_0, other_row_ptr[x]);
+
+                            if (pixel_1 >= 0) {
+                                pixel_1 = imlib_histogram_rgb565_diff(pixel_1, other_row_ptr[x + 1]);
+                            }
                         }
-                    }
-                } else {
-                    for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                        uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y),
-                                 *other_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(other, y);
-                        for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                            int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
-                            int other_pixel = IMAGE_GET_RGB565_PIXEL_FAST(other_row_ptr, x);
-                            int r = abs(COLOR_RGB565_TO_R5(pixel) - COLOR_RGB565_TO_R5(other_pixel));
-                            int g = abs(COLOR_RGB565_TO_G6(pixel) - COLOR_RGB565_TO_G6(other_pixel));
-                            int b = abs(COLOR_RGB565_TO_B5(pixel) - COLOR_RGB565_TO_B5(other_pixel));
-                            pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
-                            ((uint32_t *) out->LBins)[fast_roundf((COLOR_RGB565_TO_L(pixel) - COLOR_L_MIN) * l_mult)]++;
-                            ((uint32_t *) out->ABins)[fast_roundf((COLOR_RGB565_TO_A(pixel) - COLOR_A_MIN) * a_mult)]++;
-                            ((uint32_t *) out->BBins)[fast_roundf((COLOR_RGB565_TO_B(pixel) - COLOR_B_MIN) * b_mult)]++;
+
+                        l_bins_0[l_lut[COLOR_RGB565_TO_L(pixel_0) - COLOR_L_MIN]]++;
+                        a_bins_0[a_lut[COLOR_RGB565_TO_A(pixel_0) - COLOR_A_MIN]]++;
+                        b_bins_0[b_lut[COLOR_RGB565_TO_B(pixel_0) - COLOR_B_MIN]]++;
+
+                        if (pixel_1 >= 0) {
+                            l_bins_1[l_lut[COLOR_RGB565_TO_L(pixel_1) - COLOR_L_MIN]]++;
+                            a_bins_1[a_lut[COLOR_RGB565_TO_A(pixel_1) - COLOR_A_MIN]]++;
+                            b_bins_1[b_lut[COLOR_RGB565_TO_B(pixel_1) - COLOR_B_MIN]]++;
                         }
                     }
                 }
+
+                imlib_histogram_merge((uint32_t *) out->LBins, l_bins, out->LBinCount, 2);
+                imlib_histogram_merge((uint32_t *) out->ABins, a_bins, out->ABinCount, 2);
+                imlib_histogram_merge((uint32_t *) out->BBins, b_bins, out->BBinCount, 2);
+                fb_free(); // b_bins
+                fb_free(); // a_bins
+                fb_free(); // l_bins
             } else {
                 // Reset pixel count.
                 pixel_count = 0;
@@ -395,9 +474,9 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
                             for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
                                 int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
                                 if (COLOR_THRESHOLD_RGB565(pixel, lnk_data, invert)) {
-                                    ((uint32_t *) out->LBins)[fast_roundf((COLOR_RGB565_TO_L(pixel) - COLOR_L_MIN) * l_mult)]++;
-                                    ((uint32_t *) out->ABins)[fast_roundf((COLOR_RGB565_TO_A(pixel) - COLOR_A_MIN) * a_mult)]++;
-                                    ((uint32_t *) out->BBins)[fast_roundf((COLOR_RGB565_TO_B(pixel) - COLOR_B_MIN) * b_mult)]++;
+                                    ((uint32_t *) out->LBins)[l_lut[COLOR_RGB565_TO_L(pixel) - COLOR_L_MIN]]++;
+                                    ((uint32_t *) out->ABins)[a_lut[COLOR_RGB565_TO_A(pixel) - COLOR_A_MIN]]++;
+                                    ((uint32_t *) out->BBins)[b_lut[COLOR_RGB565_TO_B(pixel) - COLOR_B_MIN]]++;
                                     pixel_count++;
                                 }
                             }
@@ -418,9 +497,9 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
                                 int b = abs(COLOR_RGB565_TO_B5(pixel) - COLOR_RGB565_TO_B5(other_pixel));
                                 pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
                                 if (COLOR_THRESHOLD_RGB565(pixel, lnk_data, invert)) {
-                                    ((uint32_t *) out->LBins)[fast_roundf((COLOR_RGB565_TO_L(pixel) - COLOR_L_MIN) * l_mult)]++;
-                                    ((uint32_t *) out->ABins)[fast_roundf((COLOR_RGB565_TO_A(pixel) - COLOR_A_MIN) * a_mult)]++;
-                                    ((uint32_t *) out->BBins)[fast_roundf((COLOR_RGB565_TO_B(pixel) - COLOR_B_MIN) * b_mult)]++;
+                                    ((uint32_t *) out->LBins)[l_lut[COLOR_RGB565_TO_L(pixel) - COLOR_L_MIN]]++;
+                                    ((uint32_t *) out->ABins)[a_lut[COLOR_RGB565_TO_A(pixel) - COLOR_A_MIN]]++;
+                                    ((uint32_t *) out->BBins)[b_lut[COLOR_RGB565_TO_B(pixel) - COLOR_B_MIN]]++;
                                     pixel_count++;
                                 }
                             }
@@ -443,12 +522,20 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
                 out->BBins[i] = ((uint32_t *) out->BBins)[i] * pixels;
             }
 
+            fb_free(); // b_lut
+            fb_free(); // a_lut
+            fb_free(); // l_lut
             break;
         }
         default: {
             break;
         }
     }
+
+    #if defined(IMLIB_ENABLE_THRESHOLD_BITMAPS)
+    nlr_pop();
+    imlib_thresholds_release(thresholds);
+    #endif
 }
 
 void imlib_get_percentile(percentile_t *out, pixformat_t pixfmt, histogram_t *ptr, float percentile) {
@@ -884,6 +971,16 @@ bool imlib_get_regression(find_lines_list_lnk_data_t *out,
     bool result = false;
     memset(out, 0, sizeof(find_lines_list_lnk_data_t));
 
+    #if defined(IMLIB_ENABLE_THRESHOLD_BITMAPS)
+    imlib_thresholds_compile(thresholds, ptr, roi->w * roi->h);
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) != 0) {
+        // Unpin the bitmaps if anything below raises.
+        imlib_thresholds_release(thresholds);
+        nlr_jump(nlr.ret_val);
+    }
+    #endif
+
     if (!robust) {
         // Least Squares
         int blob_x1 = roi->x + roi->w - 1;
@@ -1202,5 +1299,184 @@ bool imlib_get_regression(find_lines_list_lnk_data_t *out,
         fb_free(); // x_histogram
     }
 
+    #if defined(IMLIB_ENABLE_THRESHOLD_BITMAPS)
+    nlr_pop();
+    imlib_thresholds_release(thresholds);
+    #endif
+
     return result;
 }
+
+// Channels are stored as unsigned bytes. LAB A/B are offset by 128.
+static int imlib_roi_stats_channel_offset(pixformat_t pixfmt, int channel) {
+    return ((pixfmt == PIXFORMAT_RGB565) && channel) ? -128 : 0;
+}
+
+static inline int imlib_roi_stats_get_value(image_t *img, int x, int y, int channel) {
+    switch (img->pixfmt) {
+        case PIXFORMAT_BINARY: {
+            return IMAGE_GET_BINARY_PIXEL(img, x, y);
+        }
+        case PIXFORMAT_GRAYSCALE: {
+            return IMAGE_GET_GRAYSCALE_PIXEL(img, x, y);
+        }
+        case PIXFORMAT_RGB565: {
+            int pixel = IMAGE_GET_RGB565_PIXEL(img, x, y);
+            int value = (channel == 0) ? COLOR_RGB565_TO_L(pixel) :
+                        ((channel == 1) ? COLOR_RGB565_TO_A(pixel) : COLOR_RGB565_TO_B(pixel));
+            return value - imlib_roi_stats_channel_offset(PIXFORMAT_RGB565, channel);
+        }
+        default: {
+            return 0;
+        }
+    }
+}
+
+void imlib_roi_stats_index_init(roi_stats_index_t *index, image_t *img) {
+    index->img = img;
+    index->channels = (img->pixfmt == PIXFORMAT_RGB565) ? 3 : 1;
+    index->blocks_w = img->w >> ROI_STATS_BLOCK_SHIFT;
+    index->blocks_h = img->h >> ROI_STATS_BLOCK_SHIFT;
+
+    int stride = index->blocks_w + 1;
+    size_t table_size = stride * (index->blocks_h + 1);
+    size_t blocks_size = index->blocks_w * index->blocks_h;
+
+    for (int c = 0; c < index->channels; c++) {
+        index->sum[c] = fb_alloc0(table_size * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+        index->sum_sq[c] = fb_alloc0(table_size * sizeof(uint64_t), FB_ALLOC_NO_HINT);
+        index->block_min[c] = fb_alloc(blocks_size, FB_ALLOC_NO_HINT);
+        index->block_max[c] = fb_alloc(blocks_size, FB_ALLOC_NO_HINT);
+    }
+
+    for (int c = 0; c < index->channels; c++) {
+        uint32_t *sum = index->sum[c];
+        uint64_t *sum_sq = index->sum_sq[c];
+
+        for (int by = 0; by < index->blocks_h; by++) {
+            for (int bx = 0; bx < index->blocks_w; bx++) {
+                uint32_t block_sum = 0, block_sum_sq = 0;
+                int min = UINT8_MAX, max = 0;
+
+                for (int y = by << ROI_STATS_BLOCK_SHIFT, yy = y + (1 << ROI_STATS_BLOCK_SHIFT); y < yy; y++) {
+                    for (int x = bx << ROI_STATS_BLOCK_SHIFT, xx = x + (1 << ROI_STATS_BLOCK_SHIFT); x < xx; x++) {
+                        int value = imlib_roi_stats_get_value(img, x, y, c);
+                        block_sum += value;
+                        block_sum_sq += value * value;
+                        min = IM_MIN(min, value);
+                        max = IM_MAX(max, value);
+                    }
+                }
+
+                index->block_min[c][(by * index->blocks_w) + bx] = min;
+                index->block_max[c][(by * index->blocks_w) + bx] = max;
+
+                int i = ((by + 1) * stride) + bx + 1;
+                sum[i] = block_sum + sum[i - 1] + sum[i - stride] - sum[i - stride - 1];
+                sum_sq[i] = block_sum_sq + sum_sq[i - 1] + sum_sq[i - stride] - sum_sq[i - stride - 1];
+            }
+        }
+    }
+}
+
+void imlib_roi_stats_index_free(roi_stats_index_t *index) {
+    for (int c = index->channels - 1; c >= 0; c--) {
+        fb_free(); // block_max
+        fb_free(); // block_min
+        fb_free(); // sum_sq
+        fb_free(); // sum
+    }
+}
+
+void imlib_roi_stats(roi_stats_index_t *index, rectangle_t *roi, statistics_t *out) {
+    memset(out, 0, sizeof(statistics_t));
+
+    int pixels = roi->w * roi->h;
+    int x_end = roi->x + roi->w, y_end = roi->y + roi->h;
+
+    // Blocks completely inside of the roi come from the tables, the pixels around them are read.
+    int bx_start = (roi->x + (1 << ROI_STATS_BLOCK_SHIFT) - 1) >> ROI_STATS_BLOCK_SHIFT;
+    int by_start = (roi->y + (1 << ROI_STATS_BLOCK_SHIFT) - 1) >> ROI_STATS_BLOCK_SHIFT;
+    int bx_end = x_end >> ROI_STATS_BLOCK_SHIFT, by_end = y_end >> ROI_STATS_BLOCK_SHIFT;
+
+    if ((bx_start >= bx_end) || (by_start >= by_end)) {
+        bx_start = bx_end = by_start = by_end = 0;
+    }
+
+    int inner_x = bx_start << ROI_STATS_BLOCK_SHIFT, inner_x_end = bx_end << ROI_STATS_BLOCK_SHIFT;
+    int inner_y = by_start << ROI_STATS_BLOCK_SHIFT, inner_y_end = by_end << ROI_STATS_BLOCK_SHIFT;
+    int stride = index->blocks_w + 1;
+
+    for (int c = 0; c < index->channels; c++) {
+        uint32_t sum = 0;
+        uint64_t sum_sq = 0;
+        int min = UINT8_MAX, max = 0;
+
+        if (bx_start < bx_end) {
+            uint32_t *s = index->sum[c];
+            uint64_t *s_sq = index->sum_sq[c];
+            int i0 = (by_start * stride) + bx_start, i1 = (by_start * stride) + bx_end;
+            int i2 = (by_end * stride) + bx_start, i3 = (by_end * stride) + bx_end;
+            sum = s[i3] - s[i2] - s[i1] + s[i0];
+            sum_sq = s_sq[i3] - s_sq[i2] - s_sq[i1] + s_sq[i0];
+
+            for (int by = by_start; by < by_end; by++) {
+                uint8_t *block_min = index->block_min[c] + (by * index->blocks_w);
+                uint8_t *block_max = index->block_max[c] + (by * index->blocks_w);
+
+                for (int bx = bx_start; bx < bx_end; bx++) {
+                    min = IM_MIN(min, block_min[bx]);
+                    max = IM_MAX(max, block_max[bx]);
+                }
+            }
+        }
+
+        for (int y = roi->y; y < y_end; y++) {
+            bool inner_row = (inner_y <= y) && (y < inner_y_end);
+
+            for (int x = roi->x; x < x_end; x++) {
+                if (inner_row && (x == inner_x)) {
+                    x = inner_x_end - 1;
+                    continue;
+                }
+
+                int value = imlib_roi_stats_get_value(index->img, x, y, c);
+                sum += value;
+                sum_sq += value * value;
+                min = IM_MIN(min, value);
+                max = IM_MAX(max, value);
+            }
+        }
+
+        float avg = sum / ((float) pixels);
+        float var = (sum_sq / ((float) pixels)) - (avg * avg);
+
+        int offset = imlib_roi_stats_channel_offset(index->img->pixfmt, c);
+        int mean = fast_floorf(avg) + offset;
+        int stdev = fast_floorf(fast_sqrtf(IM_MAX(var, 0.0f)));
+
+        switch (c) {
+            case 0: {
+                out->LMean = mean;
+                out->LSTDev = stdev;
+                out->LMin = min + offset;
+                out->LMax = max + offset;
+                break;
+            }
+            case 1: {
+                out->AMean = mean;
+                out->ASTDev = stdev;
+                out->AMin = min + offset;
+                out->AMax = max + offset;
+                break;
+            }
+            default: {
+                out->BMean = mean;
+                out->BSTDev = stdev;
+                out->BMin = min + offset;
+                out->BMax = max + offset;
+                break;
+            }
+        }
+    }
+}
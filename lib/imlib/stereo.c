@@ -27,226 +27,361 @@
 
 #ifdef IMLIB_ENABLE_STEREO_DISPARITY
 
-#define BLOCK_W       4
-#define BLOCK_H       4
-
-#define BLOCK_W_L     (((BLOCK_W) / 2) - 1)
-#define BLOCK_W_R     ((BLOCK_W) / 2)
-#define BLOCK_H_U     (((BLOCK_H) / 2) - 1)
-#define BLOCK_H_D     ((BLOCK_H) / 2)
-
-#define BLOCK_SIZE    ((BLOCK_W) *(BLOCK_H))
-
-static inline void shift(uint8_t *data, image_t *img, int x, int y) {
-#if defined(ARM_MATH_DSP) && (!(BLOCK_SIZE % 4))
-    int x_2 = x + BLOCK_W_R;
-    uint32_t *data_32 = (uint32_t *) data;
-
-    #if BLOCK_SIZE == 4
-    uint32_t temp = __UXTB16_RORn(*data_32, 8);
-    temp |= IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y) << 8;
-    temp |= IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 1) << 24;
-    *data_32 = temp;
-    #elif BLOCK_SIZE == 16
-    data_32[0] = (data_32[0] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y - 1) << 24);
-    data_32[1] = (data_32[1] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y) << 24);
-    data_32[2] = (data_32[2] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 1) << 24);
-    data_32[3] = (data_32[3] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 2) << 24);
-    #elif BLOCK_SIZE == 64
-    data_32[0] = (data_32[0] >> 8) | (data_32[1] << 24);
-    data_32[1] = (data_32[1] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y - 3) << 24);
-    data_32[2] = (data_32[2] >> 8) | (data_32[3] << 24);
-    data_32[3] = (data_32[3] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y - 2) << 24);
-    data_32[4] = (data_32[4] >> 8) | (data_32[5] << 24);
-    data_32[5] = (data_32[5] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y - 1) << 24);
-    data_32[6] = (data_32[6] >> 8) | (data_32[7] << 24);
-    data_32[7] = (data_32[7] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y) << 24);
-    data_32[8] = (data_32[8] >> 8) | (data_32[9] << 24);
-    data_32[9] = (data_32[9] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 1) << 24);
-    data_32[10] = (data_32[10] >> 8) | (data_32[11] << 24);
-    data_32[11] = (data_32[11] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 2) << 24);
-    data_32[12] = (data_32[12] >> 8) | (data_32[13] << 24);
-    data_32[13] = (data_32[13] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 3) << 24);
-    data_32[14] = (data_32[14] >> 8) | (data_32[15] << 24);
-    data_32[15] = (data_32[15] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 4) << 24);
-    #else
-    for (int j = -BLOCK_H_U, last = (BLOCK_W / sizeof(uint32_t)) - 1; j <= BLOCK_H_D; j++, data_32 += last + 1) {
-        for (int i = 0; i < last; i++) {
-            data_32[i] = (data_32[i] >> 8) | (data_32[i + 1] << 24);
+// Disparities are matched on the left image and searched for to the right in the right image.
+// Matching is done in three stages over a sliding window of rows so that memory stays at
+// O(width * disparities):
+//
+// 1. Each pixel is turned into a feature (the pixel value for SAD or a 5x5 census bit string).
+// 2. Pixel costs (absolute difference or hamming distance) are summed over a block_w x block_h
+//    window by keeping per column sums that are updated as rows enter and leave the window.
+// 3. Optionally, the block costs are smoothed along a few scanline directions (SGM) before the
+//    best disparity is picked and optionally refined to 1/16th of a pixel with a parabola fit.
+//
+// The disparity map replaces the right image.
+
+#define STEREO_CENSUS_R         (2)
+#define STEREO_SUBPIXEL_SHIFT   (4)
+#define STEREO_SUBPIXEL_ONE     (1 << STEREO_SUBPIXEL_SHIFT)
+
+typedef struct stereo_path {
+    int dx; // -1, 0 or 1 column offset of the previous row on the path.
+    uint16_t *cost; // w * d aggregated path costs of the previous row.
+    uint16_t *min; // w minimum path costs of the previous row.
+} stereo_path_t;
+
+static void stereo_feature_row(image_t *img, int x_offset, int w, int y, bool census, uint32_t *features) {
+    int y_c = IM_CLAMP(y, 0, img->h - 1);
+
+    if (!census) {
+        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y_c) + x_offset;
+
+        for (int x = 0; x < w; x++) {
+            features[x] = row_ptr[x];
         }
-        data_32[last] = (data_32[last] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + j) << 24);
+
+        return;
     }
-    #endif
-#else
-    for (int i = 0, j = -BLOCK_H_U; j <= BLOCK_H_D; j++) {
-        int y_p = y + j;
-        uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y_p);
-        for (int k = -BLOCK_W_L; k <= BLOCK_W_R; k++) {
-            int x_p = x + k;
-            data[i++] = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x_p);
+
+    uint8_t *row_ptrs[(STEREO_CENSUS_R * 2) + 1];
+
+    for (int j = -STEREO_CENSUS_R; j <= STEREO_CENSUS_R; j++) {
+        int y_p = IM_CLAMP(y_c + j, 0, img->h - 1);
+        row_ptrs[j + STEREO_CENSUS_R] = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y_p) + x_offset;
+    }
+
+    for (int x = 0; x < w; x++) {
+        int center = row_ptrs[STEREO_CENSUS_R][x];
+        uint32_t bits = 0;
+
+        for (int j = 0; j < ((STEREO_CENSUS_R * 2) + 1); j++) {
+            uint8_t *row_ptr = row_ptrs[j];
+
+            for (int i = -STEREO_CENSUS_R; i <= STEREO_CENSUS_R; i++) {
+                if ((j != STEREO_CENSUS_R) || i) {
+                    int x_p = IM_CLAMP(x + i, 0, w - 1);
+                    bits = (bits << 1) | (row_ptr[x_p] < center);
+                }
+            }
         }
+
+        features[x] = bits;
     }
-#endif
 }
 
-static inline uint32_t sad(uint8_t *data_l, uint8_t *data_r) {
-    uint32_t diff = 0;
-
-#if defined(ARM_MATH_DSP) && (!(BLOCK_SIZE % 4))
-    uint32_t *data_l_32 = (uint32_t *) data_l;
-    uint32_t *data_r_32 = (uint32_t *) data_r;
-
-    #if BLOCK_SIZE == 4
-    diff = __USADA8(*data_l_32, *data_r_32, diff);
-    #elif BLOCK_SIZE == 16
-    diff = __USADA8(data_l_32[0], data_r_32[0], diff);
-    diff = __USADA8(data_l_32[1], data_r_32[1], diff);
-    diff = __USADA8(data_l_32[2], data_r_32[2], diff);
-    diff = __USADA8(data_l_32[3], data_r_32[3], diff);
-    #elif BLOCK_SIZE == 64
-    diff = __USADA8(data_l_32[0],  data_r_32[0],  diff);
-    diff = __USADA8(data_l_32[1],  data_r_32[1],  diff);
-    diff = __USADA8(data_l_32[2],  data_r_32[2],  diff);
-    diff = __USADA8(data_l_32[3],  data_r_32[3],  diff);
-    diff = __USADA8(data_l_32[4],  data_r_32[4],  diff);
-    diff = __USADA8(data_l_32[5],  data_r_32[5],  diff);
-    diff = __USADA8(data_l_32[6],  data_r_32[6],  diff);
-    diff = __USADA8(data_l_32[7],  data_r_32[7],  diff);
-    diff = __USADA8(data_l_32[8],  data_r_32[8],  diff);
-    diff = __USADA8(data_l_32[9],  data_r_32[9],  diff);
-    diff = __USADA8(data_l_32[10], data_r_32[10], diff);
-    diff = __USADA8(data_l_32[11], data_r_32[11], diff);
-    diff = __USADA8(data_l_32[12], data_r_32[12], diff);
-    diff = __USADA8(data_l_32[13], data_r_32[13], diff);
-    diff = __USADA8(data_l_32[14], data_r_32[14], diff);
-    diff = __USADA8(data_l_32[15], data_r_32[15], diff);
-    #else
-    for (int i = 0; i < (BLOCK_SIZE / sizeof(uint32_t)); i++) {
-        diff = __USADA8(data_l_32[i], data_r_32[i], diff);
+// Adds (or removes) the pixel costs of one row to the per column cost sums.
+static void stereo_cost_row(uint32_t *features_l, uint32_t *features_r, int w, int d,
+                            bool census, bool add, uint16_t *col_cost) {
+    for (int x = 0; x < w; x++, col_cost += d) {
+        uint32_t feature_l = features_l[x];
+
+        for (int i = 0, ii = IM_MIN(d, w - x); i < ii; i++) {
+            uint32_t feature_r = features_r[x + i];
+            int cost = census ? __builtin_popcount(feature_l ^ feature_r) : abs(((int) feature_l) - ((int) feature_r));
+            col_cost[i] = add ? (col_cost[i] + cost) : (col_cost[i] - cost);
+        }
+
+        // Disparities past the right edge match the last column.
+        if ((w - x) < d) {
+            uint32_t feature_r = features_r[w - 1];
+            int cost = census ? __builtin_popcount(feature_l ^ feature_r) : abs(((int) feature_l) - ((int) feature_r));
+
+            for (int i = w - x; i < d; i++) {
+                col_cost[i] = add ? (col_cost[i] + cost) : (col_cost[i] - cost);
+            }
+        }
     }
-    #endif
-#else
-    for (int i = 0; i < BLOCK_SIZE; i++) {
-        int d = data_l[i] - data_r[i];
-        diff += abs(d);
+}
+
+// Sums the column costs horizontally over the block width.
+static void stereo_block_row(uint16_t *col_cost, int w, int d, int block_l, int block_r, uint16_t *block_cost) {
+    memset(block_cost, 0, d * sizeof(uint16_t));
+
+    for (int i = -block_l; i <= block_r; i++) {
+        uint16_t *col = col_cost + (IM_CLAMP(i, 0, w - 1) * d);
+
+        for (int k = 0; k < d; k++) {
+            block_cost[k] += col[k];
+        }
     }
-#endif
 
-    return diff;
+    for (int x = 1; x < w; x++) {
+        uint16_t *prev = block_cost + ((x - 1) * d);
+        uint16_t *next = block_cost + (x * d);
+        uint16_t *col_add = col_cost + (IM_MIN(x + block_r, w - 1) * d);
+        uint16_t *col_sub = col_cost + (IM_MAX(x - block_l - 1, 0) * d);
+
+        for (int k = 0; k < d; k++) {
+            next[k] = prev[k] + col_add[k] - col_sub[k];
+        }
+    }
 }
 
-void imlib_stereo_disparity(image_t *img, bool reversed, int max_disparity, int threshold) {
-    int width_2 = img->w / 2, width_2_m_1 = width_2 - 1;
-    int height_1 = img->h, height_1_m_1 = height_1 - 1;
+// Computes the path costs of one pixel from the path costs of the previous pixel on the path.
+// The path costs may be updated in place (path == prev).
+static uint16_t stereo_sgm_step(uint16_t *cost, uint16_t *prev, uint16_t prev_min, uint16_t *path,
+                                int d, int p1, int p2) {
+    uint32_t path_min = UINT16_MAX;
 
-    int xl_offset = 0;
-    int xr_offset = width_2;
+    if (!prev) {
+        for (int k = 0; k < d; k++) {
+            path[k] = cost[k];
+            path_min = IM_MIN(path_min, cost[k]);
+        }
+
+        return path_min;
+    }
 
-    if (reversed) {
-        xl_offset = xr_offset;
-        xr_offset = 0;
+    uint32_t jump = prev_min + p2;
+    uint32_t left = UINT32_MAX - p1;
+
+    for (int k = 0; k < d; k++) {
+        uint32_t center = prev[k];
+        uint32_t right = ((k + 1) < d) ? prev[k + 1] : (UINT32_MAX - p1);
+        uint32_t v = IM_MIN(IM_MIN(center, jump), IM_MIN(left, right) + p1);
+        uint32_t p = cost[k] + v - prev_min;
+        left = center;
+        path[k] = p;
+        path_min = IM_MIN(path_min, p);
     }
 
-    float disparity_scale = COLOR_GRAYSCALE_MAX / max_disparity;
+    return path_min;
+}
 
-    image_t buf;
-    buf.w = width_2;
-    buf.h = BLOCK_H_D;
-    buf.pixfmt = img->pixfmt;
+void imlib_stereo_disparity(image_t *img, bool reversed, int max_disparity, int threshold,
+                            int block_w, int block_h, bool census, int paths, int p1, int p2, bool subpixel) {
+    if (img->pixfmt != PIXFORMAT_GRAYSCALE) {
+        return;
+    }
 
-    switch (img->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            break;
+    int w = img->w / 2;
+    int h = img->h;
+    int d = max_disparity + 1;
+    int xl_offset = reversed ? w : 0;
+    int xr_offset = reversed ? 0 : w;
+
+    int block_l = (block_w - 1) / 2, block_r = block_w / 2;
+    int block_u = (block_h - 1) / 2, block_d = block_h / 2;
+    int census_r = census ? STEREO_CENSUS_R : 0;
+
+    // Path costs are at most the block cost plus p2 so block costs are saturated to fit in 16-bits.
+    uint32_t cost_max = UINT16_MAX - p2;
+
+    // Features for the rows in the block window. The row entering the window replaces the row leaving it.
+    int feature_rows = block_h;
+    uint32_t *features_l = fb_alloc(feature_rows * w * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint32_t *features_r = fb_alloc(feature_rows * w * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint16_t *col_cost = fb_alloc0(w * d * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint16_t *block_cost = fb_alloc(w * d * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+
+    // Output rows are held until the census window no longer reads the right image rows they replace.
+    int out_rows = census_r + 1;
+    uint8_t *out = fb_alloc(out_rows * w, FB_ALLOC_NO_HINT);
+
+    uint32_t *sum_cost = NULL;
+    uint16_t *path_cost[2] = { NULL, NULL };
+    stereo_path_t vpaths[3];
+    int vpaths_n = (paths >= 5) ? 3 : ((paths >= 3) ? 1 : 0);
+
+    if (paths) {
+        sum_cost = fb_alloc(w * d * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+        path_cost[0] = fb_alloc(d * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+        path_cost[1] = fb_alloc(d * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+
+        for (int i = 0; i < vpaths_n; i++) {
+            vpaths[i].dx = (i == 0) ? 0 : ((i == 1) ? -1 : 1);
+            vpaths[i].cost = fb_alloc(w * d * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+            vpaths[i].min = fb_alloc(w * sizeof(uint16_t), FB_ALLOC_NO_HINT);
         }
-        case PIXFORMAT_GRAYSCALE: {
-            buf.data = fb_alloc(IMAGE_GRAYSCALE_LINE_LEN_BYTES(&buf) * BLOCK_H_D, FB_ALLOC_NO_HINT);
-            uint8_t *data_l = fb_alloc(BLOCK_SIZE, FB_ALLOC_NO_HINT);
-            uint8_t *data_r = fb_alloc(BLOCK_SIZE, FB_ALLOC_NO_HINT);
-
-            for (int y = 0, yy = height_1 - BLOCK_H_D; y < height_1; y++) {
-                for (int xl = 0, xx = width_2 - BLOCK_W_R; xl < width_2; xl++) {
-                    if ((xl >= BLOCK_W_L) && (xl < xx) && (y >= BLOCK_H_U) && (y < yy)) {
-                        // fast way
-                        shift(data_l, img, xl + xl_offset, y);
-                    } else {
-                        // slow way
-                        for (int i = 0, j = -BLOCK_H_U; j <= BLOCK_H_D; j++) {
-                            int y_p = y + j;
-                            int y = IM_CLAMP(y_p, 0, height_1_m_1);
-                            uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                            for (int k = -BLOCK_W_L; k <= BLOCK_W_R; k++) {
-                                int x_p = xl + k;
-                                int x = IM_CLAMP(x_p, 0, width_2_m_1) + xl_offset;
-                                data_l[i++] = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x);
-                            }
-                        }
-                    }
+    }
+
+    // Fill the window with the rows above the first row (edge pixels are repeated).
+    for (int y = -block_u; y < block_d; y++) {
+        int slot = (y + feature_rows) % feature_rows;
+        stereo_feature_row(img, xl_offset, w, y, census, features_l + (slot * w));
+        stereo_feature_row(img, xr_offset, w, y, census, features_r + (slot * w));
+        stereo_cost_row(features_l + (slot * w), features_r + (slot * w), w, d, census, true, col_cost);
+    }
 
-                    uint32_t min_diff = UINT32_MAX;
-                    int min_disparity = 0;
-
-                    for (int xr = xl, disparity = 0;
-                         (xr < width_2) && (disparity <= max_disparity); xr++, disparity++) {
-                        if (disparity && (xr >= BLOCK_W_L) && (xr < xx) && (y >= BLOCK_H_U) && (y < yy)) {
-                            // fast way
-                            shift(data_r, img, xr + xr_offset, y);
-                        } else {
-                            // slow way
-                            for (int i = 0, j = -BLOCK_H_U; j <= BLOCK_H_D; j++) {
-                                int y_p = y + j;
-                                int y = IM_CLAMP(y_p, 0, height_1_m_1);
-                                uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                                for (int k = -BLOCK_W_L; k <= BLOCK_W_R; k++) {
-                                    int x_p = xr + k;
-                                    int x = IM_CLAMP(x_p, 0, width_2_m_1) + xr_offset;
-                                    data_r[i++] = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x);
-                                }
-                            }
-                        }
-
-                        // Record the closest matching block in the scan line.
-                        uint32_t diff = sad(data_l, data_r);
-                        if (diff < min_diff) {
-                            min_diff = diff;
-                            min_disparity = disparity;
-                        }
-
-                        if (min_diff <= threshold) {
-                            break;
-                        }
+    for (int y = 0; y < h; y++) {
+        int slot = (y + block_d) % feature_rows;
+
+        // The slot of the row entering the window holds the row leaving the window.
+        if (y) {
+            stereo_cost_row(features_l + (slot * w), features_r + (slot * w), w, d, census, false, col_cost);
+        }
+
+        stereo_feature_row(img, xl_offset, w, y + block_d, census, features_l + (slot * w));
+        stereo_feature_row(img, xr_offset, w, y + block_d, census, features_r + (slot * w));
+        stereo_cost_row(features_l + (slot * w), features_r + (slot * w), w, d, census, true, col_cost);
+        stereo_block_row(col_cost, w, d, block_l, block_r, block_cost);
+
+        if (paths) {
+            for (int x = 0; x < w; x++) {
+                uint16_t *cost = block_cost + (x * d);
+
+                for (int k = 0; k < d; k++) {
+                    cost[k] = IM_MIN(cost[k], cost_max);
+                }
+
+                // Disparities past the right edge are invalid.
+                for (int k = IM_MAX(w - x, 0); k < d; k++) {
+                    cost[k] = cost_max;
+                }
+            }
+
+            // Left to right.
+            uint16_t prev_min = 0;
+
+            for (int x = 0; x < w; x++) {
+                uint16_t *prev = path_cost[(x + 1) % 2], *path = path_cost[x % 2];
+                uint32_t *sum = sum_cost + (x * d);
+                prev_min = stereo_sgm_step(block_cost + (x * d), x ? prev : NULL, prev_min, path, d, p1, p2);
+
+                for (int k = 0; k < d; k++) {
+                    sum[k] = path[k];
+                }
+            }
+
+            // Right to left.
+            for (int x = w - 1; x >= 0; x--) {
+                uint16_t *prev = path_cost[(x + 1) % 2], *path = path_cost[x % 2];
+                uint32_t *sum = sum_cost + (x * d);
+                prev_min = stereo_sgm_step(block_cost + (x * d), (x < (w - 1)) ? prev : NULL, prev_min, path, d, p1, p2);
+
+                for (int k = 0; k < d; k++) {
+                    sum[k] += path[k];
+                }
+            }
+
+            // Top to bottom, top-left to bottom-right and top-right to bottom-left. Each path is updated
+            // in place walking away from the column it reads from so the previous row is still there.
+            for (int i = 0; i < vpaths_n; i++) {
+                stereo_path_t *vpath = vpaths + i;
+
+                for (int n = 0; n < w; n++) {
+                    int x = (vpath->dx < 0) ? (w - 1 - n) : n;
+                    int x_p = x + vpath->dx;
+                    bool first = (!y) || (x_p < 0) || (x_p >= w);
+                    uint16_t *path = vpath->cost + (x * d);
+                    uint32_t *sum = sum_cost + (x * d);
+
+                    vpath->min[x] = stereo_sgm_step(block_cost + (x * d),
+                                                    first ? NULL : (vpath->cost + (x_p * d)),
+                                                    first ? 0 : vpath->min[x_p], path, d, p1, p2);
+
+                    for (int k = 0; k < d; k++) {
+                        sum[k] += path[k];
                     }
+                }
+            }
+        }
+
+        uint8_t *out_row_ptr = out + ((y % out_rows) * w);
 
-                    uint8_t *buf_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % BLOCK_H_D));
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, xl, fast_floorf(min_disparity * disparity_scale));
+        for (int x = 0; x < w; x++) {
+            int k_max = IM_MIN(d, w - x);
+            int best = 0;
+
+            if (paths) {
+                uint32_t *cost = sum_cost + (x * d);
+                uint32_t best_cost = UINT32_MAX;
+
+                for (int k = 0; k < k_max; k++) {
+                    if (cost[k] < best_cost) {
+                        best_cost = cost[k];
+                        best = k;
+                    }
                 }
+            } else {
+                uint16_t *cost = block_cost + (x * d);
+                uint32_t best_cost = UINT32_MAX;
 
-                if (y >= BLOCK_H_U) {
-                    // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, (y - BLOCK_H_U)) + xr_offset,
-                           IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, ((y - BLOCK_H_U) % BLOCK_H_D)),
-                           IMAGE_GRAYSCALE_LINE_LEN_BYTES(&buf));
+                for (int k = 0; k < k_max; k++) {
+                    if (cost[k] < best_cost) {
+                        best_cost = cost[k];
+                        best = k;
+                    }
+
+                    // Take the first good enough match like a scanline search would.
+                    if ((!census) && (best_cost <= threshold)) {
+                        break;
+                    }
                 }
             }
 
-            // Copy any remaining lines from the buffer image...
-            for (int y = IM_MAX(height_1 - BLOCK_H_U, 0); y < height_1; y++) {
-                memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y) + xr_offset,
-                       IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % BLOCK_H_D)),
-                       IMAGE_GRAYSCALE_LINE_LEN_BYTES(&buf));
+            int disparity = best << STEREO_SUBPIXEL_SHIFT;
+
+            if (subpixel && (best > 0) && (best < (k_max - 1))) {
+                int c_m, c_0, c_p;
+
+                if (paths) {
+                    uint32_t *cost = sum_cost + (x * d) + best;
+                    c_m = cost[-1], c_0 = cost[0], c_p = cost[1];
+                } else {
+                    uint16_t *cost = block_cost + (x * d) + best;
+                    c_m = cost[-1], c_0 = cost[0], c_p = cost[1];
+                }
+
+                int denom = c_m + c_p - (2 * c_0);
+
+                if (denom > 0) {
+                    int offset = ((c_m - c_p) * (STEREO_SUBPIXEL_ONE / 2)) / denom;
+                    disparity += IM_CLAMP(offset, -(STEREO_SUBPIXEL_ONE / 2), (STEREO_SUBPIXEL_ONE / 2));
+                }
             }
 
-            fb_free(); // data_r
-            fb_free(); // data_l
-            fb_free(); // buf
-            break;
+            int value = (disparity * COLOR_GRAYSCALE_MAX) / (max_disparity << STEREO_SUBPIXEL_SHIFT);
+            out_row_ptr[x] = IM_CLAMP(value, COLOR_GRAYSCALE_MIN, COLOR_GRAYSCALE_MAX);
         }
-        case PIXFORMAT_RGB565: {
-            break;
+
+        // Rows above y - census_r aren't read anymore.
+        if (y >= census_r) {
+            int y_out = y - census_r;
+            memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y_out) + xr_offset, out + ((y_out % out_rows) * w), w);
         }
-        default: {
-            break;
+    }
+
+    // Copy any remaining lines from the output buffer...
+    for (int y = IM_MAX(h - census_r, 0); y < h; y++) {
+        memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y) + xr_offset, out + ((y % out_rows) * w), w);
+    }
+
+    if (paths) {
+        for (int i = 0; i < vpaths_n; i++) {
+            fb_free(); // vpaths[i].min
+            fb_free(); // vpaths[i].cost
         }
+
+        fb_free(); // path_cost[1]
+        fb_free(); // path_cost[0]
+        fb_free(); // sum_cost
     }
+
+    fb_free(); // out
+    fb_free(); // block_cost
+    fb_free(); // col_cost
+    fb_free(); // features_r
+    fb_free(); // features_l
 }
 
 #endif // IMLIB_ENABLE_STEREO_DISPARITY
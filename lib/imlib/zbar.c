@@ -1053,6 +1053,7 @@ struct zbar_image_s {
 
     unsigned seq;               /* page/frame sequence number */
     zbar_symbol_set_t *syms;    /* decoded result set */
+    imlib_budget_t *budget;     /* optional scan time budget */
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -2148,6 +2149,11 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
     zbar_scanner_t *scn = iscn->scn;
     unsigned w, h, cx1, cy1;
     int density;
+    /* scan lines are numbered horizontal first, then vertical. lines before
+     * the budget resume point were scanned by the previous call and at least
+     * one new line is scanned before the budget is checked. */
+    unsigned line = 0, resume = img->budget ? img->budget->resume : 0;
+    int stop = 0;
 
     /* timestamp image
      * FIXME prefer video timestamp
@@ -2208,36 +2214,50 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
 
         while(y < cy1) {
             int cx0 = img->crop_x;;
-            zprintf(128, "img_x+: %04d,%04d @%p\n", x, y, p);
-            svg_path_start("vedge", 1. / 32, 0, y + 0.5);
-            iscn->dx = iscn->du = 1;
-            iscn->umin = cx0;
-            while(x < cx1) {
-                uint8_t d = *p;
-                movedelta(1, 0);
-                zbar_scan_y(scn, d);
+            if(line++ < resume) {
+                movedelta((int) cx1 - x, 0);
+            }
+            else if(line > resume + 1 && (stop = imlib_budget_expired(img->budget)))
+                break;
+            else {
+                zprintf(128, "img_x+: %04d,%04d @%p\n", x, y, p);
+                svg_path_start("vedge", 1. / 32, 0, y + 0.5);
+                iscn->dx = iscn->du = 1;
+                iscn->umin = cx0;
+                while(x < cx1) {
+                    uint8_t d = *p;
+                    movedelta(1, 0);
+                    zbar_scan_y(scn, d);
+                }
+                ASSERT_POS;
+                quiet_border(iscn);
+                svg_path_end();
             }
-            ASSERT_POS;
-            quiet_border(iscn);
-            svg_path_end();
 
             movedelta(-1, density);
             iscn->v = y;
             if(y >= cy1)
                 break;
 
-            zprintf(128, "img_x-: %04d,%04d @%p\n", x, y, p);
-            svg_path_start("vedge", -1. / 32, w, y + 0.5);
-            iscn->dx = iscn->du = -1;
-            iscn->umin = cx1;
-            while(x >= cx0) {
-                uint8_t d = *p;
-                movedelta(-1, 0);
-                zbar_scan_y(scn, d);
+            if(line++ < resume) {
+                movedelta(cx0 - 1 - x, 0);
+            }
+            else if(line > resume + 1 && (stop = imlib_budget_expired(img->budget)))
+                break;
+            else {
+                zprintf(128, "img_x-: %04d,%04d @%p\n", x, y, p);
+                svg_path_start("vedge", -1. / 32, w, y + 0.5);
+                iscn->dx = iscn->du = -1;
+                iscn->umin = cx1;
+                while(x >= cx0) {
+                    uint8_t d = *p;
+                    movedelta(-1, 0);
+                    zbar_scan_y(scn, d);
+                }
+                ASSERT_POS;
+                quiet_border(iscn);
+                svg_path_end();
             }
-            ASSERT_POS;
-            quiet_border(iscn);
-            svg_path_end();
 
             movedelta(1, density);
             iscn->v = y;
@@ -2247,7 +2267,7 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
     iscn->dx = 0;
 
     density = CFG(iscn, ZBAR_CFG_X_DENSITY);
-    if(density > 0) {
+    if(density > 0 && !stop) {
         const uint8_t *p = data;
         int x = 0, y = 0;
 
@@ -2262,36 +2282,50 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
 
         while(x < cx1) {
             int cy0 = img->crop_y;
-            zprintf(128, "img_y+: %04d,%04d @%p\n", x, y, p);
-            svg_path_start("vedge", 1. / 32, 0, x + 0.5);
-            iscn->dy = iscn->du = 1;
-            iscn->umin = cy0;
-            while(y < cy1) {
-                uint8_t d = *p;
-                movedelta(0, 1);
-                zbar_scan_y(scn, d);
+            if(line++ < resume) {
+                movedelta(0, (int) cy1 - y);
+            }
+            else if(line > resume + 1 && (stop = imlib_budget_expired(img->budget)))
+                break;
+            else {
+                zprintf(128, "img_y+: %04d,%04d @%p\n", x, y, p);
+                svg_path_start("vedge", 1. / 32, 0, x + 0.5);
+                iscn->dy = iscn->du = 1;
+                iscn->umin = cy0;
+                while(y < cy1) {
+                    uint8_t d = *p;
+                    movedelta(0, 1);
+                    zbar_scan_y(scn, d);
+                }
+                ASSERT_POS;
+                quiet_border(iscn);
+                svg_path_end();
             }
-            ASSERT_POS;
-            quiet_border(iscn);
-            svg_path_end();
 
             movedelta(density, -1);
             iscn->v = x;
             if(x >= cx1)
                 break;
 
-            zprintf(128, "img_y-: %04d,%04d @%p\n", x, y, p);
-            svg_path_start("vedge", -1. / 32, h, x + 0.5);
-            iscn->dy = iscn->du = -1;
-            iscn->umin = cy1;
-            while(y >= cy0) {
-                uint8_t d = *p;
-                movedelta(0, -1);
-                zbar_scan_y(scn, d);
+            if(line++ < resume) {
+                movedelta(0, cy0 - 1 - y);
+            }
+            else if(line > resume + 1 && (stop = imlib_budget_expired(img->budget)))
+                break;
+            else {
+                zprintf(128, "img_y-: %04d,%04d @%p\n", x, y, p);
+                svg_path_start("vedge", -1. / 32, h, x + 0.5);
+                iscn->dy = iscn->du = -1;
+                iscn->umin = cy1;
+                while(y >= cy0) {
+                    uint8_t d = *p;
+                    movedelta(0, -1);
+                    zbar_scan_y(scn, d);
+                }
+                ASSERT_POS;
+                quiet_border(iscn);
+                svg_path_end();
             }
-            ASSERT_POS;
-            quiet_border(iscn);
-            svg_path_end();
 
             movedelta(density, 1);
             iscn->v = x;
@@ -2301,6 +2335,9 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
     iscn->dy = 0;
     iscn->img = NULL;
 
+    if(img->budget)
+        img->budget->resume = stop ? line - 1 : 0;
+
 #ifdef ENABLE_QRCODE
     _zbar_qr_decode(iscn->qr, iscn, img);
 #endif
@@ -8723,7 +8760,7 @@ void zbar_scanner_get_state (const zbar_scanner_t *scn,
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void imlib_find_barcodes(list_t *out, image_t *ptr, rectangle_t *roi)
+void imlib_find_barcodes(list_t *out, image_t *ptr, rectangle_t *roi, imlib_budget_t *budget)
 {
     uint8_t *grayscale_image = (ptr->pixfmt == PIXFORMAT_GRAYSCALE) ? ptr->data : fb_alloc(roi->w * roi->h, FB_ALLOC_NO_HINT);
 
@@ -8754,6 +8791,7 @@ void imlib_find_barcodes(list_t *out, image_t *ptr, rectangle_t *roi)
     image.userdata = 0;
     image.seq = 0;
     image.syms = 0;
+    image.budget = budget;
 
     list_init(out, sizeof(find_barcodes_list_lnk_data_t));
 
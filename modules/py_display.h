@@ -72,6 +72,12 @@ typedef struct _py_display_obj_t {
     omv_spi_t spi_bus;
     bool spi_tx_running;
     uint32_t spi_baudrate;
+    bool partial_refresh;
+    uint32_t band_lines;
+    bool row_hashes_valid;
+    uint32_t *row_hashes;
+    rectangle_t bounds;
+    rectangle_t framebuffer_bounds[FRAMEBUFFER_COUNT];
     #endif
     bool triple_buffer;
     uint32_t framebuffer_tail;
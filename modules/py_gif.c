@@ -46,6 +46,7 @@ typedef struct py_gif_obj {
     bool color;
     bool loop;
     FIL fp;
+    gif_state_t state;
 } py_gif_obj_t;
 
 static void py_gif_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
@@ -103,25 +104,26 @@ static mp_obj_t py_gif_add_frame(size_t n_args, const mp_obj_t *pos_args, mp_map
         mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Image format is not supported"));
     }
 
-    gif_add_frame(&self->fp, image, args[ARG_delay].u_int);
+    gif_add_frame(&self->fp, &self->state, image, args[ARG_delay].u_int);
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_KW(py_gif_add_frame_obj, 2, py_gif_add_frame);
 
 static mp_obj_t py_gif_close(mp_obj_t self_in) {
     py_gif_obj_t *self = MP_OBJ_TO_PTR(self_in);
-    gif_close(&self->fp);
+    gif_close(&self->fp, &self->state);
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_1(py_gif_close_obj, py_gif_close);
 
 static mp_obj_t py_gif_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
-    enum { ARG_width, ARG_height, ARG_color, ARG_loop };
+    enum { ARG_width, ARG_height, ARG_color, ARG_loop, ARG_delta };
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_width, MP_ARG_INT | MP_ARG_KW_ONLY,  {.u_int = -1 } },
         { MP_QSTR_height, MP_ARG_INT | MP_ARG_KW_ONLY,  {.u_int = -1 } },
         { MP_QSTR_color, MP_ARG_INT | MP_ARG_KW_ONLY,  {.u_int = -1 } },
         { MP_QSTR_loop, MP_ARG_INT | MP_ARG_KW_ONLY,  {.u_bool = true } },
+        { MP_QSTR_delta, MP_ARG_BOOL | MP_ARG_KW_ONLY,  {.u_bool = true } },
     };
 
     // Parse args.
@@ -137,8 +139,8 @@ static mp_obj_t py_gif_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t *k
     gif->color = (args[ARG_color].u_int == -1) ? (framebuffer_get_depth(fb) >= 2) : args[ARG_color].u_bool;
     gif->loop = args[ARG_loop].u_bool;
 
-    file_open(&gif->fp, path, false, FA_WRITE | FA_CREATE_ALWAYS);
-    gif_open(&gif->fp, gif->width, gif->height, gif->color, gif->loop);
+    file_open(&gif->fp, path, false, FA_WRITE | FA_CREATE_ALWAYS | FILE_WRITE_BEHIND | FILE_HEAP_OWNER);
+    gif_open(&gif->fp, &gif->state, gif->width, gif->height, gif->color, gif->loop, args[ARG_delta].u_bool);
     return gif;
 }
 static MP_DEFINE_CONST_FUN_OBJ_KW(py_gif_open_obj, 1, py_gif_open);
@@ -165,6 +165,133 @@ static MP_DEFINE_CONST_OBJ_TYPE(
     MP_TYPE_FLAG_NONE,
     print, py_lbp_print
     );
+
+// LBP descriptors stored back to back so a query can be matched against all of them in one call.
+typedef struct _py_lbp_gallery_obj_t {
+    mp_obj_base_t base;
+    size_t count;
+    size_t alloc;
+    uint8_t *descs;
+} py_lbp_gallery_obj_t;
+
+static void py_lbp_gallery_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    py_lbp_gallery_obj_t *self = self_in;
+    mp_printf(print, "{\"count\":%d}", self->count);
+}
+
+static mp_obj_t py_lbp_gallery_unary_op(mp_unary_op_t op, mp_obj_t self_in) {
+    py_lbp_gallery_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    switch (op) {
+        case MP_UNARY_OP_LEN:
+            return MP_OBJ_NEW_SMALL_INT(self->count);
+
+        default:
+            return MP_OBJ_NULL; // op not supported
+    }
+}
+
+static void py_lbp_gallery_reserve(py_lbp_gallery_obj_t *self, size_t count) {
+    if (count > self->alloc) {
+        self->descs = m_renew(uint8_t, self->descs, self->alloc * LBP_DESC_SIZE, count * LBP_DESC_SIZE);
+        self->alloc = count;
+    }
+}
+
+// Adds an lbp_desc object or a descriptor file saved with image.save_descriptor().
+static void py_lbp_gallery_add(py_lbp_gallery_obj_t *self, mp_obj_t desc_obj) {
+    if (self->count == self->alloc) {
+        py_lbp_gallery_reserve(self, IM_MAX(self->alloc + (self->alloc / 2), 4U));
+    }
+
+    uint8_t *desc = self->descs + (self->count * LBP_DESC_SIZE);
+
+    if (mp_obj_is_str(desc_obj)) {
+        #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+        FIL fp;
+        FRESULT res = FR_OK;
+        uint32_t desc_type;
+
+        file_open(&fp, mp_obj_str_get_str(desc_obj), false, FA_READ | FA_OPEN_EXISTING);
+        file_read(&fp, &desc_type, sizeof(desc_type));
+
+        if (desc_type == DESC_LBP) {
+            res = imlib_lbp_desc_read(&fp, desc);
+        }
+
+        file_close(&fp);
+
+        if (res != FR_OK) {
+            mp_raise_msg(&mp_type_OSError, (mp_rom_error_text_t) file_strerror(res));
+        }
+
+        if (desc_type != DESC_LBP) {
+            mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Descriptor type is not supported"));
+        }
+        #else
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Image I/O is not supported"));
+        #endif
+    } else {
+        PY_ASSERT_TYPE(desc_obj, &py_lbp_type);
+        memcpy(desc, ((py_lbp_obj_t *) desc_obj)->hist, LBP_DESC_SIZE);
+    }
+
+    self->count += 1;
+}
+
+static mp_obj_t py_lbp_gallery_append(mp_obj_t self_in, mp_obj_t desc_obj) {
+    py_lbp_gallery_add(MP_OBJ_TO_PTR(self_in), desc_obj);
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(py_lbp_gallery_append_obj, py_lbp_gallery_append);
+
+static mp_obj_t py_lbp_gallery_match(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    py_lbp_gallery_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    PY_ASSERT_TYPE(args[1], &py_lbp_type);
+    py_lbp_obj_t *lbp = MP_OBJ_TO_PTR(args[1]);
+    int k = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_k), 1);
+
+    if (k < 1) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("k must be > 0!"));
+    }
+
+    k = IM_MIN(k, (int) self->count);
+    mp_obj_t match_list = mp_obj_new_list(0, NULL);
+
+    if (k) {
+        fb_alloc_mark();
+        lbp_match_t *matches = fb_alloc(k * sizeof(lbp_match_t), FB_ALLOC_NO_HINT);
+        int n = imlib_lbp_desc_knn(lbp->hist, self->descs, self->count, k, matches);
+
+        for (int i = 0; i < n; i++) {
+            mp_obj_t match_obj[2] = {
+                mp_obj_new_int(matches[i].index),
+                mp_obj_new_int(matches[i].distance)
+            };
+            mp_obj_list_append(match_list, mp_obj_new_tuple(2, match_obj));
+        }
+
+        fb_alloc_free_till_mark();
+    }
+
+    return match_list;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(py_lbp_gallery_match_obj, 2, py_lbp_gallery_match);
+
+static const mp_rom_map_elem_t py_lbp_gallery_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_append), MP_ROM_PTR(&py_lbp_gallery_append_obj) },
+    { MP_ROM_QSTR(MP_QSTR_match),  MP_ROM_PTR(&py_lbp_gallery_match_obj) }
+};
+
+static MP_DEFINE_CONST_DICT(py_lbp_gallery_locals_dict, py_lbp_gallery_locals_dict_table);
+
+static MP_DEFINE_CONST_OBJ_TYPE(
+    py_lbp_gallery_type,
+    MP_QSTR_LBPGallery,
+    MP_TYPE_FLAG_NONE,
+    print, py_lbp_gallery_print,
+    unary_op, py_lbp_gallery_unary_op,
+    locals_dict, &py_lbp_gallery_locals_dict
+    );
 #endif // IMLIB_ENABLE_FIND_LBP
 
 // Keypoints Match Object /////////////////////////////////////////////////////
@@ -987,7 +1114,7 @@ static mp_obj_t py_image_to(pixformat_t pixfmt, mp_rom_obj_t default_color_palet
                             size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     enum {
         ARG_x_scale, ARG_y_scale, ARG_roi, ARG_channel, ARG_alpha, ARG_color_palette, ARG_alpha_palette,
-        ARG_hint, ARG_copy, ARG_copy_to_fb, ARG_quality, ARG_subsampling
+        ARG_hint, ARG_copy, ARG_copy_to_fb, ARG_quality, ARG_subsampling, ARG_level
     };
     const mp_arg_t allowed_args[] = {
         { MP_QSTR_x_scale, MP_ARG_OBJ | MP_ARG_KW_ONLY, {.u_rom_obj = MP_ROM_NONE} },
@@ -1002,6 +1129,7 @@ static mp_obj_t py_image_to(pixformat_t pixfmt, mp_rom_obj_t default_color_palet
         { MP_QSTR_copy_to_fb, MP_ARG_BOOL | MP_ARG_KW_ONLY, {.u_bool = false} },
         { MP_QSTR_quality, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = 90} },
         { MP_QSTR_subsampling, MP_ARG_INT | MP_ARG_KW_ONLY,  {.u_int = JPEG_SUBSAMPLING_AUTO} },
+        { MP_QSTR_level, MP_ARG_INT | MP_ARG_KW_ONLY,  {.u_int = PNG_LEVEL_DEFAULT} },
     };
 
     // Parse args.
@@ -1023,6 +1151,10 @@ static mp_obj_t py_image_to(pixformat_t pixfmt, mp_rom_obj_t default_color_palet
         mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Quality ranges between 0 and 100"));
     }
 
+    if (args[ARG_level].u_int < PNG_LEVEL_STORE || args[ARG_level].u_int > PNG_LEVEL_FULL) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid PNG level"));
+    }
+
     float x_scale = 1.0f;
     float y_scale = 1.0f;
     py_helper_arg_to_scale(args[ARG_x_scale].u_obj, args[ARG_y_scale].u_obj, &x_scale, &y_scale);
@@ -1119,7 +1251,7 @@ static mp_obj_t py_image_to(pixformat_t pixfmt, mp_rom_obj_t default_color_palet
 
             if (((dst_img.pixfmt == PIXFORMAT_JPEG) &&
                  jpeg_compress(&temp, &dst_img_tmp, args[ARG_quality].u_int, false, args[ARG_subsampling].u_int))
-                || ((dst_img.pixfmt == PIXFORMAT_PNG) && png_compress(&temp, &dst_img_tmp))) {
+                || ((dst_img.pixfmt == PIXFORMAT_PNG) && png_compress(&temp, &dst_img_tmp, args[ARG_level].u_int))) {
                 mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Compression Failed!"));
             }
         } else {
@@ -1242,8 +1374,11 @@ static mp_obj_t py_image_save(size_t n_args, const mp_obj_t *args, mp_map_t *kw_
     int arg_q = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_quality), 50);
     PY_ASSERT_TRUE_MSG((1 <= arg_q) && (arg_q <= 100), "Error: 1 <= quality <= 100!");
 
+    int arg_level = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_level), PNG_LEVEL_DEFAULT);
+    PY_ASSERT_TRUE_MSG((PNG_LEVEL_STORE <= arg_level) && (arg_level <= PNG_LEVEL_FULL), "Invalid PNG level!");
+
     fb_alloc_mark();
-    imlib_save_image(arg_img, path, &roi, arg_q);
+    imlib_save_image(arg_img, path, &roi, arg_q, arg_level);
     fb_alloc_free_till_mark();
     return args[0];
 }
@@ -1578,15 +1713,9 @@ static mp_obj_t py_image_mask_rectangle(size_t n_args, const mp_obj_t *args, mp_
     }
 
     fb_alloc_mark();
-    image_t temp;
-    temp.w = arg_img->w;
-    temp.h = arg_img->h;
-    temp.pixfmt = PIXFORMAT_BINARY;
-    temp.data = fb_alloc0(image_size(&temp), FB_ALLOC_NO_HINT);
-
-    imlib_draw_rectangle(&temp, arg_rx, arg_ry, arg_rw, arg_rh, -1, 0, true);
-    imlib_zero(arg_img, &temp, true);
-
+    mask_rle_t rle;
+    imlib_mask_rle_from_rectangle(&rle, arg_img->w, arg_img->h, arg_rx, arg_ry, arg_rw, arg_rh);
+    imlib_zero_rle(arg_img, &rle, true);
     fb_alloc_free_till_mark();
     return args[0];
 }
@@ -1611,15 +1740,9 @@ static mp_obj_t py_image_mask_circle(size_t n_args, const mp_obj_t *args, mp_map
     }
 
     fb_alloc_mark();
-    image_t temp;
-    temp.w = arg_img->w;
-    temp.h = arg_img->h;
-    temp.pixfmt = PIXFORMAT_BINARY;
-    temp.data = fb_alloc0(image_size(&temp), FB_ALLOC_NO_HINT);
-
-    imlib_draw_circle(&temp, arg_cx, arg_cy, arg_cr, -1, 0, true);
-    imlib_zero(arg_img, &temp, true);
-
+    mask_rle_t rle;
+    imlib_mask_rle_from_circle(&rle, arg_img->w, arg_img->h, arg_cx, arg_cy, arg_cr);
+    imlib_zero_rle(arg_img, &rle, true);
     fb_alloc_free_till_mark();
     return args[0];
 }
@@ -1650,15 +1773,9 @@ static mp_obj_t py_image_mask_ellipse(size_t n_args, const mp_obj_t *args, mp_ma
     }
 
     fb_alloc_mark();
-    image_t temp;
-    temp.w = arg_img->w;
-    temp.h = arg_img->h;
-    temp.pixfmt = PIXFORMAT_BINARY;
-    temp.data = fb_alloc0(image_size(&temp), FB_ALLOC_NO_HINT);
-
-    imlib_draw_ellipse(&temp, arg_cx, arg_cy, arg_rx, arg_ry, arg_r, -1, 0, true);
-    imlib_zero(arg_img, &temp, true);
-
+    mask_rle_t rle;
+    imlib_mask_rle_from_ellipse(&rle, arg_img->w, arg_img->h, arg_cx, arg_cy, arg_rx, arg_ry, arg_r);
+    imlib_zero_rle(arg_img, &rle, true);
     fb_alloc_free_till_mark();
     return args[0];
 }
@@ -1668,10 +1785,23 @@ static MP_DEFINE_CONST_FUN_OBJ_KW(py_image_mask_ellipse_obj, 1, py_image_mask_el
 static mp_obj_t py_image_flood_fill(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
     image_t *arg_img = py_helper_arg_to_image(args[0], ARG_IMAGE_MUTABLE);
 
-    const mp_obj_t *arg_vec;
-    uint offset = py_helper_consume_array(n_args, args, 1, 2, &arg_vec);
-    int arg_x_off = mp_obj_get_int(arg_vec[0]);
-    int arg_y_off = mp_obj_get_int(arg_vec[1]);
+    // Either a single (x, y) seed or a list of (x, y) seeds filled in one pass.
+    size_t arg_seeds_len = 1;
+    mp_obj_t *arg_seeds = NULL;
+    const mp_obj_t *arg_vec = NULL;
+    uint offset;
+
+    if (MP_OBJ_IS_TYPE(args[1], &mp_type_list)) {
+        mp_obj_get_array(args[1], &arg_seeds_len, &arg_seeds);
+    }
+
+    if (arg_seeds && arg_seeds_len && (!mp_obj_is_integer(arg_seeds[0]))) {
+        offset = 2;
+    } else {
+        arg_seeds = NULL;
+        arg_seeds_len = 1;
+        offset = py_helper_consume_array(n_args, args, 1, 2, &arg_vec);
+    }
 
     float arg_seed_threshold =
         py_helper_keyword_float(n_args, args, offset + 0, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_seed_threshold), 0.05);
@@ -1691,7 +1821,21 @@ static mp_obj_t py_image_flood_fill(size_t n_args, const mp_obj_t *args, mp_map_
         py_helper_keyword_to_image(n_args, args, offset + 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_mask), NULL);
 
     fb_alloc_mark();
-    imlib_flood_fill(arg_img, arg_x_off, arg_y_off,
+    point_t *seeds = fb_alloc(arg_seeds_len * sizeof(point_t), FB_ALLOC_NO_HINT);
+
+    for (size_t i = 0; i < arg_seeds_len; i++) {
+        if (arg_seeds) {
+            mp_obj_t *arg_seed;
+            mp_obj_get_array_fixed_n(arg_seeds[i], 2, &arg_seed);
+            seeds[i].x = mp_obj_get_int(arg_seed[0]);
+            seeds[i].y = mp_obj_get_int(arg_seed[1]);
+        } else {
+            seeds[i].x = mp_obj_get_int(arg_vec[0]);
+            seeds[i].y = mp_obj_get_int(arg_vec[1]);
+        }
+    }
+
+    imlib_flood_fill(arg_img, seeds, arg_seeds_len,
                      arg_seed_threshold, arg_floating_threshold,
                      arg_c, arg_invert, clear_background, arg_msk);
     fb_alloc_free_till_mark();
@@ -1790,6 +1934,18 @@ static mp_obj_t py_image_line_op(size_t n_args, const mp_obj_t *pos_args, mp_map
         callback = imlib_mask_line_op;
     }
 
+    // Images with the same geometry and no transforms skip the draw image pipeline.
+    if (callback && (other != &temp)
+        && (other->w == image->w) && (other->h == image->h) && (other->pixfmt == image->pixfmt)
+        && (args[ARG_x].u_int == 0) && (args[ARG_y].u_int == 0) && (x_scale == 1.0f) && (y_scale == 1.0f)
+        && (roi.x == 0) && (roi.y == 0) && (roi.w == other->w) && (roi.h == other->h)
+        && (args[ARG_channel].u_int == -1) && (args[ARG_alpha].u_int == 255)
+        && (!color_palette) && (!alpha_palette) && (!args[ARG_hint].u_int)) {
+        imlib_draw_image_rows(image, other, callback, mask);
+        fb_alloc_free_till_mark();
+        return pos_args[0];
+    }
+
     void *dst_row_override = NULL;
     if (callback) {
         dst_row_override = fb_alloc0(image_line_size(image), FB_ALLOC_CACHE_ALIGN);
@@ -3697,6 +3853,150 @@ static mp_obj_t py_image_get_statistics(size_t n_args, const mp_obj_t *args, mp_
 }
 static MP_DEFINE_CONST_FUN_OBJ_KW(py_image_get_statistics_obj, 1, py_image_get_statistics);
 
+static mp_obj_t py_image_roi_stats(mp_obj_t img_obj, mp_obj_t rois_obj) {
+    image_t *arg_img = py_helper_arg_to_image(img_obj, ARG_IMAGE_UNCOMPRESSED);
+
+    if ((arg_img->pixfmt != PIXFORMAT_BINARY) &&
+        (arg_img->pixfmt != PIXFORMAT_GRAYSCALE) &&
+        (arg_img->pixfmt != PIXFORMAT_RGB565)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Only binary, grayscale and RGB565 images are supported!"));
+    }
+
+    size_t rois_len;
+    mp_obj_t *rois;
+    mp_obj_get_array(rois_obj, &rois_len, &rois);
+
+    // Validate all the rois before building the index.
+    rectangle_t bounds = { 0, 0, arg_img->w, arg_img->h };
+
+    for (size_t i = 0; i < rois_len; i++) {
+        mp_obj_t *roi;
+        mp_obj_get_array_fixed_n(rois[i], 4, &roi);
+        rectangle_t r = {
+            mp_obj_get_int(roi[0]), mp_obj_get_int(roi[1]), mp_obj_get_int(roi[2]), mp_obj_get_int(roi[3])
+        };
+
+        if ((r.w < 1) || (r.h < 1) || (!rectangle_overlap(&r, &bounds))) {
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("ROI does not overlap on the image!"));
+        }
+    }
+
+    mp_obj_list_t *out = MP_OBJ_TO_PTR(mp_obj_new_list(rois_len, NULL));
+
+    fb_alloc_mark();
+    roi_stats_index_t index;
+    imlib_roi_stats_index_init(&index, arg_img);
+
+    for (size_t i = 0; i < rois_len; i++) {
+        mp_obj_t *roi;
+        mp_obj_get_array_fixed_n(rois[i], 4, &roi);
+        rectangle_t r = {
+            mp_obj_get_int(roi[0]), mp_obj_get_int(roi[1]), mp_obj_get_int(roi[2]), mp_obj_get_int(roi[3])
+        };
+        rectangle_intersected(&r, &bounds);
+
+        statistics_t stats;
+        imlib_roi_stats(&index, &r, &stats);
+
+        if (arg_img->pixfmt == PIXFORMAT_RGB565) {
+            mp_obj_t tuple[12] = {
+                mp_obj_new_int(stats.LMean), mp_obj_new_int(stats.LSTDev),
+                mp_obj_new_int(stats.LMin), mp_obj_new_int(stats.LMax),
+                mp_obj_new_int(stats.AMean), mp_obj_new_int(stats.ASTDev),
+                mp_obj_new_int(stats.AMin), mp_obj_new_int(stats.AMax),
+                mp_obj_new_int(stats.BMean), mp_obj_new_int(stats.BSTDev),
+                mp_obj_new_int(stats.BMin), mp_obj_new_int(stats.BMax)
+            };
+            out->items[i] = mp_obj_new_tuple(12, tuple);
+        } else {
+            mp_obj_t tuple[4] = {
+                mp_obj_new_int(stats.LMean), mp_obj_new_int(stats.LSTDev),
+                mp_obj_new_int(stats.LMin), mp_obj_new_int(stats.LMax)
+            };
+            out->items[i] = mp_obj_new_tuple(4, tuple);
+        }
+    }
+
+    imlib_roi_stats_index_free(&index);
+    fb_alloc_free_till_mark();
+
+    return MP_OBJ_FROM_PTR(out);
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(py_image_roi_stats_obj, py_image_roi_stats);
+
+static mp_obj_t py_image_dominant_colors(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    image_t *arg_img = py_helper_arg_to_image(args[0], ARG_IMAGE_UNCOMPRESSED);
+
+    if (arg_img->pixfmt != PIXFORMAT_RGB565) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Expected an RGB565 image"));
+    }
+
+    int k = py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_k), 8);
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 2, kw_args, &roi);
+    int stride = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_stride), 4);
+    int iterations = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_iterations), 10);
+    mp_obj_t centroids_obj = py_helper_keyword_object(n_args, args, 5, kw_args,
+                                                      MP_OBJ_NEW_QSTR(MP_QSTR_centroids), mp_const_none);
+
+    if ((k < 1) || (COLOR_KMEANS_MAX_K < k)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("1 <= k <= 16!"));
+    }
+
+    if (stride < 1) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Stride must be > 0!"));
+    }
+
+    if (iterations < 1) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Iterations must be > 0!"));
+    }
+
+    // Warm start from (r, g, b) tuples or from the ((r, g, b), count) result of a previous call.
+    color_cluster_t clusters[COLOR_KMEANS_MAX_K];
+    int n_init = 0;
+
+    if (centroids_obj != mp_const_none) {
+        size_t len;
+        mp_obj_t *items;
+        mp_obj_get_array(centroids_obj, &len, &items);
+
+        for (size_t i = 0; (i < len) && (n_init < k); i++, n_init++) {
+            size_t item_len;
+            mp_obj_t *item;
+            mp_obj_get_array(items[i], &item_len, &item);
+
+            if ((item_len == 2) && (!mp_obj_is_int(item[0]))) {
+                mp_obj_get_array_fixed_n(item[0], 3, &item);
+            } else if (item_len != 3) {
+                mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Expected (r, g, b) centroids!"));
+            }
+
+            clusters[n_init].r = IM_MAX(IM_MIN(mp_obj_get_int(item[0]), COLOR_R8_MAX), COLOR_R8_MIN);
+            clusters[n_init].g = IM_MAX(IM_MIN(mp_obj_get_int(item[1]), COLOR_G8_MAX), COLOR_G8_MIN);
+            clusters[n_init].b = IM_MAX(IM_MIN(mp_obj_get_int(item[2]), COLOR_B8_MAX), COLOR_B8_MIN);
+        }
+    }
+
+    int n = imlib_color_kmeans(arg_img, &roi, stride, k, iterations, clusters, n_init);
+    mp_obj_t colors_list = mp_obj_new_list(0, NULL);
+
+    for (int i = 0; i < n; i++) {
+        mp_obj_t rgb[3] = {
+            mp_obj_new_int(clusters[i].r),
+            mp_obj_new_int(clusters[i].g),
+            mp_obj_new_int(clusters[i].b)
+        };
+        mp_obj_t color[2] = {
+            mp_obj_new_tuple(3, rgb),
+            mp_obj_new_int(clusters[i].count)
+        };
+        mp_obj_list_append(colors_list, mp_obj_new_tuple(2, color));
+    }
+
+    return colors_list;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(py_image_dominant_colors_obj, 1, py_image_dominant_colors);
+
 // Line Object //
 #define py_line_obj_size    8
 typedef struct py_line_obj {
@@ -4536,6 +4836,45 @@ static mp_obj_t py_image_find_lines(size_t n_args, const mp_obj_t *args, mp_map_
 static MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_lines_obj, 1, py_image_find_lines);
 #endif // IMLIB_ENABLE_FIND_LINES
 
+#if (defined(IMLIB_ENABLE_FIND_LINE_SEGMENTS) && (!defined(OMV_NO_GPL))) || defined(IMLIB_ENABLE_QRCODES) \
+    || defined(IMLIB_ENABLE_DATAMATRICES) || (defined(IMLIB_ENABLE_BARCODES) && (!defined(OMV_NO_GPL)))
+// Parses the budget_us and resume arguments of a detector. Returns NULL when no
+// budget was given so that the detector runs to completion.
+static imlib_budget_t *py_image_get_budget(size_t n_args, const mp_obj_t *args, size_t arg_index,
+                                           mp_map_t *kw_args, imlib_budget_t *budget) {
+    int budget_us = py_helper_keyword_int(n_args, args, arg_index, kw_args,
+                                          MP_OBJ_NEW_QSTR(MP_QSTR_budget_us), 0);
+    int resume = py_helper_keyword_int(n_args, args, arg_index + 1, kw_args,
+                                       MP_OBJ_NEW_QSTR(MP_QSTR_resume), 0);
+
+    if (budget_us < 0) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("budget_us must be >= 0"));
+    }
+
+    if (resume < 0) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("resume must be >= 0"));
+    }
+
+    if (!budget_us) {
+        return NULL;
+    }
+
+    imlib_budget_init(budget, budget_us, resume);
+    return budget;
+}
+
+// Detectors with a budget return (results, resume) where resume is None if the
+// detector finished or the value to pass back in to continue where it stopped.
+static mp_obj_t py_image_budget_result(mp_obj_t objects_list, imlib_budget_t *budget) {
+    if (!budget) {
+        return objects_list;
+    }
+
+    mp_obj_t resume = budget->expired ? mp_obj_new_int(budget->resume) : mp_const_none;
+    return mp_obj_new_tuple(2, (mp_obj_t []) {objects_list, resume});
+}
+#endif
+
 #if defined(IMLIB_ENABLE_FIND_LINE_SEGMENTS) && (!defined(OMV_NO_GPL))
 static mp_obj_t py_image_find_line_segments(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
     image_t *arg_img = py_image_cobj(args[0]);
@@ -4546,9 +4885,12 @@ static mp_obj_t py_image_find_line_segments(size_t n_args, const mp_obj_t *args,
     unsigned int merge_distance = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_merge_distance), 0);
     unsigned int max_theta_diff = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_theta_diff), 15);
 
+    imlib_budget_t budget_data;
+    imlib_budget_t *budget = py_image_get_budget(n_args, args, 4, kw_args, &budget_data);
+
     list_t out;
     fb_alloc_mark();
-    imlib_lsd_find_line_segments(&out, arg_img, &roi, merge_distance, max_theta_diff);
+    imlib_lsd_find_line_segments(&out, arg_img, &roi, merge_distance, max_theta_diff, budget);
     fb_alloc_free_till_mark();
 
     mp_obj_list_t *objects_list = mp_obj_new_list(list_size(&out), NULL);
@@ -4572,7 +4914,7 @@ static mp_obj_t py_image_find_line_segments(size_t n_args, const mp_obj_t *args,
         objects_list->items[i] = o;
     }
 
-    return objects_list;
+    return py_image_budget_result(objects_list, budget);
 }
 static MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_line_segments_obj, 1, py_image_find_line_segments);
 #endif // IMLIB_ENABLE_FIND_LINE_SEGMENTS
@@ -5034,9 +5376,12 @@ static mp_obj_t py_image_find_qrcodes(size_t n_args, const mp_obj_t *args, mp_ma
     rectangle_t roi;
     py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
 
+    imlib_budget_t budget_data;
+    imlib_budget_t *budget = py_image_get_budget(n_args, args, 2, kw_args, &budget_data);
+
     list_t out;
     fb_alloc_mark();
-    imlib_find_qrcodes(&out, arg_img, &roi);
+    imlib_find_qrcodes(&out, arg_img, &roi, budget);
     fb_alloc_free_till_mark();
 
     mp_obj_list_t *objects_list = mp_obj_new_list(list_size(&out), NULL);
@@ -5074,7 +5419,7 @@ static mp_obj_t py_image_find_qrcodes(size_t n_args, const mp_obj_t *args, mp_ma
         m_free(lnk_data.payload);
     }
 
-    return objects_list;
+    return py_image_budget_result(objects_list, budget);
 }
 static MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_qrcodes_obj, 1, py_image_find_qrcodes);
 #endif // IMLIB_ENABLE_QRCODES
@@ -5467,9 +5812,12 @@ static mp_obj_t py_image_find_datamatrices(size_t n_args, const mp_obj_t *args,
 
     int effort = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_effort), 200);
 
+    imlib_budget_t budget_data;
+    imlib_budget_t *budget = py_image_get_budget(n_args, args, 3, kw_args, &budget_data);
+
     list_t out;
     fb_alloc_mark();
-    imlib_find_datamatrices(&out, arg_img, &roi, effort);
+    imlib_find_datamatrices(&out, arg_img, &roi, effort, budget);
     fb_alloc_free_till_mark();
 
     mp_obj_list_t *objects_list = mp_obj_new_list(list_size(&out), NULL);
@@ -5507,7 +5855,7 @@ static mp_obj_t py_image_find_datamatrices(size_t n_args, const mp_obj_t *args,
         m_free(lnk_data.payload);
     }
 
-    return objects_list;
+    return py_image_budget_result(objects_list, budget);
 }
 static MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_datamatrices_obj, 1, py_image_find_datamatrices);
 #endif // IMLIB_ENABLE_DATAMATRICES
@@ -5646,9 +5994,12 @@ static mp_obj_t py_image_find_barcodes(size_t n_args, const mp_obj_t *args, mp_m
     rectangle_t roi;
     py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
 
+    imlib_budget_t budget_data;
+    imlib_budget_t *budget = py_image_get_budget(n_args, args, 2, kw_args, &budget_data);
+
     list_t out;
     fb_alloc_mark();
-    imlib_find_barcodes(&out, arg_img, &roi);
+    imlib_find_barcodes(&out, arg_img, &roi, budget);
     fb_alloc_free_till_mark();
 
     mp_obj_list_t *objects_list = mp_obj_new_list(list_size(&out), NULL);
@@ -5684,7 +6035,7 @@ static mp_obj_t py_image_find_barcodes(size_t n_args, const mp_obj_t *args, mp_m
         m_free(lnk_data.payload);
     }
 
-    return objects_list;
+    return py_image_budget_result(objects_list, budget);
 }
 static MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_barcodes_obj, 1, py_image_find_barcodes);
 #endif // IMLIB_ENABLE_BARCODES
@@ -6016,6 +6367,10 @@ static mp_obj_t py_image_find_hog(size_t n_args, const mp_obj_t *args, mp_map_t
 
     int size = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_size), 8);
 
+    if (size < 2) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Size must be >= 2!"));
+    }
+
     fb_alloc_mark();
     imlib_find_hog(arg_img, &roi, size);
     fb_alloc_free_till_mark();
@@ -6023,17 +6378,121 @@ static mp_obj_t py_image_find_hog(size_t n_args, const mp_obj_t *args, mp_map_t
     return args[0];
 }
 static MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_hog_obj, 1, py_image_find_hog);
+
+static mp_obj_t py_image_hog_vector(hog_grid_t *grid, int cell_x, int cell_y, int x_cells, int y_cells) {
+    size_t len = HOG_DESCRIPTOR_SIZE(x_cells, y_cells);
+    #if defined(MODULE_ULAB_ENABLED)
+    size_t shape[ULAB_MAX_DIMS] = {0};
+    shape[ULAB_MAX_DIMS - 1] = len;
+    ndarray_obj_t *ndarray = ndarray_new_dense_ndarray(1, shape, NDARRAY_FLOAT);
+    imlib_hog_descriptor(grid, cell_x, cell_y, x_cells, y_cells, (float *) ndarray->array);
+    return MP_OBJ_FROM_PTR(ndarray);
+    #else
+    float *features = fb_alloc(len * sizeof(float), FB_ALLOC_NO_HINT);
+    imlib_hog_descriptor(grid, cell_x, cell_y, x_cells, y_cells, features);
+    mp_obj_list_t *list = MP_OBJ_TO_PTR(mp_obj_new_list(len, NULL));
+
+    for (size_t i = 0; i < len; i++) {
+        list->items[i] = mp_obj_new_float(features[i]);
+    }
+
+    fb_free(); // features
+    return MP_OBJ_FROM_PTR(list);
+    #endif
+}
+
+static mp_obj_t py_image_hog_features(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    image_t *arg_img = py_helper_arg_to_image(args[0], ARG_IMAGE_GRAYSCALE);
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
+
+    int size = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_size), 8);
+    int window[2] = {0, 0};
+    py_helper_keyword_int_array(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_window), window, 2);
+    int stride = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_stride), 1);
+
+    if (size < 2) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Size must be >= 2!"));
+    }
+
+    if (stride < 1) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Stride must be > 0!"));
+    }
+
+    if (((roi.w / size) < 2) || ((roi.h / size) < 2)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("ROI must be at least 2x2 cells!"));
+    }
+
+    bool sliding = window[0] || window[1];
+    int x_cells = window[0] / size;
+    int y_cells = window[1] / size;
+
+    if (sliding && ((x_cells < 2) || (y_cells < 2) || (x_cells > (roi.w / size)) || (y_cells > (roi.h / size)))) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Window must be between 2x2 cells and the ROI!"));
+    }
+
+    hog_grid_t grid;
+    fb_alloc_mark();
+    imlib_hog_grid_init(&grid, arg_img, &roi, size);
+
+    mp_obj_t result;
+
+    if (!sliding) {
+        result = py_image_hog_vector(&grid, 0, 0, grid.x_cells, grid.y_cells);
+    } else {
+        // Slide the window over the grid in steps of stride cells.
+        result = mp_obj_new_list(0, NULL);
+
+        for (int cy = 0; (cy + y_cells) <= grid.y_cells; cy += stride) {
+            for (int cx = 0; (cx + x_cells) <= grid.x_cells; cx += stride) {
+                mp_obj_t rect[4] = {
+                    mp_obj_new_int(roi.x + (cx * size)),
+                    mp_obj_new_int(roi.y + (cy * size)),
+                    mp_obj_new_int(x_cells * size),
+                    mp_obj_new_int(y_cells * size)
+                };
+                mp_obj_t item[2] = {
+                    mp_obj_new_tuple(4, rect),
+                    py_image_hog_vector(&grid, cx, cy, x_cells, y_cells)
+                };
+                mp_obj_list_append(result, mp_obj_new_tuple(2, item));
+            }
+        }
+    }
+
+    fb_alloc_free_till_mark();
+    return result;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(py_image_hog_features_obj, 1, py_image_hog_features);
 #endif // IMLIB_ENABLE_HOG
 
 #ifdef IMLIB_ENABLE_SELECTIVE_SEARCH
 static mp_obj_t py_image_selective_search(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
-    image_t *img = py_helper_arg_to_image(args[0], ARG_IMAGE_MUTABLE);
+    image_t *img = py_helper_arg_to_image(args[0], ARG_IMAGE_UNCOMPRESSED);
+
+    if (img->pixfmt != PIXFORMAT_RGB565) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Expected an RGB565 image"));
+    }
+
     int t = py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 500);
     int s = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_size), 20);
     float a1 = py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_a1), 1.0f);
-    float a2 = py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_a1), 1.0f);
-    float a3 = py_helper_keyword_float(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_a1), 1.0f);
-    array_t *proposals_array = imlib_selective_search(img, t, s, a1, a2, a3);
+    float a2 = py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_a2), 1.0f);
+    float a3 = py_helper_keyword_float(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_a3), 1.0f);
+    // 0 picks the smallest scale which brings the image down to 80x60 pixels or less.
+    int scale = py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_scale), 0);
+    int max_regions = py_helper_keyword_int(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_regions), 64);
+
+    if (scale < 0) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Scale must be >= 0!"));
+    }
+
+    if ((max_regions < 1) || (1024 < max_regions)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("1 <= max_regions <= 1024!"));
+    }
+
+    array_t *proposals_array = imlib_selective_search(img, t, s, a1, a2, a3, scale, max_regions);
 
     // Add proposals to a new Python list...
     mp_obj_t proposals_list = mp_obj_new_list(0, NULL);
@@ -6074,8 +6533,34 @@ static mp_obj_t py_image_stereo_disparity(size_t n_args, const mp_obj_t *args, m
         mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("0 <= threshold!"));
     }
 
+    int block_size[2] = { 4, 4 };
+    py_helper_keyword_int_array(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_block_size), block_size, 2);
+
+    if ((block_size[0] < 1) || (16 < block_size[0]) || (block_size[1] < 1) || (16 < block_size[1])) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("1 <= block_size <= 16!"));
+    }
+
+    bool census = py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_census), false);
+    int paths = py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_paths), 0);
+
+    if ((paths != 0) && (paths != 2) && (paths != 3) && (paths != 5)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("paths must be 0, 2, 3 or 5!"));
+    }
+
+    // Default smoothness penalties scale with the block area and the per pixel cost range.
+    int area = block_size[0] * block_size[1];
+    int p1 = py_helper_keyword_int(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_p1), area * (census ? 2 : 8));
+    int p2 = py_helper_keyword_int(n_args, args, 8, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_p2), area * (census ? 8 : 32));
+
+    if ((p1 < 0) || (p2 < p1) || (32767 < p2)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("0 <= p1 <= p2 <= 32767!"));
+    }
+
+    bool subpixel = py_helper_keyword_int(n_args, args, 9, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_subpixel), false);
+
     fb_alloc_mark();
-    imlib_stereo_disparity(img, reversed, max_disparity, threshold);
+    imlib_stereo_disparity(img, reversed, max_disparity, threshold, block_size[0], block_size[1],
+                           census, paths, p1, p2, subpixel);
     fb_alloc_free_till_mark();
 
     return args[0];
@@ -6441,6 +6926,8 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_get_stats),           MP_ROM_PTR(&py_image_get_statistics_obj)},
     {MP_ROM_QSTR(MP_QSTR_get_statistics),      MP_ROM_PTR(&py_image_get_statistics_obj)},
     {MP_ROM_QSTR(MP_QSTR_statistics),          MP_ROM_PTR(&py_image_get_statistics_obj)},
+    {MP_ROM_QSTR(MP_QSTR_roi_stats),           MP_ROM_PTR(&py_image_roi_stats_obj)},
+    {MP_ROM_QSTR(MP_QSTR_dominant_colors),     MP_ROM_PTR(&py_image_dominant_colors_obj)},
     {MP_ROM_QSTR(MP_QSTR_get_regression),      MP_ROM_PTR(&py_image_get_regression_obj)},
     /* Find Methods */
     {MP_ROM_QSTR(MP_QSTR_find_blobs),          MP_ROM_PTR(&py_image_find_blobs_obj)},
@@ -6517,8 +7004,10 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     #endif
     #ifdef IMLIB_ENABLE_HOG
     {MP_ROM_QSTR(MP_QSTR_find_hog),            MP_ROM_PTR(&py_image_find_hog_obj)},
+    {MP_ROM_QSTR(MP_QSTR_hog_features),        MP_ROM_PTR(&py_image_hog_features_obj)},
     #else
     {MP_ROM_QSTR(MP_QSTR_find_hog),            MP_ROM_PTR(&py_func_unavailable_obj)},
+    {MP_ROM_QSTR(MP_QSTR_hog_features),        MP_ROM_PTR(&py_func_unavailable_obj)},
     #endif
     #ifdef IMLIB_ENABLE_SELECTIVE_SEARCH
     {MP_ROM_QSTR(MP_QSTR_selective_search),    MP_ROM_PTR(&py_image_selective_search_obj)},
@@ -6817,6 +7306,32 @@ mp_obj_t py_image_load_cascade(size_t n_args, const mp_obj_t *args, mp_map_t *kw
 static MP_DEFINE_CONST_FUN_OBJ_KW(py_image_load_cascade_obj, 1, py_image_load_cascade);
 #endif // IMLIB_ENABLE_FEATURES
 
+#ifdef IMLIB_ENABLE_FIND_LBP
+static mp_obj_t py_image_lbp_gallery(size_t n_args, const mp_obj_t *args) {
+    py_lbp_gallery_obj_t *gallery = m_new_obj(py_lbp_gallery_obj_t);
+    gallery->base.type = &py_lbp_gallery_type;
+    gallery->count = 0;
+    gallery->alloc = 0;
+    gallery->descs = NULL;
+
+    if (n_args) {
+        mp_obj_t len = mp_obj_len_maybe(args[0]);
+        if (len != MP_OBJ_NULL) {
+            py_lbp_gallery_reserve(gallery, mp_obj_get_int(len));
+        }
+
+        mp_obj_iter_buf_t iter_buf;
+        mp_obj_t item, iterable = mp_getiter(args[0], &iter_buf);
+        while ((item = mp_iternext(iterable)) != MP_OBJ_STOP_ITERATION) {
+            py_lbp_gallery_add(gallery, item);
+        }
+    }
+
+    return gallery;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_image_lbp_gallery_obj, 0, 1, py_image_lbp_gallery);
+#endif // IMLIB_ENABLE_FIND_LBP
+
 #if defined(IMLIB_ENABLE_DESCRIPTOR)
 #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
 mp_obj_t py_image_load_descriptor(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
@@ -7040,6 +7555,51 @@ int py_image_descriptor_from_roi(image_t *img, const char *path, rectangle_t *ro
 }
 #endif // IMLIB_ENABLE_KEYPOINTS && IMLIB_ENABLE_IMAGE_FILE_IO
 
+#if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+static mp_obj_t py_image_write_behind(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_buffers, ARG_buffer_size };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_buffers, MP_ARG_INT, {.u_int = 8 } },
+        { MP_QSTR_buffer_size, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = 4096 } },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if ((args[ARG_buffers].u_int < 0) || (args[ARG_buffer_size].u_int <= 0)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid write-behind buffer count or size"));
+    }
+
+    // Zero buffers writes out everything queued and disables the queue.
+    file_queue_enable(args[ARG_buffers].u_int, args[ARG_buffer_size].u_int);
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(py_image_write_behind_obj, 0, py_image_write_behind);
+
+static mp_obj_t py_image_write_behind_flush() {
+    file_queue_flush();
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(py_image_write_behind_flush_obj, py_image_write_behind_flush);
+
+static mp_obj_t py_image_write_behind_stats() {
+    file_queue_stats_t stats;
+    file_queue_stats(&stats);
+    return mp_obj_new_tuple(5, (mp_obj_t []) {mp_obj_new_int(stats.queued),
+                                              mp_obj_new_int(stats.written),
+                                              mp_obj_new_int(stats.stalls),
+                                              mp_obj_new_int(stats.high_water),
+                                              mp_obj_new_int(stats.errors)});
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(py_image_write_behind_stats_obj, py_image_write_behind_stats);
+
+MP_REGISTER_ROOT_POINTER(struct _file_queue_t *file_queue);
+#endif // IMLIB_ENABLE_IMAGE_FILE_IO
+
+#if defined(IMLIB_ENABLE_THRESHOLD_BITMAPS)
+MP_REGISTER_ROOT_POINTER(struct _threshold_bitmap_t *threshold_bitmaps[IMLIB_THRESHOLD_BITMAPS]);
+#endif
+
 static const mp_rom_map_elem_t globals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR___name__),            MP_OBJ_NEW_QSTR(MP_QSTR_image)},
     // Pixel formats
@@ -7079,6 +7639,10 @@ static const mp_rom_map_elem_t globals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_JPEG_SUBSAMPLING_444), MP_ROM_INT(JPEG_SUBSAMPLING_444)},
     {MP_ROM_QSTR(MP_QSTR_JPEG_SUBSAMPLING_422), MP_ROM_INT(JPEG_SUBSAMPLING_422)},
     {MP_ROM_QSTR(MP_QSTR_JPEG_SUBSAMPLING_420), MP_ROM_INT(JPEG_SUBSAMPLING_420)},
+    {MP_ROM_QSTR(MP_QSTR_PNG_LEVEL_STORE), MP_ROM_INT(PNG_LEVEL_STORE)},
+    {MP_ROM_QSTR(MP_QSTR_PNG_LEVEL_HUFFMAN), MP_ROM_INT(PNG_LEVEL_HUFFMAN)},
+    {MP_ROM_QSTR(MP_QSTR_PNG_LEVEL_RLE), MP_ROM_INT(PNG_LEVEL_RLE)},
+    {MP_ROM_QSTR(MP_QSTR_PNG_LEVEL_FULL), MP_ROM_INT(PNG_LEVEL_FULL)},
     #ifdef IMLIB_FIND_TEMPLATE
     {MP_ROM_QSTR(MP_QSTR_SEARCH_EX),           MP_ROM_INT(SEARCH_EX)},
     {MP_ROM_QSTR(MP_QSTR_SEARCH_DS),           MP_ROM_INT(SEARCH_DS)},
@@ -7154,6 +7718,20 @@ static const mp_rom_map_elem_t globals_dict_table[] = {
     #ifdef IMLIB_ENABLE_FEATURES
     {MP_ROM_QSTR(MP_QSTR_HaarCascade),         MP_ROM_PTR(&py_image_load_cascade_obj)},
     #endif
+    #ifdef IMLIB_ENABLE_FIND_LBP
+    {MP_ROM_QSTR(MP_QSTR_LBPGallery),          MP_ROM_PTR(&py_image_lbp_gallery_obj)},
+    #else
+    {MP_ROM_QSTR(MP_QSTR_LBPGallery),          MP_ROM_PTR(&py_func_unavailable_obj)},
+    #endif
+    #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+    {MP_ROM_QSTR(MP_QSTR_write_behind),        MP_ROM_PTR(&py_image_write_behind_obj)},
+    {MP_ROM_QSTR(MP_QSTR_write_behind_stats),  MP_ROM_PTR(&py_image_write_behind_stats_obj)},
+    {MP_ROM_QSTR(MP_QSTR_write_behind_flush),  MP_ROM_PTR(&py_image_write_behind_flush_obj)},
+    #else
+    {MP_ROM_QSTR(MP_QSTR_write_behind),        MP_ROM_PTR(&py_func_unavailable_obj)},
+    {MP_ROM_QSTR(MP_QSTR_write_behind_stats),  MP_ROM_PTR(&py_func_unavailable_obj)},
+    {MP_ROM_QSTR(MP_QSTR_write_behind_flush),  MP_ROM_PTR(&py_func_unavailable_obj)},
+    #endif // IMLIB_ENABLE_IMAGE_FILE_IO
     #if defined(IMLIB_ENABLE_DESCRIPTOR) && defined(IMLIB_ENABLE_IMAGE_FILE_IO)
     {MP_ROM_QSTR(MP_QSTR_load_descriptor),     MP_ROM_PTR(&py_image_load_descriptor_obj)},
     {MP_ROM_QSTR(MP_QSTR_save_descriptor),     MP_ROM_PTR(&py_image_save_descriptor_obj)},
@@ -55,6 +55,41 @@
 #define ORIGINAL_VER            10
 #define RGB565_FIXED_VER        11
 #define NEW_PIXFORMAT_VER       20
+#define INDEXED_VER             21
+#define COMPRESSED_VER          22
+
+// V2.1 files start every group of INDEX_GROUP_FRAMES frames with an index chunk. Index chunks
+// use the frame chunk header with a pixformat of INDEX_CHUNK_TAG and keep the offset of the next
+// index chunk, the number of valid entries and the time stamp of the frame before the group in
+// the header padding. Each entry holds the file offset, time stamp (ms since the stream was
+// opened) and pixformat of a frame. Entries are buffered in RAM and written back when a group
+// is full, on sync() and on close(). Frames written after the last write back are recovered by
+// walking the frames of the last group when the file is opened.
+#define INDEX_CHUNK_TAG         0x58444E49 // "INDX"
+#define INDEX_GROUP_FRAMES      256
+#define INDEX_ENTRY_WORDS       3
+#define INDEX_SIZE              (INDEX_GROUP_FRAMES * INDEX_ENTRY_WORDS * sizeof(uint32_t))
+#define CHUNK_HEADER_SIZE       32
+#define CHUNK_HEADER_WORDS      (CHUNK_HEADER_SIZE / sizeof(uint32_t))
+
+// V2.2 frames may be compressed. The header padding then holds the codec (plus CODEC_DELTA_FLAG
+// for delta frames) and the number of bytes stored. The frame is stored as CODEC_BLOCK_SIZE
+// blocks of residuals, each preceded by its stored length (or'ed with CODEC_BLOCK_RAW when the
+// block did not compress). Key frame residuals are taken against the left neighbour and delta
+// frame residuals against the previous frame. Residual blocks are compressed with the LZ4 block
+// format.
+#define CODEC_RAW               0
+#define CODEC_LZ4               1
+#define CODEC_MASK              0xFF
+#define CODEC_DELTA_FLAG        (1 << 8)
+#define CODEC_BLOCK_SIZE        16384U
+#define CODEC_BLOCK_RAW         (1U << 31)
+
+#define LZ4_HASH_BITS           12
+#define LZ4_MIN_MATCH           4
+#define LZ4_LAST_LITERALS       5
+#define LZ4_MATCH_LIMIT         12
+#define LZ4_BOUND(n)            ((n) + ((n) / 255) + 16)
 
 #define IMAGE_ALIGNMENT         OMV_CACHE_LINE_SIZE
 
@@ -79,6 +114,23 @@ typedef struct py_imageio_obj {
         struct {
             FIL fp;
             int version;
+            uint32_t timestamp;     // Time stamp of the last frame read or written.
+            uint32_t *groups;       // Offsets of the index chunks.
+            uint32_t groups_count;
+            uint32_t groups_alloc;
+            uint32_t *index;        // Entries of the cached group.
+            int index_group;        // Cached group or -1.
+            uint32_t index_count;
+            uint32_t index_next;
+            uint32_t index_base;
+            bool index_dirty;
+            uint32_t codec;
+            uint32_t keyframe;
+            uint32_t chunk_codec;   // Codec and stored size of the last chunk header read.
+            uint32_t chunk_stored;
+            image_t reference;      // Last compressed frame read or written.
+            uint32_t reference_size;
+            int reference_offset;   // Frame in reference or -1.
         };
         #endif
         struct {
@@ -177,6 +229,576 @@ static mp_obj_t py_imageio_size(mp_obj_t self) {
 }
 static MP_DEFINE_CONST_FUN_OBJ_1(py_imageio_size_obj, py_imageio_size);
 
+#if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+// Reads a chunk header at the current file position and returns the padded size of its data.
+static uint32_t int_py_imageio_read_header(FIL *fp, uint32_t *header) {
+    file_read(fp, header, CHUNK_HEADER_SIZE);
+
+    if (header[3] == INDEX_CHUNK_TAG) {
+        return header[4];
+    }
+
+    if (!IMLIB_PIXFORMAT_IS_VALID(header[3])) {
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Invalid image stream pixformat"));
+    }
+
+    if ((header[5] & CODEC_MASK) != CODEC_RAW) {
+        return OMV_ALIGN_TO(header[6], ALIGN_SIZE);
+    }
+
+    image_t image = { 0 };
+    image.w = header[1];
+    image.h = header[2];
+    image.pixfmt = header[3];
+    image.size = header[4];
+    return OMV_ALIGN_TO(image_size(&image), ALIGN_SIZE);
+}
+
+// Steps over any index chunks at the current file position.
+static void int_py_imageio_skip_index(py_imageio_obj_t *stream) {
+    FIL *fp = &stream->fp;
+
+    while ((f_tell(fp) + CHUNK_HEADER_SIZE) <= f_size(fp)) {
+        uint32_t offset = f_tell(fp), header[CHUNK_HEADER_WORDS];
+        file_read(fp, header, CHUNK_HEADER_SIZE);
+
+        if (header[3] != INDEX_CHUNK_TAG) {
+            file_seek(fp, offset);
+            break;
+        }
+
+        file_seek(fp, offset + CHUNK_HEADER_SIZE + header[4]);
+    }
+}
+
+static void int_py_imageio_index_add_group(py_imageio_obj_t *stream, uint32_t offset) {
+    if (stream->groups_count == stream->groups_alloc) {
+        uint32_t alloc = IM_MAX(stream->groups_alloc * 2, 16U);
+        stream->groups = m_renew(uint32_t, stream->groups, stream->groups_alloc, alloc);
+        stream->groups_alloc = alloc;
+    }
+
+    stream->groups[stream->groups_count++] = offset;
+}
+
+// Writes back the cached group. The file position is preserved.
+static void int_py_imageio_index_flush(py_imageio_obj_t *stream) {
+    if (!stream->index_dirty) {
+        return;
+    }
+
+    FIL *fp = &stream->fp;
+    uint32_t offset = f_tell(fp);
+    uint32_t header[CHUNK_HEADER_WORDS] = {
+        0, 0, 0, INDEX_CHUNK_TAG, INDEX_SIZE, stream->index_next, stream->index_count, stream->index_base
+    };
+
+    file_seek(fp, stream->groups[stream->index_group]);
+    file_write(fp, header, CHUNK_HEADER_SIZE);
+    file_write(fp, stream->index, INDEX_SIZE);
+    file_seek(fp, offset);
+    stream->index_dirty = false;
+}
+
+// Caches the entries of a group, recovering the entries of frames written after the group
+// was last written back. The file position is preserved.
+static void int_py_imageio_index_load(py_imageio_obj_t *stream, uint32_t group) {
+    if (stream->index_group == ((int) group)) {
+        return;
+    }
+
+    int_py_imageio_index_flush(stream);
+
+    FIL *fp = &stream->fp;
+    uint32_t offset = f_tell(fp), header[CHUNK_HEADER_WORDS];
+    file_seek(fp, stream->groups[group]);
+    file_read(fp, header, CHUNK_HEADER_SIZE);
+
+    if ((header[3] != INDEX_CHUNK_TAG) || (header[4] != INDEX_SIZE) || (header[6] > INDEX_GROUP_FRAMES)) {
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Invalid image stream index"));
+    }
+
+    file_read(fp, stream->index, INDEX_SIZE);
+    stream->index_group = group;
+    stream->index_count = header[6];
+    stream->index_next = header[5];
+    stream->index_base = header[7];
+
+    if (stream->index_count < INDEX_GROUP_FRAMES) {
+        uint32_t timestamp = stream->index_base;
+
+        if (stream->index_count) {
+            uint32_t *entry = stream->index + ((stream->index_count - 1) * INDEX_ENTRY_WORDS);
+            file_seek(fp, entry[0]);
+            file_seek(fp, entry[0] + CHUNK_HEADER_SIZE + int_py_imageio_read_header(fp, header));
+            timestamp = entry[1];
+        }
+
+        while ((stream->index_count < INDEX_GROUP_FRAMES) && ((f_tell(fp) + CHUNK_HEADER_SIZE) <= f_size(fp))) {
+            uint32_t frame = f_tell(fp);
+            file_read(fp, header, CHUNK_HEADER_SIZE);
+
+            // Stop at the next group or a partially written frame.
+            if ((header[3] == INDEX_CHUNK_TAG) || (!IMLIB_PIXFORMAT_IS_VALID(header[3]))) {
+                break;
+            }
+
+            file_seek(fp, frame);
+            uint32_t size = int_py_imageio_read_header(fp, header);
+
+            if ((frame + CHUNK_HEADER_SIZE + size) > f_size(fp)) {
+                break;
+            }
+
+            uint32_t *entry = stream->index + (stream->index_count++ * INDEX_ENTRY_WORDS);
+            timestamp += header[0];
+            entry[0] = frame;
+            entry[1] = timestamp;
+            entry[2] = header[3];
+            file_seek(fp, frame + CHUNK_HEADER_SIZE + size);
+        }
+    }
+
+    file_seek(fp, offset);
+}
+
+static uint32_t *int_py_imageio_index_entry(py_imageio_obj_t *stream, uint32_t offset) {
+    int_py_imageio_index_load(stream, offset / INDEX_GROUP_FRAMES);
+    return stream->index + ((offset % INDEX_GROUP_FRAMES) * INDEX_ENTRY_WORDS);
+}
+
+// Sets up the index of a new file or follows the index chunks of an existing file to find the
+// groups and the frame count.
+static void int_py_imageio_index_open(py_imageio_obj_t *stream, bool existing) {
+    FIL *fp = &stream->fp;
+    stream->timestamp = 0;
+    stream->groups = NULL;
+    stream->groups_count = 0;
+    stream->groups_alloc = 0;
+    stream->index = m_new(uint32_t, INDEX_GROUP_FRAMES * INDEX_ENTRY_WORDS);
+    stream->index_group = -1;
+    stream->index_count = 0;
+    stream->index_next = 0;
+    stream->index_base = 0;
+    stream->index_dirty = false;
+
+    if (!existing) {
+        return;
+    }
+
+    for (uint32_t offset = MAGIC_SIZE; (offset + CHUNK_HEADER_SIZE + INDEX_SIZE) <= f_size(fp);) {
+        uint32_t header[CHUNK_HEADER_WORDS];
+        file_seek(fp, offset);
+        file_read(fp, header, CHUNK_HEADER_SIZE);
+
+        if (header[3] != INDEX_CHUNK_TAG) {
+            break;
+        }
+
+        int_py_imageio_index_add_group(stream, offset);
+
+        // The chain only moves forward, anything else is a corrupt (or unfinished) link.
+        if (header[5] <= offset) {
+            break;
+        }
+
+        offset = header[5];
+    }
+
+    if (stream->groups_count) {
+        int_py_imageio_index_load(stream, stream->groups_count - 1);
+        stream->count = ((stream->groups_count - 1) * INDEX_GROUP_FRAMES) + stream->index_count;
+    }
+
+    file_seek(fp, MAGIC_SIZE);
+}
+
+// Caches the group that the frame at the current offset is written to, starting a new group
+// when needed, and moves the file position to where the frame goes.
+static void int_py_imageio_index_prepare(py_imageio_obj_t *stream) {
+    FIL *fp = &stream->fp;
+    uint32_t group = stream->offset / INDEX_GROUP_FRAMES;
+    uint32_t entry = stream->offset % INDEX_GROUP_FRAMES;
+
+    if (group < stream->groups_count) {
+        int_py_imageio_index_load(stream, group);
+
+        if (entry > stream->index_count) {
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid stream offset"));
+        }
+
+        if (!entry) {
+            file_seek(fp, stream->groups[group] + CHUNK_HEADER_SIZE + INDEX_SIZE);
+        }
+
+        // The rest of the file is truncated after the frame is written.
+        stream->groups_count = group + 1;
+        stream->index_count = entry;
+        stream->index_next = 0;
+        stream->index_dirty = true;
+    } else if ((group == stream->groups_count) && (!entry)) {
+        uint32_t offset = f_tell(fp);
+
+        if (group) {
+            int_py_imageio_index_load(stream, group - 1);
+            stream->index_next = offset;
+            stream->index_dirty = true;
+        }
+
+        int_py_imageio_index_flush(stream);
+        int_py_imageio_index_add_group(stream, offset);
+
+        // Reserve space for the index of the new group.
+        memset(stream->index, 0, INDEX_SIZE);
+        stream->index_group = group;
+        stream->index_count = 0;
+        stream->index_next = 0;
+        stream->index_base = stream->timestamp;
+        stream->index_dirty = true;
+        int_py_imageio_index_flush(stream);
+        file_seek(fp, offset + CHUNK_HEADER_SIZE + INDEX_SIZE);
+    } else {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid stream offset"));
+    }
+}
+
+static uint8_t *int_py_imageio_lz4_length(uint8_t *out, uint32_t length) {
+    for (; length >= 255; length -= 255) {
+        *out++ = 255;
+    }
+
+    *out++ = length;
+    return out;
+}
+
+static uint8_t *int_py_imageio_lz4_sequence(uint8_t *out, const uint8_t *literals, uint32_t literals_len,
+                                            uint32_t match_offset, uint32_t match_len) {
+    uint8_t *token = out++;
+    *token = IM_MIN(literals_len, 15U) << 4;
+
+    if (literals_len >= 15) {
+        out = int_py_imageio_lz4_length(out, literals_len - 15);
+    }
+
+    memcpy(out, literals, literals_len);
+    out += literals_len;
+
+    if (match_offset) {
+        *out++ = match_offset;
+        *out++ = match_offset >> 8;
+        *token |= IM_MIN(match_len, 15U);
+
+        if (match_len >= 15) {
+            out = int_py_imageio_lz4_length(out, match_len - 15);
+        }
+    }
+
+    return out;
+}
+
+// Compresses a block (of at most 64KB) into the LZ4 block format. The output buffer must hold
+// LZ4_BOUND(size) bytes. Returns the compressed size.
+static uint32_t int_py_imageio_lz4_compress(const uint8_t *data, uint32_t size, uint8_t *out, uint16_t *table) {
+    const uint8_t *ip = data, *anchor = data, *end = data + size;
+    uint8_t *op = out;
+
+    memset(table, 0, sizeof(uint16_t) << LZ4_HASH_BITS);
+
+    if (size > LZ4_MATCH_LIMIT) {
+        const uint8_t *limit = end - LZ4_MATCH_LIMIT;
+
+        // Skip faster through data which does not compress like LZ4 does.
+        for (uint32_t misses = 0; ip < limit;) {
+            uint32_t sequence;
+            memcpy(&sequence, ip, sizeof(sequence));
+
+            uint32_t hash = (sequence * 2654435761U) >> (32 - LZ4_HASH_BITS);
+            const uint8_t *match = data + table[hash];
+            table[hash] = ip - data;
+
+            if ((match >= ip) || memcmp(match, ip, LZ4_MIN_MATCH)) {
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+
+            uint32_t match_len = LZ4_MIN_MATCH;
+
+            while (((ip + match_len) < (end - LZ4_LAST_LITERALS)) && (ip[match_len] == match[match_len])) {
+                match_len++;
+            }
+
+            op = int_py_imageio_lz4_sequence(op, anchor, ip - anchor, ip - match, match_len - LZ4_MIN_MATCH);
+            ip = anchor = ip + match_len;
+            misses = 0;
+        }
+    }
+
+    op = int_py_imageio_lz4_sequence(op, anchor, end - anchor, 0, 0);
+    return op - out;
+}
+
+static bool int_py_imageio_lz4_read_length(const uint8_t **ip, const uint8_t *end, uint32_t *length) {
+    for (uint8_t byte = 255; byte == 255; *length += byte) {
+        if (*ip >= end) {
+            return false;
+        }
+
+        byte = *(*ip)++;
+    }
+
+    return true;
+}
+
+// Decompresses an LZ4 block which must fill the output buffer exactly.
+static bool int_py_imageio_lz4_decompress(const uint8_t *data, uint32_t size, uint8_t *out, uint32_t out_size) {
+    const uint8_t *ip = data, *end = data + size;
+    uint8_t *op = out, *out_end = out + out_size;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+        uint32_t literals_len = token >> 4;
+
+        if ((literals_len == 15) && (!int_py_imageio_lz4_read_length(&ip, end, &literals_len))) {
+            return false;
+        }
+
+        if ((literals_len > (end - ip)) || (literals_len > (out_end - op))) {
+            return false;
+        }
+
+        memcpy(op, ip, literals_len);
+        ip += literals_len;
+        op += literals_len;
+
+        // The last sequence has no match.
+        if (ip == end) {
+            break;
+        }
+
+        if ((end - ip) < 2) {
+            return false;
+        }
+
+        uint32_t match_offset = ip[0] | (ip[1] << 8), match_len = token & 15;
+        ip += 2;
+
+        if ((match_len == 15) && (!int_py_imageio_lz4_read_length(&ip, end, &match_len))) {
+            return false;
+        }
+
+        match_len += LZ4_MIN_MATCH;
+
+        if ((!match_offset) || (match_offset > (op - out)) || (match_len > (out_end - op))) {
+            return false;
+        }
+
+        // Matches may overlap their output.
+        for (const uint8_t *match = op - match_offset; match_len; match_len--) {
+            *op++ = *match++;
+        }
+    }
+
+    return op == out_end;
+}
+
+// Computes the residuals of a block against the left neighbour, or the reference frame when
+// ref is not NULL. 16-bit pixels are differenced as whole pixels.
+static void int_py_imageio_filter(uint8_t *residuals, const uint8_t *data, const uint8_t *ref,
+                                  uint32_t offset, uint32_t size, bool wide) {
+    if (wide) {
+        uint16_t *r16 = (uint16_t *) residuals;
+        const uint16_t *d16 = (const uint16_t *) data, *ref16 = (const uint16_t *) ref;
+
+        for (uint32_t i = 0, o = offset / 2; i < (size / 2); i++, o++) {
+            r16[i] = d16[o] - (ref ? ref16[o] : (o ? d16[o - 1] : 0));
+        }
+    } else {
+        for (uint32_t i = 0, o = offset; i < size; i++, o++) {
+            residuals[i] = data[o] - (ref ? ref[o] : (o ? data[o - 1] : 0));
+        }
+    }
+}
+
+// Inverse of int_py_imageio_filter(). The reference frame may be data itself.
+static void int_py_imageio_unfilter(uint8_t *data, const uint8_t *residuals, const uint8_t *ref,
+                                    uint32_t offset, uint32_t size, bool wide) {
+    if (wide) {
+        uint16_t *d16 = (uint16_t *) data;
+        const uint16_t *r16 = (const uint16_t *) residuals, *ref16 = (const uint16_t *) ref;
+
+        for (uint32_t i = 0, o = offset / 2; i < (size / 2); i++, o++) {
+            d16[o] = r16[i] + (ref ? ref16[o] : (o ? d16[o - 1] : 0));
+        }
+    } else {
+        for (uint32_t i = 0, o = offset; i < size; i++, o++) {
+            data[o] = residuals[i] + (ref ? ref[o] : (o ? data[o - 1] : 0));
+        }
+    }
+}
+
+// Makes sure the reference frame can hold a frame like image. Returns false if out of memory.
+static bool int_py_imageio_reference_alloc(py_imageio_obj_t *stream, image_t *image) {
+    uint32_t size = image_size(image);
+
+    if (stream->reference_size < size) {
+        m_free(stream->reference.data);
+        stream->reference.data = m_malloc_maybe(size);
+        stream->reference_size = stream->reference.data ? size : 0;
+    }
+
+    stream->reference.w = image->w;
+    stream->reference.h = image->h;
+    stream->reference.pixfmt = image->pixfmt;
+    stream->reference_offset = -1;
+    return stream->reference.data != NULL;
+}
+
+// Writes the codec fields of the header and the compressed data of a frame.
+static void int_py_imageio_encode(py_imageio_obj_t *stream, image_t *image) {
+    FIL *fp = &stream->fp;
+    uint32_t size = image_size(image), stored = 0;
+    bool wide = image->bpp == 2;
+
+    // Delta frames are only written against the previous frame with the same geometry.
+    bool delta = (stream->keyframe > 1)
+                 && (stream->offset % stream->keyframe)
+                 && ((stream->reference_offset + 1) == ((int) stream->offset))
+                 && (stream->reference.w == image->w)
+                 && (stream->reference.h == image->h)
+                 && (stream->reference.pixfmt == image->pixfmt);
+    const uint8_t *ref = delta ? stream->reference.data : NULL;
+
+    file_write_long(fp, CODEC_LZ4 | (delta ? CODEC_DELTA_FLAG : 0));
+    uint32_t stored_offset = f_tell(fp);
+    file_write_long(fp, 0); // stored size
+    file_write_long(fp, 0);
+
+    uint8_t *residuals = fb_alloc(CODEC_BLOCK_SIZE, FB_ALLOC_NO_HINT);
+    uint8_t *out = fb_alloc(LZ4_BOUND(CODEC_BLOCK_SIZE), FB_ALLOC_NO_HINT);
+    uint16_t *table = fb_alloc(sizeof(uint16_t) << LZ4_HASH_BITS, FB_ALLOC_NO_HINT);
+
+    for (uint32_t offset = 0, n; offset < size; offset += n) {
+        n = IM_MIN(size - offset, CODEC_BLOCK_SIZE);
+        int_py_imageio_filter(residuals, image->data, ref, offset, n, wide);
+        uint32_t len = int_py_imageio_lz4_compress(residuals, n, out, table);
+
+        if (len < n) {
+            file_write_long(fp, len);
+            file_write(fp, out, len);
+        } else {
+            len = n;
+            file_write_long(fp, len | CODEC_BLOCK_RAW);
+            file_write(fp, residuals, len);
+        }
+
+        stored += sizeof(uint32_t) + len;
+    }
+
+    fb_free(); // table
+    fb_free(); // out
+    fb_free(); // residuals
+
+    if (stored % ALIGN_SIZE) {
+        char padding[ALIGN_SIZE] = {};
+        file_write(fp, padding, ALIGN_SIZE - (stored % ALIGN_SIZE));
+    }
+
+    uint32_t end = f_tell(fp);
+    file_seek(fp, stored_offset);
+    file_write_long(fp, stored);
+    file_seek(fp, end);
+
+    // Keep the frame around for the next delta frame.
+    if ((stream->keyframe > 1) && (delta || int_py_imageio_reference_alloc(stream, image))) {
+        memcpy(stream->reference.data, image->data, size);
+        stream->reference_offset = stream->offset;
+    } else {
+        stream->reference_offset = -1;
+    }
+}
+
+// Reads the compressed data of a frame into image->data. Delta frames are added to ref, which
+// may be image->data itself.
+static void int_py_imageio_decode(FIL *fp, image_t *image, uint32_t stored, const uint8_t *ref) {
+    uint32_t size = image_size(image), consumed = 0;
+    bool wide = image->bpp == 2;
+
+    uint8_t *residuals = fb_alloc(CODEC_BLOCK_SIZE, FB_ALLOC_NO_HINT);
+    uint8_t *in = fb_alloc(CODEC_BLOCK_SIZE, FB_ALLOC_NO_HINT);
+
+    for (uint32_t offset = 0, n; offset < size; offset += n) {
+        n = IM_MIN(size - offset, CODEC_BLOCK_SIZE);
+
+        uint32_t len;
+        file_read(fp, &len, sizeof(len));
+        consumed += sizeof(len) + (len & ~CODEC_BLOCK_RAW);
+
+        if (len == (n | CODEC_BLOCK_RAW)) {
+            file_read(fp, residuals, n);
+        } else if (len < n) {
+            file_read(fp, in, len);
+
+            if (!int_py_imageio_lz4_decompress(in, len, residuals, n)) {
+                mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Invalid image stream data"));
+            }
+        } else {
+            mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Invalid image stream data"));
+        }
+
+        int_py_imageio_unfilter(image->data, residuals, ref, offset, n, wide);
+    }
+
+    fb_free(); // in
+    fb_free(); // residuals
+
+    if (consumed != stored) {
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Invalid image stream data"));
+    }
+
+    if (stored % ALIGN_SIZE) {
+        char ignore[ALIGN_SIZE];
+        file_read(fp, ignore, ALIGN_SIZE - (stored % ALIGN_SIZE));
+    }
+}
+
+// Decodes the frames from the last key frame up to the frame before offset into the reference.
+static void int_py_imageio_reference_load(py_imageio_obj_t *stream, image_t *image, uint32_t offset) {
+    FIL *fp = &stream->fp;
+    uint32_t position = f_tell(fp), header[CHUNK_HEADER_WORDS];
+
+    if (!int_py_imageio_reference_alloc(stream, image)) {
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Out of memory for the delta frame reference"));
+    }
+
+    uint32_t key = offset;
+
+    do {
+        if (!key) {
+            mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Invalid image stream data"));
+        }
+
+        file_seek(fp, int_py_imageio_index_entry(stream, --key)[0]);
+        file_read(fp, header, CHUNK_HEADER_SIZE);
+    } while (header[5] & CODEC_DELTA_FLAG);
+
+    for (uint32_t i = key; i < offset; i++) {
+        file_seek(fp, int_py_imageio_index_entry(stream, i)[0]);
+        file_read(fp, header, CHUNK_HEADER_SIZE);
+
+        if (((header[5] & CODEC_MASK) != CODEC_LZ4) || (header[1] != ((uint32_t) image->w))
+            || (header[2] != ((uint32_t) image->h)) || (header[3] != image->pixfmt)) {
+            mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Invalid image stream data"));
+        }
+
+        int_py_imageio_decode(fp, &stream->reference, header[6],
+                              (header[5] & CODEC_DELTA_FLAG) ? stream->reference.data : NULL);
+    }
+
+    stream->reference_offset = offset - 1;
+    file_seek(fp, position);
+}
+#endif
+
 static mp_obj_t py_imageio_write(mp_obj_t self, mp_obj_t img_obj) {
     py_imageio_obj_t *stream = py_imageio_obj(self);
     image_t *image = py_image_cobj(img_obj);
@@ -189,6 +811,13 @@ static mp_obj_t py_imageio_write(mp_obj_t self, mp_obj_t img_obj) {
     } else if (stream->type == IMAGE_IO_FILE_STREAM) {
         FIL *fp = &stream->fp;
 
+        if (stream->version >= INDEXED_VER) {
+            int_py_imageio_index_prepare(stream);
+        }
+
+        stream->timestamp += elapsed_ms;
+
+        uint32_t frame = f_tell(fp);
         file_write_long(fp, elapsed_ms);
         file_write_long(fp, image->w);
         file_write_long(fp, image->h);
@@ -212,14 +841,23 @@ static mp_obj_t py_imageio_write(mp_obj_t self, mp_obj_t img_obj) {
         } else {
             file_write_long(fp, image->pixfmt);
             file_write_long(fp, image->size);
-            file_write(fp, padding, AFTER_SIZE_PADDING);
         }
 
-        uint32_t size = image_size(image);
-        file_write(fp, image->data, size);
+        if ((stream->version >= COMPRESSED_VER) && (stream->codec != CODEC_RAW) && (!image->is_compressed)) {
+            int_py_imageio_encode(stream, image);
+        } else {
+            if (stream->version >= NEW_PIXFORMAT_VER) {
+                file_write(fp, padding, AFTER_SIZE_PADDING);
+            }
+
+            uint32_t size = image_size(image);
+            file_write(fp, image->data, size);
+
+            if (size % ALIGN_SIZE) {
+                file_write(fp, padding, ALIGN_SIZE - (size % ALIGN_SIZE));
+            }
 
-        if (size % ALIGN_SIZE) {
-            file_write(fp, padding, ALIGN_SIZE - (size % ALIGN_SIZE));
+            stream->reference_offset = -1;
         }
 
         // Seeking to the middle of a file and writing data corrupts the remainder of the file. So,
@@ -228,6 +866,13 @@ static mp_obj_t py_imageio_write(mp_obj_t self, mp_obj_t img_obj) {
             file_truncate(fp);
         }
 
+        if (stream->version >= INDEXED_VER) {
+            uint32_t *entry = stream->index + (stream->index_count++ * INDEX_ENTRY_WORDS);
+            entry[0] = frame;
+            entry[1] = stream->timestamp;
+            entry[2] = image->pixfmt;
+        }
+
         stream->count = stream->offset + 1;
     #endif
     } else if (stream->type == IMAGE_IO_MEMORY_STREAM) {
@@ -259,6 +904,7 @@ static void int_py_imageio_pause(py_imageio_obj_t *stream, bool pause) {
     #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
     } else if (stream->type == IMAGE_IO_FILE_STREAM) {
         file_read(&stream->fp, &elapsed_ms, 4);
+        stream->timestamp += elapsed_ms;
     #endif
     } else if (stream->type == IMAGE_IO_MEMORY_STREAM) {
         elapsed_ms = *((uint32_t *) (stream->buffer + (stream->offset * stream->size)));
@@ -275,6 +921,10 @@ static void int_py_imageio_pause(py_imageio_obj_t *stream, bool pause) {
 static void int_py_imageio_read_chunk(py_imageio_obj_t *stream, image_t *image, bool pause) {
     FIL *fp = &stream->fp;
 
+    if (stream->version >= INDEXED_VER) {
+        int_py_imageio_skip_index(stream);
+    }
+
     if (f_eof(fp)) {
         mp_raise_msg(&mp_type_EOFError, MP_ERROR_TEXT("End of stream"));
     }
@@ -286,6 +936,7 @@ static void int_py_imageio_read_chunk(py_imageio_obj_t *stream, image_t *image,
 
     uint32_t bpp;
     file_read(fp, &bpp, 4);
+    stream->chunk_codec = CODEC_RAW;
 
     if (stream->version < NEW_PIXFORMAT_VER) {
         if (bpp < 0) {
@@ -309,8 +960,13 @@ static void int_py_imageio_read_chunk(py_imageio_obj_t *stream, image_t *image,
         image->pixfmt = bpp;
         file_read(fp, &image->size, 4);
 
-        char ignore[AFTER_SIZE_PADDING];
-        file_read(fp, ignore, AFTER_SIZE_PADDING);
+        uint32_t padding[AFTER_SIZE_PADDING / sizeof(uint32_t)];
+        file_read(fp, padding, AFTER_SIZE_PADDING);
+
+        if (stream->version >= COMPRESSED_VER) {
+            stream->chunk_codec = padding[0];
+            stream->chunk_stored = padding[1];
+        }
     }
 }
 #endif
@@ -335,6 +991,10 @@ static mp_obj_t py_imageio_read(size_t n_args, const mp_obj_t *pos_args, mp_map_
     } else if (stream->type == IMAGE_IO_FILE_STREAM) {
         FIL *fp = &stream->fp;
 
+        if (stream->version >= INDEXED_VER) {
+            int_py_imageio_skip_index(stream);
+        }
+
         if (f_eof(fp)) {
             if (args[ARG_loop].u_bool == false) {
                 return mp_const_none;
@@ -343,6 +1003,7 @@ static mp_obj_t py_imageio_read(size_t n_args, const mp_obj_t *pos_args, mp_map_
             file_seek(fp, MAGIC_SIZE);
 
             stream->offset = 0;
+            stream->timestamp = 0;
 
             if (f_eof(fp)) {
                 // Empty file
@@ -373,25 +1034,48 @@ static mp_obj_t py_imageio_read(size_t n_args, const mp_obj_t *pos_args, mp_map_
     #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
     } else if (stream->type == IMAGE_IO_FILE_STREAM) {
         FIL *fp = &stream->fp;
-        file_read(fp, image.data, size);
 
-        // Check if original byte reversed data.
-        if ((image.pixfmt == PIXFORMAT_RGB565) && (stream->version == ORIGINAL_VER)) {
-            uint32_t *data_ptr = (uint32_t *) image.data;
-            size_t data_len = image.w * image.h;
+        if ((stream->chunk_codec & CODEC_MASK) == CODEC_LZ4) {
+            const uint8_t *ref = NULL;
+
+            if (stream->chunk_codec & CODEC_DELTA_FLAG) {
+                if ((stream->reference_offset + 1) != ((int) stream->offset)) {
+                    int_py_imageio_reference_load(stream, &image, stream->offset);
+                }
 
-            for (; data_len >= 2; data_len -= 2, data_ptr += 1) {
-                *data_ptr = __REV16(*data_ptr); // long aligned
+                ref = stream->reference.data;
             }
 
-            if (data_len) {
-                *((uint16_t *) data_ptr) = __REV16(*((uint16_t *) data_ptr)); // word aligned
+            int_py_imageio_decode(fp, &image, stream->chunk_stored, ref);
+
+            // Keep the frame around once delta frames have been seen.
+            if (stream->reference.data && ((ref) || int_py_imageio_reference_alloc(stream, &image))) {
+                memcpy(stream->reference.data, image.data, size);
+                stream->reference_offset = stream->offset;
             }
-        }
+        } else if ((stream->chunk_codec & CODEC_MASK) != CODEC_RAW) {
+            mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Invalid image stream codec"));
+        } else {
+            file_read(fp, image.data, size);
+
+            // Check if original byte reversed data.
+            if ((image.pixfmt == PIXFORMAT_RGB565) && (stream->version == ORIGINAL_VER)) {
+                uint32_t *data_ptr = (uint32_t *) image.data;
+                size_t data_len = image.w * image.h;
 
-        if (size % ALIGN_SIZE) {
-            char ignore[ALIGN_SIZE];
-            file_read(fp, ignore, ALIGN_SIZE - (size % ALIGN_SIZE));
+                for (; data_len >= 2; data_len -= 2, data_ptr += 1) {
+                    *data_ptr = __REV16(*data_ptr); // long aligned
+                }
+
+                if (data_len) {
+                    *((uint16_t *) data_ptr) = __REV16(*((uint16_t *) data_ptr)); // word aligned
+                }
+            }
+
+            if (size % ALIGN_SIZE) {
+                char ignore[ALIGN_SIZE];
+                file_read(fp, ignore, ALIGN_SIZE - (size % ALIGN_SIZE));
+            }
         }
 
         if (stream->offset >= stream->count) {
@@ -422,9 +1106,36 @@ static mp_obj_t py_imageio_seek(mp_obj_t self, mp_obj_t offs) {
     }
 
     #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
-    if (stream->type == IMAGE_IO_FILE_STREAM) {
+    if ((stream->type == IMAGE_IO_FILE_STREAM) && (stream->version >= INDEXED_VER)) {
+        FIL *fp = &stream->fp;
+
+        if (stream->count < ((uint32_t) offset)) {
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid stream offset"));
+        }
+
+        stream->timestamp = 0;
+
+        if (offset) {
+            uint32_t *entry = int_py_imageio_index_entry(stream, offset - 1);
+            stream->timestamp = entry[1];
+
+            // Appending to the end of the file.
+            if (((uint32_t) offset) == stream->count) {
+                uint32_t header[CHUNK_HEADER_WORDS];
+                file_seek(fp, entry[0]);
+                file_seek(fp, entry[0] + CHUNK_HEADER_SIZE + int_py_imageio_read_header(fp, header));
+            }
+        } else {
+            file_seek(fp, MAGIC_SIZE); // skip past the file header
+        }
+
+        if (((uint32_t) offset) < stream->count) {
+            file_seek(fp, int_py_imageio_index_entry(stream, offset)[0]);
+        }
+    } else if (stream->type == IMAGE_IO_FILE_STREAM) {
         FIL *fp = &stream->fp;
         file_seek(fp, MAGIC_SIZE); // skip past the file header
+        stream->timestamp = 0;
 
         for (int i = 0; i < offset; i++) {
             image_t image = {};
@@ -450,11 +1161,92 @@ static mp_obj_t py_imageio_seek(mp_obj_t self, mp_obj_t offs) {
 }
 static MP_DEFINE_CONST_FUN_OBJ_2(py_imageio_seek_obj, py_imageio_seek);
 
+// Seeks to the last frame recorded at or before the given time in ms since the stream was opened.
+static mp_obj_t py_imageio_seek_time(mp_obj_t self, mp_obj_t ms_obj) {
+    py_imageio_obj_t *stream = py_imageio_obj(self);
+    int ms = mp_obj_get_int(ms_obj);
+    uint32_t offset = 0;
+
+    if (ms < 0) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid stream time"));
+    }
+
+    if (0) {
+    #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+    } else if ((stream->type == IMAGE_IO_FILE_STREAM) && (stream->version >= INDEXED_VER)) {
+        if (stream->count) {
+            // Binary search the first frames of the groups and then the frames of the group.
+            uint32_t lo = 0, hi = (stream->count - 1) / INDEX_GROUP_FRAMES;
+
+            while (lo < hi) {
+                uint32_t mid = (lo + hi + 1) / 2;
+
+                if (int_py_imageio_index_entry(stream, mid * INDEX_GROUP_FRAMES)[1] <= ((uint32_t) ms)) {
+                    lo = mid;
+                } else {
+                    hi = mid - 1;
+                }
+            }
+
+            hi = IM_MIN((lo + 1) * INDEX_GROUP_FRAMES, stream->count) - 1;
+            lo = lo * INDEX_GROUP_FRAMES;
+
+            while (lo < hi) {
+                uint32_t mid = (lo + hi + 1) / 2;
+
+                if (int_py_imageio_index_entry(stream, mid)[1] <= ((uint32_t) ms)) {
+                    lo = mid;
+                } else {
+                    hi = mid - 1;
+                }
+            }
+
+            offset = lo;
+        }
+    } else if (stream->type == IMAGE_IO_FILE_STREAM) {
+        FIL *fp = &stream->fp;
+        file_seek(fp, MAGIC_SIZE); // skip past the file header
+        stream->timestamp = 0;
+
+        for (uint32_t i = 0; !f_eof(fp); i++) {
+            image_t image = {};
+            int_py_imageio_read_chunk(stream, &image, false);
+
+            if (stream->timestamp > ((uint32_t) ms)) {
+                break;
+            }
+
+            offset = i;
+            file_seek(fp, f_tell(fp) + OMV_ALIGN_TO(image_size(&image), ALIGN_SIZE));
+        }
+    #endif
+    } else if (stream->type == IMAGE_IO_MEMORY_STREAM) {
+        uint32_t timestamp = 0;
+
+        for (uint32_t i = 0; i < stream->count; i++) {
+            timestamp += *((uint32_t *) (stream->buffer + (i * stream->size)));
+
+            if (timestamp > ((uint32_t) ms)) {
+                break;
+            }
+
+            offset = i;
+        }
+    }
+
+    return py_imageio_seek(self, mp_obj_new_int(offset));
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(py_imageio_seek_time_obj, py_imageio_seek_time);
+
 static mp_obj_t py_imageio_sync(mp_obj_t self) {
     #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
     py_imageio_obj_t *stream = py_imageio_obj(self);
 
     if (stream->type == IMAGE_IO_FILE_STREAM) {
+        if (stream->version >= INDEXED_VER) {
+            int_py_imageio_index_flush(stream);
+        }
+
         file_sync(&stream->fp);
     }
     #endif
@@ -469,6 +1261,12 @@ static mp_obj_t py_imageio_close(mp_obj_t self) {
     if (0) {
     #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
     } else if (stream->type == IMAGE_IO_FILE_STREAM) {
+        if (stream->version >= INDEXED_VER) {
+            int_py_imageio_index_flush(stream);
+        }
+
+        m_free(stream->reference.data);
+        stream->reference.data = NULL;
         file_close(&stream->fp);
     #endif
     } else if (stream->type == IMAGE_IO_MEMORY_STREAM) {
@@ -481,25 +1279,50 @@ static mp_obj_t py_imageio_close(mp_obj_t self) {
 }
 static MP_DEFINE_CONST_FUN_OBJ_1(py_imageio_close_obj, py_imageio_close);
 
-static mp_obj_t py_imageio_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
-    mp_arg_check_num(n_args, n_kw, 2, 2, false);
+static mp_obj_t py_imageio_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args) {
+    enum { ARG_stream, ARG_mode, ARG_codec, ARG_keyframe };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_stream, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_mode, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_codec, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = CODEC_RAW} },
+        { MP_QSTR_keyframe, MP_ARG_INT | MP_ARG_KW_ONLY, {.u_int = 30} },
+    };
+
+    // Parse args.
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if ((args[ARG_codec].u_int != CODEC_RAW) && (args[ARG_codec].u_int != CODEC_LZ4)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid stream codec"));
+    }
+
+    if (args[ARG_keyframe].u_int < 1) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid key frame interval"));
+    }
+
     py_imageio_obj_t *stream = mp_obj_malloc_with_finaliser(py_imageio_obj_t, &py_imageio_type);
     stream->closed = false;
 
     if (0) {
     #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
-    } else if (mp_obj_is_str(args[0])) {
+    } else if (mp_obj_is_str(args[ARG_stream].u_obj)) {
         // File Stream I/O
         FIL *fp = &stream->fp;
         stream->type = IMAGE_IO_FILE_STREAM;
         stream->count = 0;
+        stream->codec = args[ARG_codec].u_int;
+        stream->keyframe = args[ARG_keyframe].u_int;
+        stream->chunk_codec = CODEC_RAW;
+        stream->reference.data = NULL;
+        stream->reference_size = 0;
+        stream->reference_offset = -1;
 
-        char mode = mp_obj_str_get_str(args[1])[0];
+        char mode = mp_obj_str_get_str(args[ARG_mode].u_obj)[0];
 
         if ((mode == 'W') || (mode == 'w')) {
-            file_open(fp, mp_obj_str_get_str(args[0]), false, FA_READ | FA_WRITE | FA_OPEN_ALWAYS);
-            const char string[] = "OMV IMG STR V2.0";
-            stream->version = NEW_PIXFORMAT_VER;
+            file_open(fp, mp_obj_str_get_str(args[ARG_stream].u_obj), false, FA_READ | FA_WRITE | FA_OPEN_ALWAYS);
+            const char string[] = "OMV IMG STR V2.2";
+            stream->version = COMPRESSED_VER;
 
             // Overwrite if file is too small.
             if (f_size(fp) < MAGIC_SIZE) {
@@ -518,7 +1341,9 @@ static mp_obj_t py_imageio_make_new(const mp_obj_type_t *type, size_t n_args, si
                     || (period != ((uint8_t) '.'))
                     || (version != ORIGINAL_VER)
                     || (version != RGB565_FIXED_VER)
-                    || (version != NEW_PIXFORMAT_VER)) {
+                    || (version != NEW_PIXFORMAT_VER)
+                    || (version != INDEXED_VER)
+                    || (version != COMPRESSED_VER)) {
                     file_seek(fp, 0);
                     file_write(fp, string, sizeof(string) - 1); // exclude null terminator
                 } else {
@@ -530,7 +1355,7 @@ static mp_obj_t py_imageio_make_new(const mp_obj_type_t *type, size_t n_args, si
 
         if ((mode == 'R') || (mode == 'r')) {
             uint8_t version_hi, version_lo;
-            file_open(fp, mp_obj_str_get_str(args[0]), false, FA_READ | FA_WRITE | FA_OPEN_EXISTING);
+            file_open(fp, mp_obj_str_get_str(args[ARG_stream].u_obj), false, FA_READ | FA_WRITE | FA_OPEN_EXISTING);
             file_read_check(fp, "OMV IMG STR ", 12); // Magic
             file_read_check(fp, "V", 1);
             file_read(fp, &version_hi, 1);
@@ -541,19 +1366,27 @@ static mp_obj_t py_imageio_make_new(const mp_obj_type_t *type, size_t n_args, si
 
             if ((stream->version != ORIGINAL_VER)
                 && (stream->version != RGB565_FIXED_VER)
-                && (stream->version != NEW_PIXFORMAT_VER)) {
-                mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Expected version V1.0, V1.1, or V2.0"));
+                && (stream->version != NEW_PIXFORMAT_VER)
+                && (stream->version != INDEXED_VER)
+                && (stream->version != COMPRESSED_VER)) {
+                mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Expected version V1.0, V1.1, V2.0, V2.1, or V2.2"));
+            }
+
+            if (stream->version >= INDEXED_VER) {
+                int_py_imageio_index_open(stream, true);
             }
-        } else if ((mode != 'W') && (mode != 'w')) {
+        } else if ((mode == 'W') || (mode == 'w')) {
+            int_py_imageio_index_open(stream, false);
+        } else {
             mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid stream mode, expected 'R/r' or 'W/w'"));
         }
     #endif
-    } else if (mp_obj_is_type(args[0], &mp_type_tuple)) {
+    } else if (mp_obj_is_type(args[ARG_stream].u_obj, &mp_type_tuple)) {
         // Memory Stream I/O
         stream->type = IMAGE_IO_MEMORY_STREAM;
 
         mp_obj_t *image_info;
-        mp_obj_get_array_fixed_n(args[0], 3, &image_info);
+        mp_obj_get_array_fixed_n(args[ARG_stream].u_obj, 3, &image_info);
         int w = mp_obj_get_int(image_info[0]);
         int h = mp_obj_get_int(image_info[1]);
         int pixfmt = mp_obj_get_int(image_info[2]);
@@ -570,7 +1403,7 @@ static mp_obj_t py_imageio_make_new(const mp_obj_type_t *type, size_t n_args, si
             image.pixfmt = PIXFORMAT_BINARY;
         }
 
-        stream->count = mp_obj_get_int(args[1]);
+        stream->count = mp_obj_get_int(args[ARG_mode].u_obj);
         stream->size = IMAGE_T_SIZE_ALIGNED + OMV_ALIGN_TO(image_size(&image), IMAGE_ALIGNMENT);
 
         fb_alloc_mark();
@@ -591,6 +1424,8 @@ static const mp_rom_map_elem_t py_imageio_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR___del__),         MP_ROM_PTR(&py_imageio_close_obj)       },
     { MP_ROM_QSTR(MP_QSTR_FILE_STREAM),     MP_ROM_INT(IMAGE_IO_FILE_STREAM)        },
     { MP_ROM_QSTR(MP_QSTR_MEMORY_STREAM),   MP_ROM_INT(IMAGE_IO_MEMORY_STREAM)      },
+    { MP_ROM_QSTR(MP_QSTR_CODEC_RAW),       MP_ROM_INT(CODEC_RAW)                   },
+    { MP_ROM_QSTR(MP_QSTR_CODEC_LZ4),       MP_ROM_INT(CODEC_LZ4)                   },
     { MP_ROM_QSTR(MP_QSTR_type),            MP_ROM_PTR(&py_imageio_get_type_obj)    },
     { MP_ROM_QSTR(MP_QSTR_is_closed),       MP_ROM_PTR(&py_imageio_is_closed_obj)   },
     { MP_ROM_QSTR(MP_QSTR_count),           MP_ROM_PTR(&py_imageio_count_obj)       },
@@ -605,6 +1440,7 @@ static const mp_rom_map_elem_t py_imageio_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_write),           MP_ROM_PTR(&py_imageio_write_obj)       },
     { MP_ROM_QSTR(MP_QSTR_read),            MP_ROM_PTR(&py_imageio_read_obj)        },
     { MP_ROM_QSTR(MP_QSTR_seek),            MP_ROM_PTR(&py_imageio_seek_obj)        },
+    { MP_ROM_QSTR(MP_QSTR_seek_time),       MP_ROM_PTR(&py_imageio_seek_time_obj)   },
     { MP_ROM_QSTR(MP_QSTR_sync),            MP_ROM_PTR(&py_imageio_sync_obj)        },
     { MP_ROM_QSTR(MP_QSTR_close),           MP_ROM_PTR(&py_imageio_close_obj)       }
 };
@@ -60,7 +60,7 @@ static void py_mjpeg_print(const mp_print_t *print, mp_obj_t self_in, mp_print_k
               self->width,
               self->height,
               self->frames,
-              f_size(&self->fp));
+              file_size(&self->fp));
 }
 
 static mp_obj_t py_mjpeg_is_closed(mp_obj_t self_in) {
@@ -89,7 +89,7 @@ static MP_DEFINE_CONST_FUN_OBJ_1(py_mjpeg_count_obj, py_mjpeg_count);
 
 static mp_obj_t py_mjpeg_size(mp_obj_t self_in) {
     py_mjpeg_obj_t *self = MP_OBJ_TO_PTR(self_in);
-    return mp_obj_new_int(f_size(&self->fp));
+    return mp_obj_new_int(file_size(&self->fp));
 }
 static MP_DEFINE_CONST_FUN_OBJ_1(py_mjpeg_size_obj, py_mjpeg_size);
 
@@ -199,7 +199,7 @@ static mp_obj_t py_mjpeg_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t
     mjpeg->width = (args[ARG_width].u_int == -1) ? framebuffer_get_width(fb) : args[ARG_width].u_int;
     mjpeg->height = (args[ARG_height].u_int == -1) ? framebuffer_get_height(fb) : args[ARG_height].u_int;
 
-    file_open(&mjpeg->fp, path, false, FA_WRITE | FA_CREATE_ALWAYS);
+    file_open(&mjpeg->fp, path, false, FA_WRITE | FA_CREATE_ALWAYS | FILE_WRITE_BEHIND | FILE_HEAP_OWNER);
     mjpeg_open(&mjpeg->fp, mjpeg->width, mjpeg->height);
     return mjpeg;
 }
@@ -41,6 +41,8 @@
 #define LCD_COMMAND_DISPON          (0x29)
 #define LCD_COMMAND_RAMWR           (0x2C)
 #define LCD_COMMAND_SLPOUT          (0x11)
+#define LCD_COMMAND_CASET           (0x2A)
+#define LCD_COMMAND_RASET           (0x2B)
 #define LCD_COMMAND_MADCTL          (0x36)
 #define LCD_COMMAND_COLMOD          (0x3A)
 
@@ -133,6 +135,152 @@ static void spi_display_command(py_display_obj_t *self, uint8_t cmd, uint8_t arg
     spi_write(self, cmd, &arg, (arg > 0) ? 1 : 0, false);
 }
 
+// Commands sent by user code may move the address window or change the panel
+// contents so the next frame is sent in full.
+static int spi_bus_write(py_display_obj_t *self, uint8_t cmd, uint8_t *args, size_t n_args, bool dcs) {
+    self->row_hashes_valid = false;
+    return spi_write(self, cmd, args, n_args, dcs);
+}
+
+// Row sink for writes without triple buffering. Rows are sent through an
+// address window that spans columns [x_start, x_end). With partial refresh a
+// row is only sent when its hash differs from the one sent last time and each
+// run of dirty rows gets its own window. With bands, rows are packed into one
+// of two band buffers and a full band is sent by DMA while the next band is
+// drawn into the other buffer.
+typedef struct spi_display_rows {
+    py_display_obj_t *self;
+    int x_start;
+    int x_end;
+    int next_y;
+    bool window_open;
+    uint16_t *bands[2];
+    int band;
+    int band_lines;
+    int band_count;
+    volatile bool band_busy;
+} spi_display_rows_t;
+
+static uint32_t spi_display_row_hash(const uint16_t *row, int width) {
+    // FNV-1a over pixels.
+    uint32_t hash = 0x811C9DC5;
+    for (int i = 0; i < width; i++) {
+        hash = (hash ^ row[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+static void spi_display_band_callback(omv_spi_t *spi, void *userdata, void *buf) {
+    ((spi_display_rows_t *) userdata)->band_busy = false;
+}
+
+static void spi_display_band_wait(spi_display_rows_t *state) {
+    for (mp_uint_t start = mp_hal_ticks_ms(); state->band_busy;) {
+        if ((mp_hal_ticks_ms() - start) >= 1000) {
+            omv_spi_transfer_abort(&state->self->spi_bus);
+            state->band_busy = false;
+        }
+    }
+}
+
+static void spi_display_band_flush(spi_display_rows_t *state) {
+    if (!state->band_count) {
+        return;
+    }
+
+    py_display_obj_t *self = state->self;
+    uint16_t *band = state->bands[state->band];
+    size_t size = state->band_count * (state->x_end - state->x_start);
+
+    #ifdef __DCACHE_PRESENT
+    // Flush data for DMA
+    SCB_CleanDCache_by_Addr((uint32_t *) band, size * sizeof(uint16_t));
+    #endif
+
+    // Only one band is in flight at a time, the other one is being filled.
+    spi_display_band_wait(state);
+    state->band_busy = true;
+
+    omv_spi_transfer_t spi_xfer = {
+        .txbuf = band,
+        .size = (!self->byte_swap) ? size : (size * 2),
+        .flags = OMV_SPI_XFER_DMA,
+        .userdata = state,
+        .callback = spi_display_band_callback,
+    };
+
+    if (omv_spi_transfer_start(&self->spi_bus, &spi_xfer) != 0) {
+        state->band_busy = false;
+    }
+
+    state->band ^= 1;
+    state->band_count = 0;
+}
+
+static void spi_display_window_close(spi_display_rows_t *state) {
+    if (state->window_open) {
+        spi_display_band_flush(state);
+        spi_display_band_wait(state);
+        spi_switch_mode(state->self, 8, false);
+        omv_gpio_write(OMV_SPI_DISPLAY_SSEL_PIN, 1);
+        state->window_open = false;
+    }
+}
+
+static void spi_display_write_row(spi_display_rows_t *state, int y, uint16_t *row) {
+    py_display_obj_t *self = state->self;
+
+    if (self->row_hashes) {
+        uint32_t hash = spi_display_row_hash(row, self->width);
+
+        if (self->row_hashes_valid && (self->row_hashes[y] == hash)) {
+            return;
+        }
+
+        self->row_hashes[y] = hash;
+    }
+
+    if (state->x_start >= state->x_end) {
+        return;
+    }
+
+    // Open a new window from this row to the bottom of the panel unless this
+    // row directly follows the last row sent.
+    if ((!state->window_open) || (state->next_y != y)) {
+        spi_display_window_close(state);
+
+        if (self->partial_refresh) {
+            uint16_t x_end = state->x_end - 1, y_end = self->height - 1;
+            spi_write(self, LCD_COMMAND_CASET, (uint8_t []) {
+                state->x_start >> 8, state->x_start, x_end >> 8, x_end
+            }, 4, false);
+            spi_write(self, LCD_COMMAND_RASET, (uint8_t []) {
+                y >> 8, y, y_end >> 8, y_end
+            }, 4, false);
+        }
+
+        spi_display_command(self, LCD_COMMAND_RAMWR, 0);
+        spi_switch_mode(self, (!self->byte_swap) ? 16 : 8, true);
+        omv_gpio_write(OMV_SPI_DISPLAY_SSEL_PIN, 0);
+        state->window_open = true;
+    }
+
+    int width = state->x_end - state->x_start;
+
+    if (state->band_lines) {
+        memcpy(state->bands[state->band] + (state->band_count * width),
+               row + state->x_start, width * sizeof(uint16_t));
+
+        if (++state->band_count == state->band_lines) {
+            spi_display_band_flush(state);
+        }
+    } else {
+        spi_transmit_16(self, (uint8_t *) (row + state->x_start), width);
+    }
+
+    state->next_y = y + 1;
+}
+
 static void spi_display_callback(omv_spi_t *spi, void *userdata, void *buf) {
     py_display_obj_t *self = (py_display_obj_t *) userdata;
 
@@ -209,8 +357,30 @@ static void spi_display_kick(py_display_obj_t *self) {
 }
 
 static void spi_display_draw_image_cb(int x_start, int x_end, int y_row, imlib_draw_row_data_t *data) {
-    py_display_obj_t *lcd_self = (py_display_obj_t *) data->callback_arg;
-    spi_transmit_16(lcd_self, data->dst_row_override, lcd_self->width);
+    spi_display_write_row((spi_display_rows_t *) data->callback_arg, y_row, data->dst_row_override);
+}
+
+// Zeros the parts of a framebuffer covered by the old bounds but not the new
+// bounds. Everything outside of the old bounds is already black.
+static void spi_display_zero_margins(image_t *dst_img, rectangle_t *old, point_t *p0, point_t *p1) {
+    for (int i = old->y, ii = old->y + old->h; i < ii; i++) {
+        uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(dst_img, i);
+        int x_start = old->x, x_end = old->x + old->w;
+
+        if ((i < p0->y) || (i >= p1->y)) {
+            memset(row_ptr + x_start, 0, (x_end - x_start) * sizeof(uint16_t));
+            continue;
+        }
+
+        if (x_start < p0->x) {
+            memset(row_ptr + x_start, 0, (IM_MIN(x_end, p0->x) - x_start) * sizeof(uint16_t));
+        }
+
+        if (x_end > p1->x) {
+            int x = IM_MAX(x_start, p1->x);
+            memset(row_ptr + x, 0, (x_end - x) * sizeof(uint16_t));
+        }
+    }
 }
 
 static void spi_display_write(py_display_obj_t *self, image_t *src_img, int dst_x_start, int dst_y_start,
@@ -226,43 +396,75 @@ static void spi_display_write(py_display_obj_t *self, image_t *src_img, int dst_
                                 y_scale, roi, alpha, alpha_palette, hint, &p0, &p1);
     bool black = p0.x == -1;
 
+    if (black) {
+        p0.x = p0.y = p1.x = p1.y = 0;
+    }
+
     if (!self->triple_buffer) {
         dst_img.data = fb_alloc0(self->width * sizeof(uint16_t), FB_ALLOC_NO_HINT);
 
-        spi_display_command(self, LCD_COMMAND_RAMWR, 0);
-        spi_switch_mode(self, (!self->byte_swap) ? 16 : 8, true);
-        omv_gpio_write(OMV_SPI_DISPLAY_SSEL_PIN, 0);
+        spi_display_rows_t state = {
+            .self = self,
+            .x_start = 0,
+            .x_end = self->width,
+            .band_lines = self->band_lines,
+        };
 
-        if (black) {
-            // zero the whole image
-            for (int i = 0; i < self->height; i++) {
-                spi_transmit_16(self, dst_img.data, self->width);
-            }
-        } else {
-            // Zero the top rows
-            for (int i = 0; i < p0.y; i++) {
-                spi_transmit_16(self, dst_img.data, self->width);
+        if (state.band_lines) {
+            for (int i = 0; i < 2; i++) {
+                state.bands[i] = fb_alloc(state.band_lines * self->width * sizeof(uint16_t), FB_ALLOC_CACHE_ALIGN);
             }
+        }
 
-            // Transmits left/right parts already zeroed...
-            imlib_draw_image(&dst_img, src_img, dst_x_start, dst_y_start,
-                             x_scale, y_scale, roi, rgb_channel, alpha, color_palette, alpha_palette,
-                             hint | IMAGE_HINT_BLACK_BACKGROUND, spi_display_draw_image_cb, self, dst_img.data);
+        // Columns outside of both the old and new bounds are black in both
+        // frames so only the columns inside either of them are sent.
+        if (self->row_hashes && self->row_hashes_valid) {
+            state.x_start = self->width;
+            state.x_end = 0;
 
-            // Zero the bottom rows
-            if (p1.y < self->height) {
-                memset(dst_img.data, 0, self->width * sizeof(uint16_t));
+            if (self->bounds.w) {
+                state.x_start = self->bounds.x;
+                state.x_end = self->bounds.x + self->bounds.w;
             }
 
-            for (int i = p1.y; i < self->height; i++) {
-                spi_transmit_16(self, dst_img.data, self->width);
+            if (!black) {
+                state.x_start = IM_MIN(state.x_start, p0.x);
+                state.x_end = IM_MAX(state.x_end, p1.x);
             }
         }
 
-        spi_switch_mode(self, 8, false);
-        omv_gpio_write(OMV_SPI_DISPLAY_SSEL_PIN, 1);
+        // Zero the top rows
+        for (int i = 0; i < p0.y; i++) {
+            spi_display_write_row(&state, i, (uint16_t *) dst_img.data);
+        }
+
+        // Left/right parts of the row buffer are already zeroed...
+        if (!black) {
+            imlib_draw_image(&dst_img, src_img, dst_x_start, dst_y_start,
+                             x_scale, y_scale, roi, rgb_channel, alpha, color_palette, alpha_palette,
+                             hint | IMAGE_HINT_BLACK_BACKGROUND, spi_display_draw_image_cb, &state, dst_img.data);
+            memset(dst_img.data, 0, self->width * sizeof(uint16_t));
+        }
+
+        // Zero the bottom rows
+        for (int i = p1.y; i < self->height; i++) {
+            spi_display_write_row(&state, i, (uint16_t *) dst_img.data);
+        }
+
+        spi_display_window_close(&state);
         spi_display_command(self, LCD_COMMAND_DISPON, 0);
-        fb_free();
+
+        if (self->row_hashes) {
+            rectangle_init(&self->bounds, p0.x, p0.y, p1.x - p0.x, p1.y - p0.y);
+            self->row_hashes_valid = true;
+        }
+
+        if (state.band_lines) {
+            fb_free(); // state.bands[1]
+            fb_free(); // state.bands[0]
+        }
+
+        fb_free(); // dst_img.data
     } else {
         // For triple buffering we are never drawing where tail or head
         // (which may instantly update to to be equal to tail) is.
@@ -272,39 +474,15 @@ static void spi_display_write(py_display_obj_t *self, image_t *src_img, int dst_
         }
         dst_img.data = (uint8_t *) self->framebuffers[new_framebuffer_tail];
 
-        if (black) {
-            // zero the whole image
-            memset(dst_img.data, 0, self->width * self->height * sizeof(uint16_t));
-        } else {
-            // Zero the top rows
-            if (p0.y) {
-                memset(dst_img.data, 0, self->width * p0.y * sizeof(uint16_t));
-            }
-
-            if (p0.x) {
-                for (int i = p0.y; i < p1.y; i++) {
-                    // Zero left
-                    memset(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&dst_img, i), 0, p0.x * sizeof(uint16_t));
-                }
-            }
+        // Only the margins the last image drawn into this framebuffer covered
+        // need to be cleared, the rest of the framebuffer is already black.
+        spi_display_zero_margins(&dst_img, &self->framebuffer_bounds[new_framebuffer_tail], &p0, &p1);
+        rectangle_init(&self->framebuffer_bounds[new_framebuffer_tail], p0.x, p0.y, p1.x - p0.x, p1.y - p0.y);
 
+        if (!black) {
             imlib_draw_image(&dst_img, src_img, dst_x_start, dst_y_start,
                              x_scale, y_scale, roi, rgb_channel, alpha, color_palette,
                              alpha_palette, hint | IMAGE_HINT_BLACK_BACKGROUND, NULL, NULL, NULL);
-
-            if (self->width - p1.x) {
-                for (int i = p0.y; i < p1.y; i++) {
-                    // Zero right
-                    memset(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&dst_img, i) + p1.x, 0,
-                           (self->width - p1.x) * sizeof(uint16_t));
-                }
-            }
-
-            // Zero the bottom rows
-            if (self->height - p1.y) {
-                memset(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&dst_img, p1.y),
-                       0, self->width * (self->height - p1.y) * sizeof(uint16_t));
-            }
         }
 
         #ifdef __DCACHE_PRESENT
@@ -361,7 +539,7 @@ static void spi_display_deinit(py_display_obj_t *self) {
 mp_obj_t spi_display_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args) {
     enum {
         ARG_width, ARG_height, ARG_refresh, ARG_bgr, ARG_byte_swap, ARG_hmirror, ARG_vflip,
-        ARG_triple_buffer, ARG_controller, ARG_backlight
+        ARG_triple_buffer, ARG_controller, ARG_backlight, ARG_partial_refresh, ARG_band_lines
     };
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_width,         MP_ARG_INT,  {.u_int = 128  } },
@@ -374,6 +552,8 @@ mp_obj_t spi_display_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
         { MP_QSTR_triple_buffer, MP_ARG_BOOL, {.u_bool = LCD_TRIPLE_BUFFER_DEFAULT} },
         { MP_QSTR_controller,    MP_ARG_OBJ | MP_ARG_KW_ONLY, {.u_rom_obj = MP_ROM_NONE} },
         { MP_QSTR_backlight,     MP_ARG_OBJ | MP_ARG_KW_ONLY, {.u_rom_obj = MP_ROM_NONE} },
+        { MP_QSTR_partial_refresh, MP_ARG_BOOL | MP_ARG_KW_ONLY, {.u_bool = false} },
+        { MP_QSTR_band_lines,    MP_ARG_INT  | MP_ARG_KW_ONLY, {.u_int = 0} },
     };
 
     // Parse args.
@@ -389,6 +569,9 @@ mp_obj_t spi_display_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
     if ((args[ARG_refresh].u_int < 1) || (args[ARG_refresh].u_int > 120)) {
         mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid Refresh Rate!"));
     }
+    if (args[ARG_band_lines].u_int < 0) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid Band Lines!"));
+    }
 
     py_display_obj_t *self = mp_obj_malloc_with_finaliser(py_display_obj_t, &py_spi_display_type);
     self->framebuffer_tail = 0;
@@ -401,6 +584,27 @@ mp_obj_t spi_display_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
     self->byte_swap = args[ARG_byte_swap].u_bool;
     self->controller = args[ARG_controller].u_obj;
     self->bl_controller = args[ARG_backlight].u_obj;
+    // Partial refresh uses the standard DCS column/row address commands which
+    // custom controllers may not implement. It's opt-in since dirty rows are
+    // found by hash alone and a collision leaves a stale row on the panel
+    // until it changes again.
+    self->partial_refresh = args[ARG_partial_refresh].u_bool && (self->controller == mp_const_none);
+    self->row_hashes_valid = false;
+    self->row_hashes = NULL;
+    rectangle_init(&self->bounds, 0, 0, 0, 0);
+    // Bands are sent with a single DMA transfer each so they're limited to the
+    // max transfer size. Panels with rows wider than that keep the per-row
+    // transfers. Triple buffering already overlaps drawing and sending.
+    self->band_lines = 0;
+    #if !OMV_SPI_NO_DMA
+    if (!self->triple_buffer) {
+        uint32_t max_xfer = (!self->byte_swap) ? OMV_SPI_MAX_16BIT_XFER : (OMV_SPI_MAX_8BIT_XFER / 2);
+        self->band_lines = IM_MIN((uint32_t) args[ARG_band_lines].u_int, max_xfer / self->width);
+    }
+    #endif
+    for (int i = 0; i < FRAMEBUFFER_COUNT; i++) {
+        rectangle_init(&self->framebuffer_bounds[i], 0, 0, 0, 0);
+    }
 
     omv_spi_config_t spi_config;
     omv_spi_default_config(&spi_config, OMV_SPI_DISPLAY_CONTROLLER);
@@ -459,6 +663,8 @@ mp_obj_t spi_display_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
             self->framebuffers[i] = (uint16_t *) fb_alloc0(fb_size, FB_ALLOC_CACHE_ALIGN);
         }
         fb_alloc_mark_permanent();
+    } else if (self->partial_refresh) {
+        self->row_hashes = m_new(uint32_t, self->height);
     }
 
     return MP_OBJ_FROM_PTR(self);
@@ -471,7 +677,7 @@ static const py_display_p_t py_display_p = {
     #ifdef OMV_SPI_DISPLAY_BL_PIN
     .set_backlight = spi_display_set_backlight,
     #endif
-    .bus_write = spi_write,
+    .bus_write = spi_bus_write,
 };
 
 MP_DEFINE_CONST_OBJ_TYPE(
@@ -244,6 +244,9 @@ soft_reset_exit:
     #endif
     machine_pwm_deinit_all();
     soft_timer_deinit();
+    #ifdef IMLIB_ENABLE_IMAGE_FILE_IO
+    file_queue_deinit();
+    #endif
     gc_sweep_all();
     mp_deinit();
     first_soft_reset = false;
@@ -63,6 +63,7 @@
 #include "omv_csi.h"
 #include "usbdbg.h"
 #include "tinyusb_debug.h"
+#include "file_utils.h"
 #include "py_fir.h"
 #if MICROPY_PY_AUDIO
 #include "py_audio.h"
@@ -275,6 +276,9 @@ soft_reset_exit:
     rp2_dma_deinit();
     machine_pwm_deinit_all();
     machine_pin_deinit();
+    #ifdef IMLIB_ENABLE_IMAGE_FILE_IO
+    file_queue_deinit();
+    #endif
     gc_sweep_all();
     mp_deinit();
     first_soft_reset = false;
@@ -171,6 +171,7 @@ target_sources(${MICROPY_TARGET} PRIVATE
     ${TOP_DIR}/lib/imlib/lbp.c
     ${TOP_DIR}/lib/imlib/line.c
     ${TOP_DIR}/lib/imlib/lsd.c
+    ${TOP_DIR}/lib/imlib/mask.c
     ${TOP_DIR}/lib/imlib/mathop.c
     ${TOP_DIR}/lib/imlib/mjpeg.c
     ${TOP_DIR}/lib/imlib/orb.c
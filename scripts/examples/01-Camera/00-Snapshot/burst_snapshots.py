@@ -0,0 +1,39 @@
+# This work is licensed under the MIT license.
+# Copyright (c) 2013-2023 OpenMV LLC. All rights reserved.
+# https://github.com/openmv/openmv/blob/master/LICENSE
+#
+# Burst Snapshots Example
+#
+# Note: You will need an SD card to run this example.
+#
+# This example saves a burst of images using the write-behind queue. With the
+# queue enabled img.save() returns as soon as the file data is queued in RAM and
+# the SD card writes happen in the background between frames.
+
+import sensor
+import image
+import time
+
+sensor.reset()  # Reset and initialize the sensor.
+sensor.set_pixformat(sensor.RGB565)  # Set pixel format to RGB565 (or GRAYSCALE)
+sensor.set_framesize(sensor.QVGA)  # Set frame size to QVGA (320x240)
+sensor.skip_frames(time=2000)  # Wait for settings take effect.
+
+# Queue up to 16 x 4KB of file data.
+image.write_behind(16, buffer_size=4096)
+
+clock = time.clock()
+for i in range(30):
+    clock.tick()
+    img = sensor.snapshot()
+    img.save("burst_%02d.jpg" % i, quality=90)
+    print(clock.fps())
+
+# Wait for all the files to be written out.
+image.write_behind_flush()
+
+# (queued bytes, written bytes, stalls, high water mark, errors)
+# If stalls is high the queue needs more buffers to keep up with the camera.
+print(image.write_behind_stats())
+
+raise (Exception("Please reset the camera to see the new files."))
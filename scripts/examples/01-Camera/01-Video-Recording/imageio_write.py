@@ -23,7 +23,9 @@ sensor.skip_frames(time=2000)  # Wait for settings take effect.
 clock = time.clock()  # Create a clock object to track the FPS.
 
 led = machine.LED("LED_RED")
-stream = image.ImageIO("stream.bin", "w")
+# Frames are stored losslessly compressed with CODEC_LZ4 (use CODEC_RAW for the fastest writes).
+# Every keyframe'th frame is stored whole, the others as deltas against the previous frame.
+stream = image.ImageIO("stream.bin", "w", codec=image.ImageIO.CODEC_LZ4, keyframe=30)
 
 # Red LED on means we are capturing frames.
 led.on()
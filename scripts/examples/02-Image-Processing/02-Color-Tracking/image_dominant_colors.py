@@ -0,0 +1,38 @@
+# This work is licensed under the MIT license.
+# Copyright (c) 2013-2023 OpenMV LLC. All rights reserved.
+# https://github.com/openmv/openmv/blob/master/LICENSE
+#
+# Image Dominant Colors Example
+#
+# This script finds the dominant colors of the image with k-means clustering. The
+# clusters of the last frame are passed back in as the starting centroids so each
+# frame only needs a few iterations to converge and the palette order stays stable.
+
+import sensor
+import time
+
+sensor.reset()
+sensor.set_pixformat(sensor.RGB565)
+sensor.set_framesize(sensor.QVGA)
+sensor.skip_frames(time=2000)
+sensor.set_auto_gain(False)  # must be turned off for color tracking
+sensor.set_auto_whitebal(False)  # must be turned off for color tracking
+clock = time.clock()
+
+colors = None
+
+while True:
+    clock.tick()
+    img = sensor.snapshot()
+    # A list of ((r, g, b), count) sorted by count. Only every 4th pixel of every 4th row is used.
+    colors = img.dominant_colors(k=6, stride=4, iterations=5, centroids=colors)
+
+    # Draw the palette as a bar sized by how much of the image each color covers.
+    total = sum(count for rgb, count in colors)
+    x = 0
+    for rgb, count in colors:
+        w = (count * img.width()) // total
+        img.draw_rectangle(x, img.height() - 16, w, 16, color=rgb, fill=True)
+        x += w
+
+    print(colors, clock.fps())
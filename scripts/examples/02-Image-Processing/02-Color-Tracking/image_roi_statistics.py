@@ -0,0 +1,32 @@
+# This work is licensed under the MIT license.
+# Copyright (c) 2013-2023 OpenMV LLC. All rights reserved.
+# https://github.com/openmv/openmv/blob/master/LICENSE
+#
+# Image ROI Statistics Example
+#
+# This script computes the statistics of a grid of ROIs at once. roi_stats() indexes
+# the image once in 8x8 blocks and then only reads the pixels along the edges of each
+# ROI, which is much faster than calling get_statistics() for every ROI. The index takes
+# about 14 bytes per block and channel (about 18KB for a QVGA grayscale image).
+
+import sensor
+import time
+
+sensor.reset()
+sensor.set_pixformat(sensor.GRAYSCALE)  # or RGB565.
+sensor.set_framesize(sensor.QVGA)
+sensor.skip_frames(time=2000)
+sensor.set_auto_gain(False)  # must be turned off for color tracking
+sensor.set_auto_whitebal(False)  # must be turned off for color tracking
+clock = time.clock()
+
+# An 8x6 grid of 40x40 ROIs.
+rois = [(x * 40, y * 40, 40, 40) for y in range(6) for x in range(8)]
+
+while True:
+    clock.tick()
+    img = sensor.snapshot()
+    # Grayscale returns (mean, stdev, min, max) per ROI and RGB565 returns the same for L, A and B.
+    stats = img.roi_stats(rois)
+    print(stats[0])
+    print(clock.fps())
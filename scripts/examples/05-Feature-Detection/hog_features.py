@@ -0,0 +1,45 @@
+# This work is licensed under the MIT license.
+# Copyright (c) 2013-2024 OpenMV LLC. All rights reserved.
+# https://github.com/openmv/openmv/blob/master/LICENSE
+#
+# HoG Features Example
+#
+# This example shows how to extract HoG feature vectors for sliding window detection.
+#
+# The gradients of the image are binned into cells once per frame and every window
+# reuses the normalized blocks it overlaps. Each vector can be scored by a linear SVM
+# (a dot product with its weights plus a bias) or passed to an ml model. Here the
+# vector of the window in the center of the first frame is used as the reference and
+# the closest window of each new frame is drawn.
+
+import sensor
+import time
+from ulab import numpy as np
+
+sensor.reset()
+sensor.set_framesize(sensor.QQVGA)
+sensor.set_pixformat(sensor.GRAYSCALE)
+sensor.skip_frames(time=2000)
+
+CELL_SIZE = 8
+WINDOW = (32, 64)  # Pedestrian shaped window in pixels (4x8 cells).
+
+img = sensor.snapshot()
+x = ((img.width() - WINDOW[0]) // (2 * CELL_SIZE)) * CELL_SIZE
+y = ((img.height() - WINDOW[1]) // (2 * CELL_SIZE)) * CELL_SIZE
+reference = img.hog_features(roi=(x, y) + WINDOW, size=CELL_SIZE)
+
+clock = time.clock()
+while True:
+    clock.tick()
+    img = sensor.snapshot()
+
+    best = None
+    for rect, features in img.hog_features(size=CELL_SIZE, window=WINDOW, stride=1):
+        d = features - reference
+        score = np.sum(d * d)
+        if best is None or score < best[0]:
+            best = (score, rect)
+
+    img.draw_rectangle(best[1], color=255)
+    print(best[0], clock.fps())
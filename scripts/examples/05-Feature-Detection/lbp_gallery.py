@@ -0,0 +1,46 @@
+# This work is licensed under the MIT license.
+# Copyright (c) 2013-2024 OpenMV LLC. All rights reserved.
+# https://github.com/openmv/openmv/blob/master/LICENSE
+#
+# LBP Gallery Example
+#
+# This example enrolls the first few faces it sees into an LBP gallery and then
+# matches every new face against the whole gallery in a single call.
+#
+# A gallery can also be built from descriptor files saved with image.save_descriptor():
+#
+#   gallery = image.LBPGallery(["/faces/%d.lbp" % i for i in range(100)])
+
+import sensor
+import time
+import image
+
+ENROLL = 10  # Number of faces to enroll.
+
+sensor.reset()
+sensor.set_contrast(1)
+sensor.set_gainceiling(16)
+sensor.set_framesize(sensor.HQVGA)
+sensor.set_pixformat(sensor.GRAYSCALE)
+sensor.skip_frames(time=2000)
+
+face_cascade = image.HaarCascade("/rom/haarcascade_frontalface.cascade", stages=25)
+gallery = image.LBPGallery()
+clock = time.clock()
+
+while True:
+    clock.tick()
+    img = sensor.snapshot()
+
+    for face in img.find_features(face_cascade, threshold=0.5, scale_factor=1.25):
+        desc = img.find_lbp(face)
+        if len(gallery) < ENROLL:
+            gallery.append(desc)
+            img.draw_string(face[0], face[1] - 10, "Enrolled %d" % len(gallery))
+        else:
+            # The 3 closest faces as (index, distance) sorted by distance.
+            matches = gallery.match(desc, k=3)
+            img.draw_string(face[0], face[1] - 10, "Face %d (%d)" % matches[0])
+        img.draw_rectangle(face)
+
+    print(clock.fps())
@@ -3,6 +3,11 @@
 # https://github.com/openmv/openmv/blob/master/LICENSE
 #
 # Selective Search Example
+#
+# Selective search segments the image into regions and then greedily merges the most
+# similar neighbors, returning the bounding box of every region it creates as an object
+# proposal. The image is downscaled internally (scale=0 picks the factor automatically)
+# and max_regions caps how many segments take part in the merging.
 
 import sensor
 import time
@@ -19,7 +24,7 @@ clock = time.clock()  # Create a clock object to track the FPS.
 while True:
     clock.tick()  # Update the FPS clock.
     img = sensor.snapshot()  # Take a picture and return the image.
-    rois = img.selective_search(threshold=200, size=20, a1=0.5, a2=1.0, a3=1.0)
+    rois = img.selective_search(threshold=200, size=20, a1=0.5, a2=1.0, a3=1.0, scale=0, max_regions=64)
     for r in rois:
         img.draw_rectangle(r, color=(255, 0, 0))
         # from random import randint
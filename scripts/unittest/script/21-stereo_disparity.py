@@ -0,0 +1,39 @@
+def unittest(data_path, temp_path):
+    import image
+    w, h, max_disparity, block_w, block_h = 16, 8, 6, 4, 4
+    img = image.Image(w * 2, h, image.GRAYSCALE)
+
+    # Random texture on the left and the same texture shifted by 3 on the right.
+    seed = 1
+    src = bytearray(w * 2 * h)
+    for y in range(h):
+        for x in range(w):
+            seed = (seed * 1103515245 + 12345) & 0x7FFFFFFF
+            src[(y * w * 2) + x] = (seed >> 16) & 0xFF
+        for x in range(w):
+            src[(y * w * 2) + w + x] = src[(y * w * 2) + max(x - 3, 0)]
+    for y in range(h):
+        for x in range(w * 2):
+            img.set_pixel(x, y, src[(y * w * 2) + x])
+
+    img.stereo_disparity(max_disparity=max_disparity, threshold=0, block_size=(block_w, block_h))
+
+    # Brute force SAD with clamped edges.
+    def pixel(x, y):
+        return src[(min(max(y, 0), h - 1) * w * 2) + x]
+
+    bl, br, bu, bd = (block_w - 1) // 2, block_w // 2, (block_h - 1) // 2, block_h // 2
+    for y in range(h):
+        for x in range(w):
+            best, best_cost = 0, -1
+            for k in range(min(max_disparity + 1, w - x)):
+                cost = 0
+                for j in range(y - bu, y + bd + 1):
+                    for i in range(x - bl, x + br + 1):
+                        xc = min(max(i, 0), w - 1)
+                        cost += abs(pixel(xc, j) - pixel(w + min(xc + k, w - 1), j))
+                if (best_cost < 0) or (cost < best_cost):
+                    best, best_cost = k, cost
+            if img.get_pixel(w + x, y) != (best * 255) // max_disparity:
+                return False
+    return True